@@ -6,3 +6,10 @@ set(SANITIZING_FLAGS -fno-sanitize-recover=all -fsanitize=undefined -fsanitize=a
 # ask for more warnings from the compiler
 set (CMAKE_BASE_CXX_FLAGS "${CMAKE_CXX_FLAGS}")
 set (CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -Wall -Wpedantic -Wextra -Weffc++ -Werror -Wshadow -Wpointer-arith -Wcast-qual -Wformat=2 -Wno-unqualified-std-cast-call")
+
+# verify the properties of descriptors on the trusted construction paths (e.g. accepted sockets), which
+# release builds take on the kernel's word
+option (CHECK_TRUSTED_DESCRIPTORS "Verify descriptors that the kernel guarantees" OFF)
+if (CHECK_TRUSTED_DESCRIPTORS)
+  add_compile_definitions (CHECK_TRUSTED_DESCRIPTORS)
+endif ()
@@ -11,11 +11,46 @@ macro (ttest name)
   set_property(TEST ${name} PROPERTY FIXTURES_REQUIRED compile)
 endmacro (ttest)
 
+set(compile_name_opt "compile with optimization")
+add_test(NAME ${compile_name_opt}
+  COMMAND "${CMAKE_COMMAND}" --build "${CMAKE_BINARY_DIR}" -t speed_testing)
+
+# speed tests carry the speed_test label, so `ctest -L speed_test` runs just the benchmarks
+macro (stest name)
+  add_test(NAME ${name} COMMAND "${name}")
+  set_property(TEST ${name} PROPERTY FIXTURES_REQUIRED compile_opt)
+  set_property(TEST ${name} PROPERTY LABELS speed_test)
+endmacro (stest)
+
 set_property(TEST ${compile_name} PROPERTY TIMEOUT -1)
 set_tests_properties(${compile_name} PROPERTIES FIXTURES_SETUP compile)
 
+set_property(TEST ${compile_name_opt} PROPERTY TIMEOUT -1)
+set_tests_properties(${compile_name_opt} PROPERTIES FIXTURES_SETUP compile_opt)
+
 add_test(NAME t_webget COMMAND "${PROJECT_SOURCE_DIR}/tests/webget_t.sh" "${PROJECT_BINARY_DIR}")
 set_property(TEST t_webget PROPERTY FIXTURES_REQUIRED compile)
 
-add_custom_target (pa0 COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure --stop-on-failure --timeout 12 -R 'webget')
+ttest(address_basics)
+ttest(byte_stream_basics)
+ttest(byte_stream_stress)
+ttest(checksum_basics)
+ttest(concurrent_queue_basics)
+ttest(coroutine_basics)
+ttest(eventloop_basics)
+ttest(file_descriptor_basics)
+ttest(flow_table_basics)
+ttest(http_response_parser_basics)
+ttest(io_uring_basics)
+ttest(local_socket_basics)
+ttest(packet_headers_basics)
+ttest(timer_wheel_basics)
+
+stest(byte_stream_speed_test)
+stest(concurrent_queue_speed_test)
+stest(util_speed_test)
+
+add_custom_target (pa0 COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure --stop-on-failure --timeout 12 -R 'webget|^byte_stream_')
+
+add_custom_target (speed COMMAND ${CMAKE_CTEST_COMMAND} --timeout 180 -R '_speed_test')
 
@@ -0,0 +1,81 @@
+#include "byte_stream.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+ByteStream::ByteStream( uint64_t capacity )
+  : capacity_( capacity )
+  , mask_( bit_ceil( max<uint64_t>( capacity, 1 ) ) - 1 )
+  , buffer_( make_unique_for_overwrite<char[]>( mask_ + 1 ) ) // NOLINT(*-avoid-c-arrays)
+{}
+
+void Writer::push( string_view data )
+{
+  if ( closed_ ) {
+    return;
+  }
+
+  const uint64_t len = min<uint64_t>( data.size(), available_capacity() );
+  const uint64_t start = bytes_pushed_ & mask_;
+  const uint64_t first = min( len, mask_ + 1 - start );
+
+  memcpy( &buffer_[start], data.data(), first );
+  memcpy( &buffer_[0], data.data() + first, len - first );
+  bytes_pushed_ += len;
+}
+
+void Writer::close()
+{
+  closed_ = true;
+}
+
+bool Writer::is_closed() const
+{
+  return closed_;
+}
+
+uint64_t Writer::available_capacity() const
+{
+  return capacity_ - ( bytes_pushed_ - bytes_popped_ );
+}
+
+uint64_t Writer::bytes_pushed() const
+{
+  return bytes_pushed_;
+}
+
+string_view Reader::peek() const
+{
+  const uint64_t start = bytes_popped_ & mask_;
+  return { &buffer_[start], min( bytes_buffered(), mask_ + 1 - start ) };
+}
+
+array<string_view, 2> Reader::peek_all() const
+{
+  const string_view first = peek();
+  return { first, { &buffer_[0], bytes_buffered() - first.size() } };
+}
+
+void Reader::pop( uint64_t len )
+{
+  bytes_popped_ += min( len, bytes_buffered() );
+}
+
+bool Reader::is_finished() const
+{
+  return closed_ and bytes_buffered() == 0;
+}
+
+uint64_t Reader::bytes_buffered() const
+{
+  return bytes_pushed_ - bytes_popped_;
+}
+
+uint64_t Reader::bytes_popped() const
+{
+  return bytes_popped_;
+}
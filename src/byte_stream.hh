@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class Reader;
+class Writer;
+
+//! \brief A bounded, in-memory byte pipe between one writer and one reader.
+//! \details Bytes live in a single ring whose size is the capacity rounded up to a power of two. The
+//! ring is allocated once at construction, so pushing and popping never allocate.
+class ByteStream
+{
+public:
+  explicit ByteStream( uint64_t capacity );
+
+  // Helper functions (provided) to access the ByteStream's Reader and Writer interfaces
+  Reader& reader();
+  const Reader& reader() const;
+  Writer& writer();
+  const Writer& writer() const;
+
+  void set_error() { error_ = true; }       // Signal that the stream suffered an error.
+  bool has_error() const { return error_; } // Has the stream had an error?
+
+protected:
+  uint64_t capacity_;
+  uint64_t mask_;                  // ring size - 1 (the ring size is a power of two)
+  std::unique_ptr<char[]> buffer_; // NOLINT(*-avoid-c-arrays)
+  uint64_t bytes_pushed_ {};       // ring index of the next byte to write, before masking
+  uint64_t bytes_popped_ {};       // ring index of the next byte to read, before masking
+  bool closed_ {};
+  bool error_ {};
+};
+
+class Writer : public ByteStream
+{
+public:
+  void push( std::string_view data ); // Push data to stream, but only as much as available capacity allows.
+  void close();                       // Signal that the stream has reached its ending. Nothing more will be
+                                      // written.
+
+  bool is_closed() const;              // Has the stream been closed?
+  uint64_t available_capacity() const; // How many bytes can be pushed to the stream right now?
+  uint64_t bytes_pushed() const;       // Total number of bytes cumulatively pushed to the stream
+};
+
+class Reader : public ByteStream
+{
+public:
+  std::string_view peek() const; // Peek at the next bytes in the buffer (up to the end of the ring)
+  void pop( uint64_t len );      // Remove `len` bytes from the buffer
+
+  // All buffered bytes, as at most two contiguous pieces (the second is empty unless the data wraps),
+  // e.g. for a gather write with FileDescriptor::write()
+  std::array<std::string_view, 2> peek_all() const;
+
+  bool is_finished() const;        // Is the stream finished (closed and fully popped)?
+  uint64_t bytes_buffered() const; // Number of bytes currently buffered (pushed and not popped)
+  uint64_t bytes_popped() const;   // Total number of bytes cumulatively popped from stream
+};
+
+/*
+ * read: A (provided) helper function thats peeks and pops up to `len` bytes
+ * from a ByteStream Reader into a string;
+ */
+void read( Reader& reader, uint64_t len, std::string& out );
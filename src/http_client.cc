@@ -0,0 +1,610 @@
+#include "http_client.hh"
+
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+bool iequals( string_view a, string_view b )
+{
+  return a.size() == b.size() and equal( a.begin(), a.end(), b.begin(), []( char x, char y ) {
+           return tolower( static_cast<unsigned char>( x ) ) == tolower( static_cast<unsigned char>( y ) );
+         } );
+}
+
+bool icontains( string_view haystack, string_view needle )
+{
+  for ( size_t i = 0; i + needle.size() <= haystack.size(); ++i ) {
+    if ( iequals( haystack.substr( i, needle.size() ), needle ) ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+string_view trim( string_view str )
+{
+  const auto first = str.find_first_not_of( " \t" );
+  if ( first == string_view::npos ) {
+    return {};
+  }
+  return str.substr( first, str.find_last_not_of( " \t" ) - first + 1 );
+}
+
+template<typename T>
+T parse_number( string_view str, int base, const char* what )
+{
+  T value {};
+  const auto [end, error] = from_chars( str.data(), str.data() + str.size(), value, base );
+  if ( error != errc {} or end != str.data() + str.size() or str.empty() ) {
+    throw runtime_error( string( "HTTP: invalid " ) + what + ": \"" + string( str ) + "\"" );
+  }
+  return value;
+}
+} // namespace
+
+string_view HTTPResponseHead::header( string_view name ) const
+{
+  for ( const auto& [key, value] : headers ) {
+    if ( iequals( key, name ) ) {
+      return value;
+    }
+  }
+  return {};
+}
+
+string HTTPResponseHead::to_string() const
+{
+  string ret = version + " " + std::to_string( status_code ) + " " + reason + "\r\n";
+  for ( const auto& [key, value] : headers ) {
+    ret += key + ": " + value + "\r\n";
+  }
+  return ret + "\r\n";
+}
+
+// take one line (up to LF, with any CR stripped) out of `data`, accumulating it in line_
+bool HTTPResponseParser::take_line( string_view& data )
+{
+  if ( line_done_ ) {
+    line_.clear();
+    line_done_ = false;
+  }
+
+  const auto newline = data.find( '\n' );
+  line_.append( data.substr( 0, newline ) );
+  if ( newline == string_view::npos ) {
+    data = {};
+    if ( line_.size() > kMaxLineLength ) {
+      throw runtime_error( "HTTP: line too long" );
+    }
+    return false;
+  }
+
+  data.remove_prefix( newline + 1 );
+  if ( not line_.empty() and line_.back() == '\r' ) {
+    line_.pop_back();
+  }
+  line_done_ = true;
+  return true;
+}
+
+void HTTPResponseParser::parse_status_line()
+{
+  const string_view line { line_ };
+  const auto first_space = line.find( ' ' );
+  if ( first_space == string_view::npos or not line.starts_with( "HTTP/" ) ) {
+    throw runtime_error( "HTTP: invalid status line: \"" + line_ + "\"" );
+  }
+
+  const string_view rest = line.substr( first_space + 1 );
+  const auto second_space = rest.find( ' ' );
+
+  head_ = {};
+  head_.version = line.substr( 0, first_space );
+  head_.status_code = parse_number<unsigned int>( rest.substr( 0, second_space ), 10, "status code" );
+  if ( second_space != string_view::npos ) {
+    head_.reason = rest.substr( second_space + 1 );
+  }
+}
+
+void HTTPResponseParser::parse_header_line()
+{
+  const string_view line { line_ };
+  const auto colon = line.find( ':' );
+  if ( colon == string_view::npos or colon == 0 ) {
+    throw runtime_error( "HTTP: invalid header line: \"" + line_ + "\"" );
+  }
+  head_.headers.emplace_back( line.substr( 0, colon ), trim( line.substr( colon + 1 ) ) );
+}
+
+bool HTTPResponseParser::finish_head()
+{
+  // interim responses (other than a protocol switch, which we never ask for) precede the real one
+  if ( head_.status_code >= 100 and head_.status_code < 200 ) {
+    state_ = State::StatusLine;
+    return false;
+  }
+
+  const string_view connection = head_.header( "Connection" );
+  if ( head_.version == "HTTP/1.0" ) {
+    keep_alive_ = icontains( connection, "keep-alive" );
+  } else {
+    keep_alive_ = not icontains( connection, "close" );
+  }
+
+  const string_view content_length = head_.header( "Content-Length" );
+  if ( icontains( head_.header( "Transfer-Encoding" ), "chunked" ) ) {
+    state_ = State::ChunkSize;
+  } else if ( not content_length.empty() ) {
+    remaining_ = parse_number<uint64_t>( content_length, 10, "Content-Length" );
+    state_ = State::Body;
+  } else if ( head_.status_code == 204 or head_.status_code == 304 ) {
+    remaining_ = 0;
+    state_ = State::Body;
+  } else {
+    // without a length, the body runs to the end of the connection
+    keep_alive_ = false;
+    state_ = State::UntilClose;
+  }
+
+  return true;
+}
+
+HTTPResponseParser::Event HTTPResponseParser::parse( string_view& data, string_view& body )
+{
+  while ( true ) {
+    switch ( state_ ) {
+      case State::StatusLine:
+        if ( not data.empty() ) {
+          in_message_ = true;
+        }
+        if ( not take_line( data ) ) {
+          return Event::NeedMore;
+        }
+        if ( line_.empty() ) {
+          continue; // tolerate stray blank lines between responses
+        }
+        parse_status_line();
+        state_ = State::Headers;
+        continue;
+
+      case State::Headers:
+        if ( not take_line( data ) ) {
+          return Event::NeedMore;
+        }
+        if ( not line_.empty() ) {
+          parse_header_line();
+          continue;
+        }
+        if ( finish_head() ) {
+          return Event::Head;
+        }
+        continue;
+
+      case State::Body:
+      case State::ChunkData: {
+        if ( remaining_ == 0 ) {
+          if ( state_ == State::ChunkData ) {
+            state_ = State::ChunkDataEnd;
+            continue;
+          }
+          state_ = State::StatusLine;
+          in_message_ = false;
+          return Event::Complete;
+        }
+        if ( data.empty() ) {
+          return Event::NeedMore;
+        }
+        const size_t len = min<uint64_t>( remaining_, data.size() );
+        body = data.substr( 0, len );
+        data.remove_prefix( len );
+        remaining_ -= len;
+        return Event::Body;
+      }
+
+      case State::ChunkSize: {
+        if ( not take_line( data ) ) {
+          return Event::NeedMore;
+        }
+        const string_view size = trim( string_view { line_ }.substr( 0, line_.find( ';' ) ) );
+        remaining_ = parse_number<uint64_t>( size, 16, "chunk size" );
+        state_ = remaining_ ? State::ChunkData : State::Trailers;
+        continue;
+      }
+
+      case State::ChunkDataEnd:
+        if ( not take_line( data ) ) {
+          return Event::NeedMore;
+        }
+        if ( not line_.empty() ) {
+          throw runtime_error( "HTTP: missing CRLF after chunk" );
+        }
+        state_ = State::ChunkSize;
+        continue;
+
+      case State::Trailers:
+        if ( not take_line( data ) ) {
+          return Event::NeedMore;
+        }
+        if ( line_.empty() ) {
+          state_ = State::StatusLine;
+          in_message_ = false;
+          return Event::Complete;
+        }
+        continue; // trailers are ignored
+
+      case State::UntilClose:
+        if ( data.empty() ) {
+          return Event::NeedMore;
+        }
+        body = data;
+        data = {};
+        return Event::Body;
+    }
+  }
+}
+
+HTTPResponseParser::Event HTTPResponseParser::finish_eof()
+{
+  if ( state_ == State::UntilClose ) {
+    state_ = State::StatusLine;
+    in_message_ = false;
+    return Event::Complete;
+  }
+
+  if ( in_message_ ) {
+    throw runtime_error( "HTTP: connection closed in the middle of a response" );
+  }
+
+  return Event::NeedMore;
+}
+
+HTTPClient::Connection::Connection( string s_host, TCPSocket&& s_socket )
+  : host( move( s_host ) ), socket( move( s_socket ) )
+{}
+
+HTTPClient::HTTPClient( EventLoop& loop, HTTPClientOptions options )
+  : loop_( loop )
+  , options_( move( options ) )
+  , resolver_( loop, 1 )
+  , connection_category_( loop.add_category( "HTTP connections" ) )
+{}
+
+HTTPClient::~HTTPClient()
+{
+  for ( auto& [name, host] : hosts_ ) {
+    for ( const auto& connection : host.connections ) {
+      connection->dead = true;
+      for ( auto& rule : connection->rules ) {
+        rule.cancel();
+      }
+      loop_.cancel_timer( connection->idle_timer );
+    }
+  }
+}
+
+void HTTPClient::get( const string& host, const string& path, HTTPResponseHandlers handlers )
+{
+  ++outstanding_;
+  hosts_[host].queued.push_back( { host, path, move( handlers ) } );
+  dispatch( host );
+}
+
+void HTTPClient::run()
+{
+  while ( outstanding_ > 0 and loop_.wait_next_event( -1 ) != EventLoop::Result::Exit ) {}
+}
+
+void HTTPClient::complete( PendingRequest& request, const exception_ptr& error )
+{
+  --outstanding_;
+  request.handlers.on_done( error );
+}
+
+// hand queued requests for `host_name` to connections, opening connections as needed
+void HTTPClient::dispatch( const string& host_name )
+{
+  auto& host = hosts_[host_name];
+  if ( host.queued.empty() ) {
+    return;
+  }
+
+  if ( host.addresses.empty() ) {
+    if ( not host.resolving ) {
+      host.resolving = true;
+      resolver_.resolve( host_name, options_.service, [this, host_name]( const auto& addresses, auto error ) {
+        auto& resolved_host = hosts_[host_name];
+        resolved_host.resolving = false;
+        if ( error ) {
+          for ( auto& request : exchange( resolved_host.queued, {} ) ) {
+            complete( request, error );
+          }
+          return;
+        }
+        resolved_host.addresses = addresses;
+        dispatch( host_name );
+      } );
+    }
+    return;
+  }
+
+  while ( not host.queued.empty() ) {
+    // pick the open connection with the fewest requests in flight
+    shared_ptr<Connection> best;
+    for ( const auto& connection : host.connections ) {
+      if ( not connection->closing and connection->in_flight.size() < options_.max_pipeline_depth
+           and ( not best or connection->in_flight.size() < best->in_flight.size() ) ) {
+        best = connection;
+      }
+    }
+
+    // prefer a new connection over queueing behind a busy one, up to the per-host and overall limits
+    if ( ( not best or not best->in_flight.empty() )
+         and host.connections.size() < options_.max_connections_per_host ) {
+      if ( connection_count_ < options_.max_connections ) {
+        open_connection( host, host_name );
+        continue;
+      }
+      // a host with no connection at all may take the slot of another host's idle one
+      if ( host.connections.empty() and reclaim_idle_connection( host_name ) ) {
+        continue;
+      }
+    }
+
+    if ( not best ) {
+      return; // every connection is saturated; wait for responses
+    }
+
+    send_request( best, move( host.queued.front() ) );
+    host.queued.pop_front();
+  }
+}
+
+void HTTPClient::open_connection( Host& host, const string& host_name )
+{
+  const Address& address = host.addresses.at( host.next_address % host.addresses.size() );
+
+  shared_ptr<Connection> connection;
+  try {
+    auto pending = TCPSocket::connect_async( address );
+    connection = make_shared<Connection>( host_name, move( pending.socket() ) );
+  } catch ( const exception& ) {
+    // charge the failure to every waiting request, so a host that can't be reached is eventually given up on
+    ++host.next_address;
+    const auto error = current_exception();
+    // take the queue first: completion handlers may call get(), which adds to it
+    auto waiting = exchange( host.queued, {} );
+    deque<PendingRequest> retry;
+    for ( auto& request : waiting ) {
+      if ( ++request.attempts >= options_.max_attempts ) {
+        complete( request, error );
+      } else {
+        retry.push_back( move( request ) );
+      }
+    }
+    // requests the handlers added wait behind the ones that were already queued
+    move( host.queued.begin(), host.queued.end(), back_inserter( retry ) );
+    host.queued = move( retry );
+    return;
+  }
+  host.connections.push_back( connection );
+  ++connection_count_;
+
+  const auto cancel = [this, connection] {
+    if ( not connection->dead ) {
+      if ( not connection->connected ) {
+        ++hosts_[connection->host].next_address;
+      }
+      close_connection( connection, make_exception_ptr( runtime_error( "HTTP: connection error" ) ) );
+    }
+  };
+
+  connection->rules.push_back( loop_.add_rule(
+    connection_category_,
+    connection->socket,
+    Direction::Out,
+    [this, connection] { on_writable( connection ); },
+    [connection] {
+      return not connection->dead
+             and ( not connection->connected or connection->outbound_offset < connection->outbound.size() );
+    },
+    cancel ) );
+
+  connection->rules.push_back( loop_.add_rule(
+    connection_category_,
+    connection->socket,
+    Direction::In,
+    [this, connection] { on_readable( connection ); },
+    [connection] { return not connection->dead and connection->connected; },
+    cancel ) );
+
+  reset_idle_timer( connection );
+}
+
+void HTTPClient::send_request( const shared_ptr<Connection>& connection, PendingRequest&& request )
+{
+  if ( connection->outbound_offset == connection->outbound.size() ) {
+    connection->outbound.clear();
+    connection->outbound_offset = 0;
+  }
+
+  connection->outbound.append( "GET " ).append( request.path ).append( " HTTP/1.1\r\n" );
+  connection->outbound.append( "Host: " ).append( request.host ).append( "\r\n" );
+  connection->outbound.append( "Connection: keep-alive\r\n\r\n" );
+  connection->in_flight.push_back( move( request ) );
+  if ( connection->in_flight.size() == 1 ) {
+    reset_idle_timer( connection ); // the connection was idle, so its timeout wasn't running
+  }
+}
+
+void HTTPClient::reset_idle_timer( const shared_ptr<Connection>& connection )
+{
+  loop_.cancel_timer( connection->idle_timer );
+  const bool waiting = not connection->connected or not connection->in_flight.empty();
+  if ( connection->dead or not waiting or options_.idle_timeout.count() == 0 ) {
+    return;
+  }
+
+  connection->idle_timer = loop_.add_timer( connection_category_, options_.idle_timeout, [this, connection] {
+    if ( not connection->connected ) {
+      ++hosts_[connection->host].next_address;
+    }
+    close_connection( connection, make_exception_ptr( runtime_error( "HTTP: connection timed out" ) ) );
+  } );
+}
+
+void HTTPClient::on_writable( const shared_ptr<Connection>& connection )
+{
+  if ( not connection->connected ) {
+    try {
+      connection->socket.throw_if_error();
+    } catch ( const exception& ) {
+      // try the next address for the following connection
+      ++hosts_[connection->host].next_address;
+      close_connection( connection, current_exception() );
+      return;
+    }
+    connection->connected = true;
+    reset_idle_timer( connection );
+  }
+
+  if ( connection->outbound_offset < connection->outbound.size() ) {
+    try {
+      connection->outbound_offset
+        += connection->socket.write( string_view { connection->outbound }.substr( connection->outbound_offset ) );
+    } catch ( const exception& ) {
+      close_connection( connection, current_exception() );
+    }
+  }
+}
+
+void HTTPClient::on_readable( const shared_ptr<Connection>& connection )
+{
+  try {
+    // a read error (e.g. ECONNRESET) fails only this connection's requests
+    const size_t len = connection->socket.read( read_buffer_ );
+    if ( len > 0 ) {
+      handle_input( connection, { read_buffer_.data(), len } );
+      reset_idle_timer( connection );
+    } else if ( connection->socket.eof() ) {
+      if ( connection->parser.finish_eof() == HTTPResponseParser::Event::Complete ) {
+        complete( connection->in_flight.front(), nullptr );
+        connection->in_flight.pop_front();
+      }
+      close_connection( connection, make_exception_ptr( runtime_error( "HTTP: connection closed by server" ) ) );
+    }
+  } catch ( const exception& ) {
+    close_connection( connection, current_exception() );
+  }
+}
+
+void HTTPClient::handle_input( const shared_ptr<Connection>& connection, string_view data )
+{
+  string_view body;
+  while ( not connection->dead ) {
+    const auto event = connection->parser.parse( data, body );
+    if ( event == HTTPResponseParser::Event::NeedMore ) {
+      return;
+    }
+
+    if ( connection->in_flight.empty() ) {
+      throw runtime_error( "HTTP: response received with no request outstanding" );
+    }
+    auto& request = connection->in_flight.front();
+
+    switch ( event ) {
+      case HTTPResponseParser::Event::Head:
+        connection->closing |= not connection->parser.keep_alive();
+        request.handlers.on_head( connection->parser.head() );
+        break;
+      case HTTPResponseParser::Event::Body:
+        request.handlers.on_body( body );
+        break;
+      case HTTPResponseParser::Event::Complete: {
+        PendingRequest finished = move( request );
+        connection->in_flight.pop_front();
+        const bool keep_alive = connection->parser.keep_alive();
+        complete( finished, nullptr );
+        if ( not keep_alive ) {
+          close_connection( connection,
+                            make_exception_ptr( runtime_error( "HTTP: connection closed by server" ) ) );
+          return;
+        }
+        dispatch( connection->host ); // the pipeline has room for a queued request
+        break;
+      }
+      case HTTPResponseParser::Event::NeedMore:
+        break;
+    }
+  }
+}
+
+void HTTPClient::close_connection( const shared_ptr<Connection>& connection, const exception_ptr& error )
+{
+  if ( connection->dead ) {
+    return;
+  }
+  connection->dead = true;
+  for ( auto& rule : connection->rules ) {
+    rule.cancel();
+  }
+  loop_.cancel_timer( connection->idle_timer );
+  if ( not connection->socket.closed() ) {
+    connection->socket.close();
+  }
+
+  auto& host = hosts_[connection->host];
+  host.connections.remove( connection );
+  --connection_count_;
+
+  // GET is idempotent, so requests that were never answered can be retried on another connection
+  for ( auto it = connection->in_flight.rbegin(); it != connection->in_flight.rend(); ++it ) {
+    if ( ++it->attempts >= options_.max_attempts ) {
+      complete( *it, error );
+    } else {
+      host.queued.push_front( move( *it ) );
+    }
+  }
+  connection->in_flight.clear();
+
+  dispatch( connection->host );
+  dispatch_waiting();
+}
+
+void HTTPClient::dispatch_waiting()
+{
+  // collect names first: dispatching can complete requests, whose handlers may add hosts
+  vector<string> waiting;
+  for ( const auto& [name, host] : hosts_ ) {
+    if ( not host.queued.empty() and not host.addresses.empty() ) {
+      waiting.push_back( name );
+    }
+  }
+
+  for ( const auto& name : waiting ) {
+    if ( connection_count_ >= options_.max_connections ) {
+      return;
+    }
+    dispatch( name );
+  }
+}
+
+bool HTTPClient::reclaim_idle_connection( const string& host_name )
+{
+  for ( auto& [name, host] : hosts_ ) {
+    if ( name == host_name ) {
+      continue;
+    }
+    for ( const auto& connection : host.connections ) {
+      if ( connection->connected and connection->in_flight.empty() ) {
+        const auto idle = connection; // close_connection() removes it from the list being walked
+        close_connection( idle, nullptr );
+        return true;
+      }
+    }
+  }
+  return false;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "eventloop.hh"
+#include "resolver.hh"
+#include "socket.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//! The status line and headers of an HTTP response
+struct HTTPResponseHead
+{
+  std::string version {};     //!< e.g. "HTTP/1.1"
+  unsigned int status_code {}; //!< e.g. 200
+  std::string reason {};      //!< e.g. "OK"
+  std::vector<std::pair<std::string, std::string>> headers {};
+
+  //! The value of the first header called `name` (compared case-insensitively), or "" if there is none
+  std::string_view header( std::string_view name ) const;
+
+  //! The status line and headers as they would appear on the wire
+  std::string to_string() const;
+};
+
+//! \brief Incremental parser for the sequence of HTTP/1.1 responses arriving on one connection
+//! \details Bodies delimited by Content-Length, by chunked transfer coding, or by the end of the
+//! connection are supported. Body bytes are returned as views into the caller's input and never copied.
+class HTTPResponseParser
+{
+public:
+  //! What parse() found
+  enum class Event
+  {
+    NeedMore, //!< All input was consumed without completing anything else.
+    Head,     //!< The status line and headers are complete (see head()).
+    Body,     //!< `body` holds the next piece of the body.
+    Complete  //!< The response is complete; the next byte belongs to the next response.
+  };
+
+private:
+  enum class State
+  {
+    StatusLine,
+    Headers,
+    Body,
+    ChunkSize,
+    ChunkData,
+    ChunkDataEnd,
+    Trailers,
+    UntilClose
+  };
+
+  static constexpr size_t kMaxLineLength = 65536;
+
+  State state_ { State::StatusLine };
+  std::string line_ {};    //!< Partial (or, if line_done_, complete) status, header, or chunk-size line
+  bool line_done_ {};      //!< line_ holds a complete line that has been processed
+  bool in_message_ {};     //!< Bytes of a response have been seen since the last Complete
+  HTTPResponseHead head_ {};
+  uint64_t remaining_ {};  //!< Bytes left in the Content-Length body or the current chunk
+  bool keep_alive_ { true };
+
+  bool take_line( std::string_view& data );
+  void parse_status_line();
+  void parse_header_line();
+  //! Decide how the body is delimited once the headers are complete
+  //! \returns false for an interim (1xx) response, which is skipped
+  bool finish_head();
+
+public:
+  //! \brief Consume `data` until something happens, advancing `data` past what was used
+  //! \details Throws std::runtime_error on malformed input.
+  Event parse( std::string_view& data, std::string_view& body );
+
+  //! \brief Report that the connection was closed by the peer
+  //! \returns Complete if this ends a body delimited by the end of the connection, or NeedMore if
+  //! no response was in progress; throws std::runtime_error if a response was cut short.
+  Event finish_eof();
+
+  const HTTPResponseHead& head() const { return head_; }
+
+  //! May the connection carry another response after the current one?
+  bool keep_alive() const { return keep_alive_; }
+
+  //! Is the parser between responses?
+  bool idle() const { return not in_message_; }
+};
+
+//! Callbacks for one request made with HTTPClient::get()
+struct HTTPResponseHandlers
+{
+  std::function<void( const HTTPResponseHead& )> on_head = []( const HTTPResponseHead& ) {};
+  //! Called with each piece of the body; the view is only valid during the call
+  std::function<void( std::string_view )> on_body = []( std::string_view ) {};
+  //! Called once, with nullptr on success or the reason the request failed
+  std::function<void( std::exception_ptr )> on_done = []( const std::exception_ptr& ) {};
+};
+
+//! Tuning knobs for HTTPClient
+struct HTTPClientOptions
+{
+  std::string service { "http" };    //!< Service name or port number to connect to
+  size_t max_connections { 64 };     //!< Connections open at once across all hosts
+  size_t max_connections_per_host { 6 };
+  size_t max_pipeline_depth { 8 };   //!< Requests sent on a connection before their responses have arrived
+  size_t max_attempts { 3 };         //!< Tries per request when connections close before it is answered
+  //! Close a connection that is connecting or awaiting a response but makes no progress for this long
+  //! (its requests are retried as if it had closed); 0 waits forever
+  std::chrono::milliseconds idle_timeout { 30000 };
+};
+
+//! \brief An HTTP/1.1 client that keeps persistent connections to each host and pipelines GET requests
+//! \details Everything runs on one EventLoop: names are resolved with an AsyncResolver, connections
+//! are opened with non-blocking connects, and responses are parsed as bytes arrive. Writing to a
+//! connection the server has closed raises SIGPIPE, so applications should ignore that signal.
+class HTTPClient
+{
+  struct PendingRequest
+  {
+    std::string host;
+    std::string path;
+    HTTPResponseHandlers handlers;
+    size_t attempts {};
+  };
+
+  struct Connection
+  {
+    std::string host;
+    TCPSocket socket;
+    bool connected {};
+    bool closing {}; //!< No new requests: the server will close after the last response in flight
+    bool dead {};    //!< Closed and removed from its host
+    std::string outbound {};
+    size_t outbound_offset {};
+    std::deque<PendingRequest> in_flight {}; //!< Written (or queued in outbound), awaiting responses
+    HTTPResponseParser parser {};
+    std::vector<EventLoop::RuleHandle> rules {};
+    EventLoop::TimerHandle idle_timer {}; //!< Armed while the connection is waiting for the server
+
+    Connection( std::string s_host, TCPSocket&& s_socket );
+  };
+
+  struct Host
+  {
+    std::deque<PendingRequest> queued {};
+    std::list<std::shared_ptr<Connection>> connections {};
+    std::vector<Address> addresses {};
+    bool resolving {};
+    size_t next_address {};
+  };
+
+  static constexpr size_t kReadSize = 65536;
+
+  EventLoop& loop_;
+  HTTPClientOptions options_;
+  AsyncResolver resolver_;
+  size_t connection_category_;
+  std::unordered_map<std::string, Host> hosts_ {};
+  size_t outstanding_ {};
+  size_t connection_count_ {}; //!< Open connections across all hosts, bounded by max_connections
+  std::array<char, kReadSize> read_buffer_ {}; //!< Shared by all connections; body views point into it
+
+  void dispatch( const std::string& host_name );
+  void open_connection( Host& host, const std::string& host_name );
+
+  //! Give free connection slots to hosts whose requests are waiting for one
+  void dispatch_waiting();
+
+  //! Close an idle connection to another host to make room under max_connections
+  //! \returns false if every open connection is busy
+  bool reclaim_idle_connection( const std::string& host_name );
+  void send_request( const std::shared_ptr<Connection>& connection, PendingRequest&& request );
+
+  //! Restart the connection's idle timeout, or stop it if the connection isn't waiting for the server
+  void reset_idle_timer( const std::shared_ptr<Connection>& connection );
+  void on_writable( const std::shared_ptr<Connection>& connection );
+  void on_readable( const std::shared_ptr<Connection>& connection );
+  void handle_input( const std::shared_ptr<Connection>& connection, std::string_view data );
+
+  //! Close a connection and requeue (or fail) the requests it hadn't answered
+  void close_connection( const std::shared_ptr<Connection>& connection, const std::exception_ptr& error );
+
+  //! Finish a request (successfully if `error` is null)
+  void complete( PendingRequest& request, const std::exception_ptr& error );
+
+public:
+  explicit HTTPClient( EventLoop& loop, HTTPClientOptions options = {} );
+  ~HTTPClient();
+
+  //! Queue a GET request for http://host/path
+  void get( const std::string& host, const std::string& path, HTTPResponseHandlers handlers );
+
+  //! Number of requests that have not finished yet
+  size_t outstanding() const { return outstanding_; }
+
+  //! Run the event loop until every request has finished
+  void run();
+
+  HTTPClient( const HTTPClient& other ) = delete;
+  HTTPClient& operator=( const HTTPClient& other ) = delete;
+  HTTPClient( HTTPClient&& other ) = delete;
+  HTTPClient& operator=( HTTPClient&& other ) = delete;
+};
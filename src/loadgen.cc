@@ -0,0 +1,728 @@
+#include "address.hh"
+#include "buffer.hh"
+#include "eventloop.hh"
+#include "socket.hh"
+#include "tcp_server.hh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct Options
+{
+  bool udp {};
+  string host { "127.0.0.1" };
+  uint16_t port {};
+  size_t connections { 16 };
+  size_t message_size { 1024 };
+  size_t depth { 1 };   // messages in flight per connection
+  size_t threads { 1 }; // on each side
+  chrono::milliseconds duration { 5000 };
+};
+
+// Each message starts with the time it was sent, which comes back in the echo
+constexpr size_t kTimestampSize = sizeof( int64_t );
+
+// How long a UDP connection waits for any echo before counting its messages in flight as lost
+constexpr chrono::milliseconds kLossTimeout { 200 };
+
+constexpr size_t kReadSize = 65536;
+
+// Every rule is edge-triggered and drains its socket until it would block. Linux may report readiness that
+// isn't there (e.g. for a datagram then dropped for its checksum), which would trip the EventLoop's busy-wait
+// check on a level-triggered rule that found nothing to read.
+constexpr auto kTrigger = EventLoop::Trigger::Edge;
+
+int64_t now_ns()
+{
+  return chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// Servers: echo every byte (TCP) or datagram (UDP) back to where it came from
+
+// A TCP connection being echoed; its rules own it
+struct EchoConnection
+{
+  TCPSocket socket;
+  string pending {};   // echoed bytes that didn't fit in the socket buffer
+  size_t pending_offset {};
+  vector<EventLoop::RuleHandle> rules {};
+
+  void close()
+  {
+    for ( auto& rule : rules ) {
+      rule.cancel();
+    }
+  }
+
+  // write pending bytes until they are all written or the socket is full; false if the connection failed
+  bool flush()
+  {
+    while ( pending_offset < pending.size() ) {
+      const IOResult written = socket.try_write( string_view { pending }.substr( pending_offset ) );
+      if ( written.would_block() ) {
+        return true;
+      }
+      if ( not written ) {
+        close();
+        return false;
+      }
+      pending_offset += written.bytes();
+    }
+    pending.clear();
+    pending_offset = 0;
+    return true;
+  }
+};
+
+void echo_tcp( EventLoop& loop, const size_t category, TCPSocket&& socket )
+{
+  auto connection = make_shared<EchoConnection>( EchoConnection { .socket = move( socket ) } );
+  connection->socket.set_nodelay( true );
+  const auto close = [connection] { connection->close(); };
+
+  connection->rules.push_back( loop.add_rule(
+    category,
+    connection->socket,
+    EventLoop::Direction::In,
+    [connection] {
+      thread_local array<char, kReadSize> buffer;
+      for ( ;; ) {
+        const IOResult read = connection->socket.try_read( buffer );
+        if ( read.would_block() ) {
+          return;
+        }
+        if ( not read or read.bytes() == 0 ) {
+          connection->close();
+          return;
+        }
+
+        // echo straight from the buffer unless earlier bytes are still waiting to go out
+        const string_view received { buffer.data(), read.bytes() };
+        size_t written = 0;
+        if ( connection->pending.empty() ) {
+          const IOResult result = connection->socket.try_write( received );
+          if ( not result and not result.would_block() ) {
+            connection->close();
+            return;
+          }
+          written = result.bytes();
+        }
+        connection->pending.append( received.substr( written ) );
+      }
+    },
+    [] { return true; },
+    close,
+    kTrigger ) );
+
+  connection->rules.push_back( loop.add_rule(
+    category,
+    connection->socket,
+    EventLoop::Direction::Out,
+    [connection] { connection->flush(); },
+    [connection] { return not connection->pending.empty(); },
+    close,
+    kTrigger ) );
+}
+
+// One thread per UDP socket in a SO_REUSEPORT group, each echoing a batch of datagrams per system call
+class UDPEchoServer
+{
+  vector<UDPSocket> sockets_ {};
+  vector<thread> threads_ {};
+  atomic<bool> stopping_ {};
+
+  void run( UDPSocket& socket )
+  {
+    BufferPool pool { kReadSize };
+    array<DatagramSocket::ReceivedDatagram, DatagramSocket::kMaxBatch> received;
+    for ( auto& slot : received ) {
+      slot.payload = pool.acquire();
+    }
+    vector<Address> sources;
+    vector<DatagramSocket::OutgoingDatagram> echoes;
+
+    EventLoop loop;
+    loop.add_rule(
+      loop.add_category( "UDP echo" ),
+      socket,
+      EventLoop::Direction::In,
+      [&] {
+        for ( size_t count = socket.recv_batch( received ); count > 0; count = socket.recv_batch( received ) ) {
+          sources.clear();
+          echoes.clear();
+          for ( size_t i = 0; i < count; ++i ) {
+            sources.push_back( received[i].source_address() );
+          }
+          for ( size_t i = 0; i < count; ++i ) {
+            echoes.push_back( { .destination = &sources[i], .payload = received[i].payload } );
+          }
+          // a full send buffer drops the rest, like any other loss
+          for ( span<const DatagramSocket::OutgoingDatagram> rest { echoes }; not rest.empty(); ) {
+            const size_t sent = socket.send_batch( rest );
+            if ( sent == 0 ) {
+              break;
+            }
+            rest = rest.subspan( sent );
+          }
+        }
+      },
+      [] { return true; },
+      [] {},
+      kTrigger );
+
+    while ( not stopping_.load() ) {
+      loop.wait_next_event( 100 );
+    }
+  }
+
+public:
+  UDPEchoServer( const Address& address, const size_t threads )
+  {
+    Address bound = address;
+    for ( size_t i = 0; i < max<size_t>( threads, 1 ); ++i ) {
+      UDPSocket socket { address.family() };
+      socket.set_reuseaddr();
+      socket.set_reuseport();
+      socket.bind( bound );
+      bound = socket.local_address();
+      socket.set_blocking( false );
+      sockets_.push_back( move( socket ) );
+    }
+  }
+
+  Address local_address() const { return sockets_.front().local_address(); }
+
+  void start()
+  {
+    for ( auto& socket : sockets_ ) {
+      threads_.emplace_back( [this, &socket] { run( socket ); } );
+    }
+  }
+
+  void stop()
+  {
+    stopping_ = true;
+    for ( auto& thread : threads_ ) {
+      thread.join();
+    }
+    threads_.clear();
+  }
+
+  ~UDPEchoServer() { stop(); }
+
+  UDPEchoServer( const UDPEchoServer& other ) = delete;
+  UDPEchoServer& operator=( const UDPEchoServer& other ) = delete;
+  UDPEchoServer( UDPEchoServer&& other ) = delete;
+  UDPEchoServer& operator=( UDPEchoServer&& other ) = delete;
+};
+
+// An echo server of either kind, running until stop() or destruction
+class EchoServer
+{
+  unique_ptr<ShardedTCPServer> tcp_ {};
+  unique_ptr<UDPEchoServer> udp_ {};
+
+public:
+  explicit EchoServer( const Options& options )
+  {
+    const Address address { options.host, options.port };
+    if ( options.udp ) {
+      udp_ = make_unique<UDPEchoServer>( address, options.threads );
+      udp_->start();
+      return;
+    }
+
+    // the handler runs on each shard's own thread, so each shard can keep its category id unlocked
+    auto categories = make_shared<vector<optional<size_t>>>( max<size_t>( options.threads, 1 ) );
+    tcp_ = make_unique<ShardedTCPServer>(
+      address,
+      [categories]( const size_t shard, EventLoop& loop, TCPSocket&& connection ) {
+        auto& category = categories->at( shard );
+        if ( not category ) {
+          category = loop.add_category( "TCP echo" );
+        }
+        echo_tcp( loop, *category, move( connection ) );
+      },
+      options.threads );
+    tcp_->start();
+  }
+
+  Address local_address() const { return tcp_ ? tcp_->local_address() : udp_->local_address(); }
+
+  void stop()
+  {
+    if ( tcp_ ) {
+      tcp_->stop();
+    }
+    if ( udp_ ) {
+      udp_->stop();
+    }
+  }
+};
+
+// ---------------------------------------------------------------------------------------------------------
+// Clients: keep `depth` messages in flight on each connection, timing each one's echo
+
+struct Results
+{
+  uint64_t messages {};
+  uint64_t bytes {};
+  uint64_t lost {};
+  vector<int64_t> latencies_ns {};
+
+  void add( const Results& other )
+  {
+    messages += other.messages;
+    bytes += other.bytes;
+    lost += other.lost;
+    latencies_ns.insert( latencies_ns.end(), other.latencies_ns.begin(), other.latencies_ns.end() );
+  }
+};
+
+// A message of `size` bytes, stamped with the current time
+void stamp( string& message )
+{
+  const int64_t sent = now_ns();
+  memcpy( message.data(), &sent, kTimestampSize );
+}
+
+void record_echo( Results& results, const string_view message )
+{
+  int64_t sent {};
+  memcpy( &sent, message.data(), kTimestampSize );
+  results.latencies_ns.push_back( now_ns() - sent );
+  ++results.messages;
+  results.bytes += message.size();
+}
+
+// A TCP client connection; its rules own it
+struct TCPClientConnection
+{
+  TCPSocket socket;
+  string message;
+  string outgoing {};
+  size_t outgoing_offset {};
+  string incoming {}; // the part of an echoed message received so far
+  vector<EventLoop::RuleHandle> rules {};
+
+  void send_message()
+  {
+    stamp( message );
+    outgoing.append( message );
+  }
+
+  // write outgoing bytes until they are all written or the socket is full
+  void flush()
+  {
+    while ( outgoing_offset < outgoing.size() ) {
+      const size_t written = socket.write( string_view { outgoing }.substr( outgoing_offset ) );
+      if ( written == 0 ) {
+        return;
+      }
+      outgoing_offset += written;
+    }
+    outgoing.clear();
+    outgoing_offset = 0;
+  }
+
+  void close()
+  {
+    for ( auto& rule : rules ) {
+      rule.cancel();
+    }
+  }
+};
+
+void run_tcp_client( EventLoop& loop,
+                     const size_t category,
+                     const Options& options,
+                     const Address& server,
+                     const bool& measuring,
+                     Results& results,
+                     vector<shared_ptr<TCPClientConnection>>& connections )
+{
+  TCPSocket socket { server.family() };
+  socket.connect( server );
+  socket.set_nodelay( true );
+  socket.set_blocking( false );
+
+  auto connection = make_shared<TCPClientConnection>(
+    TCPClientConnection { .socket = move( socket ), .message = string( options.message_size, 'x' ) } );
+  connections.push_back( connection );
+  for ( size_t i = 0; i < options.depth; ++i ) {
+    connection->send_message();
+  }
+  connection->flush();
+
+  connection->rules.push_back( loop.add_rule(
+    category,
+    connection->socket,
+    EventLoop::Direction::In,
+    [connection, &measuring, &results, size = options.message_size] {
+      thread_local array<char, kReadSize> buffer;
+      for ( ;; ) {
+        const IOResult read = connection->socket.try_read( buffer );
+        if ( read.would_block() ) {
+          break;
+        }
+        if ( not read or read.bytes() == 0 ) {
+          throw runtime_error( "loadgen: the server closed a connection" );
+        }
+
+        for ( string_view received { buffer.data(), read.bytes() }; not received.empty(); ) {
+          const size_t take = min( received.size(), size - connection->incoming.size() );
+          connection->incoming.append( received.substr( 0, take ) );
+          received.remove_prefix( take );
+          if ( connection->incoming.size() == size ) {
+            if ( measuring ) {
+              record_echo( results, connection->incoming );
+              connection->send_message();
+            }
+            connection->incoming.clear();
+          }
+        }
+      }
+      connection->flush();
+    },
+    [] { return true; },
+    [] {},
+    kTrigger ) );
+
+  connection->rules.push_back( loop.add_rule(
+    category,
+    connection->socket,
+    EventLoop::Direction::Out,
+    [connection] { connection->flush(); },
+    [connection] { return not connection->outgoing.empty(); },
+    [] {},
+    kTrigger ) );
+}
+
+// A UDP client "connection" (a connected socket); its rules own it
+struct UDPClientConnection
+{
+  UDPSocket socket;
+  string message;
+  size_t in_flight {};
+  int64_t last_echo_ns {};
+  vector<EventLoop::RuleHandle> rules {};
+
+  // send messages until `depth` are in flight (or the send buffer is full)
+  void fill( const size_t depth )
+  {
+    while ( in_flight < depth ) {
+      stamp( message );
+      if ( not socket.try_send( message ) ) {
+        return;
+      }
+      ++in_flight;
+    }
+  }
+
+  void close()
+  {
+    for ( auto& rule : rules ) {
+      rule.cancel();
+    }
+  }
+};
+
+void run_udp_client( EventLoop& loop,
+                     const size_t category,
+                     const Options& options,
+                     const Address& server,
+                     const bool& measuring,
+                     Results& results,
+                     vector<shared_ptr<UDPClientConnection>>& connections )
+{
+  UDPSocket socket { server.family() };
+  socket.connect( server );
+  socket.set_blocking( false );
+
+  auto connection = make_shared<UDPClientConnection>(
+    UDPClientConnection { .socket = move( socket ), .message = string( options.message_size, 'x' ) } );
+  connection->last_echo_ns = now_ns();
+  connections.push_back( connection );
+  connection->fill( options.depth );
+
+  connection->rules.push_back( loop.add_rule(
+    category,
+    connection->socket,
+    EventLoop::Direction::In,
+    [connection, &measuring, &results, &options] {
+      thread_local array<char, kReadSize> buffer;
+      for ( ;; ) {
+        const IOResult read = connection->socket.try_read( buffer );
+        if ( read.would_block() ) {
+          break;
+        }
+        if ( not read ) {
+          throw unix_error { "recv", read.error() };
+        }
+        if ( read.bytes() != options.message_size ) {
+          continue; // not one of ours
+        }
+        connection->last_echo_ns = now_ns();
+        connection->in_flight -= min<size_t>( connection->in_flight, 1 ); // late echoes were already counted
+        if ( measuring ) {
+          record_echo( results, { buffer.data(), read.bytes() } );
+        }
+      }
+      if ( measuring ) {
+        connection->fill( options.depth );
+      }
+    },
+    [] { return true; },
+    [] {},
+    kTrigger ) );
+}
+
+// Every kLossTimeout, count the messages of UDP connections that have heard nothing since as lost, and refill
+void check_udp_losses( EventLoop& loop,
+                       const size_t category,
+                       const Options& options,
+                       const bool& measuring,
+                       Results& results,
+                       const vector<shared_ptr<UDPClientConnection>>& connections )
+{
+  loop.add_timer( category, kLossTimeout, [&loop, category, &options, &measuring, &results, &connections] {
+    if ( not measuring ) {
+      return;
+    }
+    const int64_t deadline = now_ns() - chrono::duration_cast<chrono::nanoseconds>( kLossTimeout ).count();
+    for ( const auto& connection : connections ) {
+      if ( connection->last_echo_ns < deadline ) {
+        results.lost += exchange( connection->in_flight, 0 );
+        connection->last_echo_ns = now_ns();
+        connection->fill( options.depth );
+      }
+    }
+    check_udp_losses( loop, category, options, measuring, results, connections );
+  } );
+}
+
+// One client thread: `count` connections on its own EventLoop, measured for options.duration
+Results run_client_thread( const Options& options, const Address& server, const size_t count )
+{
+  Results results;
+  results.latencies_ns.reserve( 1 << 20 );
+
+  EventLoop loop;
+  const size_t category = loop.add_category( options.udp ? "UDP client" : "TCP client" );
+  bool measuring = true;
+  vector<shared_ptr<TCPClientConnection>> tcp_connections;
+  vector<shared_ptr<UDPClientConnection>> udp_connections;
+
+  for ( size_t i = 0; i < count; ++i ) {
+    if ( options.udp ) {
+      run_udp_client( loop, category, options, server, measuring, results, udp_connections );
+    } else {
+      run_tcp_client( loop, category, options, server, measuring, results, tcp_connections );
+    }
+  }
+  if ( options.udp ) {
+    check_udp_losses( loop, category, options, measuring, results, udp_connections );
+  }
+
+  loop.add_timer( category, options.duration, [&] { measuring = false; } );
+  while ( measuring ) {
+    loop.wait_next_event( -1 );
+  }
+
+  for ( const auto& connection : tcp_connections ) {
+    connection->close();
+  }
+  // messages still in flight at the end aren't counted, as lost or otherwise
+  for ( const auto& connection : udp_connections ) {
+    connection->close();
+  }
+  return results;
+}
+
+int64_t percentile( const vector<int64_t>& sorted, const double fraction )
+{
+  if ( sorted.empty() ) {
+    return 0;
+  }
+  const auto rank = static_cast<size_t>( fraction * static_cast<double>( sorted.size() ) );
+  return sorted[min( sorted.size() - 1, rank )];
+}
+
+void run_clients( const Options& options, const Address& server )
+{
+  const size_t threads = min( max<size_t>( options.threads, 1 ), options.connections );
+  vector<Results> per_thread( threads );
+  vector<exception_ptr> errors( threads );
+  vector<thread> workers;
+
+  for ( size_t i = 0; i < threads; ++i ) {
+    // spread the connections as evenly as possible
+    const size_t count = options.connections / threads + ( i < options.connections % threads ? 1 : 0 );
+    workers.emplace_back( [&, i, count] {
+      try {
+        per_thread[i] = run_client_thread( options, server, count );
+      } catch ( ... ) {
+        errors[i] = current_exception();
+      }
+    } );
+  }
+  for ( auto& worker : workers ) {
+    worker.join();
+  }
+  for ( const auto& error : errors ) {
+    if ( error ) {
+      rethrow_exception( error );
+    }
+  }
+
+  Results total;
+  for ( const auto& results : per_thread ) {
+    total.add( results );
+  }
+  ranges::sort( total.latencies_ns );
+
+  const double seconds = chrono::duration<double>( options.duration ).count();
+  const auto us = []( int64_t ns ) { return static_cast<double>( ns ) / 1e3; };
+  cerr << fixed << setprecision( 2 );
+  cerr << "loadgen: " << ( options.udp ? "UDP" : "TCP" ) << " to " << server.to_string() << ", "
+       << options.connections << " connections x " << options.depth << " in flight, " << options.message_size
+       << "-byte messages, " << threads << " client threads, " << seconds << " s\n";
+  cerr << "loadgen: " << total.messages << " messages echoed = " << static_cast<double>( total.messages ) / seconds
+       << " msg/s, " << 8 * static_cast<double>( total.bytes ) / seconds / 1e9 << " Gbit/s each way";
+  if ( options.udp ) {
+    cerr << ", " << total.lost << " lost";
+  }
+  cerr << "\n";
+  cerr << "loadgen: latency p50 " << us( percentile( total.latencies_ns, 0.5 ) ) << " us, p90 "
+       << us( percentile( total.latencies_ns, 0.9 ) ) << " us, p99 " << us( percentile( total.latencies_ns, 0.99 ) )
+       << " us, p99.9 " << us( percentile( total.latencies_ns, 0.999 ) ) << " us, max "
+       << us( total.latencies_ns.empty() ? 0 : total.latencies_ns.back() ) << " us\n";
+}
+
+void usage( const char* argv0 )
+{
+  cerr << "Usage: " << argv0 << " [-u] [-c CONNECTIONS] [-m MESSAGE_BYTES] [-d DEPTH] [-j THREADS] [-t SECONDS]\n";
+  cerr << "\tRuns an echo server and clients over loopback, and reports throughput and latency.\n";
+  cerr << "   or: " << argv0 << " server [-u] [-j THREADS] [-p PORT] [ADDRESS]\n";
+  cerr << "\tEchoes TCP connections (or UDP datagrams, with -u) until interrupted.\n";
+  cerr << "   or: " << argv0 << " client [-u] [-c CONNECTIONS] [-m MESSAGE_BYTES] [-d DEPTH] [-j THREADS]"
+       << " [-t SECONDS] ADDRESS PORT\n";
+  cerr << "\tMeasures a running server. Each connection keeps DEPTH messages in flight.\n";
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort(); // For sticklers: don't try to access argv[0] if argc <= 0.
+    }
+
+    auto args = span( argv, argc );
+
+    // A peer closing a connection early must surface as an exception, not kill the process.
+    signal( SIGPIPE, SIG_IGN );
+
+    string mode { "loopback" };
+    size_t first_option = 1;
+    if ( argc >= 2 and ( string_view { args[1] } == "server" or string_view { args[1] } == "client" ) ) {
+      mode = args[1];
+      first_option = 2;
+    }
+
+    Options options;
+    vector<string> positional;
+    for ( size_t i = first_option; i < args.size(); i++ ) {
+      const string_view arg { args[i] };
+      if ( arg == "-u" ) {
+        options.udp = true;
+      } else if ( ( arg == "-c" or arg == "-m" or arg == "-d" or arg == "-j" or arg == "-t" or arg == "-p" )
+                  and i + 1 < args.size() ) {
+        const string value { args[++i] };
+        if ( arg == "-c" ) {
+          options.connections = stoul( value );
+        } else if ( arg == "-m" ) {
+          options.message_size = stoul( value );
+        } else if ( arg == "-d" ) {
+          options.depth = stoul( value );
+        } else if ( arg == "-j" ) {
+          options.threads = stoul( value );
+        } else if ( arg == "-t" ) {
+          options.duration = chrono::milliseconds { static_cast<int64_t>( stod( value ) * 1000 ) };
+        } else {
+          options.port = static_cast<uint16_t>( stoul( value ) );
+        }
+      } else if ( not arg.starts_with( '-' ) ) {
+        positional.emplace_back( arg );
+      } else {
+        usage( args.front() );
+        return EXIT_FAILURE;
+      }
+    }
+
+    const size_t max_message = options.udp ? 65507 : kReadSize;
+    if ( options.message_size < kTimestampSize or options.message_size > max_message or options.connections == 0
+         or options.depth == 0 ) {
+      cerr << "loadgen: need " << kTimestampSize << " <= MESSAGE_BYTES <= " << max_message
+           << ", and at least one connection and message in flight\n";
+      return EXIT_FAILURE;
+    }
+
+    if ( mode == "server" ) {
+      if ( positional.size() > 1 ) {
+        usage( args.front() );
+        return EXIT_FAILURE;
+      }
+      if ( not positional.empty() ) {
+        options.host = positional.front();
+      }
+      EchoServer server { options };
+      cerr << "loadgen: echoing " << ( options.udp ? "UDP" : "TCP" ) << " on " << server.local_address().to_string()
+           << "\n";
+      for ( ;; ) {
+        pause();
+      }
+    }
+
+    if ( mode == "client" ) {
+      if ( positional.size() != 2 ) {
+        usage( args.front() );
+        return EXIT_FAILURE;
+      }
+      run_clients( options, Address { positional[0], positional[1] } );
+      return EXIT_SUCCESS;
+    }
+
+    if ( not positional.empty() ) {
+      usage( args.front() );
+      return EXIT_FAILURE;
+    }
+    EchoServer server { options };
+    run_clients( options, server.local_address() );
+    server.stop();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
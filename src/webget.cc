@@ -1,19 +1,191 @@
-#include "socket.hh"
+#include "http_client.hh"
 
+#include <algorithm>
+#include <chrono>
+#include <csignal>
 #include <cstdlib>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <span>
+#include <sstream>
 #include <string>
+#include <vector>
 
 using namespace std;
 
 void get_URL( const string& host, const string& path )
 {
-  // Update here with your code!
-  cerr << "Function called: get_URL(" << host << ", " << path << ")\n";
-  cerr << "Warning: get_URL() has not been implemented yet.\n";
+  EventLoop loop;
+  HTTPClient client { loop };
+
+  exception_ptr failure;
+  client.get( host,
+              path,
+              { .on_head = []( const HTTPResponseHead& head ) { cout << head.to_string(); },
+                .on_body = []( string_view body ) { cout << body; },
+                .on_done = [&failure]( const exception_ptr& error ) { failure = error; } } );
+  client.run();
+
+  cout.flush();
+  if ( failure ) {
+    rethrow_exception( failure );
+  }
+}
+
+namespace {
+
+struct BatchOptions
+{
+  string list_file { "-" }; // "-" means stdin
+  string output_dir {};     // empty means stdout
+  HTTPClientOptions client {};
+};
+
+struct Fetch
+{
+  string host;
+  string path;
+  chrono::steady_clock::time_point start {};
+  chrono::steady_clock::duration latency {};
+  uint64_t bytes {};
+  bool done {};
+  ofstream file {};     // with an output directory
+  string held_back {};  // on stdout: body bytes waiting for the earlier fetches to finish
+};
+
+vector<Fetch> read_fetch_list( istream& in )
+{
+  vector<Fetch> fetches;
+  string line;
+  while ( getline( in, line ) ) {
+    istringstream fields { line };
+    string host, path;
+    if ( not( fields >> host ) or host.starts_with( '#' ) ) {
+      continue;
+    }
+    if ( not( fields >> path ) ) {
+      path = "/";
+    }
+    fetches.push_back( { .host = host, .path = path } );
+  }
+  return fetches;
+}
+
+chrono::steady_clock::duration percentile( vector<chrono::steady_clock::duration> sorted, double fraction )
+{
+  if ( sorted.empty() ) {
+    return {};
+  }
+  const auto rank = static_cast<size_t>( fraction * static_cast<double>( sorted.size() ) );
+  const size_t index = min( sorted.size() - 1, rank );
+  return sorted[index];
 }
 
+// Fetch every HOST PATH line of the list concurrently. Bodies go to numbered files in the output directory, or
+// to stdout in list order: the earliest unfinished fetch streams straight through and later ones are held back.
+void get_URLs( const BatchOptions& options )
+{
+  vector<Fetch> fetches;
+  if ( options.list_file == "-" ) {
+    fetches = read_fetch_list( cin );
+  } else {
+    ifstream list { options.list_file };
+    if ( not list ) {
+      throw runtime_error( "can't open " + options.list_file );
+    }
+    fetches = read_fetch_list( list );
+  }
+
+  EventLoop loop;
+  HTTPClient client { loop, options.client };
+
+  size_t next_to_print = 0;
+  size_t failures = 0;
+  const auto to_stdout = options.output_dir.empty();
+
+  const auto start = chrono::steady_clock::now();
+  for ( size_t i = 0; i < fetches.size(); i++ ) {
+    auto& fetch = fetches[i];
+    fetch.start = chrono::steady_clock::now();
+    client.get(
+      fetch.host,
+      fetch.path,
+      { .on_head =
+          [&, i]( const HTTPResponseHead& ) {
+            if ( not to_stdout and not fetches[i].file.is_open() ) {
+              fetches[i].file.open( options.output_dir + "/" + to_string( i ), ios::binary | ios::trunc );
+            }
+          },
+        .on_body =
+          [&, i]( string_view body ) {
+            auto& f = fetches[i];
+            f.bytes += body.size();
+            if ( not to_stdout ) {
+              f.file << body;
+            } else if ( i == next_to_print ) {
+              cout << body;
+            } else {
+              f.held_back += body;
+            }
+          },
+        .on_done =
+          [&, i]( const exception_ptr& error ) {
+            auto& f = fetches[i];
+            f.done = true;
+            f.latency = chrono::steady_clock::now() - f.start;
+            f.file.close();
+            if ( error ) {
+              ++failures;
+              try {
+                rethrow_exception( error );
+              } catch ( const exception& e ) {
+                cerr << "webget: " << f.host << " " << f.path << ": " << e.what() << "\n";
+              }
+            }
+            while ( to_stdout and next_to_print < fetches.size() and fetches[next_to_print].done ) {
+              if ( ++next_to_print < fetches.size() ) {
+                cout << exchange( fetches[next_to_print].held_back, {} );
+              }
+            }
+          } } );
+  }
+  client.run();
+  cout.flush();
+
+  const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  uint64_t total_bytes = 0;
+  vector<chrono::steady_clock::duration> latencies;
+  for ( const auto& fetch : fetches ) {
+    total_bytes += fetch.bytes;
+    latencies.push_back( fetch.latency );
+  }
+  ranges::sort( latencies );
+
+  const auto ms = []( chrono::steady_clock::duration d ) { return chrono::duration<double, milli>( d ).count(); };
+  cerr << fixed << setprecision( 2 );
+  cerr << "webget: " << fetches.size() << " fetches (" << failures << " failed), " << total_bytes << " bytes in "
+       << elapsed.count() << " s = " << 8 * static_cast<double>( total_bytes ) / elapsed.count() / 1e6
+       << " Mbit/s\n";
+  cerr << "webget: latency p50 " << ms( percentile( latencies, 0.5 ) ) << " ms, p99 "
+       << ms( percentile( latencies, 0.99 ) ) << " ms\n";
+
+  if ( failures > 0 ) {
+    throw runtime_error( to_string( failures ) + " fetches failed" );
+  }
+}
+
+void usage( const char* argv0 )
+{
+  cerr << "Usage: " << argv0 << " HOST PATH\n";
+  cerr << "\tExample: " << argv0 << " api.ipify.org /\n";
+  cerr << "   or: " << argv0 << " --batch [-o DIR] [-s SERVICE] [-c CONNECTIONS] [-h PER_HOST] [-d DEPTH]"
+       << " [-t IDLE_SECONDS] [FILE]\n";
+  cerr << "\tFetches every \"HOST PATH\" line of FILE (or stdin) concurrently.\n";
+}
+
+} // namespace
+
 int main( int argc, char* argv[] )
 {
   try {
@@ -23,12 +195,45 @@ int main( int argc, char* argv[] )
 
     auto args = span( argv, argc );
 
+    // A server closing a connection early must surface as an exception, not kill the process.
+    signal( SIGPIPE, SIG_IGN );
+
+    if ( argc >= 2 and string_view { args[1] } == "--batch" ) {
+      BatchOptions options;
+      for ( size_t i = 2; i < args.size(); i++ ) {
+        const string_view arg { args[i] };
+        if ( ( arg == "-o" or arg == "-s" or arg == "-c" or arg == "-h" or arg == "-d" or arg == "-t" )
+             and i + 1 < args.size() ) {
+          const string value { args[++i] };
+          if ( arg == "-o" ) {
+            options.output_dir = value;
+          } else if ( arg == "-s" ) {
+            options.client.service = value;
+          } else if ( arg == "-c" ) {
+            options.client.max_connections = stoul( value );
+          } else if ( arg == "-h" ) {
+            options.client.max_connections_per_host = stoul( value );
+          } else if ( arg == "-t" ) {
+            options.client.idle_timeout = chrono::seconds { stoul( value ) };
+          } else {
+            options.client.max_pipeline_depth = stoul( value );
+          }
+        } else if ( i + 1 == args.size() and ( arg == "-" or not arg.starts_with( '-' ) ) ) {
+          options.list_file = arg;
+        } else {
+          usage( args.front() );
+          return EXIT_FAILURE;
+        }
+      }
+      get_URLs( options );
+      return EXIT_SUCCESS;
+    }
+
     // The program takes two command-line arguments: the hostname and "path" part of the URL.
     // Print the usage message unless there are these two arguments (plus the program name
     // itself, so arg count = 3 in total).
     if ( argc != 3 ) {
-      cerr << "Usage: " << args.front() << " HOST PATH\n";
-      cerr << "\tExample: " << args.front() << " api.ipify.org /\n";
+      usage( args.front() );
       return EXIT_FAILURE;
     }
 
@@ -0,0 +1,179 @@
+#include "address.hh"
+#include "common.hh"
+#include "socket.hh"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+
+using namespace std;
+
+namespace {
+
+void expect_contents( const string& name, const string& expected, const string& actual )
+{
+  if ( actual != expected ) {
+    throw ExpectationViolation { "Expected " + name + " to be \"" + Printer::prettify( expected )
+                                 + "\", but it was \"" + Printer::prettify( actual ) + "\"" };
+  }
+}
+
+// an Address survives conversion to a sockaddr and back, and to its numeric form and back
+void expect_round_trips( const Address& address )
+{
+  const Address copied { static_cast<const sockaddr*>( address ), address.size() };
+  if ( copied != address or copied.hash() != address.hash() ) {
+    throw ExpectationViolation { address.to_string() + " should equal its copy through a sockaddr" };
+  }
+
+  const Address numeric = address.family() == AF_INET
+                            ? Address::from_ipv4_numeric( address.ipv4_numeric(), address.port() )
+                            : Address::from_ipv6_numeric( address.ipv6_numeric(), address.port() );
+  if ( numeric != address ) {
+    throw ExpectationViolation { address.to_string() + " should equal its copy through its numeric form" };
+  }
+
+  const Address reparsed { address.ip(), address.port() };
+  if ( reparsed != address ) {
+    throw ExpectationViolation { address.to_string() + " should equal its copy through ip()" };
+  }
+}
+
+void ipv4()
+{
+  const Address address { "18.243.0.1", 80 };
+  if ( address.family() != AF_INET or address.port() != 80 or address.ipv4_numeric() != 0x12F30001 ) {
+    throw ExpectationViolation { "18.243.0.1:80 was parsed wrongly" };
+  }
+  expect_contents( "IPv4 ip()", "18.243.0.1", address.ip() );
+  expect_contents( "IPv4 to_string()", "18.243.0.1:80", address.to_string() );
+  expect_round_trips( address );
+
+  if ( address.is_ipv4_mapped() or address.unmapped() != address ) {
+    throw ExpectationViolation { "an IPv4 address is not IPv4-mapped, and unmaps to itself" };
+  }
+}
+
+void ipv6()
+{
+  const Address address { "2001:db8::1", 53 };
+  const array<uint8_t, 16> expected_bytes { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+  if ( address.family() != AF_INET6 or address.port() != 53 or address.ipv6_numeric() != expected_bytes ) {
+    throw ExpectationViolation { "[2001:db8::1]:53 was parsed wrongly" };
+  }
+  expect_contents( "IPv6 ip()", "2001:db8::1", address.ip() );
+  expect_contents( "IPv6 to_string()", "[2001:db8::1]:53", address.to_string() );
+  expect_round_trips( address );
+
+  // the non-canonical spelling is the same address
+  if ( Address { "2001:0db8:0:0:0:0:0:0001", 53 } != address ) {
+    throw ExpectationViolation { "2001:0db8:0:0:0:0:0:0001 should equal 2001:db8::1" };
+  }
+
+  bool threw = false;
+  try {
+    address.ipv4_numeric();
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  if ( not threw ) {
+    throw ExpectationViolation { "ipv4_numeric() of an IPv6 address should throw" };
+  }
+}
+
+void ipv4_mapped()
+{
+  const Address mapped { "::ffff:192.0.2.7", 8080 };
+  if ( not mapped.is_ipv4_mapped() ) {
+    throw ExpectationViolation { "::ffff:192.0.2.7 should be IPv4-mapped" };
+  }
+  expect_round_trips( mapped );
+
+  const Address unmapped = mapped.unmapped();
+  if ( unmapped != Address { "192.0.2.7", 8080 } ) {
+    throw ExpectationViolation { "::ffff:192.0.2.7 should unmap to 192.0.2.7, not " + unmapped.to_string() };
+  }
+  if ( mapped == unmapped ) {
+    throw ExpectationViolation { "a mapped address and its IPv4 address are different Addresses" };
+  }
+}
+
+// addresses that differ in family, IP or port are different keys
+void as_keys()
+{
+  const unordered_set<Address> keys { Address { "10.0.0.1", 1 },
+                                      Address { "10.0.0.1", 2 },
+                                      Address { "10.0.0.2", 1 },
+                                      Address { "::ffff:10.0.0.1", 1 },
+                                      Address { "fd00::1", 1 },
+                                      Address { "fd00::1", 2 },
+                                      Address { "10.0.0.1", 1 } };
+  if ( keys.size() != 6 ) {
+    throw ExpectationViolation { "distinct addresses", size_t { 6 }, keys.size() };
+  }
+  if ( not keys.contains( Address::from_ipv4_numeric( 0x0A000002, 1 ) ) ) {
+    throw ExpectationViolation { "an equal Address built another way should be found" };
+  }
+}
+
+// a dual-stack listener sees an IPv4 client as an IPv4-mapped peer, which unmaps to the client's address
+void dual_stack()
+{
+  TCPSocket listener { AF_INET6 };
+  listener.set_ipv6_only( false );
+  listener.set_reuseaddr();
+  listener.bind( Address { "::" } );
+  listener.listen();
+
+  TCPSocket client;
+  client.connect( Address { "127.0.0.1", listener.local_address().port() } );
+  TCPSocket server = listener.accept();
+
+  const Address peer = server.peer_address();
+  if ( not peer.is_ipv4_mapped() or peer.unmapped() != client.local_address() ) {
+    throw ExpectationViolation { "the dual-stack peer " + peer.to_string() + " should unmap to "
+                                 + client.local_address().to_string() };
+  }
+}
+
+// a resolved hostname is IPv4, so a default TCPSocket can connect to it
+void resolved_hostname()
+{
+  const Address http { "localhost", "http" };
+  if ( http.family() != AF_INET or http.port() != 80 ) {
+    throw ExpectationViolation { "localhost:http should resolve to an IPv4 address, not " + http.to_string() };
+  }
+
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( Address { "127.0.0.1" } );
+  listener.listen();
+  TCPSocket client;
+  client.connect( Address { "localhost", to_string( listener.local_address().port() ) } );
+  if ( listener.accept().peer_address() != client.local_address() ) {
+    throw ExpectationViolation { "a default TCPSocket should connect to a resolved hostname" };
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    ipv4();
+    ipv6();
+    ipv4_mapped();
+    as_keys();
+    dual_stack();
+    resolved_hostname();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
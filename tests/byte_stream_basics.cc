@@ -0,0 +1,108 @@
+#include "byte_stream_test_harness.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+int main()
+{
+  try {
+    {
+      ByteStreamTestHarness test { "construction", 15 };
+      test.execute( IsClosed { false } );
+      test.execute( IsFinished { false } );
+      test.execute( HasError { false } );
+      test.execute( BytesPushed { 0 } );
+      test.execute( BytesPopped { 0 } );
+      test.execute( AvailableCapacity { 15 } );
+      test.execute( BytesBuffered { 0 } );
+    }
+
+    {
+      ByteStreamTestHarness test { "write-read-close", 15 };
+      test.execute( Push { "cat" } );
+      test.execute( BytesPushed { 3 } );
+      test.execute( AvailableCapacity { 12 } );
+      test.execute( Peek { "cat" } );
+      test.execute( ReadAll { "cat" } );
+      test.execute( BytesPopped { 3 } );
+      test.execute( IsFinished { false } );
+      test.execute( Close {} );
+      test.execute( IsClosed { true } );
+      test.execute( IsFinished { true } );
+      test.execute( AvailableCapacity { 15 } );
+    }
+
+    {
+      ByteStreamTestHarness test { "overwrite", 2 };
+      test.execute( Push { "cat" } );
+      test.execute( BytesPushed { 2 } );
+      test.execute( AvailableCapacity { 0 } );
+      test.execute( Peek { "ca" } );
+      test.execute( Push { "t" } );
+      test.execute( Peek { "ca" } );
+      test.execute( Pop { 1 } );
+      test.execute( Push { "tmp" } );
+      test.execute( Peek { "at" } );
+      test.execute( BytesPushed { 3 } );
+      test.execute( BytesPopped { 1 } );
+    }
+
+    {
+      // capacity 6 uses a ring of 8 bytes, so these pushes wrap around its end
+      ByteStreamTestHarness test { "wrap-around", 6 };
+      test.execute( Push { "abcdef" } );
+      test.execute( Pop { 5 } );
+      test.execute( Push { "ghijk" } );
+      test.execute( Peek { "fghijk" } );
+      test.execute( BytesBuffered { 6 } );
+      test.execute( Pop { 4 } );
+      test.execute( Push { "lmno" } );
+      test.execute( Peek { "jklmno" } );
+      test.execute( ReadAll { "jklmno" } );
+      test.execute( BytesPopped { 15 } );
+      test.execute( Peek { "" } );
+    }
+
+    {
+      ByteStreamTestHarness test { "pop past end", 4 };
+      test.execute( Push { "ab" } );
+      test.execute( Pop { 10 } );
+      test.execute( BytesPopped { 2 } );
+      test.execute( BytesBuffered { 0 } );
+      test.execute( AvailableCapacity { 4 } );
+    }
+
+    {
+      ByteStreamTestHarness test { "push after close", 8 };
+      test.execute( Push { "ab" } );
+      test.execute( Close {} );
+      test.execute( Push { "cd" } );
+      test.execute( BytesPushed { 2 } );
+      test.execute( IsFinished { false } );
+      test.execute( ReadAll { "ab" } );
+      test.execute( IsFinished { true } );
+    }
+
+    {
+      ByteStreamTestHarness test { "error", 8 };
+      test.execute( SetError {} );
+      test.execute( HasError { true } );
+    }
+
+    {
+      ByteStreamTestHarness test { "zero capacity", 0 };
+      test.execute( Push { "a" } );
+      test.execute( BytesPushed { 0 } );
+      test.execute( AvailableCapacity { 0 } );
+      test.execute( Peek { "" } );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
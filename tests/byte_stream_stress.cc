@@ -0,0 +1,79 @@
+#include "byte_stream_test_harness.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t kSequences = 16;
+constexpr size_t kStepsPerSequence = 4000;
+
+// a random sequence of pushes, pops and reads, checked against a string holding what should be buffered
+void random_sequence( const size_t seed )
+{
+  mt19937 rng { static_cast<mt19937::result_type>( seed ) };
+  const uint64_t capacity = uniform_int_distribution<uint64_t> { 1, 64 }( rng );
+  ByteStreamTestHarness test { "random sequence " + to_string( seed ), capacity };
+
+  string buffered;
+  uint64_t pushed = 0;
+  uint64_t popped = 0;
+  uniform_int_distribution<size_t> length { 0, 2 * capacity };
+  uniform_int_distribution<int> byte { 'a', 'z' };
+
+  for ( size_t i = 0; i < kStepsPerSequence; ++i ) {
+    switch ( uniform_int_distribution<int> { 0, 3 }( rng ) ) {
+      case 0: {
+        string data( length( rng ), '\0' );
+        generate( data.begin(), data.end(), [&] { return static_cast<char>( byte( rng ) ); } );
+        const size_t accepted = min<size_t>( data.size(), capacity - buffered.size() );
+        buffered += data.substr( 0, accepted );
+        pushed += accepted;
+        test.execute( Push { move( data ) } );
+        break;
+      }
+      case 1: {
+        const size_t len = length( rng );
+        const size_t removed = min( len, buffered.size() );
+        buffered.erase( 0, removed );
+        popped += removed;
+        test.execute( Pop { len } );
+        break;
+      }
+      case 2:
+        test.execute( Peek { buffered } );
+        break;
+      default:
+        popped += buffered.size();
+        test.execute( ReadAll { exchange( buffered, {} ) } );
+        break;
+    }
+    test.execute( BytesBuffered { buffered.size() } );
+    test.execute( AvailableCapacity { capacity - buffered.size() } );
+  }
+
+  test.execute( BytesPushed { pushed } );
+  test.execute( BytesPopped { popped } );
+  test.execute( Close {} );
+  test.execute( ReadAll { buffered } );
+  test.execute( IsFinished { true } );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    run_in_parallel( kSequences, random_sequence );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
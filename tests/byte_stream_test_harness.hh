@@ -0,0 +1,135 @@
+#pragma once
+
+#include "byte_stream.hh"
+#include "common.hh"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+class ByteStreamTestHarness : public TestHarness<ByteStream>
+{
+public:
+  ByteStreamTestHarness( std::string test_name, uint64_t capacity )
+    : TestHarness( std::move( test_name ), "capacity=" + std::to_string( capacity ), ByteStream { capacity } )
+  {}
+};
+
+struct Push : public Action<ByteStream>
+{
+  std::string data_;
+
+  explicit Push( std::string data ) : data_( std::move( data ) ) {}
+  std::string description() const override { return "push \"" + Printer::prettify( data_ ) + "\" to the stream"; }
+  void execute( ByteStream& bs ) const override { bs.writer().push( data_ ); }
+};
+
+struct Close : public Action<ByteStream>
+{
+  std::string description() const override { return "close"; }
+  void execute( ByteStream& bs ) const override { bs.writer().close(); }
+};
+
+struct SetError : public Action<ByteStream>
+{
+  std::string description() const override { return "set_error"; }
+  void execute( ByteStream& bs ) const override { bs.set_error(); }
+};
+
+struct Pop : public Action<ByteStream>
+{
+  uint64_t len_;
+
+  explicit Pop( uint64_t len ) : len_( len ) {}
+  std::string description() const override { return "pop( " + std::to_string( len_ ) + " )"; }
+  void execute( ByteStream& bs ) const override { bs.reader().pop( len_ ); }
+};
+
+struct Peek : public Expectation<ByteStream>
+{
+  std::string output_;
+
+  explicit Peek( std::string output ) : output_( std::move( output ) ) {}
+  std::string description() const override { return "peeking produces \"" + Printer::prettify( output_ ) + "\""; }
+  void execute( ByteStream& bs ) const override
+  {
+    const auto [first, second] = bs.reader().peek_all();
+    if ( bs.reader().peek() != first ) {
+      throw ExpectationViolation { "peek() and peek_all() disagree about the first piece" };
+    }
+    if ( first.empty() and not second.empty() ) {
+      throw ExpectationViolation { "peek_all() returned an empty first piece but a non-empty second piece" };
+    }
+    const std::string got = std::string { first } + std::string { second };
+    if ( got != output_ ) {
+      throw ExpectationViolation { "Expected \"" + Printer::prettify( output_ ) + "\" in buffer, but found \""
+                                   + Printer::prettify( got ) + "\"" };
+    }
+  }
+};
+
+struct ReadAll : public Expectation<ByteStream>
+{
+  std::string output_;
+
+  explicit ReadAll( std::string output ) : output_( std::move( output ) ) {}
+  std::string description() const override { return "reading \"" + Printer::prettify( output_ ) + "\""; }
+  void execute( ByteStream& bs ) const override
+  {
+    std::string got;
+    read( bs.reader(), output_.size(), got );
+    if ( got != output_ ) {
+      throw ExpectationViolation { "Expected to read \"" + Printer::prettify( output_ ) + "\", but found \""
+                                   + Printer::prettify( got ) + "\"" };
+    }
+  }
+};
+
+struct IsClosed : public ExpectBool<ByteStream>
+{
+  using ExpectBool::ExpectBool;
+  std::string name() const override { return "is_closed"; }
+  bool value( ByteStream& bs ) const override { return bs.writer().is_closed(); }
+};
+
+struct IsFinished : public ExpectBool<ByteStream>
+{
+  using ExpectBool::ExpectBool;
+  std::string name() const override { return "is_finished"; }
+  bool value( ByteStream& bs ) const override { return bs.reader().is_finished(); }
+};
+
+struct HasError : public ExpectBool<ByteStream>
+{
+  using ExpectBool::ExpectBool;
+  std::string name() const override { return "has_error"; }
+  bool value( ByteStream& bs ) const override { return bs.has_error(); }
+};
+
+struct BytesBuffered : public ExpectNumber<ByteStream, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "bytes_buffered"; }
+  uint64_t value( ByteStream& bs ) const override { return bs.reader().bytes_buffered(); }
+};
+
+struct BytesPushed : public ExpectNumber<ByteStream, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "bytes_pushed"; }
+  uint64_t value( ByteStream& bs ) const override { return bs.writer().bytes_pushed(); }
+};
+
+struct BytesPopped : public ExpectNumber<ByteStream, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "bytes_popped"; }
+  uint64_t value( ByteStream& bs ) const override { return bs.reader().bytes_popped(); }
+};
+
+struct AvailableCapacity : public ExpectNumber<ByteStream, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "available_capacity"; }
+  uint64_t value( ByteStream& bs ) const override { return bs.writer().available_capacity(); }
+};
@@ -0,0 +1,200 @@
+#include "checksum.hh"
+#include "common.hh"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+namespace {
+
+// RFC 1071 one byte at a time: big-endian words, an odd last byte padded with zero, carries added back in
+uint16_t reference_checksum( const string_view data, uint64_t sum = 0 )
+{
+  for ( size_t i = 0; i < data.size(); ++i ) {
+    const auto byte = static_cast<uint8_t>( data[i] );
+    sum += i % 2 == 0 ? uint64_t { byte } << 8U : byte;
+  }
+  while ( sum > 0xffff ) {
+    sum = ( sum & 0xffffU ) + ( sum >> 16U );
+  }
+  return static_cast<uint16_t>( ~sum );
+}
+
+string random_bytes( mt19937_64& random, size_t length )
+{
+  string bytes( length, '\0' );
+  for ( auto& byte : bytes ) {
+    byte = static_cast<char>( random() );
+  }
+  return bytes;
+}
+
+void expect_checksum( const string& name, const string_view data, const uint32_t sum = 0 )
+{
+  const uint16_t expected = reference_checksum( data, sum );
+  const uint16_t actual = internet_checksum( data, sum );
+  if ( actual != expected ) {
+    throw ExpectationViolation { name + " (" + to_string( data.size() ) + " bytes)", expected, actual };
+  }
+}
+
+// the example from RFC 1071, section 3
+void known_answer()
+{
+  const string data { "\x00\x01\xf2\x03\xf4\xf5\xf6\xf7", 8 };
+  if ( checksum_add( data ) != 0xddf2 or internet_checksum( data ) != 0x220d ) {
+    throw ExpectationViolation {
+      "checksum of the RFC 1071 example", uint16_t { 0x220d }, internet_checksum( data ) };
+  }
+
+  // a header with its own checksum in it sums to 0
+  string header = data;
+  header += "\x22\x0d";
+  if ( internet_checksum( header ) != 0 ) {
+    throw ExpectationViolation { "checksum including the checksum", uint16_t { 0 }, internet_checksum( header ) };
+  }
+}
+
+// every length and alignment around the kernels' block sizes agrees with the byte-at-a-time reference
+void against_reference()
+{
+  mt19937_64 random { 1071 }; // NOLINT(*-msc51-cpp)
+  const string bytes = random_bytes( random, 4096 + 8 );
+
+  for ( size_t offset = 0; offset < 8; ++offset ) {
+    const string name = "checksum at offset " + to_string( offset );
+    for ( size_t length = 0; length <= 300; ++length ) {
+      expect_checksum( name, string_view { bytes }.substr( offset, length ) );
+    }
+    expect_checksum( name, string_view { bytes }.substr( offset, 4095 ) );
+  }
+  expect_checksum( "checksum continuing a sum", string_view { bytes }.substr( 0, 1501 ), 0xfffe );
+
+  // all-ones words carry on every addition, and blocks of the vector kernels end after 1 MiB
+  for ( const size_t length : { size_t { 1 } << 20U, ( size_t { 1 } << 20U ) + 63, ( size_t { 3 } << 20U ) + 1 } ) {
+    expect_checksum( "checksum of all-ones", string( length, '\xff' ) );
+    expect_checksum( "checksum of random bytes", random_bytes( random, length ) );
+  }
+}
+
+// the vector kernel, where this CPU has one, gives the same sums as the scalar one
+void kernels_agree()
+{
+#if defined( __x86_64__ ) || defined( __aarch64__ )
+#if defined( __x86_64__ )
+  if ( not checksum_detail::has_avx2() ) {
+    return;
+  }
+  const auto vector_kernel = checksum_detail::native_sum_avx2;
+#else
+  const auto vector_kernel = checksum_detail::native_sum_neon;
+#endif
+  mt19937_64 random { 1624 }; // NOLINT(*-msc51-cpp)
+  const string bytes = random_bytes( random, 70000 );
+  for ( size_t length = 0; length < bytes.size(); length += length < 512 ? 1 : 997 ) {
+    const string_view data = string_view { bytes }.substr( length % 7, length );
+    if ( vector_kernel( data ) != checksum_detail::native_sum_scalar( data ) ) {
+      throw ExpectationViolation { "vector kernel's sum of " + to_string( length ) + " bytes",
+                                   checksum_detail::native_sum_scalar( data ),
+                                   vector_kernel( data ) };
+    }
+  }
+#endif
+}
+
+// summing in even-length pieces gives the same checksum as summing the whole
+void in_pieces()
+{
+  mt19937_64 random { 793 }; // NOLINT(*-msc51-cpp)
+  const string bytes = random_bytes( random, 2001 );
+  uint32_t sum = 0;
+  for ( size_t start = 0; start < bytes.size(); start += 2 * ( start % 37 + 1 ) ) {
+    sum = checksum_add( string_view { bytes }.substr( start, 2 * ( start % 37 + 1 ) ), sum );
+  }
+  if ( checksum_finish( sum ) != internet_checksum( bytes ) ) {
+    throw ExpectationViolation { "checksum summed in pieces", internet_checksum( bytes ), checksum_finish( sum ) };
+  }
+}
+
+// the pseudo-header sums equal sums of the pseudo-headers written out
+void pseudo_headers()
+{
+  const string ipv4 { "\x0a\x00\x00\x01\xc0\xa8\x01\x02\x00\x06\x05\xdc", 12 };
+  const uint32_t ipv4_sum = ipv4_pseudo_header_sum( 0x0A000001, 0xC0A80102, 6, 1500 );
+  if ( checksum_finish( ipv4_sum ) != reference_checksum( ipv4 ) ) {
+    throw ExpectationViolation {
+      "IPv4 pseudo-header checksum", reference_checksum( ipv4 ), checksum_finish( ipv4_sum ) };
+  }
+
+  array<uint8_t, 16> source {};
+  array<uint8_t, 16> destination {};
+  string ipv6;
+  for ( uint8_t i = 0; i < 16; ++i ) {
+    source[i] = static_cast<uint8_t>( 0xf0 + i );
+    destination[i] = static_cast<uint8_t>( 0x0f * i );
+  }
+  ipv6.append( source.begin(), source.end() );
+  ipv6.append( destination.begin(), destination.end() );
+  ipv6 += string { "\x00\x01\x00\x07\x00\x00\x00\x11", 8 };
+  const uint32_t ipv6_sum = ipv6_pseudo_header_sum( source, destination, 17, 0x10007 );
+  if ( checksum_finish( ipv6_sum ) != reference_checksum( ipv6 ) ) {
+    throw ExpectationViolation {
+      "IPv6 pseudo-header checksum", reference_checksum( ipv6 ), checksum_finish( ipv6_sum ) };
+  }
+}
+
+// updating a checksum for a changed field gives what summing the changed data again would
+void incremental_updates()
+{
+  mt19937_64 random { 1141 }; // NOLINT(*-msc51-cpp)
+  for ( size_t trial = 0; trial < 10000; ++trial ) {
+    string header = random_bytes( random, 20 );
+    const uint16_t before = internet_checksum( header );
+
+    const size_t offset = random() % 5 * 4;
+    const auto load = [&]( size_t at ) {
+      return static_cast<uint16_t>( uint16_t { static_cast<uint8_t>( header[at] ) } << 8U
+                                    | static_cast<uint8_t>( header[at + 1] ) );
+    };
+    const uint32_t old_value = uint32_t { load( offset ) } << 16U | load( offset + 2 );
+    // include changes to and from zero and all-ones words, where one's-complement arithmetic has two zeros
+    const uint32_t new_value = trial % 3 == 0 ? 0 : trial % 3 == 1 ? 0xffffffff : static_cast<uint32_t>( random() );
+    for ( size_t i = 0; i < 4; ++i ) {
+      header[offset + i] = static_cast<char>( new_value >> ( 24 - 8 * i ) );
+    }
+
+    const uint16_t updated32 = checksum_update32( before, old_value, new_value );
+    const uint16_t updated16 = checksum_update16( checksum_update16( before, old_value >> 16U, new_value >> 16U ),
+                                                  old_value & 0xffffU,
+                                                  new_value & 0xffffU );
+    if ( updated32 != internet_checksum( header ) or updated16 != updated32 ) {
+      throw ExpectationViolation { "incrementally updated checksum", internet_checksum( header ), updated32 };
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    known_answer();
+    against_reference();
+    kernels_agree();
+    in_pieces();
+    pseudo_headers();
+    incremental_updates();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
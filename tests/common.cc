@@ -1,16 +1,134 @@
 #include "common.hh"
 
+#include <atomic>
+#include <cstdlib>
+#include <exception>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <unistd.h>
 
 using namespace std;
 
+namespace {
+
+// serializes diagnostics from tests run in parallel
+mutex& output_mutex()
+{
+  static mutex m;
+  return m;
+}
+
+// step times of every harness, by step type, printed at exit
+class StepTimeReport
+{
+  mutex mutex_ {};
+  unordered_map<type_index, StepTimes> times_ {};
+
+public:
+  void add( const unordered_map<type_index, StepTimes>& times )
+  {
+    const lock_guard lock { mutex_ };
+    for ( const auto& [type, step] : times ) {
+      StepTimes& total = times_[type];
+      total.count += step.count;
+      total.total += step.total;
+      total.max = max( total.max, step.max );
+    }
+  }
+
+  StepTimeReport() = default;
+  StepTimeReport( const StepTimeReport& other ) = delete;
+  StepTimeReport( StepTimeReport&& other ) = delete;
+  StepTimeReport& operator=( const StepTimeReport& other ) = delete;
+  StepTimeReport& operator=( StepTimeReport&& other ) = delete;
+
+  ~StepTimeReport()
+  {
+    if ( times_.empty() ) {
+      return;
+    }
+
+    vector<pair<string, StepTimes>> rows;
+    rows.reserve( times_.size() );
+    for ( const auto& [type, step] : times_ ) {
+      rows.emplace_back( demangle( type.name() ), step );
+    }
+    sort( rows.begin(), rows.end(), []( const auto& a, const auto& b ) {
+      return a.second.total > b.second.total;
+    } );
+
+    const auto us = []( chrono::nanoseconds time ) { return chrono::duration<double, micro> { time }.count(); };
+    cerr << "\nStep times (total, mean and max in microseconds):\n";
+    for ( const auto& [name, step] : rows ) {
+      cerr << "  " << left << setw( 24 ) << name << right << setw( 12 ) << step.count << " steps" << fixed
+           << setprecision( 1 ) << setw( 14 ) << us( step.total ) << setprecision( 3 ) << setw( 12 )
+           << us( step.total ) / static_cast<double>( step.count ) << setprecision( 1 ) << setw( 12 )
+           << us( step.max ) << "\n";
+    }
+  }
+};
+
+StepTimeReport& step_time_report()
+{
+  static StepTimeReport report;
+  return report;
+}
+
+} // namespace
+
+bool step_timing_enabled()
+{
+  static const bool enabled = getenv( "TEST_STEP_TIMES" ) != nullptr;
+  return enabled;
+}
+
+void record_step_times( const unordered_map<type_index, StepTimes>& times )
+{
+  step_time_report().add( times );
+}
+
+void run_in_parallel( const size_t count, const function<void( size_t )>& test )
+{
+  atomic<size_t> next { 0 };
+  atomic<bool> failed { false };
+  exception_ptr first_error {};
+  mutex error_mutex;
+
+  const auto worker = [&] {
+    for ( size_t i = next++; i < count and not failed; i = next++ ) {
+      try {
+        test( i );
+      } catch ( ... ) {
+        const lock_guard lock { error_mutex };
+        if ( not failed.exchange( true ) ) {
+          first_error = current_exception();
+        }
+      }
+    }
+  };
+
+  const size_t thread_count = min<size_t>( max( thread::hardware_concurrency(), 1U ), count );
+  vector<jthread> threads;
+  threads.reserve( thread_count );
+  for ( size_t i = 1; i < thread_count; ++i ) {
+    threads.emplace_back( worker );
+  }
+  worker();
+  threads.clear();
+
+  if ( first_error ) {
+    rethrow_exception( first_error );
+  }
+}
+
 void Printer::diagnostic( std::string_view test_name,
                           const vector<pair<string, int>>& steps_executed,
                           const string& failing_step,
                           const exception& e ) const
 {
+  const lock_guard lock { output_mutex() };
   const string quote = Printer::with_color( Printer::def, "\"" );
   cerr << "\nThe test " << quote << Printer::with_color( Printer::def, test_name ) << quote
        << " failed after these steps:\n\n";
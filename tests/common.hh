@@ -3,10 +3,18 @@
 #include "conversions.hh"
 #include "exception.hh"
 
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <typeindex>
 #include <typeinfo>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -72,38 +80,127 @@ public:
                    const std::exception& e ) const;
 };
 
+// How long the steps of one type took, for TestHarness's per-step timing
+struct StepTimes
+{
+  uint64_t count {};
+  std::chrono::nanoseconds total {};
+  std::chrono::nanoseconds max {};
+
+  void add( std::chrono::nanoseconds elapsed )
+  {
+    ++count;
+    total += elapsed;
+    max = std::max( max, elapsed );
+  }
+};
+
+// Whether TestHarness times its steps (set TEST_STEP_TIMES in the environment); if so, the times of every
+// harness are added up by step type and printed when the program exits
+bool step_timing_enabled();
+void record_step_times( const std::unordered_map<std::type_index, StepTimes>& times );
+
+// Run test( 0 ), ..., test( count - 1 ) across the CPU's cores. Each call should make its own harness, since
+// a harness isn't thread-safe. If any call throws, the calls not yet started are skipped and the first
+// exception is rethrown once the others finish.
+void run_in_parallel( size_t count, const std::function<void( size_t )>& test );
+
 template<class T>
 class TestHarness
 {
   std::string test_name_;
+  std::string initialization_;
   T obj_;
 
-  std::vector<std::pair<std::string, int>> steps_executed_ {};
+  // Steps that succeeded, kept as copies so their descriptions are only formatted if a later step fails.
+  // A step passed as a reference to its base class can't be copied, so its description is formatted right away.
+  struct Step
+  {
+    std::unique_ptr<const TestStep<T>> step;
+    std::string description;
+    int color;
+  };
+  std::vector<Step> steps_executed_ {};
+
+  bool timing_ { step_timing_enabled() };
+  std::unordered_map<std::type_index, StepTimes> step_times_ {};
+
   Printer pr_ {};
 
-protected:
-  explicit TestHarness( std::string test_name, std::string_view desc, T&& object )
-    : test_name_( std::move( test_name ) ), obj_( std::move( object ) )
+  template<class S>
+  void run( const S& step )
+  {
+    if ( not timing_ ) {
+      step.execute( obj_ );
+      return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    step.execute( obj_ );
+    step_times_[typeid( step )].add( std::chrono::steady_clock::now() - start );
+  }
+
+  void fail( const TestStep<T>& step, const std::exception& e ) const
   {
-    steps_executed_.emplace_back( "Initialized " + demangle( typeid( T ).name() ) + " with " + std::string { desc },
-                                  Printer::def );
+    std::vector<std::pair<std::string, int>> steps;
+    steps.reserve( steps_executed_.size() + 1 );
+    steps.emplace_back( initialization_, Printer::def );
+    for ( const auto& [past, description, color] : steps_executed_ ) {
+      steps.emplace_back( past ? past->str() : description, color );
+    }
+    pr_.diagnostic( test_name_, steps, step.str(), e );
   }
 
+protected:
+  explicit TestHarness( std::string test_name, std::string_view desc, T&& object )
+    : test_name_( std::move( test_name ) )
+    , initialization_( "Initialized " + demangle( typeid( T ).name() ) + " with " + std::string { desc } )
+    , obj_( std::move( object ) )
+  {}
+
   const T& object() const { return obj_; }
 
 public:
-  void execute( const TestStep<T>& step )
+  TestHarness( const TestHarness& other ) = delete;
+  TestHarness& operator=( const TestHarness& other ) = delete;
+  TestHarness( TestHarness&& other ) noexcept = default;
+  TestHarness& operator=( TestHarness&& other ) noexcept = default;
+
+  ~TestHarness()
+  {
+    if ( timing_ and not step_times_.empty() ) {
+      record_step_times( step_times_ );
+    }
+  }
+
+  // The number of steps that have succeeded
+  size_t steps_executed() const { return steps_executed_.size(); }
+
+  // How long each type of step has taken so far (empty unless step_timing_enabled())
+  const std::unordered_map<std::type_index, StepTimes>& step_times() const { return step_times_; }
+
+  template<class S>
+  requires std::derived_from<std::remove_cvref_t<S>, TestStep<T>>
+  void execute( S&& step )
   {
+    using StepType = std::remove_cvref_t<S>;
     try {
-      step.execute( obj_ );
-      steps_executed_.emplace_back( step.str(), step.color() );
+      run( step );
     } catch ( const ExpectationViolation& e ) {
-      pr_.diagnostic( test_name_, steps_executed_, step.str(), e );
+      fail( step, e );
       throw std::runtime_error { "The test \"" + test_name_ + "\" failed." };
     } catch ( const std::exception& e ) {
-      pr_.diagnostic( test_name_, steps_executed_, step.str(), e );
+      fail( step, e );
       throw std::runtime_error { "The test \"" + test_name_ + "\" made your code throw an exception." };
     }
+
+    const int color = step.color();
+    if constexpr ( not std::is_abstract_v<StepType> ) {
+      if ( typeid( step ) == typeid( StepType ) ) {
+        steps_executed_.push_back( { std::make_unique<const StepType>( std::forward<S>( step ) ), {}, color } );
+        return;
+      }
+    }
+    steps_executed_.push_back( { nullptr, step.str(), color } );
   }
 };
 
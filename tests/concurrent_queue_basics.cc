@@ -0,0 +1,208 @@
+#include "common.hh"
+#include "concurrent_queue.hh"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// fill and drain a queue on one thread, many times around the ring
+template<typename Queue>
+void single_thread( const string& name )
+{
+  Queue queue { 5 };
+  if ( queue.capacity() != 8 ) {
+    throw ExpectationViolation { name + " capacity", size_t { 8 }, queue.capacity() };
+  }
+
+  uint64_t next_in = 0;
+  uint64_t next_out = 0;
+  for ( size_t round = 0; round < 10; ++round ) {
+    while ( queue.try_push( next_in ) ) {
+      ++next_in;
+    }
+    if ( next_in - next_out != queue.capacity() or queue.size_approx() != queue.capacity() ) {
+      throw ExpectationViolation { name + " should take exactly its capacity before it is full" };
+    }
+
+    // drain part of the way, so that the indices wrap at a different place each round
+    for ( size_t i = 0; i < round % queue.capacity() + 1; ++i ) {
+      uint64_t value = 0;
+      if ( not queue.try_pop( value ) or value != next_out ) {
+        throw ExpectationViolation { name + " popped out of order" };
+      }
+      ++next_out;
+    }
+  }
+
+  uint64_t value = 0;
+  while ( queue.try_pop( value ) ) {
+    if ( value != next_out++ ) {
+      throw ExpectationViolation { name + " popped out of order" };
+    }
+  }
+  if ( next_out != next_in or queue.size_approx() != 0 ) {
+    throw ExpectationViolation { name + " lost elements", next_in, next_out };
+  }
+}
+
+// move-only elements are moved through, and ones still queued are destroyed with the queue
+template<typename Queue>
+void move_only( const string& name )
+{
+  const auto shared = make_shared<int>( 7 );
+  {
+    Queue queue { 4 };
+    for ( int i = 0; i < 3; ++i ) {
+      if ( not queue.try_emplace( make_unique<shared_ptr<int>>( shared ) ) ) {
+        throw ExpectationViolation { name + " refused an element before it was full" };
+      }
+    }
+    unique_ptr<shared_ptr<int>> popped;
+    if ( not queue.try_pop( popped ) or not popped or *popped != shared ) {
+      throw ExpectationViolation { name + " did not move the element out" };
+    }
+  }
+  if ( shared.use_count() != 1 ) {
+    throw ExpectationViolation { name + " elements alive after destruction", long { 1 }, shared.use_count() };
+  }
+
+  bool threw = false;
+  try {
+    const Queue empty { 0 };
+  } catch ( const invalid_argument& ) {
+    threw = true;
+  }
+  if ( not threw ) {
+    throw ExpectationViolation { name + " should reject a capacity of 0" };
+  }
+}
+
+// one producer and one consumer: every element arrives once, in order
+void spsc_threads()
+{
+  constexpr uint64_t count = 100000;
+  SPSCQueue<uint64_t> queue { 64 };
+  uint64_t expected = 0;
+  bool in_order = true; // checked after the join: an exception can't leave the consumer thread
+
+  thread consumer { [&] {
+    while ( expected < count ) {
+      uint64_t value = 0;
+      if ( not queue.try_pop( value ) ) {
+        this_thread::yield();
+        continue;
+      }
+      in_order &= value == expected;
+      ++expected;
+    }
+  } };
+
+  for ( uint64_t i = 0; i < count; ++i ) {
+    while ( not queue.try_push( i ) ) {
+      this_thread::yield();
+    }
+  }
+  consumer.join();
+
+  if ( not in_order ) {
+    throw ExpectationViolation { "SPSCQueue delivered elements out of order" };
+  }
+}
+
+// several producers and consumers: every element arrives exactly once, and each consumer sees each
+// producer's elements in the order they were pushed
+void mpmc_threads()
+{
+  constexpr uint64_t producers = 3;
+  constexpr uint64_t consumers = 3;
+  constexpr uint64_t per_producer = 20000;
+  MPMCQueue<uint64_t> queue { 32 };
+
+  vector<vector<uint64_t>> received( consumers );
+  vector<char> ordered( consumers, true ); // not vector<bool>, whose elements share words between threads
+  vector<thread> threads;
+  for ( uint64_t p = 0; p < producers; ++p ) {
+    threads.emplace_back( [&queue, p] {
+      for ( uint64_t i = 0; i < per_producer; ++i ) {
+        while ( not queue.try_push( p * per_producer + i ) ) {
+          this_thread::yield();
+        }
+      }
+    } );
+  }
+
+  // the consumers stop once every element has been taken by one of them
+  atomic<uint64_t> taken { 0 };
+  for ( uint64_t c = 0; c < consumers; ++c ) {
+    threads.emplace_back( [&, c] {
+      vector<uint64_t> last_from( producers, 0 );
+      vector<bool> seen_from( producers, false );
+      while ( taken.load() < producers * per_producer ) {
+        uint64_t value = 0;
+        if ( not queue.try_pop( value ) ) {
+          this_thread::yield();
+          continue;
+        }
+        taken.fetch_add( 1 );
+        const uint64_t producer = value / per_producer;
+        if ( seen_from[producer] and value <= last_from[producer] ) {
+          ordered[c] = false;
+        }
+        seen_from[producer] = true;
+        last_from[producer] = value;
+        received[c].push_back( value );
+      }
+    } );
+  }
+  for ( auto& t : threads ) {
+    t.join();
+  }
+
+  vector<bool> arrived( producers * per_producer, false );
+  for ( uint64_t c = 0; c < consumers; ++c ) {
+    if ( not ordered[c] ) {
+      throw ExpectationViolation { "MPMCQueue reordered one producer's elements" };
+    }
+    for ( const uint64_t value : received[c] ) {
+      if ( arrived.at( value ) ) {
+        throw ExpectationViolation { "MPMCQueue delivered " + to_string( value ) + " twice" };
+      }
+      arrived[value] = true;
+    }
+  }
+  for ( uint64_t value = 0; value < arrived.size(); ++value ) {
+    if ( not arrived[value] ) {
+      throw ExpectationViolation { "MPMCQueue lost " + to_string( value ) };
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    single_thread<SPSCQueue<uint64_t>>( "SPSCQueue" );
+    single_thread<MPMCQueue<uint64_t>>( "MPMCQueue" );
+    move_only<SPSCQueue<unique_ptr<shared_ptr<int>>>>( "SPSCQueue" );
+    move_only<MPMCQueue<unique_ptr<shared_ptr<int>>>>( "MPMCQueue" );
+    spsc_threads();
+    mpmc_threads();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+#include "buffer.hh"
+#include "concurrent_queue.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+// Run the calling thread on `cpu`, if the machine has that many; with fewer cores the test still
+// works, but measures context switches rather than cache-line transfers.
+void pin_to_cpu( unsigned cpu )
+{
+  if ( thread::hardware_concurrency() <= cpu ) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  CPU_SET( cpu, &set );
+  pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+}
+
+// Spin briefly, then let the other thread run (which matters when both share a core)
+void backoff( unsigned& spins )
+{
+  if ( ++spins > 64 ) {
+    this_thread::yield();
+  }
+}
+
+double seconds_since( chrono::steady_clock::time_point start )
+{
+  return chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+}
+
+void check_speed( const string& name, double ops_per_second, double minimum )
+{
+  cout << name << " reached " << fixed << setprecision( 2 ) << ops_per_second / 1e6 << " M ops/s.\n";
+  if ( ops_per_second < minimum ) {
+    throw runtime_error( name + " did not meet minimum speed of " + to_string( minimum / 1e6 ) + " M ops/s." );
+  }
+}
+
+void spsc_throughput( const uint64_t count, const size_t capacity )
+{
+  SPSCQueue<uint64_t> queue { capacity };
+  uint64_t sum = 0;
+  bool in_order = true; // checked after the join: an exception can't leave the consumer thread
+
+  const auto start = chrono::steady_clock::now();
+  thread consumer { [&] {
+    pin_to_cpu( 1 );
+    uint64_t value {};
+    unsigned spins = 0;
+    for ( uint64_t received = 0; received < count; ) {
+      if ( queue.try_pop( value ) ) {
+        in_order &= ( value == received );
+        sum += value;
+        ++received;
+        spins = 0;
+      } else {
+        backoff( spins );
+      }
+    }
+  } };
+
+  pin_to_cpu( 0 );
+  unsigned spins = 0;
+  for ( uint64_t i = 0; i < count; ) {
+    if ( queue.try_push( i ) ) {
+      ++i;
+      spins = 0;
+    } else {
+      backoff( spins );
+    }
+  }
+  consumer.join();
+  const double elapsed = seconds_since( start );
+
+  if ( not in_order ) {
+    throw runtime_error( "SPSCQueue delivered out of order" );
+  }
+  if ( sum != count * ( count - 1 ) / 2 ) {
+    throw runtime_error( "SPSCQueue lost or duplicated elements" );
+  }
+  check_speed( "SPSCQueue<uint64_t> with capacity=" + to_string( capacity ),
+               static_cast<double>( count ) / elapsed,
+               1e5 );
+}
+
+void mpmc_throughput( const uint64_t per_producer, // NOLINT(bugprone-easily-swappable-parameters)
+                      const size_t capacity,
+                      const unsigned producers, // NOLINT(bugprone-easily-swappable-parameters)
+                      const unsigned consumers )
+{
+  MPMCQueue<uint64_t> queue { capacity };
+  const uint64_t total = per_producer * producers;
+  atomic<uint64_t> received { 0 };
+  atomic<uint64_t> sum { 0 };
+
+  const auto start = chrono::steady_clock::now();
+  vector<thread> threads;
+  for ( unsigned p = 0; p < producers; ++p ) {
+    threads.emplace_back( [&, p] {
+      pin_to_cpu( p );
+      unsigned spins = 0;
+      for ( uint64_t i = 0; i < per_producer; ) {
+        if ( queue.try_push( p * per_producer + i ) ) {
+          ++i;
+          spins = 0;
+        } else {
+          backoff( spins );
+        }
+      }
+    } );
+  }
+  for ( unsigned c = 0; c < consumers; ++c ) {
+    threads.emplace_back( [&, c] {
+      pin_to_cpu( producers + c );
+      uint64_t value {};
+      uint64_t local_sum = 0;
+      unsigned spins = 0;
+      while ( received.load( memory_order_relaxed ) < total ) {
+        if ( queue.try_pop( value ) ) {
+          local_sum += value;
+          received.fetch_add( 1, memory_order_relaxed );
+          spins = 0;
+        } else {
+          backoff( spins );
+        }
+      }
+      sum += local_sum;
+    } );
+  }
+  for ( auto& t : threads ) {
+    t.join();
+  }
+  const double elapsed = seconds_since( start );
+
+  if ( received != total or sum != total * ( total - 1 ) / 2 ) {
+    throw runtime_error( "MPMCQueue lost or duplicated elements" );
+  }
+  check_speed( "MPMCQueue<uint64_t> with capacity=" + to_string( capacity ) + ", " + to_string( producers )
+                 + " producers, " + to_string( consumers ) + " consumers",
+               static_cast<double>( total ) / elapsed,
+               1e5 );
+}
+
+// Hand Buffers to a worker and back through a pair of SPSC queues, one at a time, so each round trip
+// is two cross-core handoffs
+void handoff_latency( const unsigned round_trips )
+{
+  SPSCQueue<Buffer> to_worker { 16 };
+  SPSCQueue<Buffer> to_io { 16 };
+
+  thread worker { [&] {
+    pin_to_cpu( 1 );
+    Buffer buffer;
+    unsigned spins = 0;
+    for ( unsigned i = 0; i < round_trips; ) {
+      if ( to_worker.try_pop( buffer ) ) {
+        while ( not to_io.try_push( move( buffer ) ) ) {}
+        ++i;
+        spins = 0;
+      } else {
+        backoff( spins );
+      }
+    }
+  } };
+
+  pin_to_cpu( 0 );
+  vector<double> latencies;
+  latencies.reserve( round_trips );
+  Buffer buffer { string( 1500, 'x' ) };
+  for ( unsigned i = 0; i < round_trips; ++i ) {
+    const auto start = chrono::steady_clock::now();
+    while ( not to_worker.try_push( move( buffer ) ) ) {}
+    unsigned spins = 0;
+    while ( not to_io.try_pop( buffer ) ) {
+      backoff( spins );
+    }
+    latencies.push_back( chrono::duration<double, nano>( chrono::steady_clock::now() - start ).count() / 2 );
+  }
+  worker.join();
+
+  if ( buffer.size() != 1500 ) {
+    throw runtime_error( "Buffer was damaged in transit" );
+  }
+
+  ranges::sort( latencies );
+  cout << "SPSCQueue<Buffer> one-way handoff latency: p50 " << fixed << setprecision( 0 )
+       << latencies[latencies.size() / 2] << " ns, p99 " << latencies[latencies.size() * 99 / 100] << " ns.\n";
+}
+
+void program_body()
+{
+  spsc_throughput( 1e7, 1024 );
+  spsc_throughput( 1e7, 16 );
+  mpmc_throughput( 2.5e6, 1024, 2, 2 );
+  mpmc_throughput( 1e7, 1024, 1, 1 );
+  handoff_latency( 100000 );
+}
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
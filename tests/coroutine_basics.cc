@@ -0,0 +1,157 @@
+#include "common.hh"
+#include "coroutine.hh"
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+namespace {
+
+Task<void> connect_to( AsyncTCPSocket& socket, const Address& address, optional<int>& error )
+{
+  try {
+    co_await socket.connect( address );
+    error = 0;
+  } catch ( const unix_error& e ) {
+    error = e.error_code();
+  }
+}
+
+// a refused connection is reported as such, not as an aborted or unconnected one
+void refused_connect()
+{
+  EventLoop loop;
+  AsyncIO io { loop };
+  AsyncTCPSocket socket { io };
+  const Address address { "127.0.0.1", 1 };
+  optional<int> error;
+
+  io.spawn( connect_to( socket, address, error ) );
+  io.run();
+
+  if ( error != ECONNREFUSED ) {
+    throw ExpectationViolation { "connect error", ECONNREFUSED, error.value_or( -1 ) };
+  }
+}
+
+Task<void> echo_once( AsyncTCPSocket& listener )
+{
+  AsyncTCPSocket connection = co_await listener.accept();
+  array<char, 64> buffer {};
+  const size_t received = co_await connection.read( buffer );
+  co_await connection.write( string_view { buffer.data(), received } );
+}
+
+Task<void> ping( AsyncTCPSocket& socket, const Address& address, string& reply )
+{
+  co_await socket.connect( address );
+  co_await socket.write( "ping" );
+  array<char, 64> buffer {};
+  while ( reply.size() < 4 ) {
+    const size_t received = co_await socket.read( buffer );
+    if ( received == 0 ) {
+      break;
+    }
+    reply.append( buffer.data(), received );
+  }
+}
+
+// a connection that succeeds carries data both ways
+void connect_and_echo()
+{
+  EventLoop loop;
+  AsyncIO io { loop };
+
+  TCPSocket listening;
+  listening.set_reuseaddr();
+  listening.bind( Address { "127.0.0.1" } );
+  listening.listen();
+  const Address address = listening.local_address();
+  AsyncTCPSocket listener { io, move( listening ) };
+  AsyncTCPSocket client { io };
+  string reply;
+
+  io.spawn( echo_once( listener ) );
+  io.spawn( ping( client, address, reply ) );
+  io.run();
+
+  if ( reply != "ping" ) {
+    throw ExpectationViolation { "Expected the echoed reply to be \"ping\", but it was \""
+                                 + Printer::prettify( reply ) + "\"" };
+  }
+}
+
+Task<void> read_until_closed( AsyncFD& fd, const Address& address, optional<int>& error, string& reply )
+{
+  try {
+    array<char, 64> buffer {};
+    co_await fd.read( buffer );
+    error = 0;
+  } catch ( const unix_error& e ) {
+    error = e.error_code();
+  }
+
+  // having lost its descriptor, the coroutine goes on to use a new one
+  AsyncTCPSocket socket { fd.io() };
+  co_await ping( socket, address, reply );
+}
+
+Task<void> close_later( AsyncIO& io, AsyncFD& fd )
+{
+  co_await io.sleep( chrono::milliseconds { 1 } );
+  fd.fd().close();
+}
+
+// a coroutine waiting on a descriptor that another closes is resumed with an error, and can carry on
+void closed_while_waiting()
+{
+  EventLoop loop;
+  AsyncIO io { loop };
+
+  TCPSocket listening;
+  listening.set_reuseaddr();
+  listening.bind( Address { "127.0.0.1" } );
+  listening.listen();
+  const Address address = listening.local_address();
+  AsyncTCPSocket listener { io, move( listening ) };
+
+  auto [local, peer] = LocalStreamSocket::pair();
+  AsyncFD waiting { io, move( local ) };
+  optional<int> error;
+  string reply;
+
+  io.spawn( echo_once( listener ) );
+  io.spawn( read_until_closed( waiting, address, error, reply ) );
+  io.spawn( close_later( io, waiting ) );
+  io.run();
+
+  if ( error != ECONNABORTED or reply != "ping" ) {
+    throw ExpectationViolation { "the closed read should fail with ECONNABORTED, then the new connection echo, not "
+                                 + to_string( error.value_or( -1 ) ) + " and \"" + Printer::prettify( reply )
+                                 + "\"" };
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    refused_connect();
+    connect_and_echo();
+    closed_while_waiting();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,242 @@
+#include "common.hh"
+#include "eventloop.hh"
+#include "socket.hh"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  int fds[2] {};
+  if ( ::pipe( fds ) != 0 ) {
+    throw unix_error { "pipe" };
+  }
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+// an edge that arrives while its rule is uninterested waits for interest without keeping the loop awake
+void uninterested_edge_sleeps()
+{
+  auto [reader, writer] = LocalStreamSocket::pair();
+  reader.set_blocking( false );
+
+  EventLoop loop;
+  const size_t category = loop.add_category( "edge" );
+  bool interested = false;
+  size_t calls = 0;
+  string received;
+  loop.add_rule(
+    category,
+    reader,
+    Direction::In,
+    [&] {
+      ++calls;
+      string buffer;
+      reader.read( buffer );
+      received += buffer;
+    },
+    [&] { return interested; },
+    [] {},
+    EventLoop::Trigger::Edge );
+
+  writer.write( "x" );
+  loop.wait_next_event( 0 ); // collects the edge, which nobody wants yet
+
+  const auto start = chrono::steady_clock::now();
+  const auto result = loop.wait_next_event( 100 );
+  const auto waited = chrono::duration_cast<chrono::milliseconds>( chrono::steady_clock::now() - start );
+  if ( result != EventLoop::Result::Timeout or waited < chrono::milliseconds { 90 } ) {
+    throw ExpectationViolation { "an uninterested edge-ready rule should let wait_next_event() sleep" };
+  }
+  if ( calls != 0 ) {
+    throw ExpectationViolation { "calls", size_t { 0 }, calls };
+  }
+
+  // once interested, the rule gets the edge it missed, without new data arriving
+  interested = true;
+  loop.wait_next_event( 0 );
+  if ( calls != 1 or received != "x" ) {
+    throw ExpectationViolation { "the missed edge should have been offered once interest returned" };
+  }
+}
+
+// the error of a refused connection is left for the socket's owner to read, with or without an error queue rule
+void refused_connect_keeps_error( bool with_error_queue_rule )
+{
+  TCPSocket socket;
+  socket.set_blocking( false );
+  socket.connect( Address { "127.0.0.1", 1 } );
+
+  EventLoop loop;
+  const size_t category = loop.add_category( "connect" );
+  optional<int> error;
+  bool error_queue_canceled = false;
+  loop.add_rule(
+    category,
+    socket,
+    Direction::Out,
+    [] { throw runtime_error( "a refused connection should not become writable" ); },
+    [] { return true; },
+    [&] {
+      try {
+        socket.throw_if_error();
+        error = 0;
+      } catch ( const unix_error& e ) {
+        error = e.error_code();
+      }
+    } );
+  if ( with_error_queue_rule ) {
+    loop.add_error_queue_rule(
+      category, socket, [&] { socket.reap_zerocopy(); }, [&] { error_queue_canceled = true; } );
+  }
+
+  for ( int i = 0; i < 10 and not error.has_value(); ++i ) {
+    loop.wait_next_event( 100 );
+  }
+  if ( error != ECONNREFUSED ) {
+    throw ExpectationViolation { "error seen by the rule's owner", ECONNREFUSED, error.value_or( -1 ) };
+  }
+  if ( with_error_queue_rule and not error_queue_canceled ) {
+    throw ExpectationViolation { "an error left once the error queue was collected should cancel its rule" };
+  }
+}
+
+// zero-copy completions raise EPOLLERR without an error, and cancel none of the socket's rules
+void zerocopy_notifications()
+{
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( Address { "127.0.0.1" } );
+  listener.listen();
+  TCPSocket client;
+  client.connect( listener.local_address() );
+  TCPSocket server = listener.accept();
+  client.set_blocking( false );
+  client.set_zerocopy( true );
+
+  EventLoop loop;
+  const size_t category = loop.add_category( "zerocopy" );
+  size_t reaped = 0;
+  string received;
+  bool canceled = false;
+  loop.add_error_queue_rule(
+    category, client, [&] { reaped += client.reap_zerocopy(); }, [&] { canceled = true; } );
+  loop.add_rule(
+    category,
+    client,
+    Direction::In,
+    [&] {
+      string buffer;
+      client.read( buffer );
+      received += buffer;
+    },
+    [] { return true; },
+    [&] { canceled = true; } );
+
+  const Buffer payload { string( 64 * 1024, 'z' ) };
+  const size_t sent = client.write_zerocopy( payload );
+  for ( int i = 0; i < 10 and client.zerocopy_pending() > 0; ++i ) {
+    loop.wait_next_event( 100 );
+  }
+  if ( client.zerocopy_pending() != 0 or reaped == 0 ) {
+    throw ExpectationViolation { "the error queue rule should have collected the zero-copy completion" };
+  }
+
+  server.write( "pong" );
+  for ( int i = 0; i < 10 and received.empty(); ++i ) {
+    loop.wait_next_event( 100 );
+  }
+  if ( canceled or received != "pong" ) {
+    throw ExpectationViolation { "zero-copy notifications should not cancel the socket's other rules" };
+  }
+
+  string drained;
+  while ( drained.size() < sent ) {
+    string buffer;
+    server.read( buffer );
+    drained += buffer;
+  }
+}
+
+// cancel callbacks of closed fds' rules may add rules (e.g. to reconnect), and every one of them runs
+void cancel_adds_rules()
+{
+  EventLoop loop;
+  const size_t category = loop.add_category( "reconnect" );
+  deque<pair<FileDescriptor, FileDescriptor>> closing; // a deque, so the rules' references stay valid
+  deque<pair<FileDescriptor, FileDescriptor>> added;
+  size_t canceled = 0;
+  size_t added_calls = 0;
+
+  for ( size_t i = 0; i < 8; ++i ) {
+    closing.push_back( make_pipe() );
+    loop.add_rule(
+      category,
+      closing.back().first,
+      Direction::In,
+      [] { throw runtime_error( "a closed pipe's rule should not run" ); },
+      [] { return true; },
+      [&] {
+        ++canceled;
+        // enough new fds to make registrations_ rehash
+        for ( size_t j = 0; j < 64; ++j ) {
+          auto& [reader, writer] = added.emplace_back( make_pipe() );
+          loop.add_rule( category, reader, Direction::In, [&added_calls, &reader] {
+            ++added_calls;
+            string buffer;
+            reader.read( buffer );
+          } );
+        }
+      } );
+  }
+  loop.wait_next_event( 0 );
+
+  for ( auto& [reader, writer] : closing ) {
+    reader.close();
+  }
+  loop.wait_next_event( 0 );
+  if ( canceled != closing.size() ) {
+    throw ExpectationViolation { "cancel callbacks run", closing.size(), canceled };
+  }
+
+  // the rules added by the cancel callbacks are registered, and fire
+  for ( auto& [reader, writer] : added ) {
+    writer.write( "x" );
+  }
+  for ( int i = 0; i < 10 and added_calls < added.size(); ++i ) {
+    loop.wait_next_event( 0 );
+  }
+  if ( added_calls != added.size() ) {
+    throw ExpectationViolation { "rules added by cancel callbacks that ran", added.size(), added_calls };
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    uninterested_edge_sleeps();
+    refused_connect_keeps_error( false );
+    refused_connect_keeps_error( true );
+    zerocopy_notifications();
+    cancel_adds_rules();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,242 @@
+#include "common.hh"
+#include "file_descriptor.hh"
+#include "io_result.hh"
+#include "socket.hh"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  int fds[2] {};
+  if ( ::pipe( fds ) != 0 ) {
+    throw unix_error { "pipe" };
+  }
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+void expect_contents( const string& name, const string& expected, const string& actual )
+{
+  if ( actual != expected ) {
+    throw ExpectationViolation { "Expected " + name + " to be \"" + Printer::prettify( expected )
+                                 + "\", but it was \"" + Printer::prettify( actual ) + "\"" };
+  }
+}
+
+// a short read leaves exactly the bytes read, whatever the buffer held before
+void short_reads()
+{
+  auto [reader, writer] = make_pipe();
+  string buffer( 40, 'X' );
+
+  writer.write( "abc" );
+  reader.read( buffer );
+  expect_contents( "buffer after a short read", "abc", buffer );
+
+  reader.set_read_size( 8 );
+  writer.write( "0123456789" );
+  reader.read( buffer );
+  expect_contents( "buffer after a read of read_size()", "01234567", buffer );
+  reader.read( buffer );
+  expect_contents( "buffer after reading the rest", "89", buffer );
+
+  writer.close();
+  reader.read( buffer );
+  expect_contents( "buffer at EOF", "", buffer );
+  if ( not reader.eof() ) {
+    throw ExpectationViolation { "eof", true, reader.eof() };
+  }
+}
+
+// a gather-write of more buffers than one writev takes still writes all of them, unless the fd fills up
+void long_gather_writes()
+{
+  auto [reader, writer] = make_pipe();
+
+  vector<string> pieces;
+  string expected;
+  for ( size_t i = 0; i < 200; ++i ) {
+    pieces.push_back( to_string( i ) + "," );
+    expected += pieces.back();
+  }
+  const vector<string_view> views { pieces.begin(), pieces.end() };
+
+  const size_t written = writer.write( views );
+  if ( written != expected.size() ) {
+    throw ExpectationViolation { "bytes written", expected.size(), written };
+  }
+  string received;
+  reader.read( received );
+  expect_contents( "data read back", expected, received );
+
+  // a non-blocking pipe takes only part of 256 KiB, and the count says how much
+  writer.set_blocking( false );
+  const string block( 4096, 'x' );
+  const vector<string_view> blocks( 64 * 1024 * 4 / block.size(), block );
+  const size_t accepted = writer.write( blocks );
+  if ( accepted == 0 or accepted >= block.size() * blocks.size() ) {
+    throw ExpectationViolation { "a full non-blocking pipe should take some but not all of the blocks" };
+  }
+  size_t drained = 0;
+  reader.set_blocking( false );
+  while ( true ) {
+    reader.read( received );
+    if ( received.empty() ) {
+      break;
+    }
+    drained += received.size();
+  }
+  if ( drained != accepted ) {
+    throw ExpectationViolation { "bytes drained", accepted, drained };
+  }
+}
+
+// IOResult carries a byte count or an errno, and throws only when asked to
+void io_results()
+{
+  const IOResult none;
+  if ( not none.ok() or none.bytes() != 0 or none.error() != 0 ) {
+    throw ExpectationViolation { "a default IOResult should be a success with no bytes" };
+  }
+
+  const IOResult five = IOResult::success( 5 );
+  if ( not five or five.bytes() != 5 or five.would_block() or five.value_or_throw( "five" ) != 5 ) {
+    throw ExpectationViolation { "IOResult::success( 5 ) should be a success of 5 bytes" };
+  }
+
+  const IOResult blocked = IOResult::failure( EAGAIN );
+  if ( blocked or not blocked.would_block() or blocked.bytes() != 0
+       or blocked.error_code() != errc::resource_unavailable_try_again ) {
+    throw ExpectationViolation { "IOResult::failure( EAGAIN ) should be a failure that would block" };
+  }
+
+  const IOResult reset = IOResult::failure( ECONNRESET );
+  if ( reset.would_block() ) {
+    throw ExpectationViolation { "ECONNRESET is not a failure that would block" };
+  }
+  try {
+    reset.value_or_throw( "attempt" );
+    throw ExpectationViolation { "value_or_throw() should throw for a failure" };
+  } catch ( const unix_error& e ) {
+    if ( e.error_code() != ECONNRESET or string_view { e.what() }.substr( 0, 8 ) != "attempt:" ) {
+      throw ExpectationViolation { "value_or_throw() threw the wrong error: " + string { e.what() } };
+    }
+  }
+}
+
+// the try_*() calls report what read() and write() would throw, and keep the same accounting
+void non_throwing_io()
+{
+  auto [reader, writer] = make_pipe();
+  reader.set_blocking( false );
+
+  string buffer( 16, '\0' );
+  IOResult result = reader.try_read( span { buffer } );
+  if ( not result.would_block() or reader.read_count() != 0 ) {
+    throw ExpectationViolation { "reading an empty non-blocking pipe should fail with EAGAIN, counting nothing" };
+  }
+
+  result = writer.try_write( "hello" );
+  if ( not result or result.bytes() != 5 or writer.write_count() != 1 ) {
+    throw ExpectationViolation { "try_write() should write and count the whole buffer" };
+  }
+  OwnedBuffer owned { 3 };
+  result = reader.try_read( owned );
+  expect_contents( "first try_read( OwnedBuffer& )", "hel", string { string_view { owned } } );
+  result = reader.try_read( owned );
+  expect_contents( "second try_read( OwnedBuffer& )", "lo", string { string_view { owned } } );
+  if ( reader.read_count() != 2 ) {
+    throw ExpectationViolation { "read_count", size_t { 2 }, size_t { reader.read_count() } };
+  }
+
+  // a gather-write takes at most kMaxWriteChunks buffers per call
+  const vector<string_view> views( 100, "ab" );
+  result = writer.try_write( span { views } );
+  if ( not result or result.bytes() != 2 * 64 ) {
+    throw ExpectationViolation { "try_write( span ) bytes", size_t { 2 * 64 }, result.bytes() };
+  }
+  while ( reader.try_read( span { buffer } ).bytes() > 0 ) {}
+
+  writer.close();
+  result = reader.try_read( span { buffer } );
+  if ( not result or result.bytes() != 0 or not reader.eof() ) {
+    throw ExpectationViolation { "try_read() at EOF should succeed with 0 bytes and set eof()" };
+  }
+
+  // writing to a pipe nobody reads is EPIPE, with SIGPIPE ignored
+  auto [closed_reader, orphan_writer] = make_pipe();
+  closed_reader.close();
+  result = orphan_writer.try_write( "x" );
+  if ( result.error() != EPIPE ) {
+    throw ExpectationViolation { "error writing to a closed pipe", EPIPE, result.error() };
+  }
+}
+
+// datagrams are sent and received with try_sendto(), try_send() and try_recv()
+void non_throwing_datagrams()
+{
+  UDPSocket receiver;
+  receiver.bind( Address { "127.0.0.1" } );
+  receiver.set_blocking( false );
+  UDPSocket sender;
+  sender.bind( Address { "127.0.0.1" } );
+
+  Address source { "0.0.0.0" };
+  OwnedBuffer payload { 4 };
+  if ( not receiver.try_recv( source, payload ).would_block() ) {
+    throw ExpectationViolation { "try_recv() with nothing queued should fail with EAGAIN" };
+  }
+
+  if ( sender.try_sendto( receiver.local_address(), "ping" ).bytes() != 4 ) {
+    throw ExpectationViolation { "try_sendto() should send the whole datagram" };
+  }
+  IOResult result = receiver.try_recv( source, payload );
+  if ( not result or source != sender.local_address() ) {
+    throw ExpectationViolation { "try_recv() should receive the datagram and its source" };
+  }
+  expect_contents( "datagram", "ping", string { string_view { payload } } );
+
+  sender.connect( receiver.local_address() );
+  if ( sender.try_send( "too long" ).bytes() != 8 ) {
+    throw ExpectationViolation { "try_send() should send the whole datagram" };
+  }
+  result = receiver.try_recv( source, payload );
+  if ( result.error() != EMSGSIZE ) {
+    throw ExpectationViolation { "error receiving an oversized datagram", EMSGSIZE, result.error() };
+  }
+  expect_contents( "truncated datagram", "too ", string { string_view { payload } } );
+}
+
+} // namespace
+
+int main()
+{
+  signal( SIGPIPE, SIG_IGN );
+
+  try {
+    short_reads();
+    long_gather_writes();
+    io_results();
+    non_throwing_io();
+    non_throwing_datagrams();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+#include "common.hh"
+#include "flow_table.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+namespace {
+
+// a hash that puts every key's home in the last few slots, so probe sequences collide and wrap around
+struct ClusteredHash
+{
+  size_t operator()( const uint64_t key ) const { return ~size_t { 0 } - key % 5; }
+};
+
+// a value that checks it stayed with its key, and counts its copies so leaks and double destruction show
+struct Tracked
+{
+  uint64_t key {};
+  shared_ptr<int> token {};
+};
+
+using ClusteredTable = FlowTable<Tracked, uint64_t, ClusteredHash>;
+
+void expect_matches( ClusteredTable& table, const unordered_set<uint64_t>& reference, const string& when )
+{
+  if ( table.size() != reference.size() ) {
+    throw ExpectationViolation { "size " + when, reference.size(), table.size() };
+  }
+  for ( const uint64_t key : reference ) {
+    const Tracked* value = table.find( key );
+    if ( value == nullptr or value->key != key ) {
+      throw ExpectationViolation { to_string( key ) + " should be found with its own value " + when };
+    }
+  }
+  size_t visited = 0;
+  table.for_each( [&]( const uint64_t key, const Tracked& value ) {
+    if ( not reference.contains( key ) or value.key != key ) {
+      throw ExpectationViolation { "for_each() visited " + to_string( key ) + " " + when };
+    }
+    ++visited;
+  } );
+  if ( visited != reference.size() ) {
+    throw ExpectationViolation { "entries visited " + when, reference.size(), visited };
+  }
+}
+
+// random inserts and erases in long, wrapping probe sequences keep every remaining entry reachable
+void clustered_against_reference()
+{
+  const auto token = make_shared<int>( 0 );
+  unordered_set<uint64_t> reference;
+  mt19937_64 random { 2719 }; // NOLINT(*-msc51-cpp)
+  {
+    ClusteredTable table;
+    for ( size_t step = 0; step < 20000; ++step ) {
+      const uint64_t key = random() % 40;
+      if ( random() % 2 == 0 ) {
+        const bool inserted = table.try_emplace( key, Tracked { key, token } ).second;
+        if ( inserted != reference.insert( key ).second ) {
+          throw ExpectationViolation { "try_emplace(" + to_string( key ) + ") inserted wrongly" };
+        }
+      } else if ( table.erase( key ) != ( reference.erase( key ) == 1 ) ) {
+        throw ExpectationViolation { "erase(" + to_string( key ) + ") disagreed with the reference" };
+      }
+      if ( table.contains( key ) != reference.contains( key ) ) {
+        throw ExpectationViolation { "contains(" + to_string( key ) + ") disagreed with the reference" };
+      }
+      if ( step % 97 == 0 ) {
+        expect_matches( table, reference, "after step " + to_string( step ) );
+      }
+      if ( token.use_count() != static_cast<long>( reference.size() ) + 1 ) {
+        throw ExpectationViolation { "live values after step " + to_string( step ),
+                                     static_cast<long>( reference.size() ) + 1,
+                                     token.use_count() };
+      }
+    }
+
+    // erase_if() rechecks slots that a backward shift refills, including across the end of the array
+    for ( const uint64_t divisor : { 3, 2, 1 } ) {
+      const size_t removed = table.erase_if( [&]( const uint64_t key, Tracked& ) { return key % divisor == 0; } );
+      const size_t expected = erase_if( reference, [&]( const uint64_t key ) { return key % divisor == 0; } );
+      if ( removed != expected ) {
+        throw ExpectationViolation { "erase_if() removed", expected, removed };
+      }
+      expect_matches( table, reference, "after erase_if()" );
+    }
+    if ( not table.empty() ) {
+      throw ExpectationViolation { "erase_if() should have removed everything" };
+    }
+
+    table.try_emplace( 7, Tracked { 7, token } );
+  }
+  if ( token.use_count() != 1 ) {
+    throw ExpectationViolation { "live values after destruction", long { 1 }, token.use_count() };
+  }
+}
+
+// flows that come and go at a steady count never make the table grow, since erasing leaves no tombstones
+void churn_keeps_capacity()
+{
+  FlowTable<uint64_t> table { 1000 };
+  const size_t capacity = table.capacity();
+  unordered_map<FlowKey, uint64_t> reference;
+  mt19937_64 random { 1618 }; // NOLINT(*-msc51-cpp)
+
+  const auto random_key = [&] {
+    const auto remote_ip = static_cast<uint32_t>( random() );
+    return FlowKey::from_ipv4( 0x0A000001, 443, remote_ip, static_cast<uint16_t>( random() ) );
+  };
+  for ( size_t i = 0; i < 1000; ++i ) {
+    const FlowKey key = random_key();
+    table[key] = i;
+    reference[key] = i;
+  }
+
+  for ( uint64_t i = 0; i < 100000; ++i ) {
+    const auto leaving = reference.begin();
+    if ( not table.erase( leaving->first ) ) {
+      throw ExpectationViolation { leaving->first.to_string() + " should have been erased" };
+    }
+    reference.erase( leaving );
+    const FlowKey key = random_key();
+    table[key] = i;
+    reference[key] = i;
+  }
+
+  if ( table.capacity() != capacity ) {
+    throw ExpectationViolation { "capacity after churn", capacity, table.capacity() };
+  }
+  for ( const auto& [key, value] : reference ) {
+    const uint64_t* found = table.find( key );
+    if ( found == nullptr or *found != value ) {
+      throw ExpectationViolation { key.to_string() + " should be found with its value after churn" };
+    }
+  }
+}
+
+// a FlowKey is the same from an IPv4 or a dual-stack socket's addresses, and reverses to the peer's view
+void flow_keys()
+{
+  const Address local { "10.0.0.1", 5000 };
+  const Address remote { "10.0.0.2", 80 };
+  const FlowKey key { local, remote };
+  if ( key != FlowKey { Address { "::ffff:10.0.0.1", 5000 }, Address { "::ffff:10.0.0.2", 80 } }
+       or key != FlowKey::from_ipv4( 0x0A000001, 5000, 0x0A000002, 80 ) or not key.is_ipv4() ) {
+    throw ExpectationViolation { "an IPv4 flow should have one key however it is built" };
+  }
+  if ( key.local() != local or key.remote() != remote or key.to_string() != "10.0.0.1:5000 -> 10.0.0.2:80" ) {
+    throw ExpectationViolation { "the key " + key.to_string() + " lost its addresses" };
+  }
+  if ( key.reversed() != FlowKey { remote, local } or key.reversed().reversed() != key ) {
+    throw ExpectationViolation { "reversed() should swap the ends" };
+  }
+
+  const FlowKey ipv6 { Address { "fd00::1", 5000 }, Address { "10.0.0.2", 80 } };
+  if ( ipv6.is_ipv4() or ipv6 == key or ipv6.hash() == key.hash() ) {
+    throw ExpectationViolation { "an IPv6 flow should differ from the IPv4 one" };
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    clustered_against_reference();
+    churn_keeps_capacity();
+    flow_keys();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
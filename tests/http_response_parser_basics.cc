@@ -0,0 +1,114 @@
+#include "http_response_parser_test_harness.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+int main()
+{
+  try {
+    const string two_responses = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello"
+                                 "HTTP/1.1 404 Not Found\r\ncontent-length: 3\r\n\r\nbad";
+
+    {
+      HTTPResponseParserTestHarness test { "content-length" };
+      test.execute( Idle { true } );
+      test.execute( Receive { two_responses } );
+      test.execute( Transcript { "[200 OK]hello[end][404 Not Found]bad[end]" } );
+      test.execute( KeepAlive { true } );
+      test.execute( Idle { true } );
+    }
+
+    for ( const size_t piece_size : { 1, 2, 7 } ) {
+      HTTPResponseParserTestHarness test { "content-length in pieces of " + to_string( piece_size ) };
+      test.execute( Receive { two_responses, piece_size } );
+      test.execute( Transcript { "[200 OK]hello[end][404 Not Found]bad[end]" } );
+    }
+
+    {
+      HTTPResponseParserTestHarness test { "partial body" };
+      test.execute( Receive { "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nhello" } );
+      test.execute( Transcript { "[200 OK]hello" } );
+      test.execute( Idle { false } );
+      test.execute( Rejects { CloseConnection {} } );
+    }
+
+    const string chunked = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                           "5\r\nhello\r\n7;name=value\r\n, world\r\n0\r\nTrailer: x\r\n\r\n";
+    {
+      HTTPResponseParserTestHarness test { "chunked" };
+      test.execute( Receive { chunked } );
+      test.execute( Transcript { "[200 OK]hello, world[end]" } );
+      test.execute( Idle { true } );
+    }
+
+    {
+      HTTPResponseParserTestHarness test { "chunked one byte at a time, then pipelined" };
+      test.execute( Receive { chunked + "HTTP/1.1 204 No Content\r\n\r\n", 1 } );
+      test.execute( Transcript { "[200 OK]hello, world[end][204 No Content][end]" } );
+    }
+
+    {
+      HTTPResponseParserTestHarness test { "bad chunk size" };
+      test.execute( Rejects { Receive { "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n" } } );
+    }
+
+    {
+      HTTPResponseParserTestHarness test { "chunk without CRLF" };
+      test.execute(
+        Rejects { Receive { "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nabc\r\n0\r\n\r\n" } } );
+    }
+
+    {
+      HTTPResponseParserTestHarness test { "close-delimited" };
+      test.execute( Receive { "HTTP/1.1 200 OK\r\n\r\nuntil" } );
+      test.execute( KeepAlive { false } );
+      test.execute( Receive { " the end" } );
+      test.execute( Transcript { "[200 OK]until the end" } );
+      test.execute( CloseConnection {} );
+      test.execute( Transcript { "[200 OK]until the end[end]" } );
+      test.execute( Idle { true } );
+    }
+
+    {
+      HTTPResponseParserTestHarness test { "interim response and connection: close" };
+      test.execute( Receive { "HTTP/1.1 100 Continue\r\n\r\n"
+                              "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\nok" } );
+      test.execute( Transcript { "[200 OK]ok[end]" } );
+      test.execute( KeepAlive { false } );
+    }
+
+    {
+      HTTPResponseParserTestHarness test { "HTTP/1.0 keep-alive" };
+      test.execute( Receive { "HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n" } );
+      test.execute( KeepAlive { false } );
+      test.execute( Receive { "HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length: 0\r\n\r\n" } );
+      test.execute( KeepAlive { true } );
+      test.execute( Transcript { "[200 OK][end][200 OK][end]" } );
+    }
+
+    {
+      HTTPResponseParserTestHarness test { "malformed status line" };
+      test.execute( Rejects { Receive { "HTTX/1.1 200 OK\r\n\r\n" } } );
+    }
+
+    {
+      HTTPResponseParserTestHarness test { "bad content-length" };
+      test.execute( Rejects { Receive { "HTTP/1.1 200 OK\r\nContent-Length: 1x\r\n\r\n" } } );
+    }
+
+    {
+      HTTPResponseParserTestHarness test { "eof between responses" };
+      test.execute( Receive { "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n!" } );
+      test.execute( CloseConnection {} );
+      test.execute( Transcript { "[200 OK]![end]" } );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "common.hh"
+#include "http_client.hh"
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+// A parser and a transcript of what it has found: "[200 OK]" for a head, the body bytes, and "[end]" when a
+// response is complete
+struct ParsedResponses
+{
+  HTTPResponseParser parser {};
+  std::string transcript {};
+
+  void record( HTTPResponseParser::Event event, std::string_view body )
+  {
+    switch ( event ) {
+      case HTTPResponseParser::Event::Head:
+        transcript += "[" + std::to_string( parser.head().status_code ) + " " + parser.head().reason + "]";
+        break;
+      case HTTPResponseParser::Event::Body:
+        transcript += body;
+        break;
+      case HTTPResponseParser::Event::Complete:
+        transcript += "[end]";
+        break;
+      case HTTPResponseParser::Event::NeedMore:
+        break;
+    }
+  }
+};
+
+class HTTPResponseParserTestHarness : public TestHarness<ParsedResponses>
+{
+public:
+  explicit HTTPResponseParserTestHarness( std::string test_name )
+    : TestHarness( std::move( test_name ), "no input", ParsedResponses {} )
+  {}
+};
+
+// Feed `data` to the parser in pieces of at most `piece_size` bytes, until every piece is consumed
+struct Receive : public Action<ParsedResponses>
+{
+  std::string data_;
+  size_t piece_size_;
+
+  explicit Receive( std::string data, size_t piece_size = std::string::npos )
+    : data_( std::move( data ) ), piece_size_( piece_size )
+  {}
+  std::string description() const override
+  {
+    const std::string pieces
+      = piece_size_ == std::string::npos ? "" : ", " + std::to_string( piece_size_ ) + " bytes at a time";
+    return "receive \"" + Printer::prettify( data_, 48 ) + "\"" + pieces;
+  }
+  void execute( ParsedResponses& responses ) const override
+  {
+    for ( size_t offset = 0; offset < data_.size(); offset += piece_size_ ) {
+      std::string_view piece = std::string_view { data_ }.substr( offset, piece_size_ );
+      std::string_view body;
+      HTTPResponseParser::Event event {};
+      while ( ( event = responses.parser.parse( piece, body ) ) != HTTPResponseParser::Event::NeedMore ) {
+        responses.record( event, body );
+      }
+    }
+  }
+};
+
+struct CloseConnection : public Action<ParsedResponses>
+{
+  std::string description() const override { return "connection closed"; }
+  void execute( ParsedResponses& responses ) const override
+  {
+    responses.record( responses.parser.finish_eof(), {} );
+  }
+};
+
+struct Transcript : public Expectation<ParsedResponses>
+{
+  std::string transcript_;
+
+  explicit Transcript( std::string transcript ) : transcript_( std::move( transcript ) ) {}
+  std::string description() const override { return "parsed \"" + Printer::prettify( transcript_, 48 ) + "\""; }
+  void execute( ParsedResponses& responses ) const override
+  {
+    if ( responses.transcript != transcript_ ) {
+      throw ExpectationViolation { "Expected to have parsed \"" + Printer::prettify( transcript_, 96 )
+                                   + "\", but found \"" + Printer::prettify( responses.transcript, 96 ) + "\"" };
+    }
+  }
+};
+
+// The step `step` must throw std::runtime_error
+template<class Step>
+struct Rejects : public Expectation<ParsedResponses>
+{
+  Step step_;
+
+  explicit Rejects( Step step ) : step_( std::move( step ) ) {}
+  std::string description() const override { return "rejecting: " + step_.description(); }
+  void execute( ParsedResponses& responses ) const override
+  {
+    try {
+      step_.execute( responses );
+    } catch ( const std::runtime_error& ) {
+      return;
+    }
+    throw ExpectationViolation { "Expected an error from: " + step_.description() };
+  }
+};
+
+struct KeepAlive : public ExpectBool<ParsedResponses>
+{
+  using ExpectBool::ExpectBool;
+  std::string name() const override { return "keep_alive"; }
+  bool value( ParsedResponses& responses ) const override { return responses.parser.keep_alive(); }
+};
+
+struct Idle : public ExpectBool<ParsedResponses>
+{
+  using ExpectBool::ExpectBool;
+  std::string name() const override { return "idle"; }
+  bool value( ParsedResponses& responses ) const override { return responses.parser.idle(); }
+};
@@ -0,0 +1,182 @@
+#include "common.hh"
+#include "io_uring.hh"
+#include "socket.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  int fds[2] {};
+  if ( ::pipe( fds ) != 0 ) {
+    throw unix_error { "pipe" };
+  }
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+void expect_contents( const string& name, const string& expected, const string& actual )
+{
+  if ( actual != expected ) {
+    throw ExpectationViolation { "Expected " + name + " to be \"" + Printer::prettify( expected )
+                                 + "\", but it was \"" + Printer::prettify( actual ) + "\"" };
+  }
+}
+
+// more operations than the submission ring holds are queued without waiting, and all of them complete in order
+void full_submission_ring()
+{
+  IOUring ring { 4 };
+  auto [reader, writer] = make_pipe();
+
+  vector<string> pieces;
+  string expected;
+  for ( size_t i = 0; i < 40; ++i ) {
+    pieces.push_back( "piece " + to_string( i ) + ";" );
+    expected += pieces.back();
+  }
+
+  vector<size_t> written;
+  for ( const auto& piece : pieces ) {
+    ring.write( writer, piece, [&]( size_t bytes ) { written.push_back( bytes ); } );
+  }
+  while ( ring.pending() > 0 ) {
+    ring.complete();
+  }
+
+  if ( written.size() != pieces.size() ) {
+    throw ExpectationViolation { "completions run", pieces.size(), written.size() };
+  }
+  for ( size_t i = 0; i < pieces.size(); ++i ) {
+    if ( written[i] != pieces[i].size() ) {
+      throw ExpectationViolation { "bytes written by write " + to_string( i ), pieces[i].size(), written[i] };
+    }
+  }
+  if ( writer.write_count() != pieces.size() ) {
+    throw ExpectationViolation { "write_count", pieces.size(), size_t { writer.write_count() } };
+  }
+
+  // reads are queued the same way, and leave the descriptor's EOF flag set once the writer is gone
+  writer.close();
+  string received;
+  vector<string> chunks( 12, string( expected.size() / 8, '\0' ) );
+  size_t completions = 0;
+  for ( auto& chunk : chunks ) {
+    ring.read( reader, span { chunk }, [&]( size_t bytes ) {
+      received += chunk.substr( 0, bytes );
+      ++completions;
+    } );
+  }
+  while ( ring.pending() > 0 ) {
+    ring.complete();
+  }
+
+  if ( completions != chunks.size() ) {
+    throw ExpectationViolation { "read completions run", chunks.size(), completions };
+  }
+  expect_contents( "data read through the ring", expected, received );
+  if ( not reader.eof() ) {
+    throw ExpectationViolation { "eof", true, reader.eof() };
+  }
+}
+
+// an attached TCPSocket accepts, reads and writes through the ring with its ordinary interface
+void attached_sockets()
+{
+  IOUring ring { 8 };
+
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( Address { "127.0.0.1" } );
+  listener.listen();
+  ring.attach( listener );
+
+  TCPSocket client;
+  client.connect( listener.local_address() );
+  TCPSocket server = listener.accept();
+  ring.attach( server );
+  ring.attach( client );
+
+  client.write( "hello" );
+  string buffer;
+  server.read( buffer );
+  expect_contents( "request", "hello", buffer );
+
+  const vector<string_view> reply { "wor", "ld", "!" };
+  server.write( reply );
+  client.read( buffer );
+  expect_contents( "reply", "world!", buffer );
+  if ( server.read_count() != 1 or server.write_count() != 1 ) {
+    throw ExpectationViolation { "an attached socket should count reads and writes as usual" };
+  }
+
+  // an operation queued on the ring meanwhile finishes, but its completion waits for complete()
+  auto [reader, writer] = make_pipe();
+  optional<size_t> queued_write;
+  ring.write( writer, "queued", [&]( size_t bytes ) { queued_write = bytes; } );
+  client.write( "more" );
+  server.read( buffer );
+  expect_contents( "second request", "more", buffer );
+  if ( queued_write.has_value() ) {
+    throw ExpectationViolation { "a queued completion ran during an attached socket's read" };
+  }
+  reader.set_blocking( false );
+  reader.read( buffer );
+  expect_contents( "data of the queued write, submitted along with the attached socket's", "queued", buffer );
+  if ( ring.complete( 0 ) != 1 or queued_write != 6 ) {
+    throw ExpectationViolation { "complete() should run the completion reaped during the read" };
+  }
+
+  // EOF is seen by the attached socket's own call, as it would be without the ring
+  client.close();
+  server.read( buffer );
+  expect_contents( "buffer at EOF", "", buffer );
+  if ( not server.eof() ) {
+    throw ExpectationViolation { "eof", true, server.eof() };
+  }
+  ring.detach( server );
+  server.read( buffer );
+  expect_contents( "buffer at EOF after detaching", "", buffer );
+}
+
+// a descriptor outlives the ring it was attached to
+void detached_by_destructor()
+{
+  auto [reader, writer] = make_pipe();
+  {
+    IOUring ring;
+    ring.attach( reader );
+    ring.attach( writer );
+    writer.write( "through the ring" );
+  }
+  writer.write( " and without it" );
+  string buffer;
+  reader.read( buffer );
+  expect_contents( "data", "through the ring and without it", buffer );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    full_submission_ring();
+    attached_sockets();
+    detached_by_destructor();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
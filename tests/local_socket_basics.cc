@@ -0,0 +1,172 @@
+#include "common.hh"
+#include "socket.hh"
+
+#include <array>
+#include <cstdlib>
+#include <exception>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  int fds[2] {};
+  if ( ::pipe( fds ) != 0 ) {
+    throw unix_error { "pipe" };
+  }
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+void expect_contents( const string& name, const string& expected, const string& actual )
+{
+  if ( actual != expected ) {
+    throw ExpectationViolation { "Expected " + name + " to be \"" + Printer::prettify( expected )
+                                 + "\", but it was \"" + Printer::prettify( actual ) + "\"" };
+  }
+}
+
+// receive one message, expecting `payload` and `count` descriptors with it
+vector<FileDescriptor> expect_message( LocalSocket& socket, const string& payload, size_t count )
+{
+  array<char, 64> buffer {};
+  vector<FileDescriptor> fds;
+  const size_t received = socket.recv_fds( buffer, fds );
+  expect_contents( "payload", payload, string { buffer.data(), received } );
+  if ( fds.size() != count ) {
+    throw ExpectationViolation { "descriptors received with \"" + payload + "\"", count, fds.size() };
+  }
+  for ( const auto& fd : fds ) {
+    if ( not( ::fcntl( fd.fd_num(), F_GETFD ) & FD_CLOEXEC ) ) { // NOLINT(*-vararg, *-bitwise)
+      throw ExpectationViolation { "a received descriptor should be close-on-exec" };
+    }
+  }
+  return fds;
+}
+
+void expect_throws( const string& what, const function<void()>& attempt )
+{
+  bool threw = false;
+  try {
+    attempt();
+  } catch ( const exception& ) {
+    threw = true;
+  }
+  if ( not threw ) {
+    throw ExpectationViolation { what + " should throw" };
+  }
+}
+
+// both ends of a pipe passed over a stream socket refer to the same pipe, and the originals stay open
+void pass_pipe()
+{
+  auto [sender, receiver] = LocalStreamSocket::pair();
+  auto [reader, writer] = make_pipe();
+
+  if ( sender.send_fds( "pipe", { reader, writer } ) != 4 ) {
+    throw ExpectationViolation { "send_fds() should send the whole payload" };
+  }
+  auto passed = expect_message( receiver, "pipe", 2 );
+
+  passed[1].write( "from the passed writer" );
+  string buffer;
+  reader.read( buffer );
+  expect_contents( "data read from the original reader", "from the passed writer", buffer );
+
+  writer.write( "from the original writer" );
+  passed[0].read( buffer );
+  expect_contents( "data read from the passed reader", "from the original writer", buffer );
+}
+
+// messages from separate send_fds() calls carrying descriptors aren't merged by one recv_fds()
+void messages_pair_up()
+{
+  auto [sender, receiver] = LocalStreamSocket::pair();
+  auto [reader, writer] = make_pipe();
+  sender.send_fds( "first", { reader } );
+  sender.send_fds( "second", { writer, writer } );
+  sender.write( "plain" );
+
+  expect_message( receiver, "first", 1 );
+  expect_message( receiver, "second", 2 );
+  expect_message( receiver, "plain", 0 );
+}
+
+// a TCP connection passed to another socket's owner keeps working there, and is adopted only as what it is
+void pass_connection()
+{
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( Address { "127.0.0.1" } );
+  listener.listen();
+  TCPSocket client;
+  client.connect( listener.local_address() );
+
+  auto [acceptor, worker] = LocalDatagramSocket::pair();
+  {
+    const TCPSocket accepted = listener.accept();
+    acceptor.send_fds( "connection", { accepted } );
+  }
+  auto passed = expect_message( worker, "connection", 1 );
+
+  expect_throws( "adopting a TCP connection as a LocalStreamSocket",
+                 [&] { const LocalStreamSocket wrong { passed[0].duplicate() }; } );
+
+  TCPSocket connection { move( passed[0] ) };
+  if ( connection.peer_address() != client.local_address() ) {
+    throw ExpectationViolation { "the passed connection should still be connected to the client" };
+  }
+  client.write( "hello" );
+  string buffer;
+  connection.read( buffer );
+  expect_contents( "data from the client", "hello", buffer );
+}
+
+// a named listener accepts connections, and send_fds() rejects what it can't send
+void named_and_limits()
+{
+  const string name = string { '\0' } + "local_socket_basics." + to_string( ::getpid() );
+  LocalStreamSocket listener;
+  listener.bind( name );
+  listener.listen();
+  LocalStreamSocket client;
+  client.connect( name );
+  LocalStreamSocket server = listener.accept();
+  expect_contents( "listener path", name, listener.local_path() );
+  expect_contents( "client's peer path", name, client.peer_path() );
+  expect_contents( "client path", "", client.local_path() );
+
+  auto [reader, writer] = make_pipe();
+  expect_throws( "send_fds() with an empty payload", [&] { client.send_fds( "", { reader } ); } );
+  const vector<reference_wrapper<const FileDescriptor>> too_many( LocalSocket::kMaxPassedFds + 1, writer );
+  expect_throws( "send_fds() with too many descriptors", [&] { client.send_fds( "x", too_many ); } );
+
+  const vector<reference_wrapper<const FileDescriptor>> most( LocalSocket::kMaxPassedFds, writer );
+  client.send_fds( "most", most );
+  expect_message( server, "most", LocalSocket::kMaxPassedFds );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    pass_pipe();
+    messages_pair_up();
+    pass_connection();
+    named_and_limits();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
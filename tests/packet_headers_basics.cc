@@ -0,0 +1,254 @@
+#include "checksum.hh"
+#include "common.hh"
+#include "packet_headers.hh"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+namespace {
+
+void put16( string& bytes, const uint16_t value )
+{
+  bytes += static_cast<char>( value >> 8U );
+  bytes += static_cast<char>( value );
+}
+
+void put32( string& bytes, const uint32_t value )
+{
+  put16( bytes, static_cast<uint16_t>( value >> 16U ) );
+  put16( bytes, static_cast<uint16_t>( value ) );
+}
+
+void set16( string& bytes, const size_t offset, const uint16_t value )
+{
+  bytes[offset] = static_cast<char>( value >> 8U );
+  bytes[offset + 1] = static_cast<char>( value );
+}
+
+constexpr uint32_t kSource = 0x0A000001;      // 10.0.0.1
+constexpr uint32_t kDestination = 0x0A000002; // 10.0.0.2
+
+// an IPv4 packet with a correct header checksum, carrying `payload` after `options`
+string ipv4_packet( const uint8_t protocol, const string_view payload, const string_view options = {} )
+{
+  string packet;
+  packet += static_cast<char>( 0x40 | ( 20 + options.size() ) / 4 );
+  packet += '\x28'; // TOS
+  put16( packet, static_cast<uint16_t>( 20 + options.size() + payload.size() ) );
+  put16( packet, 0x1234 ); // identification
+  put16( packet, 0x4000 ); // don't fragment
+  packet += '\x40';        // TTL
+  packet += static_cast<char>( protocol );
+  put16( packet, 0 );
+  put32( packet, kSource );
+  put32( packet, kDestination );
+  packet += options;
+  set16( packet, 10, internet_checksum( packet ) );
+  packet += payload;
+  return packet;
+}
+
+// a TCP segment with a correct checksum for an IPv4 packet from kSource to kDestination
+string tcp_segment( const string_view payload, const string_view options = {} )
+{
+  string segment;
+  put16( segment, 5000 );
+  put16( segment, 80 );
+  put32( segment, 0x01020304 );
+  put32( segment, 0xfffffffe );
+  segment += static_cast<char>( ( 20 + options.size() ) / 4 << 4U );
+  segment += static_cast<char>( TCPView::kSyn | TCPView::kAck );
+  put16( segment, 65535 );
+  put16( segment, 0 );
+  put16( segment, 7 ); // urgent pointer
+  segment += options;
+  segment += payload;
+  const uint32_t pseudo_header
+    = ipv4_pseudo_header_sum( kSource, kDestination, IPPROTO_TCP, static_cast<uint16_t>( segment.size() ) );
+  set16( segment, 16, internet_checksum( segment, pseudo_header ) );
+  return segment;
+}
+
+// a UDP datagram with a correct checksum for an IPv4 packet from kSource to kDestination
+string udp_datagram( const string_view payload )
+{
+  string datagram;
+  put16( datagram, 53 );
+  put16( datagram, 40000 );
+  put16( datagram, static_cast<uint16_t>( 8 + payload.size() ) );
+  put16( datagram, 0 );
+  datagram += payload;
+  const uint32_t pseudo_header
+    = ipv4_pseudo_header_sum( kSource, kDestination, IPPROTO_UDP, static_cast<uint16_t>( datagram.size() ) );
+  set16( datagram, 6, internet_checksum( datagram, pseudo_header ) );
+  return datagram;
+}
+
+void expect( const bool condition, const string& what )
+{
+  if ( not condition ) {
+    throw ExpectationViolation { "Expected " + what };
+  }
+}
+
+// a VLAN-tagged Ethernet frame with link-layer padding, carrying IPv4 and TCP with options and an odd payload
+void tcp_in_tagged_frame()
+{
+  const array<uint8_t, 6> destination_mac { 0x02, 0, 0, 0, 0, 0x01 };
+  const array<uint8_t, 6> source_mac { 0x02, 0, 0, 0, 0, 0x02 };
+  string frame( destination_mac.begin(), destination_mac.end() );
+  frame.append( source_mac.begin(), source_mac.end() );
+  put16( frame, EthernetView::kTypeVLAN );
+  put16( frame, 0xa123 ); // priority 5, VLAN 0x123
+  put16( frame, EthernetView::kTypeIPv4 );
+  const string segment = tcp_segment( "hello", { "\x02\x04\x05\xb4", 4 } );
+  frame += ipv4_packet( IPPROTO_TCP, segment, { "\x01\x01\x01\x00", 4 } );
+  frame += string( 3, '\0' );
+
+  const auto ethernet = EthernetView::parse( frame );
+  expect( ethernet.has_value(), "a tagged frame to parse" );
+  expect( ethernet->destination() == destination_mac and ethernet->source() == source_mac, "the MAC addresses" );
+  expect( ethernet->vlan_id() == 0x123 and ethernet->header_length() == 18, "the VLAN tag to be skipped" );
+  expect( ethernet->ethertype() == EthernetView::kTypeIPv4, "the EtherType after the VLAN tag" );
+
+  const auto ip = IPv4View::parse( ethernet->payload() );
+  expect( ip.has_value(), "the IPv4 packet to parse" );
+  expect( ip->header_length() == 24 and ip->options() == string_view { "\x01\x01\x01\x00", 4 }, "IPv4 options" );
+  expect( ip->total_length() == 24 + segment.size(), "the IPv4 packet to exclude the link-layer padding" );
+  expect( ip->tos() == 0x28 and ip->identification() == 0x1234 and ip->ttl() == 64, "the IPv4 fields" );
+  expect( ip->protocol() == IPPROTO_TCP and ip->source() == kSource and ip->destination() == kDestination,
+          "the IPv4 protocol and addresses" );
+  expect( ip->dont_fragment() and not ip->is_fragment(), "an unfragmented packet" );
+  expect( ip->checksum_valid(), "a valid IPv4 header checksum" );
+
+  const auto tcp = TCPView::parse( ip->payload() );
+  expect( tcp.has_value(), "the TCP segment to parse" );
+  expect( tcp->source_port() == 5000 and tcp->destination_port() == 80, "the TCP ports" );
+  expect( tcp->sequence_number() == 0x01020304 and tcp->acknowledgment_number() == 0xfffffffe,
+          "the TCP sequence and acknowledgment numbers" );
+  expect( tcp->window() == 65535 and tcp->urgent_pointer() == 7, "the TCP window and urgent pointer" );
+  expect( tcp->has( TCPView::kSyn | TCPView::kAck ) and not tcp->has( TCPView::kSyn | TCPView::kFin ),
+          "the TCP flags" );
+  expect( tcp->options() == string_view { "\x02\x04\x05\xb4", 4 } and tcp->payload() == "hello",
+          "the TCP options and payload" );
+  expect( tcp->checksum_valid( *ip ), "a valid TCP checksum over an odd-length segment" );
+  expect( tcp->flow_key( *ip ) == FlowKey::from_ipv4( kDestination, 80, kSource, 5000 ),
+          "the flow as seen by the receiver" );
+
+  // corrupting a byte of the payload or of the IPv4 header is caught
+  string corrupted = frame;
+  corrupted[corrupted.size() - 4] ^= 0x01;
+  const auto corrupted_ip = IPv4View::parse( EthernetView::parse( corrupted )->payload() );
+  expect( corrupted_ip->checksum_valid()
+            and not TCPView::parse( corrupted_ip->payload() )->checksum_valid( *corrupted_ip ),
+          "a corrupted TCP payload to fail the checksum" );
+  corrupted = frame;
+  corrupted[18 + 8] ^= 0x01; // the TTL
+  expect( not IPv4View::parse( EthernetView::parse( corrupted )->payload() )->checksum_valid(),
+          "a corrupted IPv4 header to fail the checksum" );
+}
+
+// a UDP datagram shorter than the IPv4 payload, and the absent UDP checksum
+void udp()
+{
+  string payload = udp_datagram( "abc" );
+  payload += "trailer";
+  const auto packet = ipv4_packet( IPPROTO_UDP, payload );
+  const auto ip = IPv4View::parse( packet );
+  const auto datagram = UDPView::parse( ip->payload() );
+  expect( datagram.has_value(), "the UDP datagram to parse" );
+  expect( datagram->length() == 11 and datagram->payload() == "abc", "the datagram to end at its UDP length" );
+  expect( datagram->source_port() == 53 and datagram->destination_port() == 40000, "the UDP ports" );
+  expect( datagram->checksum_valid( *ip ), "a valid UDP checksum, whose pseudo-header has the UDP length" );
+  expect( datagram->flow_key( *ip ) == FlowKey::from_ipv4( kDestination, 40000, kSource, 53 ),
+          "the UDP flow as seen by the receiver" );
+
+  string unchecked = packet;
+  set16( unchecked, 20 + 6, 0 );
+  const auto unchecked_ip = IPv4View::parse( unchecked );
+  expect( UDPView::parse( unchecked_ip->payload() )->checksum_valid( *unchecked_ip ), "no UDP checksum to pass" );
+
+  string corrupted = packet;
+  corrupted[20 + 8] ^= 0x20;
+  const auto corrupted_ip = IPv4View::parse( corrupted );
+  expect( not UDPView::parse( corrupted_ip->payload() )->checksum_valid( *corrupted_ip ),
+          "a corrupted UDP payload to fail the checksum" );
+}
+
+// the fragment fields, and an untagged frame
+void fragments()
+{
+  string packet = ipv4_packet( IPPROTO_UDP, string( 16, 'x' ) );
+  set16( packet, 6, 0x2000 | 185 ); // more fragments, at 1480 bytes
+  const auto ip = IPv4View::parse( packet );
+  expect( ip->is_fragment() and ip->more_fragments() and not ip->dont_fragment(), "a fragment" );
+  expect( ip->fragment_offset() == 1480, "the fragment offset in bytes" );
+
+  string frame( 12, '\x02' );
+  put16( frame, EthernetView::kTypeIPv4 );
+  frame += packet;
+  const auto ethernet = EthernetView::parse( frame );
+  expect( not ethernet->vlan_id().has_value() and ethernet->header_length() == 14, "an untagged frame" );
+  expect( ethernet->payload() == packet, "the untagged frame's payload" );
+}
+
+// headers that are truncated or inconsistent with their lengths don't parse
+void malformed()
+{
+  string tagged( 12, '\0' );
+  put16( tagged, EthernetView::kTypeVLAN );
+  expect( not EthernetView::parse( string( 13, '\0' ) ), "a truncated Ethernet header to be rejected" );
+  expect( not EthernetView::parse( tagged + "\x01\x23" ), "a truncated VLAN tag to be rejected" );
+
+  const string packet = ipv4_packet( IPPROTO_TCP, tcp_segment( "" ) );
+  expect( not IPv4View::parse( string_view { packet }.substr( 0, 19 ) ), "a truncated IPv4 header to be rejected" );
+  expect( not IPv4View::parse( string_view { packet }.substr( 0, packet.size() - 1 ) ),
+          "an IPv4 packet shorter than its total length to be rejected" );
+  string wrong = packet;
+  wrong[0] = '\x65';
+  expect( not IPv4View::parse( wrong ), "an IPv6 version number to be rejected" );
+  wrong[0] = '\x44';
+  expect( not IPv4View::parse( wrong ), "an IPv4 header length below 20 to be rejected" );
+  wrong = packet;
+  set16( wrong, 2, 19 );
+  expect( not IPv4View::parse( wrong ), "a total length shorter than the header to be rejected" );
+
+  string segment = tcp_segment( "" );
+  expect( not TCPView::parse( string_view { segment }.substr( 0, 19 ) ), "a truncated TCP header to be rejected" );
+  segment[12] = '\x40';
+  expect( not TCPView::parse( segment ), "a TCP header length below 20 to be rejected" );
+  segment[12] = '\x60';
+  expect( not TCPView::parse( segment ), "a TCP header longer than the segment to be rejected" );
+
+  string datagram = udp_datagram( "abc" );
+  expect( not UDPView::parse( string_view { datagram }.substr( 0, 7 ) ), "a truncated UDP header to be rejected" );
+  expect( not UDPView::parse( string_view { datagram }.substr( 0, 10 ) ),
+          "a UDP datagram shorter than its length to be rejected" );
+  set16( datagram, 4, 7 );
+  expect( not UDPView::parse( datagram ), "a UDP length below 8 to be rejected" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    tcp_in_tagged_frame();
+    udp();
+    fragments();
+    malformed();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+#include "common.hh"
+#include "timer_wheel.hh"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr uint64_t kStart = 1'000'000;
+
+// timers spread over every level of the wheel, and past its 2^32 ms range, fire exactly on time (in the
+// first expire() that reaches their deadline, never before) and in order of deadline, unless canceled
+void against_reference()
+{
+  struct Expected
+  {
+    uint64_t deadline {};
+    TimerWheel::Handle handle {};
+    bool canceled {};
+    size_t fired {};
+  };
+
+  TimerWheel wheel { kStart };
+  mt19937_64 random { 458 }; // NOLINT(*-msc51-cpp)
+  vector<Expected> timers;
+  uint64_t now = kStart;
+  uint64_t previous_now = kStart;
+  uint64_t last_fired_deadline = 0;
+
+  const auto arm = [&]( uint64_t deadline ) {
+    const size_t id = timers.size();
+    timers.push_back( { .deadline = deadline } );
+    timers[id].handle = wheel.arm_at( deadline, [&, id] {
+      auto& timer = timers[id];
+      ++timer.fired;
+      if ( timer.deadline > now or timer.deadline <= previous_now ) {
+        throw ExpectationViolation { "timer due at " + to_string( timer.deadline ) + " fired at "
+                                     + to_string( now ) + " (previous expire() at " + to_string( previous_now )
+                                     + ")" };
+      }
+      if ( timer.deadline < last_fired_deadline ) {
+        throw ExpectationViolation { "timers fired out of order of deadline" };
+      }
+      last_fired_deadline = timer.deadline;
+    } );
+  };
+
+  // the range of each delay picks the level it starts on: 0 (< 2^8), 1, 2, 3, or beyond the top level
+  const auto random_delay = [&] {
+    const unsigned bits = array { 8U, 16U, 24U, 32U, 34U }[random() % 5];
+    return random() % ( uint64_t { 1 } << bits ) + 1;
+  };
+
+  for ( size_t i = 0; i < 2000; ++i ) {
+    arm( now + random_delay() );
+  }
+
+  for ( size_t step = 0; step < 4000; ++step ) {
+    // arm more as time goes on, cancel some of those pending, and move time forward by varying amounts
+    if ( step % 4 == 0 ) {
+      arm( now + random_delay() );
+    }
+    if ( step % 3 == 0 ) {
+      auto& timer = timers[random() % timers.size()];
+      const bool pending = not timer.canceled and timer.fired == 0;
+      if ( wheel.cancel( timer.handle ) != pending ) {
+        throw ExpectationViolation { "cancel() should succeed only for a pending timer" };
+      }
+      timer.canceled |= pending;
+    }
+
+    previous_now = now;
+    now += random_delay() / ( step % 2 == 0 ? 1 : 64 );
+    last_fired_deadline = 0;
+    wheel.expire( now );
+  }
+
+  // run out the rest
+  previous_now = now;
+  now += uint64_t { 1 } << 35;
+  last_fired_deadline = 0;
+  wheel.expire( now );
+
+  for ( const auto& timer : timers ) {
+    if ( timer.fired != ( timer.canceled ? 0 : 1 ) ) {
+      throw ExpectationViolation { "timer due at " + to_string( timer.deadline ) + " fired "
+                                   + to_string( timer.fired ) + " times"
+                                   + ( timer.canceled ? " after being canceled" : "" ) };
+    }
+  }
+  if ( not wheel.empty() ) {
+    throw ExpectationViolation { "timers left", size_t { 0 }, wheel.size() };
+  }
+}
+
+// a timer that moves down from the top level still fires on its exact millisecond
+void cascade_is_exact()
+{
+  TimerWheel wheel { 0 };
+  const uint64_t deadline = ( uint64_t { 3 } << 24 ) + ( uint64_t { 5 } << 16 ) + ( uint64_t { 7 } << 8 ) + 9;
+  bool fired = false;
+  wheel.arm_at( deadline, [&] { fired = true; } );
+
+  for ( const uint64_t early : { uint64_t { 3 } << 24, deadline - 256, deadline - 1 } ) {
+    if ( wheel.expire( early ) != 0 or fired ) {
+      throw ExpectationViolation { "the timer fired early, at " + to_string( early ) };
+    }
+    const auto until = wheel.ms_until_next( early );
+    if ( not until or early + *until > deadline ) {
+      throw ExpectationViolation { "ms_until_next() should never point past the deadline" };
+    }
+  }
+  if ( wheel.ms_until_next( deadline - 1 ) != 1 ) {
+    throw ExpectationViolation { "ms_until_next() should be exact within 256 ms of the deadline" };
+  }
+  if ( wheel.expire( deadline ) != 1 or not fired ) {
+    throw ExpectationViolation { "the timer should fire at its deadline" };
+  }
+  if ( wheel.ms_until_next( deadline ).has_value() ) {
+    throw ExpectationViolation { "an empty wheel has no next timer" };
+  }
+}
+
+// handles stay safe after their timer is gone, and callbacks may arm and cancel timers
+void handles_and_callbacks()
+{
+  TimerWheel wheel { kStart };
+  size_t first_runs = 0;
+  const auto first = wheel.arm_at( kStart + 10, [&] { ++first_runs; } );
+  if ( not wheel.cancel( first ) or wheel.cancel( first ) ) {
+    throw ExpectationViolation { "a timer can be canceled once" };
+  }
+
+  // the canceled timer's storage is reused, but its old handle doesn't reach the new timer
+  size_t second_runs = 0;
+  const auto second = wheel.arm_at( kStart + 10, [&] { ++second_runs; } );
+  if ( second.index != first.index or wheel.cancel( first ) ) {
+    throw ExpectationViolation { "a stale handle should not cancel the timer that reused its storage" };
+  }
+
+  // a callback arms a timer that is already due (it runs in the same call), and cancels a later one
+  size_t chained_runs = 0;
+  const auto later = wheel.arm_at( kStart + 50, [] { throw runtime_error( "canceled timer ran" ); } );
+  wheel.arm_at( kStart + 20, [&] {
+    wheel.arm_at( kStart + 15, [&] { ++chained_runs; } );
+    wheel.cancel( later );
+  } );
+
+  if ( wheel.expire( kStart + 30 ) != 3 or first_runs != 0 or second_runs != 1 or chained_runs != 1 ) {
+    throw ExpectationViolation { "expire() should run the second, chaining and chained timers once each" };
+  }
+  if ( wheel.cancel( second ) ) {
+    throw ExpectationViolation { "a timer that fired can't be canceled" };
+  }
+  if ( wheel.expire( kStart + 100 ) != 0 or not wheel.empty() ) {
+    throw ExpectationViolation { "nothing should be left after the later timer was canceled" };
+  }
+
+  // a deadline that has already passed runs on the next expire()
+  size_t overdue_runs = 0;
+  wheel.arm_at( kStart + 60, [&] { ++overdue_runs; } );
+  if ( wheel.expire( kStart + 100 ) != 1 or overdue_runs != 1 ) {
+    throw ExpectationViolation { "a timer armed after its deadline should run on the next expire()" };
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    against_reference();
+    cascade_is_exact();
+    handles_and_callbacks();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
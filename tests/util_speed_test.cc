@@ -0,0 +1,514 @@
+#include "address.hh"
+#include "buffer.hh"
+#include "checksum.hh"
+#include "coroutine.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+#include "flow_table.hh"
+#include "packet_headers.hh"
+#include "socket.hh"
+#include "timer_wheel.hh"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fcntl.h>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <netinet/in.h>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Microbenchmarks for util/, in the style of Google Benchmark: each body is run for a growing number of
+// iterations until one run takes at least kMinTime, and that run is reported as ns/op (plus bytes/s when
+// each operation moves a known number of bytes). The numbers are meant to be compared before and after a
+// change, so no minimum speed is enforced.
+
+namespace {
+constexpr chrono::duration<double> kMinTime { 0.1 };
+
+// Keep the compiler from discarding a computation whose result is unused
+template<typename T>
+void do_not_optimize( T& value )
+{
+  asm volatile( "" : : "r,m"( value ) : "memory" );
+}
+
+void benchmark( const string& name, const size_t bytes_per_op, const function<void( uint64_t )>& body )
+{
+  uint64_t iterations = 1;
+  while ( true ) {
+    const auto start = chrono::steady_clock::now();
+    body( iterations );
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    if ( elapsed >= kMinTime or iterations >= ( uint64_t { 1 } << 40 ) ) {
+      const double seconds_per_op = elapsed.count() / static_cast<double>( iterations );
+      cout << left << setw( 48 ) << name << right << fixed << setprecision( 1 ) << setw( 12 )
+           << seconds_per_op * 1e9 << " ns/op" << setw( 14 ) << iterations << " iterations";
+      if ( bytes_per_op ) {
+        cout << setprecision( 2 ) << setw( 10 ) << static_cast<double>( bytes_per_op ) / seconds_per_op / 1e9
+             << " GB/s";
+      }
+      cout << "\n";
+      return;
+    }
+
+    // aim a little past kMinTime, growing at most tenfold per run
+    const double scale = elapsed.count() > 0 ? 1.4 * kMinTime.count() / elapsed.count() : 10;
+    const auto next = static_cast<uint64_t>( static_cast<double>( iterations ) * min( scale, 10.0 ) );
+    iterations = max( iterations + 1, next );
+  }
+}
+
+// One write and one read of `size` bytes through a connected pair of descriptors (which must be able to
+// buffer that much)
+void read_write( const string& name, FileDescriptor& in, FileDescriptor& out, const size_t size )
+{
+  const string data( size, 'x' );
+  string received( size, 0 );
+
+  benchmark( name + " read+write " + to_string( size ) + " B", size, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      out.write( data );
+      for ( size_t total = 0; total < size; ) {
+        total += in.read( span { received }.subspan( total ) );
+      }
+    }
+  } );
+
+  if ( received != data ) {
+    throw runtime_error( name + ": data was corrupted in transit" );
+  }
+}
+
+void pipe_benchmarks()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe2", ::pipe2( fds.data(), O_CLOEXEC ) );
+  FileDescriptor in { fds[0], false };
+  FileDescriptor out { fds[1], false };
+
+  for ( const size_t size : { 64, 4096, 65536 } ) {
+    read_write( "pipe", in, out, size );
+  }
+}
+
+// The cost of a failure that a busy server sees all the time, reported by exception and by IOResult
+void error_path_benchmarks()
+{
+  signal( SIGPIPE, SIG_IGN ); // NOLINT(cert-err33-c)
+
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe2", ::pipe2( fds.data(), O_CLOEXEC ) );
+  FileDescriptor out { fds[1], false };
+  ::close( fds[0] ); // every write now fails with EPIPE
+  const string data( 64, 'x' );
+
+  benchmark( "write to closed pipe (unix_error)", 0, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      try {
+        out.write( data );
+      } catch ( const unix_error& e ) {
+        do_not_optimize( e );
+      }
+    }
+  } );
+
+  bool all_epipe = true;
+  benchmark( "write to closed pipe (try_write)", 0, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      const IOResult result = out.try_write( data );
+      all_epipe &= result.error() == EPIPE;
+    }
+  } );
+
+  if ( not all_epipe ) {
+    throw runtime_error( "try_write: expected EPIPE" );
+  }
+}
+
+void socketpair_benchmarks()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data() ) );
+  FileDescriptor in { fds[0], false };
+  FileDescriptor out { fds[1], false };
+
+  for ( const size_t size : { 64, 4096, 65536 } ) {
+    read_write( "socketpair", in, out, size );
+  }
+
+  // the same hop over loopback TCP, for comparison
+  TCPSocket listener;
+  listener.bind( Address { "127.0.0.1" } );
+  listener.listen();
+  TCPSocket client;
+  client.connect( listener.local_address() );
+  TCPSocket server = listener.accept();
+  for ( const size_t size : { 64, 4096, 65536 } ) {
+    read_write( "loopback TCP", server, client, size );
+  }
+
+  auto [sender, receiver] = LocalStreamSocket::pair();
+  vector<FileDescriptor> received;
+  array<char, 1> byte {};
+  benchmark( "LocalStreamSocket send_fds+recv_fds (1 fd)", 0, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      sender.send_fds( "x", { server } );
+      receiver.recv_fds( byte, received );
+      received.clear();
+    }
+  } );
+}
+
+void address_benchmarks()
+{
+  benchmark( "Address( ip, port )", 0, []( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      Address address { "192.168.0.1", 8080 };
+      do_not_optimize( address );
+    }
+  } );
+
+  benchmark( "Address( ip, port ) IPv6", 0, []( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      Address address { "2001:db8::1", 8080 };
+      do_not_optimize( address );
+    }
+  } );
+
+  const Address address { "192.168.0.1", 8080 };
+  benchmark( "Address::to_string", 0, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      string text = address.to_string();
+      do_not_optimize( text );
+    }
+  } );
+
+  const Address ipv6 { "2001:db8::1", 8080 };
+  benchmark( "Address::hash IPv4 + IPv6", 0, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      size_t h = address.hash() ^ ipv6.hash();
+      do_not_optimize( h );
+    }
+  } );
+}
+
+void datagram_benchmarks()
+{
+  UDPSocket socket;
+  socket.bind( Address { "127.0.0.1", 0 } );
+  const Address destination = socket.local_address();
+
+  const string payload( 64, 'x' );
+  Address source { "0" };
+  OwnedBuffer received { 2048 };
+
+  // one at a time, so the receive queue never overflows
+  benchmark( "UDPSocket sendto+recv 64 B", payload.size(), [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      socket.sendto( destination, payload );
+      socket.recv( source, received );
+    }
+  } );
+
+  constexpr size_t kBatch = 32;
+  const vector<DatagramSocket::OutgoingDatagram> outgoing( kBatch, { &destination, payload, 0 } );
+  vector<DatagramSocket::ReceivedDatagram> slots( kBatch );
+  for ( auto& slot : slots ) {
+    slot.payload = OwnedBuffer { 2048 };
+  }
+
+  benchmark( "UDPSocket send_batch+recv_batch 32 x 64 B", kBatch * payload.size(), [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      const size_t sent = socket.send_batch( outgoing );
+      for ( size_t got = 0; got < sent; ) {
+        got += socket.recv_batch( span { slots }.first( sent - got ) );
+      }
+    }
+  } );
+
+  if ( string_view { received } != payload or string_view { slots.front().payload } != payload ) {
+    throw runtime_error( "UDPSocket: datagram was corrupted in transit" );
+  }
+}
+
+void buffer_benchmarks()
+{
+  const Buffer original { string( 1500, 'x' ) };
+
+  benchmark( "Buffer copy (1500 B, shared)", 0, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      Buffer copy = original; // NOLINT(performance-unnecessary-copy-initialization)
+      do_not_optimize( copy );
+    }
+  } );
+
+  benchmark( "Buffer move (1500 B)", 0, [&]( uint64_t iterations ) {
+    Buffer a = original;
+    Buffer b;
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      b = move( a );
+      a = move( b );
+      do_not_optimize( a );
+    }
+  } );
+
+  benchmark( "Buffer from string (1500 B, deep copy)", 1500, [&]( uint64_t iterations ) {
+    const string text( 1500, 'x' );
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      Buffer copy { text };
+      do_not_optimize( copy );
+    }
+  } );
+
+  BufferPool pool { 2048 };
+  benchmark( "OwnedBuffer acquire+assign+release (2 KiB pool)", 1500, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      OwnedBuffer buffer = pool.acquire();
+      buffer.assign( original );
+      do_not_optimize( buffer );
+    }
+  } );
+
+  benchmark( "OwnedBuffer move", 0, [&]( uint64_t iterations ) {
+    OwnedBuffer a { 2048 };
+    OwnedBuffer b;
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      b = move( a );
+      a = move( b );
+      do_not_optimize( a );
+    }
+  } );
+}
+
+// The Internet checksum, as a byte-at-a-time loop and by each kernel, and parsing and verifying a packet
+void checksum_benchmarks()
+{
+  string data( 65536, 0 );
+  for ( size_t i = 0; i < data.size(); ++i ) {
+    data[i] = static_cast<char>( i * 7 + 3 );
+  }
+
+  uint64_t total = 0;
+  for ( const size_t size : { 1500, 65536 } ) {
+    const string_view bytes { data.data(), size };
+    const string suffix = " (" + to_string( size ) + " B)";
+
+    benchmark( "checksum byte loop" + suffix, size, [&]( uint64_t iterations ) {
+      for ( uint64_t i = 0; i < iterations; ++i ) {
+        uint64_t sum = 0;
+        for ( size_t j = 0; j < bytes.size(); ++j ) {
+          sum += ( j % 2 == 0 ) ? static_cast<uint8_t>( bytes[j] ) << 8U : static_cast<uint8_t>( bytes[j] );
+        }
+        total += sum;
+      }
+    } );
+    benchmark( "checksum scalar" + suffix, size, [&]( uint64_t iterations ) {
+      for ( uint64_t i = 0; i < iterations; ++i ) {
+        total += checksum_detail::native_sum_scalar( bytes );
+      }
+    } );
+#if defined( __x86_64__ )
+    if ( checksum_detail::has_avx2() ) {
+      benchmark( "checksum AVX2" + suffix, size, [&]( uint64_t iterations ) {
+        for ( uint64_t i = 0; i < iterations; ++i ) {
+          total += checksum_detail::native_sum_avx2( bytes );
+        }
+      } );
+    }
+#endif
+  }
+
+  // a 1500-byte IPv4 packet holding a TCP segment, with both checksums filled in
+  string packet( 1500, 0 );
+  ranges::copy( data.substr( 0, packet.size() ), packet.begin() );
+  const auto put16 = [&]( const size_t offset, const uint16_t value ) {
+    packet[offset] = static_cast<char>( value >> 8U );
+    packet[offset + 1] = static_cast<char>( value );
+  };
+  packet[0] = 0x45;
+  put16( 2, packet.size() );
+  packet[9] = IPPROTO_TCP;
+  put16( 10, 0 );
+  put16( 10, internet_checksum( string_view { packet }.substr( 0, 20 ) ) );
+  packet[32] = 0x50;
+  put16( 36, 0 );
+  const IPv4View header = IPv4View::parse( packet ).value();
+  put16( 36, internet_checksum( header.payload(), header.pseudo_header_sum() ) );
+
+  benchmark( "IPv4View+TCPView parse and verify (1500 B)", packet.size(), [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      const auto ip = IPv4View::parse( packet );
+      const auto tcp = TCPView::parse( ip->payload() );
+      if ( not ip->checksum_valid() or not tcp->checksum_valid( *ip ) ) {
+        throw runtime_error( "checksum_benchmarks: invalid checksum" );
+      }
+      total += tcp->flow_key( *ip ).hash();
+    }
+  } );
+  do_not_optimize( total );
+}
+
+// Lookups of per-flow state among 100k flows, by FlowKey in a FlowTable and by Address in a node-based map
+void flow_table_benchmarks()
+{
+  constexpr uint32_t kFlows = 100'000;
+  constexpr uint32_t kServer = 0x0a000001;
+
+  vector<FlowKey> keys;
+  vector<Address> peers;
+  FlowTable<uint64_t> table;
+  unordered_map<Address, uint64_t> map;
+  for ( uint32_t i = 0; i < kFlows; ++i ) {
+    const uint32_t client = 0x0a010000 + i / 64;
+    const auto port = static_cast<uint16_t>( 1024 + i % 64 );
+    keys.push_back( FlowKey::from_ipv4( kServer, 80, client, port ) );
+    peers.push_back( Address::from_ipv4_numeric( client, port ) );
+    table[keys.back()] = i;
+    map[peers.back()] = i;
+  }
+
+  uint64_t total = 0;
+  benchmark( "FlowTable find (100k flows)", 0, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      total += *table.find( keys[i * 7919 % kFlows] );
+    }
+  } );
+  benchmark( "unordered_map<Address> find (100k flows)", 0, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      total += map.find( peers[i * 7919 % kFlows] )->second;
+    }
+  } );
+  benchmark( "FlowTable erase+insert (100k flows)", 0, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      const FlowKey& key = keys[i * 7919 % kFlows];
+      table.erase( key );
+      table[key] = i;
+    }
+  } );
+  do_not_optimize( total );
+}
+
+// Arm and cancel, and arm and expire, with many other timers pending (as for idle and retransmission timeouts)
+void timer_benchmarks()
+{
+  constexpr uint64_t kPending = 100000;
+  TimerWheel wheel { 0 };
+  uint64_t fired = 0;
+  for ( uint64_t i = 0; i < kPending; ++i ) {
+    wheel.arm_at( 1'000'000'000 + i * 10, [&] { ++fired; } );
+  }
+
+  benchmark( "TimerWheel arm+cancel (100k pending)", 0, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      const auto handle = wheel.arm_at( 30'000 + i % 5000, [&] { ++fired; } );
+      wheel.cancel( handle );
+    }
+  } );
+
+  uint64_t now = 0;
+  benchmark( "TimerWheel arm+expire (100k pending)", 0, [&]( uint64_t iterations ) {
+    for ( uint64_t i = 0; i < iterations; ++i ) {
+      wheel.arm_at( now + 200, [&] { ++fired; } );
+      wheel.expire( ++now );
+    }
+  } );
+
+  if ( wheel.size() < kPending ) {
+    throw runtime_error( "TimerWheel: timers fired early" );
+  }
+  do_not_optimize( fired );
+}
+
+Task<uint64_t> add_one( const uint64_t value )
+{
+  co_return value + 1;
+}
+
+Task<void> call_tasks( const uint64_t iterations, uint64_t& result )
+{
+  for ( uint64_t i = 0; i < iterations; ++i ) {
+    result = co_await add_one( result );
+  }
+}
+
+Task<void> ping_pong( AsyncFD& out, AsyncFD& in, const uint64_t iterations, const size_t size )
+{
+  const string data( size, 'x' );
+  string received( size, 0 );
+  for ( uint64_t i = 0; i < iterations; ++i ) {
+    co_await out.write( data );
+    for ( size_t total = 0; total < size; ) {
+      total += co_await in.read( span { received }.subspan( total ) );
+    }
+  }
+  if ( received != data ) {
+    throw runtime_error( "AsyncFD: data was corrupted in transit" );
+  }
+}
+
+// The cost of a coroutine call (whose frame comes from the pool), and of awaited I/O that doesn't block
+void coroutine_benchmarks()
+{
+  EventLoop loop;
+  AsyncIO io { loop };
+
+  uint64_t result = 0;
+  benchmark( "co_await Task<uint64_t> (pooled frame)", 0, [&]( uint64_t iterations ) {
+    io.spawn( call_tasks( iterations, result ) );
+    io.run();
+  } );
+  do_not_optimize( result );
+
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data() ) );
+  AsyncFD in { io, FileDescriptor { fds[0], false } };
+  AsyncFD out { io, FileDescriptor { fds[1], false } };
+  benchmark( "AsyncFD socketpair co_await write+read 64 B", 64, [&]( uint64_t iterations ) {
+    io.spawn( ping_pong( out, in, iterations, 64 ) );
+    io.run();
+  } );
+}
+
+void program_body()
+{
+  pipe_benchmarks();
+  socketpair_benchmarks();
+  error_path_benchmarks();
+  address_benchmarks();
+  datagram_benchmarks();
+  buffer_benchmarks();
+  timer_benchmarks();
+  flow_table_benchmarks();
+  checksum_benchmarks();
+  coroutine_benchmarks();
+}
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -10,6 +10,7 @@
 #include <netdb.h>
 #include <stdexcept>
 #include <system_error>
+#include <vector>
 
 using namespace std;
 
@@ -30,11 +31,11 @@ Address::Raw::operator const sockaddr*() const
 Address::Address( const sockaddr* addr, const size_t size ) : _size( size )
 {
   // make sure proposed sockaddr can fit
-  if ( size > sizeof( _address.storage ) ) {
+  if ( size > sizeof( _address ) ) {
     throw runtime_error( "invalid sockaddr size" );
   }
 
-  memcpy( &_address.storage, addr, size );
+  memcpy( &_address, addr, size );
 }
 
 //! Error category for getaddrinfo and getnameinfo failures.
@@ -90,24 +91,77 @@ static inline addrinfo make_hints( int ai_flags, int ai_family ) // NOLINT(*-swa
 
 //! \param[in] hostname to resolve
 //! \param[in] service name (from `/etc/services`, e.g., "http" is port 80)
+//! \details Takes the resolver's first IPv4 answer, to match the family of a default-constructed TCPSocket
+//! or UDPSocket; see resolve_all() for IPv6 and the other answers.
 Address::Address( const string& hostname, const string& service )
   : Address( hostname, service, make_hints( AI_ALL, AF_INET ) )
 {}
 
-//! \param[in] ip address as a dotted quad ("1.1.1.1")
+//! \param[in] hostname to resolve
+//! \param[in] service name (from `/etc/services`, e.g., "http" is port 80)
+//! \param[in] family restricts the results to one address family, unless it is `AF_UNSPEC`
+vector<Address> Address::resolve_all( const string& hostname, const string& service, const int family )
+{
+  addrinfo hints = make_hints( AI_ADDRCONFIG, family );
+  hints.ai_socktype = SOCK_STREAM; // one entry per address, rather than one per socket type
+
+  addrinfo* resolved_address = nullptr;
+  const int gai_ret = getaddrinfo( hostname.c_str(), service.c_str(), &hints, &resolved_address );
+  if ( gai_ret != 0 ) {
+    throw tagged_error( gai_error_category(), "getaddrinfo(" + hostname + ", " + service + ")", gai_ret );
+  }
+
+  auto addrinfo_deleter = []( addrinfo* const x ) { freeaddrinfo( x ); };
+  unique_ptr<addrinfo, decltype( addrinfo_deleter )> wrapped_address( resolved_address, move( addrinfo_deleter ) );
+
+  vector<Address> addresses;
+  for ( const addrinfo* entry = wrapped_address.get(); entry != nullptr; entry = entry->ai_next ) {
+    addresses.emplace_back( entry->ai_addr, entry->ai_addrlen );
+  }
+
+  if ( addresses.empty() ) {
+    throw runtime_error( "getaddrinfo returned successfully but with no results" );
+  }
+
+  return addresses;
+}
+
+//! \param[in] ip address as a dotted quad ("1.1.1.1") or IPv6 ("2001:db8::1")
 //! \param[in] port number
-Address::Address( const string& ip, const uint16_t port )
-  // tell getaddrinfo that we don't want to resolve anything
-  : Address( ip, ::to_string( port ), make_hints( AI_NUMERICHOST | AI_NUMERICSERV, AF_INET ) )
-{}
+Address::Address( const string& ip, const uint16_t port ) : _size()
+{
+  if ( inet_pton( AF_INET, ip.c_str(), &_address.ipv4.sin_addr ) == 1 ) {
+    _address.ipv4.sin_family = AF_INET;
+    _address.ipv4.sin_port = htobe16( port );
+    _size = sizeof( sockaddr_in );
+  } else if ( inet_pton( AF_INET6, ip.c_str(), &_address.ipv6.sin6_addr ) == 1 ) {
+    _address.ipv6.sin6_family = AF_INET6;
+    _address.ipv6.sin6_port = htobe16( port );
+    _size = sizeof( sockaddr_in6 );
+  } else {
+    // other numeric forms ("0", "127.1", "fe80::1%eth0"); tell getaddrinfo that we don't want to resolve anything
+    *this = Address( ip, ::to_string( port ), make_hints( AI_NUMERICHOST | AI_NUMERICSERV, AF_UNSPEC ) );
+  }
+}
 
 // accessors
 pair<string, uint16_t> Address::ip_port() const
 {
+  // IP addresses without a scope are formatted directly, and anything else by getnameinfo
+  array<char, INET6_ADDRSTRLEN> text {};
+  if ( family() == AF_INET ) {
+    inet_ntop( AF_INET, &_address.ipv4.sin_addr, text.data(), text.size() );
+    return { text.data(), port() };
+  }
+  if ( family() == AF_INET6 and _address.ipv6.sin6_scope_id == 0 ) {
+    inet_ntop( AF_INET6, &_address.ipv6.sin6_addr, text.data(), text.size() );
+    return { text.data(), port() };
+  }
+
   array<char, NI_MAXHOST> ip {};
   array<char, NI_MAXSERV> port {};
 
-  const int gni_ret = getnameinfo( static_cast<const sockaddr*>( _address ),
+  const int gni_ret = getnameinfo( &_address.generic,
                                    _size,
                                    ip.data(),
                                    ip.size(),
@@ -121,41 +175,83 @@ pair<string, uint16_t> Address::ip_port() const
   return { ip.data(), stoi( port.data() ) };
 }
 
+uint16_t Address::port() const
+{
+  switch ( family() ) {
+    case AF_INET:
+      return be16toh( _address.ipv4.sin_port );
+    case AF_INET6:
+      return be16toh( _address.ipv6.sin6_port );
+    default:
+      return ip_port().second;
+  }
+}
+
+// IPv6 addresses are bracketed, so the port can be told apart from the address
 string Address::to_string() const
 {
   const auto ip_and_port = ip_port();
+  if ( family() == AF_INET6 ) {
+    return "[" + ip_and_port.first + "]:" + ::to_string( ip_and_port.second );
+  }
   return ip_and_port.first + ":" + ::to_string( ip_and_port.second );
 }
 
 uint32_t Address::ipv4_numeric() const
 {
-  if ( _address.storage.ss_family != AF_INET or _size != sizeof( sockaddr_in ) ) {
+  if ( family() != AF_INET or _size != sizeof( sockaddr_in ) ) {
     throw runtime_error( "ipv4_numeric called on non-IPV4 address" );
   }
 
-  sockaddr_in ipv4_addr {};
-  memcpy( &ipv4_addr, &_address.storage, _size );
-
-  return be32toh( ipv4_addr.sin_addr.s_addr );
+  return be32toh( _address.ipv4.sin_addr.s_addr );
 }
 
-Address Address::from_ipv4_numeric( const uint32_t ip_address )
+Address Address::from_ipv4_numeric( const uint32_t ip_address, const uint16_t port )
 {
   sockaddr_in ipv4_addr {};
   ipv4_addr.sin_family = AF_INET;
+  ipv4_addr.sin_port = htobe16( port );
   ipv4_addr.sin_addr.s_addr = htobe32( ip_address );
 
   return { reinterpret_cast<sockaddr*>( &ipv4_addr ), sizeof( ipv4_addr ) }; // NOLINT(*-reinterpret-cast)
 }
 
-// equality
-bool Address::operator==( const Address& other ) const
+array<uint8_t, 16> Address::ipv6_numeric() const
+{
+  if ( family() != AF_INET6 or _size != sizeof( sockaddr_in6 ) ) {
+    throw runtime_error( "ipv6_numeric called on non-IPv6 address" );
+  }
+
+  array<uint8_t, 16> bytes {};
+  memcpy( bytes.data(), &_address.ipv6.sin6_addr, bytes.size() );
+  return bytes;
+}
+
+Address Address::from_ipv6_numeric( const array<uint8_t, 16>& ip_address, const uint16_t port )
+{
+  sockaddr_in6 ipv6_addr {};
+  ipv6_addr.sin6_family = AF_INET6;
+  ipv6_addr.sin6_port = htobe16( port );
+  memcpy( &ipv6_addr.sin6_addr, ip_address.data(), ip_address.size() );
+
+  return { reinterpret_cast<sockaddr*>( &ipv6_addr ), sizeof( ipv6_addr ) }; // NOLINT(*-reinterpret-cast)
+}
+
+bool Address::is_ipv4_mapped() const
+{
+  return family() == AF_INET6 and IN6_IS_ADDR_V4MAPPED( &_address.ipv6.sin6_addr );
+}
+
+Address Address::unmapped() const
 {
-  if ( _size != other._size ) {
-    return false;
+  if ( not is_ipv4_mapped() ) {
+    return *this;
   }
 
-  return 0 == memcmp( &_address, &other._address, _size );
+  // the IPv4 address is the last four bytes of the IPv6 one
+  uint32_t ip_address {};
+  memcpy( &ip_address, &_address.ipv6.sin6_addr.s6_addr[12], sizeof( ip_address ) );
+  return from_ipv4_numeric( be32toh( ip_address ), port() );
 }
 
 // address families that correspond to each sockaddr type
@@ -175,7 +271,7 @@ constexpr int sockaddr_family<sockaddr_ll> = AF_PACKET;
 template<typename sockaddr_type>
 const sockaddr_type* Address::as() const
 {
-  const sockaddr* raw { _address };
+  const sockaddr* raw { &_address.generic };
   if ( sizeof( sockaddr_type ) < size() or raw->sa_family != sockaddr_family<sockaddr_type> ) {
     throw std::runtime_error( "Address::as() conversion failure" );
   }
@@ -1,15 +1,22 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <functional>
+#include <linux/if_packet.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <stdexcept>
 #include <string>
 #include <sys/socket.h>
 #include <utility>
+#include <vector>
 
-//! Wrapper around [IPv4 addresses](@ref man7::ip) and DNS operations.
+//! \brief Wrapper around [IPv4](@ref man7::ip) and [IPv6](@ref man7::ipv6) socket addresses, and DNS operations.
+//! \details Addresses are stored compactly (just big enough for a `sockaddr_in6`), and compare and hash
+//! by family, IP, port and IPv6 scope, so they can key hash tables.
 class Address
 {
 public:
@@ -26,40 +33,77 @@ public:
   };
 
 private:
-  socklen_t _size; //!< Size of the wrapped address.
-  Raw _address {}; //!< A wrapped [sockaddr_storage](@ref man7::socket) containing the address.
+  //! Space for the socket address types an Address can hold.
+  union Storage
+  {
+    sockaddr generic;
+    sockaddr_in ipv4;
+    sockaddr_in6 ipv6;
+    sockaddr_ll packet;
+  };
+
+  socklen_t _size;     //!< Size of the wrapped address.
+  Storage _address {}; //!< The wrapped socket address.
+
+  //! Scramble the bits of `x` (the splitmix64 finalizer), so nearby addresses and ports spread out.
+  static constexpr size_t mix( uint64_t x )
+  {
+    x = ( x ^ ( x >> 30U ) ) * 0xbf58476d1ce4e5b9ULL; // NOLINT(*-magic-numbers)
+    x = ( x ^ ( x >> 27U ) ) * 0x94d049bb133111ebULL; // NOLINT(*-magic-numbers)
+    return x ^ ( x >> 31U );                          // NOLINT(*-magic-numbers)
+  }
 
   //! Constructor from ip/host, service/port, and hints to the resolver.
   Address( const std::string& node, const std::string& service, const addrinfo& hints );
 
 public:
-  //! Construct by resolving a hostname and servicename.
+  //! \brief Construct by resolving a hostname and servicename to an IPv4 address.
+  //! \details IPv4 only, so that `TCPSocket s; s.connect( Address { host, "http" } );` works on any host;
+  //! use resolve_all() with `AF_INET6` or `AF_UNSPEC` (and a socket of the result's family) for IPv6.
   Address( const std::string& hostname, const std::string& service );
 
-  //! Construct from dotted-quad string ("18.243.0.1") and numeric port.
+  //! \brief Construct from a numeric IPv4 ("18.243.0.1") or IPv6 ("2001:db8::1") address and port.
+  //! \details Parsed without calling the resolver, except for IPv6 addresses with a scope ("fe80::1%eth0").
   explicit Address( const std::string& ip, std::uint16_t port = 0 );
 
-  //! Construct from a [sockaddr *](@ref man7::socket).
+  //! Construct from a [sockaddr *](@ref man7::socket) (IPv4, IPv6 or packet).
   Address( const sockaddr* addr, std::size_t size );
 
-  //! Equality comparison.
+  //! \brief Resolve a hostname and servicename to every matching address, in resolver order.
+  //! \param[in] family is `AF_INET`, `AF_INET6`, or `AF_UNSPEC` for both A and AAAA results
+  static std::vector<Address> resolve_all( const std::string& hostname,
+                                           const std::string& service,
+                                           int family = AF_UNSPEC );
+
+  //! Equality comparison (of family, IP, port and IPv6 scope; IPv6 flow labels are ignored).
   bool operator==( const Address& other ) const;
   bool operator!=( const Address& other ) const { return not operator==( other ); }
 
+  //! Hash consistent with operator==.
+  size_t hash() const;
+
   //! \name Conversions
   //!@{
 
-  //! Dotted-quad IP address string ("18.243.0.1") and numeric port.
+  //! IP address string ("18.243.0.1" or "2001:db8::1") and numeric port.
   std::pair<std::string, uint16_t> ip_port() const;
-  //! Dotted-quad IP address string ("18.243.0.1").
+  //! IP address string ("18.243.0.1" or "2001:db8::1").
   std::string ip() const { return ip_port().first; }
   //! Numeric port (host byte order).
-  uint16_t port() const { return ip_port().second; }
+  uint16_t port() const;
   //! Numeric IP address as an integer (i.e., in [host byte order](\ref man3::byteorder)).
   uint32_t ipv4_numeric() const;
   //! Create an Address from a 32-bit raw numeric IP address
-  static Address from_ipv4_numeric( uint32_t ip_address );
-  //! Human-readable string, e.g., "8.8.8.8:53".
+  static Address from_ipv4_numeric( uint32_t ip_address, uint16_t port = 0 );
+  //! The 16 bytes of an IPv6 address (in network order).
+  std::array<uint8_t, 16> ipv6_numeric() const;
+  //! Create an Address from the 16 bytes of an IPv6 address (in network order)
+  static Address from_ipv6_numeric( const std::array<uint8_t, 16>& ip_address, uint16_t port = 0 );
+  //! Whether this is an IPv4 address carried in IPv6, as reported by a dual-stack socket ("::ffff:1.2.3.4").
+  bool is_ipv4_mapped() const;
+  //! The IPv4 address inside an IPv4-mapped IPv6 address (or this Address, if it isn't one).
+  Address unmapped() const;
+  //! Human-readable string, e.g., "8.8.8.8:53" or "[2001:db8::1]:53".
   std::string to_string() const;
   //!@}
 
@@ -68,11 +112,61 @@ public:
 
   //! Size of the underlying address storage.
   socklen_t size() const { return _size; }
+  //! Address family (`AF_INET`, `AF_INET6`, ...).
+  int family() const { return _address.generic.sa_family; }
   //! Const pointer to the underlying socket address storage.
-  operator const sockaddr*() const { return static_cast<const sockaddr*>( _address ); } // NOLINT(*-explicit-*)
+  operator const sockaddr*() const { return &_address.generic; } // NOLINT(*-explicit-*)
   //! Safely convert to underlying sockaddr type
   template<typename sockaddr_type>
   const sockaddr_type* as() const;
 
   //!@}
 };
+
+// equality and hashing are inline, for use as hash-table keys
+inline bool Address::operator==( const Address& other ) const
+{
+  if ( family() != other.family() ) {
+    return false;
+  }
+
+  switch ( family() ) {
+    case AF_INET:
+      return _address.ipv4.sin_port == other._address.ipv4.sin_port
+             and _address.ipv4.sin_addr.s_addr == other._address.ipv4.sin_addr.s_addr;
+    case AF_INET6:
+      return _address.ipv6.sin6_port == other._address.ipv6.sin6_port
+             and _address.ipv6.sin6_scope_id == other._address.ipv6.sin6_scope_id
+             and 0 == memcmp( &_address.ipv6.sin6_addr, &other._address.ipv6.sin6_addr, sizeof( in6_addr ) );
+    default:
+      return _size == other._size and 0 == memcmp( &_address, &other._address, _size );
+  }
+}
+
+inline size_t Address::hash() const
+{
+  switch ( family() ) {
+    case AF_INET:
+      return mix( uint64_t { _address.ipv4.sin_addr.s_addr } << 16U | _address.ipv4.sin_port );
+    case AF_INET6: {
+      std::array<uint64_t, 2> halves {};
+      memcpy( halves.data(), &_address.ipv6.sin6_addr, sizeof( halves ) );
+      const uint64_t port_and_scope = uint64_t { _address.ipv6.sin6_scope_id } << 16U | _address.ipv6.sin6_port;
+      return mix( halves[0] ^ mix( halves[1] ^ mix( port_and_scope ) ) );
+    }
+    default: {
+      const auto* bytes = reinterpret_cast<const uint8_t*>( &_address ); // NOLINT(*-reinterpret-cast)
+      uint64_t h = _size;
+      for ( socklen_t i = 0; i < _size; ++i ) {
+        h = h * 31 + bytes[i]; // NOLINT(*-magic-numbers, *-pointer-arithmetic)
+      }
+      return mix( h );
+    }
+  }
+}
+
+template<>
+struct std::hash<Address>
+{
+  size_t operator()( const Address& address ) const { return address.hash(); }
+};
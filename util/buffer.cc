@@ -0,0 +1,89 @@
+#include "buffer.hh"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+OwnedBuffer::OwnedBuffer( size_t capacity )
+  : data_( new char[capacity] ), capacity_( capacity ) // NOLINT(*-owning-memory)
+{}
+
+OwnedBuffer::OwnedBuffer( OwnedBuffer&& other ) noexcept
+  : data_( exchange( other.data_, nullptr ) )
+  , capacity_( exchange( other.capacity_, 0 ) )
+  , size_( exchange( other.size_, 0 ) )
+  , pool_( exchange( other.pool_, nullptr ) )
+{}
+
+OwnedBuffer& OwnedBuffer::operator=( OwnedBuffer&& other ) noexcept
+{
+  if ( this != &other ) {
+    reset();
+    data_ = exchange( other.data_, nullptr );
+    capacity_ = exchange( other.capacity_, 0 );
+    size_ = exchange( other.size_, 0 );
+    pool_ = exchange( other.pool_, nullptr );
+  }
+  return *this;
+}
+
+void OwnedBuffer::reset()
+{
+  if ( data_ == nullptr ) {
+    return;
+  }
+
+  if ( pool_ ) {
+    pool_->release( data_ );
+  } else {
+    delete[] data_; // NOLINT(*-owning-memory)
+  }
+
+  data_ = nullptr;
+  capacity_ = size_ = 0;
+  pool_ = nullptr;
+}
+
+void OwnedBuffer::resize( size_t size )
+{
+  if ( size > capacity_ ) {
+    throw runtime_error( "OwnedBuffer::resize() beyond capacity" );
+  }
+  size_ = size;
+}
+
+void OwnedBuffer::assign( string_view str )
+{
+  resize( str.size() );
+  memcpy( data_, str.data(), str.size() );
+}
+
+BufferPool::BufferPool( size_t slab_size, size_t slabs_per_block )
+  : slab_size_( slab_size ), slabs_per_block_( slabs_per_block )
+{
+  if ( slab_size == 0 or slabs_per_block == 0 ) {
+    throw runtime_error( "BufferPool: slab size and slabs per block must be positive" );
+  }
+}
+
+void BufferPool::grow()
+{
+  auto& block = blocks_.emplace_back( make_unique_for_overwrite<char[]>( slab_size_ * slabs_per_block_ ) );
+  free_.reserve( allocated() );
+  for ( size_t i = 0; i < slabs_per_block_; ++i ) {
+    free_.push_back( block.get() + i * slab_size_ );
+  }
+}
+
+OwnedBuffer BufferPool::acquire()
+{
+  if ( free_.empty() ) {
+    grow();
+  }
+
+  char* const slab = free_.back();
+  free_.pop_back();
+  return { slab, slab_size_, this };
+}
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <vector>
 
 class Buffer
 {
@@ -21,3 +25,88 @@ public:
   size_t length() const { return buffer_->length(); }
   bool empty() const { return buffer_->empty(); }
 };
+
+class BufferPool;
+
+// A move-only byte buffer with a fixed capacity and no reference count
+// Its storage is either its own heap allocation or a slab borrowed from a BufferPool,
+// and growing it within its capacity never zero-fills.
+class OwnedBuffer
+{
+  char* data_ {};          // start of the storage (nullptr if empty-constructed or moved-from)
+  size_t capacity_ {};     // bytes of storage
+  size_t size_ {};         // bytes in use
+  BufferPool* pool_ {};    // pool to return the slab to, or nullptr if data_ came from new[]
+
+  friend class BufferPool;
+  OwnedBuffer( char* data, size_t capacity, BufferPool* pool ) : data_( data ), capacity_( capacity ), pool_( pool )
+  {}
+
+  void reset();
+
+public:
+  OwnedBuffer() = default;
+
+  // Allocate unpooled storage of `capacity` bytes
+  explicit OwnedBuffer( size_t capacity );
+
+  ~OwnedBuffer() { reset(); }
+
+  OwnedBuffer( OwnedBuffer&& other ) noexcept;
+  OwnedBuffer& operator=( OwnedBuffer&& other ) noexcept;
+  OwnedBuffer( const OwnedBuffer& other ) = delete;
+  OwnedBuffer& operator=( const OwnedBuffer& other ) = delete;
+
+  operator std::string_view() const { return { data_, size_ }; } // NOLINT(*-explicit-*)
+
+  // The full capacity, e.g. as the destination of a read; follow with resize()
+  std::span<char> storage() { return { data_, capacity_ }; }
+
+  char* data() { return data_; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+
+  // Set the number of bytes in use (must not exceed capacity)
+  void resize( size_t size );
+  void clear() { size_ = 0; }
+
+  // Copy `str` in (must fit in capacity)
+  void assign( std::string_view str );
+};
+
+// A free list of fixed-size slabs that OwnedBuffers borrow and give back on destruction
+// Slabs are carved out of larger blocks, so steady-state acquire/release never touches malloc.
+// The pool must outlive every buffer acquired from it, and is used from one thread at a time.
+class BufferPool
+{
+  size_t slab_size_;
+  size_t slabs_per_block_;
+  std::vector<std::unique_ptr<char[]>> blocks_ {}; // NOLINT(*-avoid-c-arrays)
+  std::vector<char*> free_ {};
+
+  friend class OwnedBuffer;
+  void release( char* slab ) { free_.push_back( slab ); }
+
+  // allocate one more block of slabs
+  void grow();
+
+public:
+  static constexpr size_t kDefaultSlabSize = 16384;
+
+  explicit BufferPool( size_t slab_size = kDefaultSlabSize, size_t slabs_per_block = 64 );
+
+  // Borrow an empty buffer with capacity slab_size()
+  OwnedBuffer acquire();
+
+  size_t slab_size() const { return slab_size_; }
+  size_t available() const { return free_.size(); }                         // slabs ready to hand out
+  size_t allocated() const { return blocks_.size() * slabs_per_block_; }     // slabs ever allocated
+
+  BufferPool( const BufferPool& other ) = delete;
+  BufferPool& operator=( const BufferPool& other ) = delete;
+  BufferPool( BufferPool&& other ) = delete;
+  BufferPool& operator=( BufferPool&& other ) = delete;
+  ~BufferPool() = default;
+};
@@ -0,0 +1,217 @@
+#include "checksum.hh"
+
+#include <cstring>
+#include <endian.h>
+
+#if defined( __x86_64__ )
+#include <immintrin.h>
+#elif defined( __aarch64__ )
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// fold a sum of 16-bit words to 16 bits, adding the carries back in (end-around carry)
+uint16_t fold( uint64_t sum )
+{
+  sum = ( sum & 0xffffffffU ) + ( sum >> 32U ); // NOLINT(*-magic-numbers)
+  sum = ( sum & 0xffffU ) + ( sum >> 16U );     // NOLINT(*-magic-numbers)
+  sum = ( sum & 0xffffU ) + ( sum >> 16U );     // NOLINT(*-magic-numbers)
+  sum = ( sum & 0xffffU ) + ( sum >> 16U );     // NOLINT(*-magic-numbers)
+  return static_cast<uint16_t>( sum );
+}
+
+// the sum of the last few bytes, a final odd byte standing for the first byte of a word padded with zero
+uint64_t sum_tail( const string_view data )
+{
+  uint64_t sum = 0;
+  size_t i = 0;
+  for ( ; i + 2 <= data.size(); i += 2 ) {
+    uint16_t word {};
+    memcpy( &word, data.data() + i, sizeof( word ) );
+    sum += word;
+  }
+  if ( i < data.size() ) {
+    uint16_t word {};
+    memcpy( &word, data.data() + i, 1 );
+    sum += word;
+  }
+  return sum;
+}
+
+// sums of native-order words from the kernels must become sums of network-order words; the one's-complement
+// sum commutes with swapping bytes (RFC 1071), so swap the folded result
+uint16_t to_host( const uint16_t native_sum )
+{
+  return be16toh( native_sum );
+}
+
+uint16_t (*select_kernel())( string_view )
+{
+#if defined( __x86_64__ )
+  if ( checksum_detail::has_avx2() ) {
+    return checksum_detail::native_sum_avx2;
+  }
+#elif defined( __aarch64__ )
+  return checksum_detail::native_sum_neon;
+#endif
+  return checksum_detail::native_sum_scalar;
+}
+
+// chosen once, on first use
+uint16_t native_sum( const string_view data )
+{
+  static const auto kernel = select_kernel();
+  return kernel( data );
+}
+
+} // namespace
+
+namespace checksum_detail {
+
+uint16_t native_sum_scalar( const string_view data )
+{
+  // add 32-bit halves of 64-bit words, so the 64-bit sum can't overflow for any buffer that fits in memory
+  uint64_t sum = 0;
+  size_t i = 0;
+  for ( ; i + 8 <= data.size(); i += 8 ) {
+    uint64_t word {};
+    memcpy( &word, data.data() + i, sizeof( word ) );
+    sum += ( word & 0xffffffffU ) + ( word >> 32U ); // NOLINT(*-magic-numbers)
+  }
+  return fold( sum + sum_tail( data.substr( i ) ) );
+}
+
+#if defined( __x86_64__ )
+
+bool has_avx2()
+{
+  return __builtin_cpu_supports( "avx2" );
+}
+
+__attribute__( ( target( "avx2" ) ) ) uint16_t native_sum_avx2( const string_view data )
+{
+  // each step adds two 16-bit words to every 32-bit lane, so after 16384 steps a lane is still below 2^31
+  constexpr size_t kStepsPerBlock = 16384;
+  constexpr size_t kStep = 64; // two 32-byte loads
+
+  const __m256i low_words = _mm256_set1_epi32( 0xffff ); // NOLINT(*-magic-numbers)
+  __m256i total = _mm256_setzero_si256();                // 64-bit lanes
+  size_t i = 0;
+
+  while ( i + kStep <= data.size() ) {
+    __m256i low = _mm256_setzero_si256();
+    __m256i high = _mm256_setzero_si256();
+    for ( size_t steps = 0; steps < kStepsPerBlock and i + kStep <= data.size(); ++steps, i += kStep ) {
+      const char* const p = data.data() + i;
+      const __m256i a = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );      // NOLINT
+      const __m256i b = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p + 32 ) ); // NOLINT
+      low = _mm256_add_epi32( low, _mm256_and_si256( a, low_words ) );
+      high = _mm256_add_epi32( high, _mm256_srli_epi32( a, 16 ) );
+      low = _mm256_add_epi32( low, _mm256_and_si256( b, low_words ) );
+      high = _mm256_add_epi32( high, _mm256_srli_epi32( b, 16 ) );
+    }
+
+    // the two sums are each below 2^31 per lane, so adding them can't overflow 32 bits
+    const __m256i block = _mm256_add_epi32( low, high );
+    total = _mm256_add_epi64( total, _mm256_cvtepu32_epi64( _mm256_castsi256_si128( block ) ) );
+    total = _mm256_add_epi64( total, _mm256_cvtepu32_epi64( _mm256_extracti128_si256( block, 1 ) ) );
+  }
+
+  alignas( 32 ) array<uint64_t, 4> lanes {};
+  _mm256_store_si256( reinterpret_cast<__m256i*>( lanes.data() ), total ); // NOLINT(*-reinterpret-cast)
+  const uint64_t sum = fold( lanes[0] ) + fold( lanes[1] ) + fold( lanes[2] ) + fold( lanes[3] );
+
+  return fold( sum + native_sum_scalar( data.substr( i ) ) );
+}
+
+#elif defined( __aarch64__ )
+
+uint16_t native_sum_neon( const string_view data )
+{
+  // each step adds four 16-bit words to every 32-bit lane, so 16384 steps can't overflow one
+  constexpr size_t kStepsPerBlock = 16384;
+  constexpr size_t kStep = 32; // two 16-byte loads
+
+  uint64x2_t total = vdupq_n_u64( 0 );
+  size_t i = 0;
+
+  while ( i + kStep <= data.size() ) {
+    uint32x4_t block = vdupq_n_u32( 0 );
+    for ( size_t steps = 0; steps < kStepsPerBlock and i + kStep <= data.size(); ++steps, i += kStep ) {
+      const auto* const p = reinterpret_cast<const uint16_t*>( data.data() + i ); // NOLINT(*-reinterpret-cast)
+      block = vpadalq_u16( block, vld1q_u16( p ) );
+      block = vpadalq_u16( block, vld1q_u16( p + 8 ) ); // NOLINT(*-pointer-arithmetic)
+    }
+    total = vpadalq_u32( total, block );
+  }
+
+  const uint64_t sum = fold( vgetq_lane_u64( total, 0 ) ) + fold( vgetq_lane_u64( total, 1 ) );
+  return fold( sum + native_sum_scalar( data.substr( i ) ) );
+}
+
+#endif
+
+} // namespace checksum_detail
+
+//! \param[in] data is the bytes to add
+//! \param[in] sum is the partial sum so far (0 to start)
+uint32_t checksum_add( const string_view data, const uint32_t sum )
+{
+  return fold( uint64_t { sum } + to_host( native_sum( data ) ) );
+}
+
+uint16_t checksum_finish( const uint32_t sum )
+{
+  return static_cast<uint16_t>( ~fold( sum ) );
+}
+
+//! \param[in] source is the source IPv4 address
+//! \param[in] destination is the destination IPv4 address
+//! \param[in] protocol is the IP protocol (e.g. `IPPROTO_TCP`)
+//! \param[in] length is the length of the TCP or UDP header and payload
+uint32_t ipv4_pseudo_header_sum( const uint32_t source,
+                                 const uint32_t destination,
+                                 const uint8_t protocol,
+                                 const uint16_t length )
+{
+  const uint64_t addresses = uint64_t { source >> 16U } + ( source & 0xffffU ) // NOLINT(*-magic-numbers)
+                             + ( destination >> 16U ) + ( destination & 0xffffU ); // NOLINT(*-magic-numbers)
+  return fold( addresses + protocol + length );
+}
+
+//! \param[in] source is the source IPv6 address (in network byte order)
+//! \param[in] destination is the destination IPv6 address (in network byte order)
+//! \param[in] next_header is the upper-layer protocol (e.g. `IPPROTO_TCP`)
+//! \param[in] length is the length of the TCP or UDP header and payload
+uint32_t ipv6_pseudo_header_sum( const array<uint8_t, 16>& source,
+                                 const array<uint8_t, 16>& destination,
+                                 const uint8_t next_header,
+                                 const uint32_t length )
+{
+  const string_view source_bytes { reinterpret_cast<const char*>( source.data() ), source.size() }; // NOLINT
+  const string_view destination_bytes { reinterpret_cast<const char*>( destination.data() ), // NOLINT
+                                        destination.size() };
+  const uint64_t sum = checksum_add( source_bytes, checksum_add( destination_bytes ) );
+  return fold( sum + ( length >> 16U ) + ( length & 0xffffU ) + next_header ); // NOLINT(*-magic-numbers)
+}
+
+//! \param[in] checksum is the checksum covering the field
+//! \param[in] old_value is the field's old contents
+//! \param[in] new_value is the field's new contents
+//! \details Uses HC' = ~(~HC + ~m + m') (RFC 1624, equation 3), which unlike the earlier RFC 1141 formula
+//! gives the same result as summing again.
+uint16_t checksum_update16( const uint16_t checksum, const uint16_t old_value, const uint16_t new_value )
+{
+  const uint64_t sum = uint64_t { static_cast<uint16_t>( ~checksum ) } + static_cast<uint16_t>( ~old_value )
+                       + new_value;
+  return static_cast<uint16_t>( ~fold( sum ) );
+}
+
+uint16_t checksum_update32( const uint16_t checksum, const uint32_t old_value, const uint32_t new_value )
+{
+  const uint16_t updated = checksum_update16( checksum, old_value >> 16U, new_value >> 16U ); // NOLINT
+  return checksum_update16( updated, old_value & 0xffffU, new_value & 0xffffU );             // NOLINT
+}
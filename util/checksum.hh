@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+//! \file
+//! \brief The [Internet checksum](https://www.rfc-editor.org/rfc/rfc1071) of IPv4, TCP and UDP
+//! \details Sums are computed with AVX2 on x86-64 CPUs that have it (chosen at run time) and NEON on
+//! AArch64, 32 or more bytes at a time, and otherwise eight bytes at a time. Every value here is a
+//! number in host byte order, e.g. the checksum field as read by a header view; write one to a packet
+//! in network byte order.
+
+//! \brief Add the 16-bit words of `data` (in network byte order) to the one's-complement `sum`
+//! \details To sum a packet in pieces, every piece except the last must have an even length.
+//! \returns the new partial sum, which checksum_finish() turns into a checksum
+uint32_t checksum_add( std::string_view data, uint32_t sum = 0 );
+
+//! The checksum for a partial sum: its one's-complement, folded to 16 bits
+uint16_t checksum_finish( uint32_t sum );
+
+//! \brief The checksum of `data`, continuing from a partial `sum` (e.g. of a pseudo-header)
+//! \details Checking a received header or segment, checksum field included, gives 0 if it is intact.
+inline uint16_t internet_checksum( std::string_view data, uint32_t sum = 0 )
+{
+  return checksum_finish( checksum_add( data, sum ) );
+}
+
+//! The partial sum of the IPv4 pseudo-header that TCP and UDP checksums cover
+uint32_t ipv4_pseudo_header_sum( uint32_t source, uint32_t destination, uint8_t protocol, uint16_t length );
+
+//! The partial sum of the IPv6 pseudo-header that TCP and UDP checksums cover
+uint32_t ipv6_pseudo_header_sum( const std::array<uint8_t, 16>& source,
+                                 const std::array<uint8_t, 16>& destination,
+                                 uint8_t next_header,
+                                 uint32_t length );
+
+//! \brief `checksum` after a 16-bit field it covers changes from `old_value` to `new_value`
+//! \details As in [RFC 1624](https://www.rfc-editor.org/rfc/rfc1624), e.g. to decrement a TTL or rewrite
+//! a port without summing the whole packet again.
+uint16_t checksum_update16( uint16_t checksum, uint16_t old_value, uint16_t new_value );
+
+//! `checksum` after a 32-bit field it covers (e.g. an IPv4 address) changes from `old_value` to `new_value`
+uint16_t checksum_update32( uint16_t checksum, uint32_t old_value, uint32_t new_value );
+
+namespace checksum_detail {
+
+//! \name Kernels, for tests and benchmarks
+//! The one's-complement sum of `data`'s 16-bit words in native byte order, folded to 16 bits.
+//!@{
+uint16_t native_sum_scalar( std::string_view data );
+#if defined( __x86_64__ )
+uint16_t native_sum_avx2( std::string_view data ); //!< Only on CPUs where has_avx2()
+#elif defined( __aarch64__ )
+uint16_t native_sum_neon( std::string_view data );
+#endif
+//!@}
+
+#if defined( __x86_64__ )
+//! Whether this CPU can run native_sum_avx2()
+bool has_avx2();
+#endif
+
+} // namespace checksum_detail
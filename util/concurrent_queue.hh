@@ -0,0 +1,239 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Bounded lock-free queues for handing objects (e.g. Buffers or OwnedBuffers) between threads.
+//
+// Only the objects move between threads: FileDescriptor and the types built on it are not thread-safe,
+// so each one should stay with a single thread.
+
+// Size of the unit of cache coherence; indices written by different threads are kept this far apart so
+// that they don't share a line. (std::hardware_destructive_interference_size is avoided because its
+// value is allowed to vary between compiler flags, which would break the ABI of this header.)
+inline constexpr size_t kCacheLineSize = 64;
+
+namespace concurrent_queue_detail {
+
+// Uninitialized storage for one element
+template<typename T>
+struct Slot
+{
+  alignas( T ) std::byte storage[sizeof( T )]; // NOLINT(*-avoid-c-arrays)
+
+  T* get() { return std::launder( reinterpret_cast<T*>( storage ) ); } // NOLINT(*-reinterpret-cast)
+
+  template<typename... Args>
+  void construct( Args&&... args )
+  {
+    ::new ( static_cast<void*>( storage ) ) T( std::forward<Args>( args )... );
+  }
+
+  // move the element out, leaving the slot uninitialized
+  T take()
+  {
+    T value { std::move( *get() ) };
+    get()->~T();
+    return value;
+  }
+};
+
+inline size_t round_capacity( size_t capacity )
+{
+  if ( capacity == 0 ) {
+    throw std::invalid_argument( "queue capacity must be positive" );
+  }
+  return std::bit_ceil( capacity );
+}
+
+} // namespace concurrent_queue_detail
+
+// A wait-free ring for exactly one producer thread and one consumer thread
+//
+// The producer owns tail_ and the consumer owns head_; each also keeps a cached copy of the other's index
+// and only rereads the shared one when the cached copy says the ring is full (or empty), so in the common
+// case neither thread touches a cache line the other is writing.
+template<typename T>
+class SPSCQueue
+{
+  using Slot = concurrent_queue_detail::Slot<T>;
+
+  size_t mask_;
+  std::unique_ptr<Slot[]> slots_; // NOLINT(*-avoid-c-arrays)
+
+  alignas( kCacheLineSize ) std::atomic<size_t> head_ { 0 }; // next slot to pop (written by the consumer)
+  size_t cached_tail_ { 0 };                                 // consumer's last view of tail_
+
+  alignas( kCacheLineSize ) std::atomic<size_t> tail_ { 0 }; // next slot to fill (written by the producer)
+  size_t cached_head_ { 0 };                                 // producer's last view of head_
+
+public:
+  // capacity is rounded up to a power of two
+  explicit SPSCQueue( size_t capacity )
+    : mask_( concurrent_queue_detail::round_capacity( capacity ) - 1 )
+    , slots_( std::make_unique<Slot[]>( mask_ + 1 ) ) // NOLINT(*-avoid-c-arrays)
+  {}
+
+  ~SPSCQueue()
+  {
+    for ( size_t i = head_.load( std::memory_order_relaxed ); i != tail_.load( std::memory_order_relaxed ); ++i ) {
+      slots_[i & mask_].get()->~T();
+    }
+  }
+
+  // Producer: construct an element in place unless the queue is full
+  template<typename... Args>
+  bool try_emplace( Args&&... args )
+  {
+    const size_t tail = tail_.load( std::memory_order_relaxed );
+    if ( tail - cached_head_ > mask_ ) {
+      cached_head_ = head_.load( std::memory_order_acquire );
+      if ( tail - cached_head_ > mask_ ) {
+        return false;
+      }
+    }
+    slots_[tail & mask_].construct( std::forward<Args>( args )... );
+    tail_.store( tail + 1, std::memory_order_release );
+    return true;
+  }
+
+  // Producer: push `value` unless the queue is full (in which case `value` is left untouched)
+  bool try_push( T&& value ) { return try_emplace( std::move( value ) ); }
+  bool try_push( const T& value ) { return try_emplace( value ); }
+
+  // Consumer: move the oldest element into `value` unless the queue is empty
+  bool try_pop( T& value )
+  {
+    const size_t head = head_.load( std::memory_order_relaxed );
+    if ( head == cached_tail_ ) {
+      cached_tail_ = tail_.load( std::memory_order_acquire );
+      if ( head == cached_tail_ ) {
+        return false;
+      }
+    }
+    value = slots_[head & mask_].take();
+    head_.store( head + 1, std::memory_order_release );
+    return true;
+  }
+
+  // Number of elements, exact only when neither thread is active
+  size_t size_approx() const
+  {
+    return tail_.load( std::memory_order_acquire ) - head_.load( std::memory_order_acquire );
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  SPSCQueue( const SPSCQueue& other ) = delete;
+  SPSCQueue& operator=( const SPSCQueue& other ) = delete;
+  SPSCQueue( SPSCQueue&& other ) = delete;
+  SPSCQueue& operator=( SPSCQueue&& other ) = delete;
+};
+
+// A bounded queue for any number of producer and consumer threads (Dmitry Vyukov's design)
+//
+// Each cell carries a sequence number that says whose turn it is: a producer may fill a cell when its
+// sequence equals the ticket it claimed from tail_, and a consumer may empty it when the sequence is one
+// past its ticket from head_. Tickets are claimed with a compare-and-swap, so threads contend only on
+// the index they advance, and never wait for one another while holding a cell.
+template<typename T>
+class MPMCQueue
+{
+  struct alignas( kCacheLineSize ) Cell
+  {
+    std::atomic<size_t> sequence { 0 };
+    concurrent_queue_detail::Slot<T> slot {};
+  };
+
+  size_t mask_;
+  std::unique_ptr<Cell[]> cells_; // NOLINT(*-avoid-c-arrays)
+
+  alignas( kCacheLineSize ) std::atomic<size_t> tail_ { 0 }; // next ticket for producers
+  alignas( kCacheLineSize ) std::atomic<size_t> head_ { 0 }; // next ticket for consumers
+
+public:
+  // capacity is rounded up to a power of two, and to at least 2
+  explicit MPMCQueue( size_t capacity )
+    : mask_( std::max<size_t>( concurrent_queue_detail::round_capacity( capacity ), 2 ) - 1 )
+    , cells_( std::make_unique<Cell[]>( mask_ + 1 ) ) // NOLINT(*-avoid-c-arrays)
+  {
+    for ( size_t i = 0; i <= mask_; ++i ) {
+      cells_[i].sequence.store( i, std::memory_order_relaxed );
+    }
+  }
+
+  ~MPMCQueue()
+  {
+    for ( size_t i = head_.load( std::memory_order_relaxed ); i != tail_.load( std::memory_order_relaxed ); ++i ) {
+      cells_[i & mask_].slot.get()->~T();
+    }
+  }
+
+  // Construct an element in place unless the queue is full
+  template<typename... Args>
+  bool try_emplace( Args&&... args )
+  {
+    size_t ticket = tail_.load( std::memory_order_relaxed );
+    while ( true ) {
+      Cell& cell = cells_[ticket & mask_];
+      const size_t sequence = cell.sequence.load( std::memory_order_acquire );
+      const auto lag = static_cast<std::ptrdiff_t>( sequence - ticket );
+      if ( lag == 0 ) {
+        if ( tail_.compare_exchange_weak( ticket, ticket + 1, std::memory_order_relaxed ) ) {
+          cell.slot.construct( std::forward<Args>( args )... );
+          cell.sequence.store( ticket + 1, std::memory_order_release );
+          return true;
+        }
+      } else if ( lag < 0 ) {
+        return false; // the cell still holds the element from one lap ago
+      } else {
+        ticket = tail_.load( std::memory_order_relaxed ); // another producer got there first
+      }
+    }
+  }
+
+  bool try_push( T&& value ) { return try_emplace( std::move( value ) ); }
+  bool try_push( const T& value ) { return try_emplace( value ); }
+
+  // Move the oldest available element into `value` unless the queue is empty
+  bool try_pop( T& value )
+  {
+    size_t ticket = head_.load( std::memory_order_relaxed );
+    while ( true ) {
+      Cell& cell = cells_[ticket & mask_];
+      const size_t sequence = cell.sequence.load( std::memory_order_acquire );
+      const auto lag = static_cast<std::ptrdiff_t>( sequence - ( ticket + 1 ) );
+      if ( lag == 0 ) {
+        if ( head_.compare_exchange_weak( ticket, ticket + 1, std::memory_order_relaxed ) ) {
+          value = cell.slot.take();
+          cell.sequence.store( ticket + mask_ + 1, std::memory_order_release );
+          return true;
+        }
+      } else if ( lag < 0 ) {
+        return false; // nothing has been pushed into this cell yet
+      } else {
+        ticket = head_.load( std::memory_order_relaxed ); // another consumer got there first
+      }
+    }
+  }
+
+  // Number of elements, exact only when no thread is active
+  size_t size_approx() const
+  {
+    return tail_.load( std::memory_order_acquire ) - head_.load( std::memory_order_acquire );
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  MPMCQueue( const MPMCQueue& other ) = delete;
+  MPMCQueue& operator=( const MPMCQueue& other ) = delete;
+  MPMCQueue( MPMCQueue&& other ) = delete;
+  MPMCQueue& operator=( MPMCQueue&& other ) = delete;
+};
@@ -0,0 +1,277 @@
+#include "coroutine.hh"
+
+#include <algorithm>
+#include <array>
+#include <new>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+// as many buffers as FileDescriptor::write() gathers into one writev
+constexpr size_t kMaxWriteBuffers = 64;
+
+constexpr size_t kSizeClass = 64;
+constexpr size_t kSizeClasses = 64; // frames up to 4 KiB are pooled
+
+// Per-thread free lists of coroutine frames, linked through the frames themselves
+class FramePool
+{
+  struct FreeFrame
+  {
+    FreeFrame* next;
+  };
+
+  array<FreeFrame*, kSizeClasses> free_ {};
+
+public:
+  static size_t size_class( const size_t size ) { return ( size + kSizeClass - 1 ) / kSizeClass - 1; }
+
+  void* allocate( const size_t size )
+  {
+    const size_t index = size_class( size );
+    if ( index >= kSizeClasses ) {
+      return ::operator new( size );
+    }
+    if ( FreeFrame* frame = free_[index] ) {
+      free_[index] = frame->next;
+      return frame;
+    }
+    return ::operator new( ( index + 1 ) * kSizeClass );
+  }
+
+  void deallocate( void* frame, const size_t size ) noexcept
+  {
+    const size_t index = size_class( size );
+    if ( index >= kSizeClasses ) {
+      ::operator delete( frame );
+      return;
+    }
+    free_[index] = ::new ( frame ) FreeFrame { free_[index] };
+  }
+
+  FramePool() = default;
+  FramePool( const FramePool& other ) = delete;
+  FramePool& operator=( const FramePool& other ) = delete;
+  FramePool( FramePool&& other ) = delete;
+  FramePool& operator=( FramePool&& other ) = delete;
+
+  ~FramePool()
+  {
+    for ( FreeFrame* head : free_ ) {
+      while ( head ) {
+        ::operator delete( exchange( head, head->next ) );
+      }
+    }
+  }
+};
+
+thread_local FramePool frame_pool;
+} // namespace
+
+namespace coroutine_detail {
+
+void* allocate_frame( const size_t size )
+{
+  return frame_pool.allocate( size );
+}
+
+void deallocate_frame( void* frame, const size_t size ) noexcept
+{
+  frame_pool.deallocate( frame, size );
+}
+
+void finish_spawned( AsyncIO& io, exception_ptr error ) noexcept
+{
+  --io.running_;
+  if ( error and not io.error_ ) {
+    io.error_ = move( error );
+  }
+}
+
+} // namespace coroutine_detail
+
+AsyncIO::AsyncIO( EventLoop& loop ) : loop_( loop ), category_( loop.add_category( "coroutines" ) ) {}
+
+void AsyncIO::spawn( Task<void>&& task )
+{
+  const auto handle = exchange( task.handle_, {} );
+  handle.promise().spawned_by = this;
+  ++running_;
+  handle.resume();
+}
+
+void AsyncIO::run()
+{
+  while ( running_ > 0 and loop_.wait_next_event( -1 ) != EventLoop::Result::Exit ) {}
+
+  if ( error_ ) {
+    rethrow_exception( exchange( error_, {} ) );
+  }
+  if ( running_ > 0 ) {
+    throw runtime_error( "AsyncIO: the loop stopped with coroutines still waiting" );
+  }
+}
+
+void AsyncIO::SleepAwaiter::await_suspend( const coroutine_handle<> handle )
+{
+  io.loop_.add_timer( io.category_, delay, [handle] { handle.resume(); } );
+}
+
+AsyncFD::AsyncFD( AsyncIO& io, FileDescriptor&& fd )
+  : io_( &io ), fd_( move( fd ) ), state_( make_unique<State>() )
+{
+  if ( fd_.blocking() ) {
+    fd_.set_blocking( false );
+  }
+}
+
+AsyncFD::~AsyncFD()
+{
+  if ( state_ ) {
+    for ( Watcher* watcher : { &state_->in, &state_->out } ) {
+      if ( watcher->rule ) {
+        watcher->rule->cancel();
+      }
+    }
+  }
+}
+
+void AsyncFD::wait( const EventLoop::Direction direction, Operation& operation )
+{
+  Watcher& watcher = this->watcher( direction );
+  if ( watcher.waiting ) {
+    throw runtime_error( "AsyncFD: another coroutine is already waiting in this direction" );
+  }
+  watcher.waiting = &operation;
+
+  if ( watcher.rule ) {
+    return;
+  }
+
+  // the rule stays for the life of the descriptor: with edge triggering, it costs nothing while unwanted
+  Watcher* const w = &watcher;
+  AsyncIO* const io = io_;
+  watcher.rule = io_->loop().add_rule(
+    io_->category(),
+    fd_,
+    direction,
+    [w] {
+      if ( w->waiting and w->waiting->attempt() ) {
+        exchange( w->waiting, nullptr )->handle.resume();
+      }
+    },
+    [w] { return w->waiting != nullptr; },
+    [w, io] {
+      w->closed = true;
+      if ( Operation* const waiting = exchange( w->waiting, nullptr ) ) {
+        if ( waiting->fd_closed() or not waiting->attempt() ) {
+          waiting->abort();
+        }
+        // resume from a timer, so that the coroutine never runs inside the loop's own bookkeeping
+        io->loop().add_timer( io->category(), chrono::milliseconds { 0 }, [handle = waiting->handle] {
+          handle.resume();
+        } );
+      }
+    },
+    EventLoop::Trigger::Edge );
+}
+
+bool AsyncFD::ReadAwaiter::attempt()
+{
+  result = fd.fd_.try_read( buffer );
+  return not result.would_block();
+}
+
+bool AsyncFD::WriteAwaiter::attempt()
+{
+  while ( index < buffers.size() ) {
+    // the unwritten part of the current buffer, and as many of the rest as one writev takes
+    array<string_view, kMaxWriteBuffers> pending {};
+    const size_t count = min( buffers.size() - index, pending.size() );
+    ranges::copy( buffers.subspan( index, count ), pending.begin() );
+    pending[0].remove_prefix( offset );
+
+    const IOResult result = fd.fd_.try_write( span { pending }.first( count ) );
+    if ( result.would_block() ) {
+      return false;
+    }
+    if ( not result ) {
+      error = result.error();
+      return true;
+    }
+
+    written += result.bytes();
+    size_t remaining = result.bytes() + offset;
+    while ( index < buffers.size() and remaining >= buffers[index].size() ) {
+      remaining -= buffers[index].size();
+      ++index;
+    }
+    offset = remaining;
+  }
+  return true;
+}
+
+size_t AsyncFD::WriteAwaiter::await_resume() const
+{
+  if ( error ) {
+    throw unix_error { "write", error };
+  }
+  return written;
+}
+
+AsyncTCPSocket::AsyncTCPSocket( AsyncIO& io, TCPSocket&& socket )
+  : AsyncFD( io, socket.duplicate() ), socket_( move( socket ) )
+{}
+
+bool AsyncTCPSocket::ConnectAwaiter::attempt()
+{
+  try {
+    if ( not started ) {
+      // a non-blocking connect returns at once; the socket becomes writable when it has finished
+      started = true;
+      socket.socket_.connect( address );
+      return false;
+    }
+    socket.socket_.throw_if_error();
+  } catch ( const exception& ) {
+    error = current_exception();
+  }
+  return true;
+}
+
+void AsyncTCPSocket::ConnectAwaiter::abort()
+{
+  error = make_exception_ptr( unix_error { "connect", ECONNABORTED } );
+}
+
+void AsyncTCPSocket::ConnectAwaiter::await_resume() const
+{
+  if ( error ) {
+    rethrow_exception( error );
+  }
+}
+
+bool AsyncTCPSocket::AcceptAwaiter::attempt()
+{
+  try {
+    connection = listener.socket_.accept_nonblocking();
+    return connection.has_value();
+  } catch ( const exception& ) {
+    error = current_exception();
+    return true;
+  }
+}
+
+void AsyncTCPSocket::AcceptAwaiter::abort()
+{
+  error = make_exception_ptr( unix_error { "accept", ECONNABORTED } );
+}
+
+AsyncTCPSocket AsyncTCPSocket::AcceptAwaiter::await_resume()
+{
+  if ( error ) {
+    rethrow_exception( error );
+  }
+  return AsyncTCPSocket { listener.io(), move( *connection ) };
+}
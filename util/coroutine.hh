@@ -0,0 +1,383 @@
+#pragma once
+
+#include "address.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "io_result.hh"
+#include "socket.hh"
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+
+class AsyncIO;
+
+namespace coroutine_detail {
+
+//! \brief Coroutine frames are recycled through per-thread free lists, one per 64-byte size class up to
+//! 4 KiB, so a steady stream of short-lived coroutines doesn't touch malloc
+//! \details A frame may be freed on a different thread than allocated it (it joins that thread's lists).
+void* allocate_frame( size_t size );
+void deallocate_frame( void* frame, size_t size ) noexcept;
+
+//! Report the end of a coroutine started with AsyncIO::spawn()
+void finish_spawned( AsyncIO& io, std::exception_ptr error ) noexcept;
+
+struct PromiseBase
+{
+  std::coroutine_handle<> continuation {}; //!< The coroutine awaiting this one, if any
+  AsyncIO* spawned_by {};                  //!< Set for a coroutine started by AsyncIO::spawn()
+  std::exception_ptr error {};
+
+  static void* operator new( size_t size ) { return allocate_frame( size ); }
+  static void operator delete( void* frame, size_t size ) noexcept { deallocate_frame( frame, size ); }
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  void unhandled_exception() noexcept { error = std::current_exception(); }
+
+  //! Resume the awaiting coroutine by symmetric transfer, or, for a spawned one, free the frame
+  struct FinalAwaiter
+  {
+    bool await_ready() noexcept { return false; }
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend( std::coroutine_handle<Promise> handle ) noexcept
+    {
+      PromiseBase& promise = handle.promise();
+      if ( promise.spawned_by ) {
+        AsyncIO& io = *promise.spawned_by;
+        std::exception_ptr error = std::move( promise.error );
+        handle.destroy();
+        finish_spawned( io, std::move( error ) );
+        return std::noop_coroutine();
+      }
+      return promise.continuation ? promise.continuation : std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+  FinalAwaiter final_suspend() noexcept { return {}; }
+};
+
+template<typename T>
+struct Promise : PromiseBase
+{
+  std::optional<T> value {};
+  void return_value( T&& result ) { value.emplace( std::move( result ) ); }
+  void return_value( const T& result ) { value.emplace( result ); }
+  T take()
+  {
+    if ( error ) {
+      std::rethrow_exception( error );
+    }
+    return std::move( *value );
+  }
+};
+
+template<>
+struct Promise<void> : PromiseBase
+{
+  void return_void() {}
+  void take() const
+  {
+    if ( error ) {
+      std::rethrow_exception( error );
+    }
+  }
+};
+
+} // namespace coroutine_detail
+
+//! \brief A coroutine that produces a T, started when it is co_awaited (or handed to AsyncIO::spawn())
+//! \details The awaiting coroutine is resumed directly when this one finishes (symmetric transfer, so deep
+//! chains don't grow the stack), and an exception it throws is rethrown from the co_await.
+template<typename T = void>
+class [[nodiscard]] Task
+{
+public:
+  struct promise_type : coroutine_detail::Promise<T>
+  {
+    Task get_return_object() { return Task { std::coroutine_handle<promise_type>::from_promise( *this ) }; }
+  };
+
+private:
+  std::coroutine_handle<promise_type> handle_;
+
+  explicit Task( std::coroutine_handle<promise_type> handle ) : handle_( handle ) {}
+
+  friend class AsyncIO;
+
+public:
+  Task( Task&& other ) noexcept : handle_( std::exchange( other.handle_, {} ) ) {}
+  Task& operator=( Task&& other ) noexcept
+  {
+    std::swap( handle_, other.handle_ );
+    return *this;
+  }
+  Task( const Task& other ) = delete;
+  Task& operator=( const Task& other ) = delete;
+
+  ~Task()
+  {
+    if ( handle_ ) {
+      handle_.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting ) noexcept
+  {
+    handle_.promise().continuation = awaiting;
+    return handle_;
+  }
+  T await_resume() { return handle_.promise().take(); }
+};
+
+//! \brief Runs coroutines on an EventLoop: they suspend when a descriptor would block (or in sleep()), and
+//! are resumed by the loop once it is ready
+//! \details Everything runs on the loop's thread. The descriptors are watched edge-triggered, so each
+//! registers with epoll once, not once per wait.
+class AsyncIO
+{
+  EventLoop& loop_;
+  size_t category_;
+  size_t running_ {};
+  std::exception_ptr error_ {};
+
+  friend void coroutine_detail::finish_spawned( AsyncIO& io, std::exception_ptr error ) noexcept;
+
+public:
+  explicit AsyncIO( EventLoop& loop );
+
+  EventLoop& loop() { return loop_; }
+
+  //! The EventLoop category that the coroutines' running time is charged to
+  size_t category() const { return category_; }
+
+  //! Start `task`, which runs until it first suspends; AsyncIO then owns it until it finishes
+  void spawn( Task<void>&& task );
+
+  //! Number of spawned coroutines that haven't finished
+  size_t running() const { return running_; }
+
+  //! Run the loop until every spawned coroutine has finished, then rethrow the first exception one threw
+  void run();
+
+  //! Awaitable that resumes the coroutine once `delay` has passed (see EventLoop::add_timer())
+  struct SleepAwaiter
+  {
+    AsyncIO& io;
+    std::chrono::milliseconds delay;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend( std::coroutine_handle<> handle );
+    void await_resume() const noexcept {}
+  };
+  SleepAwaiter sleep( std::chrono::milliseconds delay ) { return { *this, delay }; }
+
+  AsyncIO( const AsyncIO& other ) = delete;
+  AsyncIO& operator=( const AsyncIO& other ) = delete;
+  AsyncIO( AsyncIO&& other ) = delete;
+  AsyncIO& operator=( AsyncIO&& other ) = delete;
+  ~AsyncIO() = default;
+};
+
+//! \brief A non-blocking FileDescriptor whose reads and writes are awaited by a coroutine
+//! \details Each operation is first tried at once and only suspends if it would block, so a coroutine that
+//! keeps up with its peer rarely suspends. One coroutine at a time may wait to read, and one to write. It
+//! must not outlive the AsyncIO, and must outlive any operation that is waiting.
+class AsyncFD
+{
+protected:
+  //! \brief A suspended operation, retried each time the descriptor becomes ready
+  struct Operation
+  {
+    std::coroutine_handle<> handle {};
+
+    //! Make progress without blocking; returns true once the operation is finished (successfully or not)
+    virtual bool attempt() = 0;
+    //! Finish unsuccessfully, because the loop has stopped watching the descriptor (e.g. after an error)
+    virtual void abort() = 0;
+    //! Whether the descriptor has been closed (so its number may already belong to another file)
+    virtual bool fd_closed() const = 0;
+
+    Operation() = default;
+    Operation( const Operation& other ) = default;
+    Operation& operator=( const Operation& other ) = default;
+    Operation( Operation&& other ) = default;
+    Operation& operator=( Operation&& other ) = default;
+    virtual ~Operation() = default;
+  };
+
+  //! Waiters and rules for one direction
+  struct Watcher
+  {
+    Operation* waiting {};
+    std::optional<EventLoop::RuleHandle> rule {}; //!< Added on the first wait
+    bool closed {};                               //!< The loop stopped watching, so waits can't succeed
+  };
+
+  //! On the heap, so that the rules can point to it while the AsyncFD moves
+  struct State
+  {
+    Watcher in {};
+    Watcher out {};
+  };
+
+  //! \brief Base of the awaitables: try at once; if that would block, wait until attempt() succeeds
+  //! \details Derived classes implement attempt() and abort(), and await_resume() to report the outcome.
+  template<EventLoop::Direction direction>
+  struct Awaiter : Operation
+  {
+    AsyncFD& fd;
+
+    explicit Awaiter( AsyncFD& s_fd ) : fd( s_fd ) {}
+    bool fd_closed() const override { return fd.fd_.closed(); }
+
+    bool await_ready()
+    {
+      if ( attempt() ) {
+        return true;
+      }
+      if ( fd.watcher( direction ).closed ) {
+        abort();
+        return true;
+      }
+      return false;
+    }
+    void await_suspend( std::coroutine_handle<> awaiting )
+    {
+      handle = awaiting;
+      fd.wait( direction, *this );
+    }
+  };
+
+  AsyncIO* io_;
+  FileDescriptor fd_;
+  std::unique_ptr<State> state_;
+
+  Watcher& watcher( EventLoop::Direction direction )
+  {
+    return direction == EventLoop::Direction::In ? state_->in : state_->out;
+  }
+
+  //! Suspend `operation` until the descriptor is ready in `direction` and operation.attempt() succeeds
+  void wait( EventLoop::Direction direction, Operation& operation );
+
+  struct ReadAwaiter : Awaiter<EventLoop::Direction::In>
+  {
+    std::span<char> buffer;
+    IOResult result {};
+
+    ReadAwaiter( AsyncFD& s_fd, std::span<char> s_buffer ) : Awaiter( s_fd ), buffer( s_buffer ) {}
+    bool attempt() override;
+    void abort() override { result = IOResult::failure( ECONNABORTED ); }
+    size_t await_resume() const { return result.value_or_throw( "read" ); }
+  };
+
+  struct WriteAwaiter : Awaiter<EventLoop::Direction::Out>
+  {
+    std::span<const std::string_view> buffers;
+    size_t index {};  //!< First buffer not yet written in full
+    size_t offset {}; //!< Bytes of buffers[index] already written
+    size_t written {};
+    int error {};
+
+    WriteAwaiter( AsyncFD& s_fd, std::span<const std::string_view> s_buffers )
+      : Awaiter( s_fd ), buffers( s_buffers )
+    {}
+    bool attempt() override;
+    void abort() override { error = EPIPE; }
+    size_t await_resume() const;
+  };
+
+  //! Holds a single buffer, so that write( std::string_view ) has something to point to
+  struct WriteOneAwaiter : WriteAwaiter
+  {
+    std::string_view buffer;
+
+    WriteOneAwaiter( AsyncFD& s_fd, std::string_view s_buffer )
+      : WriteAwaiter( s_fd, {} ), buffer( s_buffer )
+    {
+      buffers = { &buffer, 1 };
+    }
+    WriteOneAwaiter( const WriteOneAwaiter& other ) = delete;
+    WriteOneAwaiter& operator=( const WriteOneAwaiter& other ) = delete;
+    WriteOneAwaiter( WriteOneAwaiter&& other ) = delete;
+    WriteOneAwaiter& operator=( WriteOneAwaiter&& other ) = delete;
+    ~WriteOneAwaiter() override = default;
+  };
+
+public:
+  //! Take over `fd` (which is made non-blocking) for coroutines running on `io`
+  AsyncFD( AsyncIO& io, FileDescriptor&& fd );
+
+  //! \brief `co_await read( buffer )` reads what is available, up to buffer.size(), waiting if nothing is
+  //! \returns the number of bytes read (0 at EOF); throws unix_error on failure
+  ReadAwaiter read( std::span<char> buffer ) { return { *this, buffer }; }
+
+  //! \brief `co_await write( buffers )` writes every byte of `buffers`, waiting whenever the descriptor is full
+  //! \returns the number of bytes written; throws unix_error on failure
+  WriteAwaiter write( std::span<const std::string_view> buffers ) { return { *this, buffers }; }
+  WriteOneAwaiter write( std::string_view buffer ) { return { *this, buffer }; }
+
+  FileDescriptor& fd() { return fd_; }
+  AsyncIO& io() { return *io_; }
+
+  ~AsyncFD();
+  AsyncFD( AsyncFD&& other ) noexcept = default;
+  AsyncFD& operator=( AsyncFD&& other ) = delete;
+  AsyncFD( const AsyncFD& other ) = delete;
+  AsyncFD& operator=( const AsyncFD& other ) = delete;
+};
+
+//! \brief A TCPSocket with awaitable read(), write(), connect() and accept()
+//! \details e.g. `auto listener = AsyncTCPSocket { io }; ...; AsyncTCPSocket connection = co_await
+//! listener.accept();`, then `co_await connection.read( buffer )`.
+class AsyncTCPSocket : public AsyncFD
+{
+  TCPSocket socket_;
+
+  struct ConnectAwaiter : Awaiter<EventLoop::Direction::Out>
+  {
+    AsyncTCPSocket& socket;
+    const Address& address;
+    bool started {};
+    std::exception_ptr error {};
+
+    ConnectAwaiter( AsyncTCPSocket& s_socket, const Address& s_address )
+      : Awaiter( s_socket ), socket( s_socket ), address( s_address )
+    {}
+    bool attempt() override;
+    void abort() override;
+    void await_resume() const;
+  };
+
+  struct AcceptAwaiter : Awaiter<EventLoop::Direction::In>
+  {
+    AsyncTCPSocket& listener;
+    std::optional<TCPSocket> connection {};
+    std::exception_ptr error {};
+
+    explicit AcceptAwaiter( AsyncTCPSocket& s_listener ) : Awaiter( s_listener ), listener( s_listener ) {}
+    bool attempt() override;
+    void abort() override;
+    AsyncTCPSocket await_resume();
+  };
+
+public:
+  //! Take over `socket` (which is made non-blocking); by default, a new IPv4 socket
+  explicit AsyncTCPSocket( AsyncIO& io, TCPSocket&& socket = TCPSocket {} );
+
+  //! `co_await connect( address )` connects (the socket must have the address's family); throws on failure
+  ConnectAwaiter connect( const Address& address ) { return { *this, address }; }
+
+  //! `co_await accept()` waits for and returns the next connection to a listening socket
+  AcceptAwaiter accept() { return AcceptAwaiter { *this }; }
+
+  TCPSocket& socket() { return socket_; }
+};
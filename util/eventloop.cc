@@ -0,0 +1,467 @@
+#include "eventloop.hh"
+
+#include "exception.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <poll.h>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+// maximum number of events collected by one call to epoll_wait()
+constexpr size_t kMaxEvents = 256;
+
+uint64_t now_ns()
+{
+  return chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// whether `fd` reports an error (or a non-empty error queue), without collecting it: reading SO_ERROR
+// would clear it before the fd's owner saw it
+bool error_reported( const FileDescriptor& fd )
+{
+  pollfd poll_fd { fd.fd_num(), 0, 0 };
+  return ::poll( &poll_fd, 1, 0 ) > 0 and ( poll_fd.revents & POLLERR ); // NOLINT(*-signed-bitwise)
+}
+} // namespace
+
+EventLoop::BasicRule::BasicRule( size_t s_category_id, InterestT s_interest, CallbackT s_callback )
+  : category_id( s_category_id ), interest( move( s_interest ) ), callback( move( s_callback ) )
+{}
+
+EventLoop::FDRule::FDRule( BasicRule&& base,
+                           FileDescriptor&& s_fd,
+                           Direction s_direction,
+                           Trigger s_trigger,
+                           CallbackT s_cancel )
+  : BasicRule( move( base ) )
+  , fd( move( s_fd ) )
+  , direction( s_direction )
+  , trigger( s_trigger )
+  , cancel( move( s_cancel ) )
+{}
+
+unsigned int EventLoop::FDRule::service_count() const
+{
+  return direction == Direction::In ? fd.read_count() : fd.write_count();
+}
+
+EventLoop::EventLoop() : epoll_fd_( ::CheckSystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) ), false )
+{
+  events_.resize( kMaxEvents );
+}
+
+size_t EventLoop::add_category( const string& name )
+{
+  if ( rule_categories_.size() >= numeric_limits<uint16_t>::max() ) {
+    throw runtime_error( "EventLoop: too many categories" );
+  }
+  rule_categories_.push_back( { name } );
+  return rule_categories_.size() - 1;
+}
+
+void EventLoop::RuleHandle::cancel()
+{
+  const shared_ptr<BasicRule> rule_shared_ptr = rule_weak_ptr_.lock();
+  if ( rule_shared_ptr ) {
+    rule_shared_ptr->cancel_requested = true;
+  }
+}
+
+EventLoop::RuleHandle EventLoop::add_rule( size_t category_id,
+                                           FileDescriptor& fd,
+                                           Direction direction,
+                                           const CallbackT& callback,
+                                           const InterestT& interest,
+                                           const CallbackT& cancel,
+                                           Trigger trigger )
+{
+  if ( category_id >= rule_categories_.size() ) {
+    throw out_of_range( "bad category_id" );
+  }
+
+  auto& registration = registration_for( fd );
+  for ( const auto& other : registration.rules ) {
+    if ( not other->cancel_requested and not other->error_queue and other->trigger != trigger ) {
+      throw runtime_error( "EventLoop: level- and edge-triggered rules cannot share a file descriptor" );
+    }
+  }
+
+  auto rule = make_shared<FDRule>(
+    BasicRule { category_id, interest, callback }, fd.duplicate(), direction, trigger, cancel );
+  registration.rules.push_back( rule );
+  return RuleHandle { rule };
+}
+
+// the rule is given Direction::Out so that EOF on the fd doesn't cancel it, but it neither reads nor writes
+EventLoop::RuleHandle EventLoop::add_error_queue_rule( size_t category_id,
+                                                       FileDescriptor& fd,
+                                                       const CallbackT& callback,
+                                                       const CallbackT& cancel )
+{
+  if ( category_id >= rule_categories_.size() ) {
+    throw out_of_range( "bad category_id" );
+  }
+
+  auto rule = make_shared<FDRule>( BasicRule { category_id, [] { return true; }, callback },
+                                   fd.duplicate(),
+                                   Direction::Out,
+                                   Trigger::Level,
+                                   cancel );
+  rule->error_queue = true;
+  registration_for( fd ).rules.push_back( rule );
+  return RuleHandle { rule };
+}
+
+EventLoop::Registration& EventLoop::registration_for( const FileDescriptor& fd )
+{
+  auto& registration = registrations_[fd.fd_num()];
+  if ( ranges::any_of( registration.rules, []( const auto& other ) { return other->fd.closed(); } ) ) {
+    // the fd number has been reused since the old file was closed, and the kernel forgot the old
+    // registration along with it
+    registration.registered_events = 0;
+  }
+  return registration;
+}
+
+EventLoop::RuleHandle EventLoop::add_rule( size_t category_id,
+                                           const CallbackT& callback,
+                                           const InterestT& interest )
+{
+  if ( category_id >= rule_categories_.size() ) {
+    throw out_of_range( "bad category_id" );
+  }
+
+  auto rule = make_shared<BasicRule>( category_id, interest, callback );
+  non_fd_rules_.push_back( rule );
+  return RuleHandle { rule };
+}
+
+void EventLoop::cancel_rule( FDRule& rule )
+{
+  if ( rule.cancel_requested ) {
+    return;
+  }
+  rule.cancel_requested = true;
+  rule.cancel();
+}
+
+void EventLoop::run_callback( const size_t category_id, const CallbackT& callback )
+{
+  const uint64_t start = now_ns();
+  callback();
+  const uint64_t elapsed = now_ns() - start;
+
+  auto& category = rule_categories_.at( category_id );
+  ++category.count;
+  category.total_ns += elapsed;
+  category.max_ns = max( category.max_ns, elapsed );
+}
+
+void EventLoop::set_registered_events( int fd, Registration& registration, uint32_t events )
+{
+  if ( events == registration.registered_events ) {
+    return;
+  }
+
+  epoll_event event {};
+  event.events = events;
+  event.data.fd = fd;
+
+  if ( events == 0 ) {
+    // the kernel drops closed fds from the set by itself, so ENOENT and EBADF are expected here
+    if ( epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_DEL, fd, nullptr ) < 0 and errno != ENOENT and errno != EBADF ) {
+      throw unix_error { "epoll_ctl(EPOLL_CTL_DEL)" };
+    }
+  } else if ( registration.registered_events == 0 ) {
+    if ( epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_ADD, fd, &event ) < 0 ) {
+      if ( errno != EEXIST ) {
+        throw unix_error { "epoll_ctl(EPOLL_CTL_ADD)" };
+      }
+      ::CheckSystemCall( "epoll_ctl(EPOLL_CTL_MOD)", epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_MOD, fd, &event ) );
+    }
+  } else {
+    if ( epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_MOD, fd, &event ) < 0 ) {
+      if ( errno != ENOENT ) {
+        throw unix_error { "epoll_ctl(EPOLL_CTL_MOD)" };
+      }
+      ::CheckSystemCall( "epoll_ctl(EPOLL_CTL_ADD)", epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_ADD, fd, &event ) );
+    }
+  }
+
+  registration.registered_events = events;
+}
+
+bool EventLoop::update_registrations()
+{
+  bool something_to_poll = false;
+  canceled_.clear();
+
+  for ( auto reg_it = registrations_.begin(); reg_it != registrations_.end(); ) {
+    auto& [fd, registration] = *reg_it;
+    uint32_t events = 0;
+
+    for ( auto it = registration.rules.begin(); it != registration.rules.end(); ) {
+      auto& rule = **it;
+      if ( rule.cancel_requested ) {
+        it = registration.rules.erase( it );
+        continue;
+      }
+
+      // a closed fd, or one that has reached EOF, will never be ready again
+      if ( rule.fd.closed() or ( rule.direction == Direction::In and rule.fd.eof() ) ) {
+        rule.cancel_requested = true;
+        canceled_.push_back( *it );
+        it = registration.rules.erase( it );
+        continue;
+      }
+
+      if ( rule.error_queue ) {
+        // epoll reports EPOLLERR whether or not it is asked for, but the fd must be in the set
+        events |= EPOLLERR;
+      } else if ( rule.trigger == Trigger::Edge ) {
+        // edge-triggered interest stays installed; interest() is consulted when the edge is handled
+        events |= static_cast<uint32_t>( rule.direction ) | EPOLLET; // NOLINT(*-signed-bitwise)
+      } else if ( rule.interest() ) {
+        events |= static_cast<uint32_t>( rule.direction );
+      }
+      ++it;
+    }
+
+    if ( registration.rules.empty() ) {
+      // the closed flag means the fd number may already belong to a different file
+      set_registered_events( fd, registration, 0 );
+      reg_it = registrations_.erase( reg_it );
+      continue;
+    }
+
+    set_registered_events( fd, registration, events );
+    something_to_poll |= ( events != 0 );
+    ++reg_it;
+  }
+
+  // cancel callbacks run after the walk, since one that adds rules (e.g. to reconnect) can rehash
+  // registrations_; then the rules they added are registered
+  if ( canceled_.empty() ) {
+    return something_to_poll;
+  }
+  for ( size_t i = 0; i < canceled_.size(); ++i ) {
+    canceled_[i]->cancel();
+  }
+  return update_registrations();
+}
+
+EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
+{
+  // first, give the non-fd rules a chance to run
+  bool non_fd_interest = false;
+  for ( auto it = non_fd_rules_.begin(); it != non_fd_rules_.end(); ) {
+    auto& rule = **it;
+    if ( rule.cancel_requested ) {
+      it = non_fd_rules_.erase( it );
+      continue;
+    }
+    if ( rule.interest() ) {
+      non_fd_interest = true;
+      run_callback( rule );
+    }
+    ++it;
+  }
+
+  const bool something_to_poll = update_registrations();
+
+  // edge-triggered rules that saw an edge while uninterested must be offered it again without blocking once
+  // they are interested; until then their edge waits, and the loop may sleep
+  bool pending_edges = false;
+  for ( const auto& [fd, registration] : registrations_ ) {
+    for ( const auto& rule : registration.rules ) {
+      if ( rule->ready and rule->interest() ) {
+        pending_edges = true;
+      }
+    }
+  }
+
+  if ( not something_to_poll and not non_fd_interest and not pending_edges and timers_.empty() ) {
+    return Result::Exit;
+  }
+
+  // sleep no longer than until the next timer is due (with only timers, epoll_wait just sleeps)
+  int effective_timeout = ( non_fd_interest or pending_edges ) ? 0 : timeout_ms;
+  if ( const auto next_timer = timers_.ms_until_next() ) {
+    const auto until_timer = static_cast<int>( min<uint64_t>( *next_timer, numeric_limits<int>::max() ) );
+    effective_timeout = effective_timeout < 0 ? until_timer : min( effective_timeout, until_timer );
+  }
+  const int event_count = epoll_wait( epoll_fd_.fd_num(),
+                                      events_.data(),
+                                      static_cast<int>( events_.size() ),
+                                      something_to_poll or not timers_.empty() ? effective_timeout : 0 );
+  if ( event_count < 0 ) {
+    if ( errno == EINTR ) {
+      return Result::Timeout;
+    }
+    throw unix_error { "epoll_wait" };
+  }
+
+  // collect the rules to run before running any, since callbacks may add or cancel rules
+  fired_.clear();
+  for ( int i = 0; i < event_count; ++i ) {
+    const auto& event = events_[i];
+    const auto registration = registrations_.find( event.data.fd );
+    if ( registration == registrations_.end() ) {
+      continue;
+    }
+    const uint32_t events = event.events;
+    const auto& rules = registration->second.rules;
+
+    // EPOLLERR may only mean that the error queue has messages, so the fd's error queue rules run first to
+    // collect them, and the other rules see EPOLLERR only if an error remains
+    const bool withhold_error = ( events & EPOLLERR ) // NOLINT(*-signed-bitwise)
+                                and ranges::any_of( rules, []( const auto& rule ) { return rule->error_queue; } );
+    for ( const auto& rule : rules ) {
+      if ( rule->error_queue ) {
+        fired_.push_back( { rule, events, false } );
+      }
+    }
+    for ( const auto& rule : rules ) {
+      if ( not rule->error_queue ) {
+        const uint32_t passed = withhold_error ? events & ~EPOLLERR : events; // NOLINT(*-signed-bitwise)
+        fired_.push_back( { rule, passed, withhold_error } );
+      }
+    }
+  }
+  if ( pending_edges ) {
+    for ( const auto& [fd, registration] : registrations_ ) {
+      for ( const auto& rule : registration.rules ) {
+        if ( rule->ready ) {
+          fired_.push_back( { rule, 0, false } );
+        }
+      }
+    }
+  }
+
+  for ( size_t i = 0; i < fired_.size(); ++i ) {
+    auto& rule = *fired_[i].rule;
+    const uint32_t events = fired_[i].events;
+
+    if ( rule.error_queue ) {
+      if ( not( events & ( EPOLLERR | EPOLLHUP ) ) ) { // NOLINT(*-signed-bitwise)
+        continue;
+      }
+      if ( not rule.cancel_requested ) {
+        run_callback( rule );
+      }
+
+      // the queue has been collected (unless the rule is gone), so an error still reported is a real one
+      const bool error = error_reported( rule.fd );
+      if ( error or rule.cancel_requested ) {
+        for ( auto& later : span { fired_ }.subspan( i + 1 ) ) {
+          if ( later.error_withheld and later.rule->fd.fd_num() == rule.fd.fd_num() ) {
+            later.events |= EPOLLERR;
+            later.error_withheld = false;
+          }
+        }
+      }
+      if ( error or ( events & EPOLLHUP ) ) { // NOLINT(*-signed-bitwise)
+        cancel_rule( rule );
+      }
+      continue;
+    }
+
+    if ( rule.cancel_requested ) {
+      continue;
+    }
+
+    const uint32_t direction = static_cast<uint32_t>( rule.direction );
+
+    if ( events & EPOLLERR ) { // NOLINT(*-signed-bitwise)
+      cancel_rule( rule );
+      continue;
+    }
+
+    // a hangup makes a reader see EOF, but a writer can make no further progress
+    const bool hangup = events & EPOLLHUP; // NOLINT(*-signed-bitwise)
+    if ( hangup and rule.direction == Direction::Out ) {
+      cancel_rule( rule );
+      continue;
+    }
+
+    if ( not( events & direction ) and not hangup and not rule.ready ) {
+      continue;
+    }
+
+    if ( rule.trigger == Trigger::Edge ) {
+      rule.ready = true;
+      if ( rule.interest() ) {
+        rule.ready = false;
+        run_callback( rule );
+      }
+      continue;
+    }
+
+    if ( not rule.interest() ) {
+      continue;
+    }
+
+    const unsigned int count_before = rule.service_count();
+    run_callback( rule );
+
+    // a level-triggered rule that neither serviced its fd nor lost interest would spin forever
+    if ( count_before == rule.service_count() and not rule.cancel_requested and not rule.fd.closed()
+         and rule.interest() ) {
+      throw runtime_error( "EventLoop: busy wait detected: rule \"" + rule_categories_.at( rule.category_id ).name
+                           + "\" did not read/write fd and is still interested" );
+    }
+  }
+
+  const size_t timers_run = timers_.expire();
+
+  return event_count > 0 or non_fd_interest or pending_edges or timers_run > 0 ? Result::Success : Result::Timeout;
+}
+
+EventLoop::TimerHandle EventLoop::add_timer( const size_t category_id,
+                                             const chrono::milliseconds delay,
+                                             const CallbackT& callback )
+{
+  rule_categories_.at( category_id ); // throw now, rather than when the timer fires, if there's no such category
+  return timers_.arm( delay, [this, category_id, callback] { run_callback( category_id, callback ); } );
+}
+
+string EventLoop::summary() const
+{
+  constexpr double kNsPerMs = 1'000'000.0;
+
+  ostringstream out;
+  uint64_t total_ns = 0;
+  for ( const auto& category : rule_categories_ ) {
+    total_ns += category.total_ns;
+  }
+
+  out << "EventLoop timing summary\n" << fixed << setprecision( 3 );
+  for ( const auto& category : rule_categories_ ) {
+    const double average_us = category.count ? static_cast<double>( category.total_ns ) / category.count / 1000 : 0;
+    out << "   " << left << setw( 32 ) << category.name << right << setw( 12 )
+        << static_cast<double>( category.total_ns ) / kNsPerMs << " ms";
+    if ( total_ns ) {
+      out << " (" << setw( 6 ) << setprecision( 2 ) << 100.0 * category.total_ns / total_ns << "%)"
+          << setprecision( 3 );
+    }
+    out << "  count=" << category.count << "  avg=" << average_us << " us"
+        << "  max=" << static_cast<double>( category.max_ns ) / 1000 << " us\n";
+  }
+
+  return out.str();
+}
+
+void EventLoop::reset_statistics()
+{
+  for ( auto& category : rule_categories_ ) {
+    category.count = category.total_ns = category.max_ns = 0;
+  }
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "file_descriptor.hh"
+#include "timer_wheel.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <list>
+#include <memory>
+#include <string>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <vector>
+
+//! \brief Waits for events on file descriptors and executes corresponding callbacks.
+//! \details Rules are grouped into named categories; the time spent in each category's
+//! callbacks is accumulated and reported by summary().
+class EventLoop
+{
+public:
+  //! Indicates interest in reading (In) or writing (Out) a polled fd.
+  enum class Direction : uint32_t
+  {
+    In = EPOLLIN,  //!< Callback will be triggered when the fd is readable.
+    Out = EPOLLOUT //!< Callback will be triggered when the fd is writable.
+  };
+
+  //! How readiness of a polled fd is reported (see [epoll(7)](\ref man7::epoll)).
+  enum class Trigger : uint8_t
+  {
+    Level, //!< Callback runs on every iteration while the fd is ready and the rule is interested.
+    Edge   //!< Callback runs once per readiness edge and must drain the fd until it would block.
+  };
+
+  //! Returned by wait_next_event() to indicate whether the loop should keep running.
+  enum class Result
+  {
+    Success, //!< At least one rule was triggered.
+    Timeout, //!< No rules were triggered before timeout.
+    Exit     //!< All rules have been canceled or were uninterested, and no timers are armed; make no further calls.
+  };
+
+private:
+  using CallbackT = std::function<void( void )>;
+  using InterestT = std::function<bool( void )>;
+
+  class BasicRule
+  {
+  public:
+    size_t category_id;
+    InterestT interest;
+    CallbackT callback;
+    bool cancel_requested {};
+
+    BasicRule( size_t s_category_id, InterestT s_interest, CallbackT s_callback );
+  };
+
+  class FDRule : public BasicRule
+  {
+  public:
+    FileDescriptor fd;   //!< Shared handle on the fd, so it stays open while the rule exists.
+    Direction direction; //!< In or Out.
+    Trigger trigger;     //!< Level or Edge.
+    CallbackT cancel;    //!< Called when the fd errors, hangs up, or reaches EOF.
+    bool ready {};       //!< Edge-triggered only: an edge was reported and not yet handled.
+    bool error_queue {}; //!< Collects the fd's error queue instead of reading or writing it.
+
+    FDRule( BasicRule&& base, FileDescriptor&& s_fd, Direction s_direction, Trigger s_trigger, CallbackT s_cancel );
+
+    //! Returns the number of times fd has been read or written, depending on direction.
+    unsigned int service_count() const;
+  };
+
+  //! The epoll registration for one kernel fd, shared by every rule watching it.
+  struct Registration
+  {
+    uint32_t registered_events {}; //!< Event mask currently installed in the kernel (0 = not installed).
+    std::list<std::shared_ptr<FDRule>> rules {};
+  };
+
+  //! Time spent in the callbacks of one category of rules.
+  struct RuleCategory
+  {
+    std::string name;
+    uint64_t count {};
+    uint64_t total_ns {};
+    uint64_t max_ns {};
+  };
+
+  FileDescriptor epoll_fd_;
+  std::unordered_map<int, Registration> registrations_ {};
+  std::list<std::shared_ptr<BasicRule>> non_fd_rules_ {};
+  std::vector<RuleCategory> rule_categories_ {};
+  TimerWheel timers_ {};
+
+  //! A rule to run this iteration, with the events epoll_wait() reported for its fd.
+  struct FiredRule
+  {
+    std::shared_ptr<FDRule> rule;
+    uint32_t events;
+    bool error_withheld; //!< EPOLLERR was held back until the fd's error queue has been collected.
+  };
+
+  std::vector<epoll_event> events_ {};               //!< Scratch space for epoll_wait().
+  std::vector<FiredRule> fired_ {};                  //!< Rules to run this iteration.
+  std::vector<std::shared_ptr<FDRule>> canceled_ {}; //!< Rules whose cancel callbacks are due.
+
+  //! The registration for `fd`, forgetting what was installed for a closed file with the same number.
+  Registration& registration_for( const FileDescriptor& fd );
+
+  //! Remove canceled rules and bring the kernel's interest set in line with the rules' interest.
+  //! \returns true if any fd rule is waiting on the kernel
+  bool update_registrations();
+
+  //! Install `events` for `fd` in the epoll set (0 removes it).
+  void set_registered_events( int fd, Registration& registration, uint32_t events );
+
+  //! Cancel a rule because its fd errored, hung up or closed.
+  static void cancel_rule( FDRule& rule );
+
+  //! Run a rule's callback and charge the elapsed time to its category.
+  void run_callback( const BasicRule& rule ) { run_callback( rule.category_id, rule.callback ); }
+  void run_callback( size_t category_id, const CallbackT& callback );
+
+public:
+  EventLoop();
+
+  //! Add a category to organize rules by name; the returned id is passed to add_rule().
+  size_t add_category( const std::string& name );
+
+  //! Returned by add_rule() to allow the rule to be canceled later.
+  class RuleHandle
+  {
+    std::weak_ptr<BasicRule> rule_weak_ptr_;
+
+  public:
+    template<class RuleType>
+    explicit RuleHandle( const std::shared_ptr<RuleType>& x ) : rule_weak_ptr_( x )
+    {}
+
+    //! Cancel the rule; its callback will not run again.
+    void cancel();
+  };
+
+  //! \brief Add a rule that runs `callback` when `fd` is ready in `direction` and `interest` returns true.
+  //! \details A level-triggered rule's callback must read or write the fd (or lose interest), or the
+  //! loop throws to report a busy wait. An edge-triggered callback must drain the fd until it would
+  //! block; the fd should be non-blocking. All rules on one fd must share the same Trigger.
+  //! EPOLLERR cancels them, unless it is explained by an error queue rule (see add_error_queue_rule()).
+  RuleHandle add_rule(
+    size_t category_id,
+    FileDescriptor& fd,
+    Direction direction,
+    const CallbackT& callback,
+    const InterestT& interest = [] { return true; },
+    const CallbackT& cancel = [] {},
+    Trigger trigger = Trigger::Level );
+
+  //! \brief Add a rule that runs `callback` when `fd` reports EPOLLERR, which a socket also does while it
+  //! has messages on its error queue (e.g. MSG_ZEROCOPY completions); `callback` must collect them all.
+  //! \details If the fd still reports an error once `callback` has run, the error is a real one: this rule
+  //! and the fd's other rules are canceled, and the error is left for their owners to read (SO_ERROR).
+  //! Otherwise the other rules carry on. The rule is also canceled when the fd hangs up.
+  RuleHandle add_error_queue_rule(
+    size_t category_id,
+    FileDescriptor& fd,
+    const CallbackT& callback,
+    const CallbackT& cancel = [] {} );
+
+  //! Add a rule that runs `callback` on every iteration in which `interest` returns true.
+  RuleHandle add_rule(
+    size_t category_id,
+    const CallbackT& callback,
+    const InterestT& interest = [] { return true; } );
+
+  //! Returned by add_timer() to allow the timer to be canceled later.
+  using TimerHandle = TimerWheel::Handle;
+
+  //! \brief Add a one-shot timer that runs `callback` once `delay` has passed (see TimerWheel).
+  //! \details Timers run from wait_next_event(), which sleeps no longer than until the next one is due.
+  TimerHandle add_timer( size_t category_id, std::chrono::milliseconds delay, const CallbackT& callback );
+
+  //! Cancel a timer; returns false if it has already run or been canceled.
+  bool cancel_timer( TimerHandle handle ) { return timers_.cancel( handle ); }
+
+  //! Calls [epoll_wait(2)](\ref man2::epoll_wait) and then executes the callbacks of ready rules and due timers.
+  //! \param[in] timeout_ms is the timeout value in milliseconds (-1 waits forever, or until the next timer)
+  Result wait_next_event( int timeout_ms );
+
+  //! Human-readable table of the time spent in each category's callbacks.
+  std::string summary() const;
+
+  //! Reset the per-category counters.
+  void reset_statistics();
+};
+
+using Direction = EventLoop::Direction;
@@ -1,11 +1,14 @@
 #include "file_descriptor.hh"
 
 #include "exception.hh"
+#include "io_uring.hh"
 
 #include <algorithm>
+#include <array>
 #include <fcntl.h>
 #include <iostream>
 #include <stdexcept>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/uio.h>
@@ -36,8 +39,16 @@ T FileDescriptor::CheckSystemCall( std::string_view s_attempt, T return_value )
   return internal_fd_->CheckSystemCall( s_attempt, return_value );
 }
 
+// subclasses such as Socket call CheckSystemCall with these types, which optimized builds would otherwise
+// only instantiate inline here
+template int FileDescriptor::CheckSystemCall( string_view s_attempt, int return_value ) const;
+template ssize_t FileDescriptor::CheckSystemCall( string_view s_attempt, ssize_t return_value ) const;
+
 // fd is the file descriptor number returned by [open(2)](\ref man2::open) or similar
-FileDescriptor::FDWrapper::FDWrapper( int fd ) : fd_( fd )
+FileDescriptor::FDWrapper::FDWrapper( int fd )
+  : fd_( fd )
+  , read_size_( kReadBufferSize )
+  , stats_( IOStats::enabled_by_default() ? make_shared<IOStats>() : nullptr )
 {
   if ( fd < 0 ) {
     throw runtime_error( "invalid fd number:" + to_string( fd ) );
@@ -47,6 +58,25 @@ FileDescriptor::FDWrapper::FDWrapper( int fd ) : fd_( fd )
   non_blocking_ = flags & O_NONBLOCK;                                 // NOLINT(*-bitwise)
 }
 
+// non_blocking is trusted to match the descriptor's O_NONBLOCK flag (verified in checked builds)
+FileDescriptor::FDWrapper::FDWrapper( int fd, bool non_blocking )
+  : fd_( fd )
+  , non_blocking_( non_blocking )
+  , read_size_( kReadBufferSize )
+  , stats_( IOStats::enabled_by_default() ? make_shared<IOStats>() : nullptr )
+{
+  if ( fd < 0 ) {
+    throw runtime_error( "invalid fd number:" + to_string( fd ) );
+  }
+
+#ifdef CHECK_TRUSTED_DESCRIPTORS
+  const int flags = CheckSystemCall( "fcntl", fcntl( fd, F_GETFL ) ); // NOLINT(*-vararg)
+  if ( static_cast<bool>( flags & O_NONBLOCK ) != non_blocking ) {   // NOLINT(*-bitwise)
+    throw runtime_error( "trusted fd " + to_string( fd ) + " has the wrong O_NONBLOCK flag" );
+  }
+#endif
+}
+
 void FileDescriptor::FDWrapper::close()
 {
   CheckSystemCall( "close", ::close( fd_ ) );
@@ -69,6 +99,10 @@ FileDescriptor::FDWrapper::~FDWrapper()
 // fd is the file descriptor number returned by [open(2)](\ref man2::open) or similar
 FileDescriptor::FileDescriptor( int fd ) : internal_fd_( make_shared<FDWrapper>( fd ) ) {}
 
+FileDescriptor::FileDescriptor( int fd, bool non_blocking )
+  : internal_fd_( make_shared<FDWrapper>( fd, non_blocking ) )
+{}
+
 // Private constructor used by duplicate()
 FileDescriptor::FileDescriptor( shared_ptr<FDWrapper> other_shared_ptr ) : internal_fd_( move( other_shared_ptr ) )
 {}
@@ -79,107 +113,301 @@ FileDescriptor FileDescriptor::duplicate() const
   return FileDescriptor { internal_fd_ };
 }
 
-// buffer is the string to be read into
-void FileDescriptor::read( string& buffer )
+void FileDescriptor::enable_stats()
 {
-  buffer.clear();
-  buffer.resize( kReadBufferSize );
+  if ( not internal_fd_->stats_ ) {
+    internal_fd_->stats_ = make_shared<IOStats>();
+  }
+}
 
-  const ssize_t bytes_read = ::read( fd_num(), buffer.data(), buffer.size() );
+void FileDescriptor::record_stats( IOStats::Direction direction,
+                                   uint64_t started_ns,
+                                   ssize_t result,
+                                   size_t requested ) const
+{
+  const uint64_t latency_ns = started_ns ? IOStats::now_ns() - started_ns : IOStats::kUntimed;
+  internal_fd_->stats_->record( direction, result, requested, latency_ns );
+  IOStats::global().record( direction, result, requested, latency_ns );
+}
+
+// bytes_read is the return value of the system call, with errno still set if it failed
+// started_ns is when the system call began, from io_start()
+size_t FileDescriptor::finish_read( string_view s_attempt,
+                                    ssize_t bytes_read,
+                                    size_t requested,
+                                    uint64_t started_ns )
+{
+  record_io( IOStats::Direction::Read, started_ns, bytes_read, requested );
   if ( bytes_read < 0 ) {
     if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
-      return;
+      return 0;
     }
-    throw unix_error { "read" };
+    throw unix_error { s_attempt };
   }
 
   register_read();
 
-  if ( bytes_read == 0 ) {
+  if ( bytes_read == 0 and requested != 0 ) {
     internal_fd_->eof_ = true;
   }
 
-  if ( bytes_read > static_cast<ssize_t>( buffer.size() ) ) {
+  if ( bytes_read > static_cast<ssize_t>( requested ) ) {
     throw runtime_error( "read() read more than requested" );
   }
 
-  buffer.resize( bytes_read );
+  return bytes_read;
 }
 
-void FileDescriptor::read( vector<unique_ptr<string>>& buffers )
+// buffer is the caller-owned storage to be read into
+size_t FileDescriptor::read( span<char> buffer )
 {
-  if ( buffers.empty() ) {
+  const uint64_t started = io_start();
+  return finish_read( "read", sys_read( buffer ), buffer.size(), started );
+}
+
+// buffer's whole capacity is offered to the kernel
+void FileDescriptor::read( OwnedBuffer& buffer )
+{
+  buffer.resize( read( buffer.storage() ) );
+}
+
+// buffer is the string to be read into
+void FileDescriptor::read( string& buffer )
+{
+  const size_t requested = internal_fd_->read_size_;
+  ssize_t bytes_read = 0;
+  int saved_errno = 0;
+  const uint64_t started = io_start();
+
+#if defined( __cpp_lib_string_resize_and_overwrite )
+  // grow without zero-filling; the operation must not throw, so errors are handled afterwards (and a read
+  // through an IOUring, which can throw, takes the path below)
+  if ( not internal_fd_->ring_ ) {
+    buffer.resize_and_overwrite( requested, [&]( char* data, size_t size ) {
+      bytes_read = ::read( fd_num(), data, size );
+      saved_errno = errno;
+      return bytes_read < 0 ? 0 : static_cast<size_t>( bytes_read );
+    } );
+    errno = saved_errno;
+    finish_read( "read", bytes_read, requested, started );
     return;
   }
+#endif
 
-  buffers.back()->clear();
-  buffers.back()->resize( kReadBufferSize );
+  // growing without clear() zero-fills only bytes beyond the previous contents, and keeps capacity; the
+  // buffer is then trimmed to what was read, as resize_and_overwrite() does, so no zeros are left over
+  buffer.resize( requested );
+  bytes_read = sys_read( buffer );
+  saved_errno = errno;
+  buffer.resize( bytes_read < 0 ? 0 : static_cast<size_t>( bytes_read ) );
+
+  errno = saved_errno;
+  finish_read( "read", bytes_read, requested, started );
+}
 
-  vector<iovec> iovecs;
-  iovecs.reserve( buffers.size() );
+// chunks are filled in order; only the first kMaxReadChunks are offered to the kernel
+size_t FileDescriptor::read( span<const span<char>> chunks )
+{
+  array<iovec, kMaxReadChunks> iovecs {};
+  const size_t count = min( chunks.size(), iovecs.size() );
   size_t total_size = 0;
-  for ( const auto& x : buffers ) {
-    iovecs.push_back( { const_cast<char*>( x->data() ), x->size() } ); // NOLINT(*-const-cast)
-    total_size += x->size();
+  for ( size_t i = 0; i < count; ++i ) {
+    iovecs[i] = { chunks[i].data(), chunks[i].size() };
+    total_size += chunks[i].size();
   }
 
-  const ssize_t bytes_read = ::readv( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) );
-  if ( bytes_read < 0 ) {
-    if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
-      return;
-    }
-    throw unix_error { "read" };
-  }
+  const uint64_t started = io_start();
+  return finish_read( "readv", sys_readv( span { iovecs.data(), count } ), total_size, started );
+}
 
-  register_read();
+size_t FileDescriptor::read( vector<unique_ptr<string>>& buffers )
+{
+  const size_t count = min( buffers.size(), kMaxReadChunks );
+  if ( count == 0 ) {
+    return 0;
+  }
 
-  if ( bytes_read > static_cast<ssize_t>( total_size ) ) {
-    throw runtime_error( "read() read more than requested" );
+  array<span<char>, kMaxReadChunks> chunks {};
+  for ( size_t i = 0; i < count; ++i ) {
+    auto& buf = *buffers[i];
+    if ( buf.size() != internal_fd_->read_size_ ) {
+      buf.resize( internal_fd_->read_size_ );
+    }
+    chunks[i] = buf;
   }
 
-  size_t remaining_size = bytes_read;
+  size_t remaining_size = read( span { chunks.data(), count } );
+  size_t filled = 0;
   for ( auto& buf : buffers ) {
-    if ( remaining_size <= buf->size() ) {
+    if ( remaining_size >= buf->size() ) {
       remaining_size -= buf->size();
-    } else if ( remaining_size == 0 ) {
-      buf->clear();
     } else {
       buf->resize( remaining_size );
       remaining_size = 0;
     }
+    filled += not buf->empty();
   }
+
+  return filled;
 }
 
 size_t FileDescriptor::write( string_view buffer )
 {
-  return write( vector<string_view> { buffer } );
+  return write( span { &buffer, 1 } );
 }
 
 size_t FileDescriptor::write( const vector<string_view>& buffers )
 {
-  vector<iovec> iovecs;
-  iovecs.reserve( buffers.size() );
-  size_t total_size = 0;
-  for ( const auto x : buffers ) {
-    iovecs.push_back( { const_cast<char*>( x.data() ), x.size() } ); // NOLINT(*-const-cast)
-    total_size += x.size();
+  return write( span { buffers } );
+}
+
+// writev is given up to kMaxWriteChunks buffers at a time, and called again while it takes all it was offered
+size_t FileDescriptor::write( span<const string_view> buffers )
+{
+  array<iovec, kMaxWriteChunks> iovecs {};
+  size_t total_written = 0;
+
+  while ( true ) {
+    const size_t count = min( buffers.size(), iovecs.size() );
+    size_t total_size = 0;
+    for ( size_t i = 0; i < count; ++i ) {
+      iovecs[i] = { const_cast<char*>( buffers[i].data() ), buffers[i].size() }; // NOLINT(*-const-cast)
+      total_size += buffers[i].size();
+    }
+
+    const uint64_t started = io_start();
+    const size_t written
+      = finish_write( "writev", sys_writev( span { iovecs.data(), count } ), total_size, started );
+    total_written += written;
+    buffers = buffers.subspan( count );
+
+    if ( written < total_size or buffers.empty() ) {
+      return total_written;
+    }
   }
+}
 
-  const ssize_t bytes_written
-    = CheckSystemCall( "writev", ::writev( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) ) );
+// bytes_written is the return value of the system call, with errno still set if it failed
+// started_ns is when the system call began, from io_start()
+size_t FileDescriptor::finish_write( string_view s_attempt,
+                                     ssize_t bytes_written,
+                                     size_t requested,
+                                     uint64_t started_ns )
+{
+  record_io( IOStats::Direction::Write, started_ns, bytes_written, requested );
+  bytes_written = CheckSystemCall( s_attempt, bytes_written );
   register_write();
 
-  if ( bytes_written == 0 and total_size != 0 ) {
+  if ( bytes_written == 0 and requested != 0 and not internal_fd_->non_blocking_ ) {
     throw runtime_error( "write returned 0 given non-empty input buffer" );
   }
 
-  if ( bytes_written > static_cast<ssize_t>( total_size ) ) {
+  if ( bytes_written > static_cast<ssize_t>( requested ) ) {
     throw runtime_error( "write wrote more than length of input buffer" );
   }
 
   return bytes_written;
 }
 
+ssize_t FileDescriptor::sys_read( span<char> buffer )
+{
+  if ( internal_fd_->ring_ ) {
+    return internal_fd_->ring_->perform_read( *this, buffer );
+  }
+  return ::read( fd_num(), buffer.data(), buffer.size() );
+}
+
+ssize_t FileDescriptor::sys_readv( span<const iovec> iovecs )
+{
+  if ( internal_fd_->ring_ ) {
+    return internal_fd_->ring_->perform_readv( *this, iovecs );
+  }
+  return ::readv( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) );
+}
+
+ssize_t FileDescriptor::sys_writev( span<const iovec> iovecs )
+{
+  if ( internal_fd_->ring_ ) {
+    return internal_fd_->ring_->perform_writev( *this, iovecs );
+  }
+  return ::writev( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) );
+}
+
+int FileDescriptor::sys_accept( int flags )
+{
+  if ( internal_fd_->ring_ ) {
+    return internal_fd_->ring_->perform_accept( *this, flags );
+  }
+  return ::accept4( fd_num(), nullptr, nullptr, flags );
+}
+
+IOResult FileDescriptor::try_finish_read( ssize_t bytes_read, size_t requested, uint64_t started_ns ) noexcept
+{
+  record_io( IOStats::Direction::Read, started_ns, bytes_read, requested );
+  if ( bytes_read < 0 ) {
+    return IOResult::failure( errno );
+  }
+
+  register_read();
+  if ( bytes_read == 0 and requested != 0 ) {
+    internal_fd_->eof_ = true;
+  }
+  return IOResult::success( bytes_read );
+}
+
+IOResult FileDescriptor::try_finish_write( ssize_t bytes_written, size_t requested, uint64_t started_ns ) noexcept
+{
+  record_io( IOStats::Direction::Write, started_ns, bytes_written, requested );
+  if ( bytes_written < 0 ) {
+    return IOResult::failure( errno );
+  }
+
+  register_write();
+  return IOResult::success( bytes_written );
+}
+
+IOResult FileDescriptor::try_read( span<char> buffer ) noexcept
+{
+  const uint64_t started = io_start();
+  return try_finish_read( ::read( fd_num(), buffer.data(), buffer.size() ), buffer.size(), started );
+}
+
+IOResult FileDescriptor::try_read( OwnedBuffer& buffer ) noexcept
+{
+  const IOResult result = try_read( buffer.storage() );
+  buffer.resize( result.bytes() );
+  return result;
+}
+
+IOResult FileDescriptor::try_write( string_view buffer ) noexcept
+{
+  const uint64_t started = io_start();
+  return try_finish_write( ::write( fd_num(), buffer.data(), buffer.size() ), buffer.size(), started );
+}
+
+IOResult FileDescriptor::try_write( span<const string_view> buffers ) noexcept
+{
+  array<iovec, kMaxWriteChunks> iovecs {};
+  const size_t count = min( buffers.size(), iovecs.size() );
+  size_t total_size = 0;
+  for ( size_t i = 0; i < count; ++i ) {
+    iovecs[i] = { const_cast<char*>( buffers[i].data() ), buffers[i].size() }; // NOLINT(*-const-cast)
+    total_size += buffers[i].size();
+  }
+
+  const uint64_t started = io_start();
+  return try_finish_write( ::writev( fd_num(), iovecs.data(), static_cast<int>( count ) ), total_size, started );
+}
+
+// size is the number of bytes read( std::string& ) asks the kernel for
+void FileDescriptor::set_read_size( size_t size )
+{
+  if ( size == 0 ) {
+    throw runtime_error( "read size must be positive" );
+  }
+  internal_fd_->read_size_ = size;
+}
+
 void FileDescriptor::set_blocking( bool blocking )
 {
   int flags = CheckSystemCall( "fcntl", fcntl( fd_num(), F_GETFL ) ); // NOLINT(*-vararg)
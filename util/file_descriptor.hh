@@ -1,10 +1,21 @@
 #pragma once
 
+#include "buffer.hh"
+#include "io_result.hh"
+#include "io_stats.hh"
+
 #include <cstddef>
 #include <limits>
 #include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <vector>
 
+class IOUring;
+
 // A reference-counted handle to a file descriptor
 class FileDescriptor
 {
@@ -19,9 +30,15 @@ class FileDescriptor
     bool non_blocking_ = false; // Flag indicating whether FDWrapper::fd_ is non-blocking
     unsigned read_count_ = 0;   // The number of times FDWrapper::fd_ has been read
     unsigned write_count_ = 0;  // The numberof times FDWrapper::fd_ has been written
+    size_t read_size_;          // The number of bytes requested by read( std::string& )
+    IOUring* ring_ = nullptr;   // Set by IOUring::attach(): read(), write() and accept() go through it
+    // System call statistics, if enabled (see enable_stats())
+    std::shared_ptr<IOStats> stats_;
 
     // Construct from a file descriptor number returned by the kernel
     explicit FDWrapper( int fd );
+    // Construct from a file descriptor number whose O_NONBLOCK flag is already known
+    FDWrapper( int fd, bool non_blocking );
     // Closes the file descriptor upon destruction
     ~FDWrapper();
     // Calls [close(2)](\ref man2::close) on FDWrapper::fd_
@@ -43,10 +60,19 @@ class FileDescriptor
   // private constructor used to duplicate the FileDescriptor (increase the reference count)
   explicit FileDescriptor( std::shared_ptr<FDWrapper> other_shared_ptr );
 
+  // slow path of record_io()
+  void record_stats( IOStats::Direction direction, uint64_t started_ns, ssize_t result, size_t requested ) const;
+
 protected:
-  // size of buffer to allocate for read()
+  // default size of buffer to allocate for read()
   static constexpr size_t kReadBufferSize = 16384;
 
+  // maximum number of buffers filled by one scatter-read
+  static constexpr size_t kMaxReadChunks = 64;
+
+  // maximum number of buffers sent by one gather-write
+  static constexpr size_t kMaxWriteChunks = 64;
+
   void set_eof() { internal_fd_->eof_ = true; }
   void register_read() { ++internal_fd_->read_count_; }   // increment read count
   void register_write() { ++internal_fd_->write_count_; } // increment write count
@@ -54,22 +80,92 @@ protected:
   template<typename T>
   T CheckSystemCall( std::string_view s_attempt, T return_value ) const;
 
+  // Time a system call for the statistics: returns its start time, or 0 if statistics aren't enabled
+  uint64_t io_start() const { return internal_fd_->stats_ ? IOStats::now_ns() : 0; }
+
+  // Add a system call that started at `started_ns` (0 if untimed) to this descriptor's statistics and the
+  // global ones, if statistics are enabled
+  void record_io( IOStats::Direction direction, uint64_t started_ns, ssize_t result, size_t requested ) const
+  {
+    if ( internal_fd_->stats_ ) {
+      record_stats( direction, started_ns, result, requested );
+    }
+  }
+
+  // Account for a read-like or write-like system call without throwing (errno must still be set if it failed)
+  IOResult try_finish_read( ssize_t bytes_read, size_t requested, uint64_t started_ns ) noexcept;
+  IOResult try_finish_write( ssize_t bytes_written, size_t requested, uint64_t started_ns ) noexcept;
+
+  // Account for the result of a read-like system call that asked for `requested` bytes
+  size_t finish_read( std::string_view s_attempt, ssize_t bytes_read, size_t requested, uint64_t started_ns = 0 );
+
+  // Account for the result of a write-like system call that offered `requested` bytes
+  size_t finish_write( std::string_view s_attempt,
+                       ssize_t bytes_written,
+                       size_t requested,
+                       uint64_t started_ns = 0 );
+
+  // The system calls behind read(), write() and accept(), made through the attached IOUring if there is one
+  // (see IOUring::attach()); each returns what the system call would, with errno set on failure
+  ssize_t sys_read( std::span<char> buffer );
+  ssize_t sys_readv( std::span<const iovec> iovecs );
+  ssize_t sys_writev( std::span<const iovec> iovecs );
+  int sys_accept( int flags );
+
+  // completes reads and writes that were submitted asynchronously
+  friend class IOUring;
+
 public:
   // Construct from a file descriptor number returned by the kernel
   explicit FileDescriptor( int fd );
 
+  // Construct from a descriptor the kernel just created with known flags (e.g. by accept4( SOCK_NONBLOCK ) or
+  // eventfd( EFD_NONBLOCK )), skipping the fcntl that would look up whether it is non-blocking. Builds with
+  // CHECK_TRUSTED_DESCRIPTORS defined make the fcntl anyway, and throw if `non_blocking` is wrong.
+  FileDescriptor( int fd, bool non_blocking );
+
   // Free the std::shared_ptr; the FDWrapper destructor calls close() when the refcount goes to zero.
   ~FileDescriptor() = default;
 
-  // Read into `buffer`
+  // Read into `buffer`, replacing its contents with up to read_size() bytes (empty if the read would block)
   void read( std::string& buffer );
-  void read( std::vector<std::unique_ptr<std::string>>& buffers );
+
+  // Scatter-read into `buffers` with one readv: each buffer is grown to read_size(), then trimmed to
+  // what the kernel supplied (buffers past the data are left empty)
+  // returns number of buffers that received data
+  size_t read( std::vector<std::unique_ptr<std::string>>& buffers );
+
+  // Read into caller-owned storage without allocating or zero-filling
+  // returns number of bytes read (0 at EOF, or if a non-blocking read would block)
+  size_t read( std::span<char> buffer );
+
+  // Scatter-read into the first kMaxReadChunks of `chunks` with one readv, filling them in order
+  // returns number of bytes read; with fixed-size chunks, ceil(bytes / chunk size) chunks were filled
+  size_t read( std::span<const std::span<char>> chunks );
+
+  // Read into the full capacity of `buffer` (e.g. a slab from a BufferPool), replacing its contents
+  void read( OwnedBuffer& buffer );
+
+  // Number of bytes requested by read( std::string& )
+  size_t read_size() const { return internal_fd_->read_size_; }
+  void set_read_size( size_t size );
 
   // Attempt to write a buffer
   // returns number of bytes written
   size_t write( std::string_view buffer );
   size_t write( const std::vector<std::string_view>& buffers );
 
+  // Gather-write `buffers` without allocating, with one writev per kMaxWriteChunks of them; stops early if a
+  // writev is short (e.g. a non-blocking fd fills up), so the count returned may be less than the total
+  size_t write( std::span<const std::string_view> buffers );
+
+  // Non-throwing versions of read() and write() for hot loops: failures, including EAGAIN on a non-blocking
+  // descriptor, come back as an IOResult instead of an exception (EOF is success with 0 bytes, as for read())
+  IOResult try_read( std::span<char> buffer ) noexcept;
+  IOResult try_read( OwnedBuffer& buffer ) noexcept; // replaces the contents, up to its capacity
+  IOResult try_write( std::string_view buffer ) noexcept;
+  IOResult try_write( std::span<const std::string_view> buffers ) noexcept; // first kMaxWriteChunks only
+
   // Close the underlying file descriptor
   void close() { internal_fd_->close(); }
 
@@ -82,10 +178,18 @@ public:
   // Size of file
   off_t size() const;
 
+  // Start recording statistics on the system calls made on this descriptor (and its duplicates),
+  // which are also added to IOStats::global()
+  void enable_stats();
+
+  // Statistics recorded so far, or nullptr if not enabled; they may be kept after the descriptor closes
+  std::shared_ptr<const IOStats> stats() const { return internal_fd_->stats_; }
+
   // FDWrapper accessors
   int fd_num() const { return internal_fd_->fd_; }                        // underlying descriptor number
   bool eof() const { return internal_fd_->eof_; }                         // EOF flag state
   bool closed() const { return internal_fd_->closed_; }                   // closed flag state
+  bool blocking() const { return not internal_fd_->non_blocking_; }       // blocking mode
   unsigned int read_count() const { return internal_fd_->read_count_; }   // number of reads
   unsigned int write_count() const { return internal_fd_->write_count_; } // number of writes
 
@@ -0,0 +1,80 @@
+#include "flow_table.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+array<uint8_t, 16> FlowKey::mapped( const uint32_t ipv4 )
+{
+  array<uint8_t, 16> ip {};
+  ip[10] = ip[11] = 0xff; // NOLINT(*-magic-numbers)
+  const uint32_t network_order = htobe32( ipv4 );
+  memcpy( &ip[12], &network_order, sizeof( network_order ) );
+  return ip;
+}
+
+//! \param[in] local is the flow's local Address
+//! \param[in] remote is the flow's remote Address (of the same family, unless one of them is IPv4-mapped)
+FlowKey::FlowKey( const Address& local, const Address& remote )
+  : local_port_( local.port() ), remote_port_( remote.port() )
+{
+  for ( auto [address, ip] : { pair { &local, &local_ip_ }, pair { &remote, &remote_ip_ } } ) {
+    switch ( address->family() ) {
+      case AF_INET:
+        *ip = mapped( address->ipv4_numeric() );
+        break;
+      case AF_INET6:
+        *ip = address->ipv6_numeric();
+        break;
+      default:
+        throw runtime_error( "FlowKey: not an IP address" );
+    }
+  }
+}
+
+FlowKey FlowKey::from_ipv4( const uint32_t local_ip,
+                            const uint16_t local_port,
+                            const uint32_t remote_ip,
+                            const uint16_t remote_port )
+{
+  FlowKey key;
+  key.local_ip_ = mapped( local_ip );
+  key.remote_ip_ = mapped( remote_ip );
+  key.local_port_ = local_port;
+  key.remote_port_ = remote_port;
+  return key;
+}
+
+FlowKey FlowKey::reversed() const
+{
+  FlowKey key;
+  key.local_ip_ = remote_ip_;
+  key.remote_ip_ = local_ip_;
+  key.local_port_ = remote_port_;
+  key.remote_port_ = local_port_;
+  return key;
+}
+
+bool FlowKey::is_ipv4() const
+{
+  // the first 12 bytes of an IPv4-mapped address
+  const array<uint8_t, 12> prefix = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff }; // NOLINT(*-magic-numbers)
+  return equal( prefix.begin(), prefix.end(), local_ip_.begin() )
+         and equal( prefix.begin(), prefix.end(), remote_ip_.begin() );
+}
+
+Address FlowKey::local() const
+{
+  return Address::from_ipv6_numeric( local_ip_, local_port_ ).unmapped();
+}
+
+Address FlowKey::remote() const
+{
+  return Address::from_ipv6_numeric( remote_ip_, remote_port_ ).unmapped();
+}
+
+string FlowKey::to_string() const
+{
+  return local().to_string() + " -> " + remote().to_string();
+}
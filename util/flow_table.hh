@@ -0,0 +1,339 @@
+#pragma once
+
+#include "address.hh"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+//! \brief The local and remote IP addresses and ports of a flow, in 36 bytes that compare and hash quickly
+//! \details IPv4 addresses are kept in their IPv4-mapped IPv6 form ("::ffff:1.2.3.4"), so a peer reached
+//! over IPv4 has the same key whether it comes from an IPv4 socket or a dual-stack one. The index of a
+//! FlowTable; unlike Address, building one from packet headers needs no resolver or string formatting.
+class FlowKey
+{
+  std::array<uint8_t, 16> local_ip_ {};  //!< In network order
+  std::array<uint8_t, 16> remote_ip_ {}; //!< In network order
+  uint16_t local_port_ {};               //!< In host order
+  uint16_t remote_port_ {};              //!< In host order
+
+  //! The IPv4-mapped form of a 32-bit IPv4 address (in host order)
+  static std::array<uint8_t, 16> mapped( uint32_t ipv4 );
+
+public:
+  //! The unspecified flow, "[::]:0 -> [::]:0"
+  FlowKey() = default;
+
+  //! Construct from a flow's local and remote Addresses (IPv4 or IPv6, e.g. a socket's); throws otherwise
+  FlowKey( const Address& local, const Address& remote );
+
+  //! Construct from the addresses and ports of an IPv4 flow (in host order, e.g. from packet headers)
+  static FlowKey from_ipv4( uint32_t local_ip, uint16_t local_port, uint32_t remote_ip, uint16_t remote_port );
+
+  //! The same flow seen from the other end
+  FlowKey reversed() const;
+
+  //! Whether both ends are IPv4 addresses
+  bool is_ipv4() const;
+
+  //! The local Address (IPv4 if it is IPv4-mapped)
+  Address local() const;
+  //! The remote Address (IPv4 if it is IPv4-mapped)
+  Address remote() const;
+  //! Human-readable string, e.g., "10.0.0.1:5000 -> 10.0.0.2:80"
+  std::string to_string() const;
+
+  //! Equality comparison (of all four fields)
+  bool operator==( const FlowKey& other ) const = default;
+
+  //! Hash consistent with operator==, whose every bit depends on every field
+  size_t hash() const
+  {
+    // the key is 36 bytes without padding; fold it as four 64-bit words and the ports
+    std::array<uint64_t, 4> words {};
+    memcpy( words.data(), this, sizeof( words ) );
+    uint32_t ports {};
+    memcpy( &ports, &local_port_, sizeof( ports ) );
+
+    uint64_t h = ports;
+    for ( const uint64_t word : words ) {
+      h = ( h ^ word ) * 0x9e3779b97f4a7c15ULL; // NOLINT(*-magic-numbers)
+      h ^= h >> 32U;                            // NOLINT(*-magic-numbers)
+    }
+    // the splitmix64 finalizer, as for Address::hash()
+    h = ( h ^ ( h >> 30U ) ) * 0xbf58476d1ce4e5b9ULL; // NOLINT(*-magic-numbers)
+    h = ( h ^ ( h >> 27U ) ) * 0x94d049bb133111ebULL; // NOLINT(*-magic-numbers)
+    return h ^ ( h >> 31U );                          // NOLINT(*-magic-numbers)
+  }
+};
+
+static_assert( sizeof( FlowKey ) == 36 and std::has_unique_object_representations_v<FlowKey> );
+
+template<>
+struct std::hash<FlowKey>
+{
+  size_t operator()( const FlowKey& key ) const { return key.hash(); }
+};
+
+//! \brief A hash table of per-flow state, stored inline with open addressing
+//! \details Entries live in one array and are found by linear probing, guided by a separate array of 32-bit
+//! tags (part of each entry's hash), so a lookup usually touches one cache line of tags and then the one
+//! entry it wants. Erasing shifts later entries of the probe sequence back, so there are no tombstones and
+//! lookups stay short however much the table churns. The capacity is a power of two, at most 7/8 full.
+//!
+//! Any key with a good std::hash and operator== works (FlowKey, or Address). Inserting or erasing may
+//! move other entries, so pointers and references into the table are valid only until the next change.
+template<typename Value, typename Key = FlowKey, typename Hash = std::hash<Key>>
+class FlowTable
+{
+public:
+  //! An entry in the table
+  struct Entry
+  {
+    Key key;     //!< Never changed while in the table
+    Value value; //!< The flow's state
+  };
+
+private:
+  //! Uninitialized storage for one Entry
+  struct Slot
+  {
+    alignas( Entry ) std::byte storage[sizeof( Entry )]; // NOLINT(*-avoid-c-arrays)
+
+    Entry* get() { return std::launder( reinterpret_cast<Entry*>( storage ) ); } // NOLINT(*-reinterpret-cast)
+  };
+
+  static constexpr size_t kMinCapacity = 16;
+
+  size_t mask_ = 0;                     //!< capacity - 1 (capacity is 0 until the first insert)
+  size_t size_ = 0;                     //!< Number of entries
+  std::unique_ptr<uint32_t[]> tags_ {}; //!< Per slot: 0 if empty, or a nonzero part of the entry's hash
+  std::unique_ptr<Slot[]> slots_ {};    //!< The entries, where tags_ is nonzero
+  [[no_unique_address]] Hash hasher_ {};
+
+  //! The tag of a hash: its upper half, never 0
+  static uint32_t tag_of( const size_t hash ) { return static_cast<uint32_t>( hash >> 32U ) | 1U; }
+
+  //! The slot holding `key`, or where it would be inserted (the first empty slot of its probe sequence)
+  size_t probe( const Key& key, const size_t hash ) const
+  {
+    const uint32_t tag = tag_of( hash );
+    for ( size_t index = hash & mask_;; index = ( index + 1 ) & mask_ ) {
+      const uint32_t slot_tag = tags_[index];
+      if ( slot_tag == 0 or ( slot_tag == tag and slots_[index].get()->key == key ) ) {
+        return index;
+      }
+    }
+  }
+
+  //! Move every entry into a new array of `capacity` slots
+  void rehash( size_t capacity )
+  {
+    FlowTable bigger;
+    bigger.mask_ = capacity - 1;
+    bigger.tags_ = std::make_unique<uint32_t[]>( capacity ); // NOLINT(*-avoid-c-arrays)
+    bigger.slots_ = std::make_unique_for_overwrite<Slot[]>( capacity ); // NOLINT(*-avoid-c-arrays)
+    bigger.hasher_ = hasher_;
+
+    for_each_slot( [&]( const size_t index ) {
+      Entry* const entry = slots_[index].get();
+      const size_t hash = hasher_( entry->key );
+      const size_t target = bigger.probe( entry->key, hash );
+      ::new ( static_cast<void*>( bigger.slots_[target].storage ) ) Entry { std::move( *entry ) };
+      bigger.tags_[target] = tag_of( hash );
+      ++bigger.size_;
+    } );
+    *this = std::move( bigger );
+  }
+
+  template<typename Function>
+  void for_each_slot( Function&& function ) const
+  {
+    for ( size_t index = 0; size_ > 0 and index <= mask_; ++index ) {
+      if ( tags_[index] != 0 ) {
+        function( index );
+      }
+    }
+  }
+
+  //! Empty the slot at `index`, then shift back later entries of its probe sequence to close the gap
+  void erase_slot( size_t index )
+  {
+    slots_[index].get()->~Entry();
+    --size_;
+    for ( size_t next = ( index + 1 ) & mask_; tags_[next] != 0; next = ( next + 1 ) & mask_ ) {
+      // an entry can move back to the gap unless its home slot lies after the gap (cyclically)
+      Entry* const entry = slots_[next].get();
+      const size_t home = hasher_( entry->key ) & mask_;
+      if ( ( ( next - home ) & mask_ ) < ( ( next - index ) & mask_ ) ) {
+        continue;
+      }
+      ::new ( static_cast<void*>( slots_[index].storage ) ) Entry { std::move( *entry ) };
+      entry->~Entry();
+      tags_[index] = tags_[next];
+      index = next;
+    }
+    tags_[index] = 0;
+  }
+
+  void destroy_all()
+  {
+    for_each_slot( [&]( const size_t index ) { slots_[index].get()->~Entry(); } );
+  }
+
+public:
+  FlowTable() = default;
+
+  //! Construct with room for `count` entries before the table grows
+  explicit FlowTable( const size_t count ) { reserve( count ); }
+
+  //! Number of entries
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  //! Number of slots (entries fit until it is 7/8 full)
+  size_t capacity() const { return tags_ ? mask_ + 1 : 0; }
+
+  //! Make room for `count` entries without growing again
+  void reserve( const size_t count )
+  {
+    const size_t capacity = std::bit_ceil( std::max( kMinCapacity, count + count / 7 + 1 ) );
+    if ( capacity > this->capacity() ) {
+      rehash( capacity );
+    }
+  }
+
+  //! The value for `key`, or nullptr if there isn't one
+  Value* find( const Key& key )
+  {
+    if ( size_ == 0 ) {
+      return nullptr;
+    }
+    const size_t index = probe( key, hasher_( key ) );
+    return tags_[index] != 0 ? &slots_[index].get()->value : nullptr;
+  }
+
+  const Value* find( const Key& key ) const { return const_cast<FlowTable*>( this )->find( key ); } // NOLINT
+
+  bool contains( const Key& key ) const { return find( key ) != nullptr; }
+
+  //! \brief The value for `key`, constructed from `args` if there isn't one yet
+  //! \returns the value, and whether it was inserted
+  template<typename... Args>
+  std::pair<Value&, bool> try_emplace( const Key& key, Args&&... args )
+  {
+    if ( ( size_ + 1 ) * 8 > capacity() * 7 ) {
+      rehash( std::max( kMinCapacity, capacity() * 2 ) );
+    }
+
+    const size_t hash = hasher_( key );
+    const size_t index = probe( key, hash );
+    if ( tags_[index] != 0 ) {
+      return { slots_[index].get()->value, false };
+    }
+
+    ::new ( static_cast<void*>( slots_[index].storage ) ) Entry { key, Value( std::forward<Args>( args )... ) };
+    tags_[index] = tag_of( hash );
+    ++size_;
+    return { slots_[index].get()->value, true };
+  }
+
+  //! The value for `key`, value-initialized if there isn't one yet
+  Value& operator[]( const Key& key ) { return try_emplace( key ).first; }
+
+  //! Remove the entry for `key`
+  //! \returns whether there was one
+  bool erase( const Key& key )
+  {
+    if ( size_ == 0 ) {
+      return false;
+    }
+    const size_t index = probe( key, hasher_( key ) );
+    if ( tags_[index] == 0 ) {
+      return false;
+    }
+    erase_slot( index );
+    return true;
+  }
+
+  //! \brief Remove every entry for which `predicate( key, value )` is true, e.g. idle flows
+  //! \returns the number removed
+  template<typename Predicate>
+  size_t erase_if( Predicate&& predicate )
+  {
+    // a backward shift can move an entry from a later slot into this one, so recheck the slot; one can
+    // also move an entry from the start of the array past the end, so sweep from the first empty slot
+    size_t start = 0;
+    while ( size_ > 0 and tags_[start] != 0 ) {
+      ++start;
+    }
+
+    size_t removed = 0;
+    for ( size_t offset = 0; size_ > 0 and offset <= mask_; ++offset ) {
+      const size_t index = ( start + offset ) & mask_;
+      while ( tags_[index] != 0 ) {
+        Entry* const entry = slots_[index].get();
+        if ( not predicate( std::as_const( entry->key ), entry->value ) ) {
+          break;
+        }
+        erase_slot( index );
+        ++removed;
+      }
+    }
+    return removed;
+  }
+
+  //! Call `function( key, value )` for every entry, in no particular order (it mustn't change the table)
+  template<typename Function>
+  void for_each( Function&& function )
+  {
+    for_each_slot( [&]( const size_t index ) {
+      Entry* const entry = slots_[index].get();
+      function( std::as_const( entry->key ), entry->value );
+    } );
+  }
+
+  //! Remove every entry (keeping the capacity)
+  void clear()
+  {
+    destroy_all();
+    if ( tags_ ) {
+      std::fill_n( tags_.get(), mask_ + 1, 0 );
+    }
+    size_ = 0;
+  }
+
+  ~FlowTable() { destroy_all(); }
+
+  FlowTable( const FlowTable& other ) = delete;
+  FlowTable& operator=( const FlowTable& other ) = delete;
+
+  FlowTable( FlowTable&& other ) noexcept
+    : mask_( std::exchange( other.mask_, 0 ) )
+    , size_( std::exchange( other.size_, 0 ) )
+    , tags_( std::move( other.tags_ ) )
+    , slots_( std::move( other.slots_ ) )
+    , hasher_( std::move( other.hasher_ ) )
+  {}
+
+  FlowTable& operator=( FlowTable&& other ) noexcept
+  {
+    if ( this != &other ) {
+      destroy_all();
+      mask_ = std::exchange( other.mask_, 0 );
+      size_ = std::exchange( other.size_, 0 );
+      tags_ = std::move( other.tags_ );
+      slots_ = std::move( other.slots_ );
+      hasher_ = std::move( other.hasher_ );
+    }
+    return *this;
+  }
+};
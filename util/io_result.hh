@@ -0,0 +1,48 @@
+#pragma once
+
+#include "exception.hh"
+
+#include <cerrno>
+#include <cstddef>
+#include <string_view>
+#include <system_error>
+
+// The outcome of a non-throwing I/O call (e.g. FileDescriptor::try_read()): a byte count, or the errno of
+// the failure. Building one never allocates, so expected network errors (EAGAIN, ECONNRESET, EPIPE, ...)
+// cost no more than success; callers that want an exception after all can use value_or_throw().
+class IOResult
+{
+  size_t bytes_ {};
+  int error_ {};
+
+  constexpr IOResult( size_t bytes, int error ) : bytes_( bytes ), error_( error ) {}
+
+public:
+  constexpr IOResult() = default;
+
+  static constexpr IOResult success( size_t bytes ) { return { bytes, 0 }; }
+  static constexpr IOResult failure( int error ) { return { 0, error }; }
+
+  constexpr bool ok() const { return error_ == 0; }
+  constexpr explicit operator bool() const { return ok(); }
+
+  // Bytes transferred (0 on failure, or at EOF for a read)
+  constexpr size_t bytes() const { return bytes_; }
+
+  // The errno of a failure (0 on success)
+  constexpr int error() const { return error_; }
+
+  // Whether a non-blocking call failed only because it would have blocked
+  constexpr bool would_block() const { return error_ == EAGAIN or error_ == EWOULDBLOCK; }
+
+  std::error_code error_code() const { return { error_, std::system_category() }; }
+
+  // The byte count, or throw unix_error (tagged with s_attempt) if the call failed
+  size_t value_or_throw( std::string_view s_attempt ) const
+  {
+    if ( not ok() ) {
+      throw unix_error { s_attempt, error_ };
+    }
+    return bytes_;
+  }
+};
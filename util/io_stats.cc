@@ -0,0 +1,184 @@
+#include "io_stats.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+size_t LatencyHistogram::bucket_of( uint64_t ns )
+{
+  if ( ns < kSubBuckets ) {
+    return ns;
+  }
+  const unsigned exponent = min<unsigned>( bit_width( ns ) - 1, kMaxExponent );
+  if ( exponent == kMaxExponent ) {
+    return kBuckets - 1;
+  }
+  // the top kSubBucketBits + 1 bits of ns: a leading 1, then the position within the power of two
+  const uint64_t top = ns >> ( exponent - kSubBucketBits );
+  return ( exponent - kSubBucketBits + 1 ) * kSubBuckets + ( top - kSubBuckets );
+}
+
+uint64_t LatencyHistogram::bucket_floor( size_t index )
+{
+  if ( index < kSubBuckets ) {
+    return index;
+  }
+  const size_t exponent = index / kSubBuckets + kSubBucketBits - 1;
+  return ( kSubBuckets + index % kSubBuckets ) << ( exponent - kSubBucketBits );
+}
+
+uint64_t LatencyHistogram::count() const
+{
+  uint64_t total = 0;
+  for ( const uint64_t n : counts ) {
+    total += n;
+  }
+  return total;
+}
+
+// reports the middle of the bucket that contains the requested rank (never more than the maximum)
+uint64_t LatencyHistogram::percentile( double quantile ) const
+{
+  const uint64_t total = count();
+  if ( total == 0 ) {
+    return 0;
+  }
+  const auto rank = static_cast<uint64_t>( clamp( quantile, 0.0, 1.0 ) * static_cast<double>( total - 1 ) );
+  uint64_t seen = 0;
+  for ( size_t i = 0; i < kBuckets; ++i ) {
+    seen += counts[i];
+    if ( seen > rank ) {
+      const uint64_t floor = bucket_floor( i );
+      const uint64_t width = i + 1 < kBuckets ? bucket_floor( i + 1 ) - floor : 1;
+      return min( floor + width / 2, max_ns );
+    }
+  }
+  return max_ns;
+}
+
+void LatencyHistogram::record( uint64_t ns )
+{
+  ++counts[bucket_of( ns )];
+  max_ns = max( max_ns, ns );
+}
+
+void LatencyHistogram::merge( const LatencyHistogram& other )
+{
+  for ( size_t i = 0; i < kBuckets; ++i ) {
+    counts[i] += other.counts[i];
+  }
+  max_ns = max( max_ns, other.max_ns );
+}
+
+uint64_t IOStats::now_ns()
+{
+  return chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void IOStats::AtomicCounters::record( ssize_t result, size_t requested, uint64_t latency_ns )
+{
+  calls.fetch_add( 1, memory_order_relaxed );
+  if ( result < 0 ) {
+    ( errno == EAGAIN or errno == EINPROGRESS ? would_block : errors ).fetch_add( 1, memory_order_relaxed );
+  } else {
+    bytes.fetch_add( result, memory_order_relaxed );
+    if ( result > 0 and static_cast<size_t>( result ) < requested ) {
+      short_calls.fetch_add( 1, memory_order_relaxed );
+    }
+  }
+
+  if ( latency_ns != kUntimed ) {
+    latency[LatencyHistogram::bucket_of( latency_ns )].fetch_add( 1, memory_order_relaxed );
+    uint64_t previous = max_ns.load( memory_order_relaxed );
+    while ( previous < latency_ns and not max_ns.compare_exchange_weak( previous, latency_ns ) ) {}
+  }
+}
+
+IOStats::Counters IOStats::AtomicCounters::load() const
+{
+  Counters counters;
+  counters.calls = calls.load( memory_order_relaxed );
+  counters.bytes = bytes.load( memory_order_relaxed );
+  counters.short_calls = short_calls.load( memory_order_relaxed );
+  counters.would_block = would_block.load( memory_order_relaxed );
+  counters.errors = errors.load( memory_order_relaxed );
+  for ( size_t i = 0; i < LatencyHistogram::kBuckets; ++i ) {
+    counters.latency.counts[i] = latency[i].load( memory_order_relaxed );
+  }
+  counters.latency.max_ns = max_ns.load( memory_order_relaxed );
+  return counters;
+}
+
+void IOStats::AtomicCounters::reset()
+{
+  for ( auto* counter : { &calls, &bytes, &short_calls, &would_block, &errors, &max_ns } ) {
+    counter->store( 0, memory_order_relaxed );
+  }
+  for ( auto& bucket : latency ) {
+    bucket.store( 0, memory_order_relaxed );
+  }
+}
+
+// errno is left as it was, so a caller can go on to report the failure
+void IOStats::record( Direction direction, ssize_t result, size_t requested, uint64_t latency_ns )
+{
+  const int saved_errno = errno;
+  ( direction == Direction::Read ? read_ : write_ ).record( result, requested, latency_ns );
+  errno = saved_errno;
+}
+
+IOStats::Snapshot IOStats::snapshot() const
+{
+  return { read_.load(), write_.load() };
+}
+
+void IOStats::reset()
+{
+  read_.reset();
+  write_.reset();
+}
+
+IOStats& IOStats::global()
+{
+  static IOStats shared_stats;
+  return shared_stats;
+}
+
+namespace {
+atomic<bool> stats_by_default { false }; // NOLINT(*-avoid-non-const-global-variables)
+} // namespace
+
+void IOStats::set_enabled_by_default( bool enabled )
+{
+  stats_by_default.store( enabled, memory_order_relaxed );
+}
+
+bool IOStats::enabled_by_default()
+{
+  return stats_by_default.load( memory_order_relaxed );
+}
+
+string IOStats::Snapshot::to_string() const
+{
+  constexpr double kNsPerUs = 1000.0;
+
+  ostringstream out;
+  out << fixed << setprecision( 3 );
+  for ( const auto& [name, counters] : { pair { "read", &read }, pair { "write", &write } } ) {
+    out << "   " << left << setw( 6 ) << name << right << "calls=" << counters->calls
+        << "  bytes=" << counters->bytes << "  short=" << counters->short_calls
+        << "  would_block=" << counters->would_block << "  errors=" << counters->errors;
+    if ( counters->latency.count() ) {
+      out << "  p50=" << static_cast<double>( counters->latency.percentile( 0.5 ) ) / kNsPerUs << " us"
+          << "  p99=" << static_cast<double>( counters->latency.percentile( 0.99 ) ) / kNsPerUs << " us"
+          << "  max=" << static_cast<double>( counters->latency.max_ns ) / kNsPerUs << " us";
+    }
+    out << "\n";
+  }
+  return out.str();
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+// A histogram of latencies in nanoseconds with log-linear buckets (as in HdrHistogram): each power of two
+// is split into kSubBuckets equal buckets, so any recorded value is known to within 1/kSubBuckets (6%).
+// Values of 2^kMaxExponent ns (about 18 minutes) or more land in the last bucket.
+class LatencyHistogram
+{
+public:
+  static constexpr unsigned kSubBucketBits = 4;
+  static constexpr uint64_t kSubBuckets = uint64_t { 1 } << kSubBucketBits;
+  static constexpr unsigned kMaxExponent = 40;
+  static constexpr size_t kBuckets = ( kMaxExponent - kSubBucketBits + 1 ) * kSubBuckets;
+
+  // Index of the bucket holding `ns`
+  static size_t bucket_of( uint64_t ns );
+
+  // Smallest value that falls in bucket `index`
+  static uint64_t bucket_floor( size_t index );
+
+  std::array<uint64_t, kBuckets> counts {};
+  uint64_t max_ns {};
+
+  // Number of recorded values
+  uint64_t count() const;
+
+  // Approximate value below which the fraction `quantile` (between 0 and 1) of recorded values fall
+  uint64_t percentile( double quantile ) const;
+
+  void record( uint64_t ns );
+  void merge( const LatencyHistogram& other );
+};
+
+// Opt-in statistics for the system calls made on one FileDescriptor (see FileDescriptor::enable_stats()),
+// and the same statistics summed over every instrumented descriptor (IOStats::global())
+//
+// Counters are relaxed atomics, so a metrics thread may take a snapshot() while the descriptor's own
+// thread keeps recording.
+class IOStats
+{
+public:
+  // Plain copy of the statistics for one direction
+  struct Counters
+  {
+    uint64_t calls {};       // system calls that completed (successfully or not)
+    uint64_t bytes {};       // bytes transferred
+    uint64_t short_calls {}; // calls that transferred some, but fewer than the bytes offered (never datagrams)
+    uint64_t would_block {}; // calls that failed with EAGAIN on a non-blocking descriptor
+    uint64_t errors {};      // calls that failed for any other reason
+    LatencyHistogram latency {};
+  };
+
+  struct Snapshot
+  {
+    Counters read {};
+    Counters write {};
+
+    // Human-readable summary: counts, then latency percentiles
+    std::string to_string() const;
+  };
+
+  enum class Direction : uint8_t
+  {
+    Read,
+    Write
+  };
+
+  // Clock for latency measurements, in nanoseconds
+  static uint64_t now_ns();
+
+  // Passed as the latency of a call that wasn't timed
+  static constexpr uint64_t kUntimed = UINT64_MAX;
+
+  // Account for a system call that returned `result` (with errno still set if it failed) after `requested`
+  // bytes were offered (0 for datagram calls, which can't be short), and took `latency_ns`
+  void record( Direction direction, ssize_t result, size_t requested, uint64_t latency_ns );
+
+  Snapshot snapshot() const;
+  void reset();
+
+  // The statistics of every instrumented descriptor, summed
+  static IOStats& global();
+
+  // Whether FileDescriptors created from now on record statistics from the start (off by default)
+  static void set_enabled_by_default( bool enabled );
+  static bool enabled_by_default();
+
+private:
+  struct AtomicCounters
+  {
+    std::atomic<uint64_t> calls {};
+    std::atomic<uint64_t> bytes {};
+    std::atomic<uint64_t> short_calls {};
+    std::atomic<uint64_t> would_block {};
+    std::atomic<uint64_t> errors {};
+    std::array<std::atomic<uint64_t>, LatencyHistogram::kBuckets> latency {};
+    std::atomic<uint64_t> max_ns {};
+
+    void record( ssize_t result, size_t requested, uint64_t latency_ns );
+    Counters load() const;
+    void reset();
+  };
+
+  AtomicCounters read_ {};
+  AtomicCounters write_ {};
+};
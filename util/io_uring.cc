@@ -0,0 +1,484 @@
+#include "io_uring.hh"
+
+#include "exception.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <iostream>
+#include <limits>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// glibc has no wrappers for the io_uring system calls
+int io_uring_setup( unsigned entries, io_uring_params& params )
+{
+  return static_cast<int>( syscall( __NR_io_uring_setup, entries, &params ) ); // NOLINT(*-vararg)
+}
+
+int io_uring_enter( int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags )
+{
+  // NOLINTNEXTLINE(*-vararg)
+  return static_cast<int>( syscall( __NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0 ) );
+}
+
+int io_uring_register( int ring_fd, unsigned opcode, const void* arg, unsigned nr_args )
+{
+  return static_cast<int>( syscall( __NR_io_uring_register, ring_fd, opcode, arg, nr_args ) ); // NOLINT(*-vararg)
+}
+
+// the submission and completion rings share one mapping (IORING_FEAT_SINGLE_MMAP, Linux 5.4)
+size_t ring_size( const io_uring_params& params )
+{
+  if ( not( params.features & IORING_FEAT_SINGLE_MMAP ) ) { // NOLINT(*-bitwise)
+    throw runtime_error( "io_uring: kernel lacks IORING_FEAT_SINGLE_MMAP" );
+  }
+  return max<size_t>( params.sq_off.array + params.sq_entries * sizeof( unsigned ),
+                      params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe ) );
+}
+
+// user_data of the cancellation requests made by the destructor
+constexpr uint64_t kCancelUserData = numeric_limits<uint64_t>::max();
+
+} // namespace
+
+IOUring::Mapping::Mapping( int ring_fd, size_t length, off_t offset )
+  : addr_( mmap( nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset ) )
+  , length_( length )
+{
+  if ( addr_ == MAP_FAILED ) { // NOLINT(*-cstyle-cast)
+    throw unix_error { "mmap" };
+  }
+}
+
+IOUring::Mapping::~Mapping()
+{
+  munmap( addr_, length_ );
+}
+
+IOUring::IOUring( unsigned entries ) : IOUring( entries, io_uring_params {} ) {}
+
+// params is filled in by io_uring_setup() before the remaining members are initialized from it
+IOUring::IOUring( unsigned entries, io_uring_params&& params )
+  : ring_fd_( [&] {
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = 2 * entries;
+    return FileDescriptor { CheckSystemCall( "io_uring_setup", io_uring_setup( entries, params ) ), false };
+  }() )
+  , sq_entries_( params.sq_entries )
+  , cq_entries_( params.cq_entries )
+  , rings_( ring_fd_.fd_num(), ring_size( params ), IORING_OFF_SQ_RING )
+  , sqes_( ring_fd_.fd_num(), params.sq_entries * sizeof( io_uring_sqe ), IORING_OFF_SQES )
+  , sq_head_( rings_.at<unsigned>( params.sq_off.head ) )
+  , sq_tail_( rings_.at<unsigned>( params.sq_off.tail ) )
+  , sq_mask_( *rings_.at<unsigned>( params.sq_off.ring_mask ) )
+  , sq_array_( rings_.at<unsigned>( params.sq_off.array ) )
+  , sqe_base_( sqes_.at<io_uring_sqe>( 0 ) )
+  , cq_head_( rings_.at<unsigned>( params.cq_off.head ) )
+  , cq_tail_( rings_.at<unsigned>( params.cq_off.tail ) )
+  , cq_mask_( *rings_.at<unsigned>( params.cq_off.ring_mask ) )
+  , cqe_base_( rings_.at<io_uring_cqe>( params.cq_off.cqes ) )
+  , sq_local_tail_( *sq_tail_ )
+{
+  // each submission slot always points at the entry with the same index
+  for ( unsigned i = 0; i < sq_entries_; ++i ) {
+    sq_array_[i] = i; // NOLINT(*-pointer-arithmetic)
+  }
+}
+
+IOUring::~IOUring()
+{
+  for ( const auto& attached : attached_ ) {
+    if ( const auto wrapper = attached.lock(); wrapper and wrapper->ring_ == this ) {
+      wrapper->ring_ = nullptr;
+    }
+  }
+
+  try {
+    cancel_all();
+  } catch ( const exception& e ) {
+    // don't throw an exception from the destructor
+    cerr << "Exception destructing IOUring: " << e.what() << endl;
+  }
+}
+
+io_uring_sqe& IOUring::prepare( uint8_t opcode, FileDescriptor& fd, const void* addr, size_t len, Operation&& op )
+{
+  if ( len > numeric_limits<uint32_t>::max() ) {
+    throw runtime_error( "io_uring: operation larger than 4 GiB" );
+  }
+
+  if ( sq_full() and enter( 0 ) == 0 ) {
+    throw runtime_error( "io_uring: submission ring is full until completions are reaped (see complete())" );
+  }
+
+  uint32_t index {};
+  if ( free_operations_.empty() ) {
+    index = operations_.size();
+    operations_.emplace_back();
+  } else {
+    index = free_operations_.back();
+    free_operations_.pop_back();
+  }
+  op.started_ns = fd.io_start();
+  op.fd.emplace( fd.duplicate() );
+  operations_[index] = move( op );
+  ++in_flight_;
+
+  io_uring_sqe& sqe = sqe_base_[sq_local_tail_ & sq_mask_]; // NOLINT(*-pointer-arithmetic)
+  sqe = {};
+  sqe.opcode = opcode;
+  sqe.off = numeric_limits<uint64_t>::max(); // read and write at the file position, like read(2) and write(2)
+  sqe.addr = reinterpret_cast<uint64_t>( addr ); // NOLINT(*-reinterpret-cast)
+  sqe.len = static_cast<uint32_t>( len );
+  sqe.user_data = index;
+
+  const auto slot = fixed_slots_.find( fd.fd_num() );
+  if ( slot == fixed_slots_.end() ) {
+    sqe.fd = fd.fd_num();
+  } else {
+    sqe.fd = static_cast<int32_t>( slot->second );
+    sqe.flags |= IOSQE_FIXED_FILE; // NOLINT(*-bitwise)
+  }
+
+  ++sq_local_tail_;
+  ++unsubmitted_;
+  return sqe;
+}
+
+bool IOUring::sq_full() const
+{
+  return sq_local_tail_ - atomic_ref { *sq_head_ }.load( memory_order_acquire ) == sq_entries_;
+}
+
+void IOUring::read( FileDescriptor& fd, span<char> buffer, Completion done )
+{
+  prepare( IORING_OP_READ,
+           fd,
+           buffer.data(),
+           buffer.size(),
+           { .done = move( done ), .requested = buffer.size(), .is_read = true } );
+}
+
+void IOUring::read( FileDescriptor& fd, OwnedBuffer& buffer, Completion done )
+{
+  const auto storage = buffer.storage();
+  prepare( IORING_OP_READ,
+           fd,
+           storage.data(),
+           storage.size(),
+           { .done = move( done ), .owned_buffer = &buffer, .requested = storage.size(), .is_read = true } );
+}
+
+void IOUring::write( FileDescriptor& fd, string_view buffer, Completion done )
+{
+  prepare(
+    IORING_OP_WRITE, fd, buffer.data(), buffer.size(), { .done = move( done ), .requested = buffer.size() } );
+}
+
+void IOUring::register_buffers( span<const span<char>> buffers )
+{
+  if ( buffers_registered_ ) {
+    throw runtime_error( "io_uring: buffers are already registered" );
+  }
+
+  vector<iovec> iovecs;
+  iovecs.reserve( buffers.size() );
+  for ( const auto& buffer : buffers ) {
+    iovecs.push_back( { buffer.data(), buffer.size() } );
+  }
+
+  CheckSystemCall(
+    "io_uring_register(IORING_REGISTER_BUFFERS)",
+    io_uring_register(
+      ring_fd_.fd_num(), IORING_REGISTER_BUFFERS, iovecs.data(), static_cast<unsigned>( iovecs.size() ) ) );
+  buffers_registered_ = true;
+}
+
+void IOUring::read_fixed( FileDescriptor& fd, span<char> buffer, unsigned buffer_index, Completion done )
+{
+  auto& sqe = prepare( IORING_OP_READ_FIXED,
+                       fd,
+                       buffer.data(),
+                       buffer.size(),
+                       { .done = move( done ), .requested = buffer.size(), .is_read = true } );
+  sqe.buf_index = buffer_index;
+}
+
+void IOUring::write_fixed( FileDescriptor& fd, string_view buffer, unsigned buffer_index, Completion done )
+{
+  auto& sqe = prepare(
+    IORING_OP_WRITE_FIXED, fd, buffer.data(), buffer.size(), { .done = move( done ), .requested = buffer.size() } );
+  sqe.buf_index = buffer_index;
+}
+
+void IOUring::register_file( const FileDescriptor& fd )
+{
+  if ( fixed_slots_.contains( fd.fd_num() ) ) {
+    return;
+  }
+
+  // the table is registered sparse (every slot -1) on first use, then filled in one slot at a time
+  if ( fixed_files_.empty() ) {
+    fixed_files_.assign( kFixedFiles, -1 );
+    CheckSystemCall(
+      "io_uring_register(IORING_REGISTER_FILES)",
+      io_uring_register( ring_fd_.fd_num(), IORING_REGISTER_FILES, fixed_files_.data(), kFixedFiles ) );
+  }
+
+  const auto free_slot = ranges::find( fixed_files_, -1 );
+  if ( free_slot == fixed_files_.end() ) {
+    throw runtime_error( "io_uring: file table is full" );
+  }
+  const auto slot = static_cast<unsigned>( free_slot - fixed_files_.begin() );
+
+  int fd_num = fd.fd_num();
+  io_uring_files_update update {};
+  update.offset = slot;
+  update.fds = reinterpret_cast<uint64_t>( &fd_num ); // NOLINT(*-reinterpret-cast)
+  CheckSystemCall( "io_uring_register(IORING_REGISTER_FILES_UPDATE)",
+                   io_uring_register( ring_fd_.fd_num(), IORING_REGISTER_FILES_UPDATE, &update, 1 ) );
+
+  *free_slot = fd_num;
+  fixed_slots_.emplace( fd_num, slot );
+}
+
+void IOUring::unregister_file( const FileDescriptor& fd )
+{
+  const auto slot = fixed_slots_.find( fd.fd_num() );
+  if ( slot == fixed_slots_.end() ) {
+    return;
+  }
+
+  int unused = -1;
+  io_uring_files_update update {};
+  update.offset = slot->second;
+  update.fds = reinterpret_cast<uint64_t>( &unused ); // NOLINT(*-reinterpret-cast)
+  CheckSystemCall( "io_uring_register(IORING_REGISTER_FILES_UPDATE)",
+                   io_uring_register( ring_fd_.fd_num(), IORING_REGISTER_FILES_UPDATE, &update, 1 ) );
+
+  fixed_files_.at( slot->second ) = -1;
+  fixed_slots_.erase( slot );
+}
+
+size_t IOUring::enter( unsigned min_complete )
+{
+  atomic_ref { *sq_tail_ }.store( sq_local_tail_, memory_order_release );
+
+  const unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  int submitted = 0;
+  do {
+    submitted = io_uring_enter( ring_fd_.fd_num(), unsubmitted_, min_complete, flags );
+  } while ( submitted < 0 and errno == EINTR );
+
+  if ( submitted < 0 ) {
+    // the completion ring is backed up: completions need to be reaped before trying again
+    if ( errno == EAGAIN or errno == EBUSY ) {
+      return 0;
+    }
+    throw unix_error { "io_uring_enter" };
+  }
+
+  unsubmitted_ -= submitted;
+  return submitted;
+}
+
+size_t IOUring::submit()
+{
+  return unsubmitted_ > 0 ? enter( 0 ) : 0;
+}
+
+size_t IOUring::complete( unsigned min_complete )
+{
+  // completions already reaped by wait_for() count towards min_complete
+  const size_t wanted = min<size_t>( min_complete, in_flight_ );
+  const auto still_wanted = static_cast<unsigned>( wanted > deferred_.size() ? wanted - deferred_.size() : 0 );
+  if ( unsubmitted_ > 0 or still_wanted > 0 ) {
+    enter( still_wanted );
+  }
+
+  size_t completed = 0;
+  while ( not deferred_.empty() ) {
+    const auto [user_data, result] = deferred_.front();
+    deferred_.pop_front();
+    ++completed;
+    finish( user_data, result );
+  }
+
+  unsigned head = *cq_head_;
+  while ( head != atomic_ref { *cq_tail_ }.load( memory_order_acquire ) ) {
+    const io_uring_cqe& cqe = cqe_base_[head & cq_mask_]; // NOLINT(*-pointer-arithmetic)
+    const uint64_t user_data = cqe.user_data;
+    const int32_t result = cqe.res;
+
+    // release the entry before running the completion, which may throw
+    atomic_ref { *cq_head_ }.store( ++head, memory_order_release );
+
+    if ( user_data != kCancelUserData ) {
+      ++completed;
+      finish( user_data, result );
+    }
+  }
+
+  return completed;
+}
+
+IOUring::Operation IOUring::release( uint64_t user_data )
+{
+  Operation op = move( operations_.at( user_data ) );
+  operations_[user_data] = {};
+  free_operations_.push_back( static_cast<uint32_t>( user_data ) );
+  --in_flight_;
+  return op;
+}
+
+void IOUring::finish( uint64_t user_data, int32_t result )
+{
+  Operation op = release( user_data );
+
+  // FileDescriptor's accounting expects a system call's return value, with errno set on failure
+  const ssize_t return_value = result < 0 ? -1 : result;
+  if ( result < 0 ) {
+    errno = -result;
+  }
+
+  size_t bytes = 0;
+  if ( op.is_read ) {
+    bytes = op.fd->finish_read( "io_uring read", return_value, op.requested, op.started_ns );
+    if ( op.owned_buffer ) {
+      op.owned_buffer->resize( bytes );
+    }
+  } else {
+    bytes = op.fd->finish_write( "io_uring write", return_value, op.requested, op.started_ns );
+  }
+
+  op.done( bytes );
+}
+
+ssize_t IOUring::wait_for( uint64_t user_data )
+{
+  while ( true ) {
+    unsigned head = *cq_head_;
+    while ( head != atomic_ref { *cq_tail_ }.load( memory_order_acquire ) ) {
+      const io_uring_cqe& cqe = cqe_base_[head & cq_mask_]; // NOLINT(*-pointer-arithmetic)
+      const uint64_t reaped = cqe.user_data;
+      const int32_t result = cqe.res;
+      atomic_ref { *cq_head_ }.store( ++head, memory_order_release );
+
+      if ( reaped == user_data ) {
+        release( user_data );
+        if ( result < 0 ) {
+          errno = -result;
+          return -1;
+        }
+        return result;
+      }
+      if ( reaped != kCancelUserData ) {
+        deferred_.emplace_back( reaped, result );
+      }
+    }
+
+    // the ring is empty now, so this waits for a new completion (or the kernel to take the entry first)
+    enter( 1 );
+  }
+}
+
+void IOUring::attach( FileDescriptor& fd )
+{
+  IOUring*& ring = fd.internal_fd_->ring_;
+  if ( ring == this ) {
+    return;
+  }
+  if ( ring ) {
+    throw runtime_error( "io_uring: descriptor is already attached to another ring" );
+  }
+
+  ring = this;
+  erase_if( attached_, []( const auto& attached ) { return attached.expired(); } );
+  attached_.emplace_back( fd.internal_fd_ );
+}
+
+void IOUring::detach( FileDescriptor& fd )
+{
+  if ( fd.internal_fd_->ring_ != this ) {
+    return;
+  }
+
+  fd.internal_fd_->ring_ = nullptr;
+  erase_if( attached_, [&]( const auto& attached ) {
+    return attached.expired() or attached.lock() == fd.internal_fd_;
+  } );
+}
+
+ssize_t IOUring::perform_read( FileDescriptor& fd, span<char> buffer )
+{
+  return wait_for( prepare( IORING_OP_READ, fd, buffer.data(), buffer.size(), {} ).user_data );
+}
+
+ssize_t IOUring::perform_readv( FileDescriptor& fd, span<const iovec> iovecs )
+{
+  return wait_for( prepare( IORING_OP_READV, fd, iovecs.data(), iovecs.size(), {} ).user_data );
+}
+
+ssize_t IOUring::perform_writev( FileDescriptor& fd, span<const iovec> iovecs )
+{
+  return wait_for( prepare( IORING_OP_WRITEV, fd, iovecs.data(), iovecs.size(), {} ).user_data );
+}
+
+int IOUring::perform_accept( FileDescriptor& fd, int flags )
+{
+  io_uring_sqe& sqe = prepare( IORING_OP_ACCEPT, fd, nullptr, 0, {} );
+  sqe.addr2 = 0; // shares storage with the file offset that prepare() set; the peer address isn't wanted
+  sqe.accept_flags = static_cast<uint32_t>( flags );
+  return static_cast<int>( wait_for( sqe.user_data ) );
+}
+
+void IOUring::cancel_all()
+{
+  // reap completions without running them, e.g. to let the kernel take more entries
+  const auto discard_completions = [&] {
+    unsigned head = *cq_head_;
+    while ( head != atomic_ref { *cq_tail_ }.load( memory_order_acquire ) ) {
+      const uint64_t user_data = cqe_base_[head & cq_mask_].user_data; // NOLINT(*-pointer-arithmetic)
+      atomic_ref { *cq_head_ }.store( ++head, memory_order_release );
+      if ( user_data != kCancelUserData ) {
+        operations_.at( user_data ) = {};
+        --in_flight_;
+      }
+    }
+  };
+
+  for ( const auto& [user_data, result] : deferred_ ) {
+    operations_.at( user_data ) = {};
+    --in_flight_;
+  }
+  deferred_.clear();
+
+  for ( uint32_t index = 0; index < operations_.size(); ++index ) {
+    if ( operations_[index].fd.has_value() ) {
+      while ( sq_full() and enter( 0 ) == 0 ) {
+        discard_completions();
+      }
+      io_uring_sqe& sqe = sqe_base_[sq_local_tail_ & sq_mask_]; // NOLINT(*-pointer-arithmetic)
+      sqe = {};
+      sqe.opcode = IORING_OP_ASYNC_CANCEL;
+      sqe.addr = index;
+      sqe.user_data = kCancelUserData;
+      ++sq_local_tail_;
+      ++unsubmitted_;
+    }
+  }
+
+  // wait for every operation to finish or be cancelled, discarding the results
+  while ( in_flight_ > 0 or unsubmitted_ > 0 ) {
+    enter( in_flight_ > 0 ? 1 : 0 );
+    discard_completions();
+  }
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "buffer.hh"
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <sys/uio.h>
+#include <unordered_map>
+#include <vector>
+
+struct io_uring_params;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+//! \brief An [io_uring(7)](\ref man7::io_uring) instance that batches reads and writes on many FileDescriptors
+//! \details Operations are queued on the submission ring and handed to the kernel together by submit() or
+//! complete(), so a batch of reads and writes costs one io_uring_enter instead of one system call each.
+//! Completions update the FileDescriptor exactly as FileDescriptor::read() and write() would (EOF flag,
+//! read and write counts), so sockets shared with an EventLoop or synchronous code stay consistent.
+//! Code written against FileDescriptor (or TCPSocket) can also use the ring unchanged, through attach().
+//!
+//! Buffers passed to an operation must stay valid, and the FileDescriptor open, until its completion runs.
+class IOUring
+{
+public:
+  //! Receives the number of bytes transferred (0 at EOF, or if a non-blocking operation would have blocked)
+  using Completion = std::function<void( size_t )>;
+
+private:
+  //! An mmap(2)ed region shared with the kernel
+  class Mapping
+  {
+    void* addr_ {};
+    size_t length_ {};
+
+  public:
+    Mapping( int ring_fd, size_t length, off_t offset );
+    ~Mapping();
+
+    template<typename T>
+    T* at( size_t offset ) const
+    {
+      return reinterpret_cast<T*>( static_cast<char*>( addr_ ) + offset ); // NOLINT(*-reinterpret-cast)
+    }
+
+    Mapping( const Mapping& other ) = delete;
+    Mapping& operator=( const Mapping& other ) = delete;
+    Mapping( Mapping&& other ) = delete;
+    Mapping& operator=( Mapping&& other ) = delete;
+  };
+
+  struct Operation
+  {
+    std::optional<FileDescriptor> fd {}; //!< Keeps the descriptor alive, and receives the accounting
+    Completion done {};
+    OwnedBuffer* owned_buffer {};        //!< Resized to the result, for read( ..., OwnedBuffer& )
+    size_t requested {};
+    uint64_t started_ns {};              //!< For the descriptor's statistics, which count time queued too
+    bool is_read {};
+  };
+
+  FileDescriptor ring_fd_;
+  unsigned sq_entries_;
+  unsigned cq_entries_;
+  Mapping rings_;
+  Mapping sqes_;
+
+  // pointers into the shared ring memory
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  io_uring_sqe* sqe_base_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe* cqe_base_;
+
+  unsigned sq_local_tail_ {}; //!< Entries up to here are prepared but not yet published to the kernel
+  unsigned unsubmitted_ {};   //!< Entries published but not yet passed to io_uring_enter
+
+  std::vector<Operation> operations_ {}; //!< Indexed by the user_data of each entry
+  std::vector<uint32_t> free_operations_ {};
+  size_t in_flight_ {};
+
+  //! Completions reaped while an attached descriptor waited for its own operation, run by complete()
+  std::deque<std::pair<uint64_t, int32_t>> deferred_ {};
+
+  //! Descriptors whose read(), write() and accept() calls go through this ring (see attach())
+  std::vector<std::weak_ptr<FileDescriptor::FDWrapper>> attached_ {};
+
+  static constexpr size_t kFixedFiles = 1024;
+
+  std::vector<int> fixed_files_ {}; //!< Registered file table (-1 marks a free slot), allocated on first use
+  std::unordered_map<int, unsigned> fixed_slots_ {};
+  bool buffers_registered_ {};
+
+  IOUring( unsigned entries, io_uring_params&& params );
+
+  //! Whether every submission entry is prepared but not yet consumed by the kernel
+  bool sq_full() const;
+
+  //! \brief Claim a submission entry for `fd`, submitting queued entries first if the ring is full
+  //! \details Throws if the kernel won't take them until completions are reaped (see complete()).
+  io_uring_sqe& prepare( uint8_t opcode, FileDescriptor& fd, const void* addr, size_t len, Operation&& op );
+
+  //! Publish prepared entries and call io_uring_enter (retrying if interrupted)
+  //! \returns the number of entries the kernel consumed: 0 if it was too busy to take any
+  size_t enter( unsigned min_complete );
+
+  //! Free the operation with this user_data, returning it
+  Operation release( uint64_t user_data );
+
+  //! Deliver one completion (the entry has already been consumed from the ring)
+  void finish( uint64_t user_data, int32_t result );
+
+  //! \brief Wait for the operation with this user_data, for an attached descriptor
+  //! \details Other completions reaped meanwhile are kept for complete(), so they run in order and their
+  //! errors are thrown there, not from the attached descriptor's call.
+  //! \returns the result as a system call would: -1 with errno set on failure
+  ssize_t wait_for( uint64_t user_data );
+
+  // the system calls of an attached FileDescriptor (see FileDescriptor::sys_read() and friends)
+  ssize_t perform_read( FileDescriptor& fd, std::span<char> buffer );
+  ssize_t perform_readv( FileDescriptor& fd, std::span<const iovec> iovecs );
+  ssize_t perform_writev( FileDescriptor& fd, std::span<const iovec> iovecs );
+  int perform_accept( FileDescriptor& fd, int flags );
+  friend class FileDescriptor;
+
+  //! Ask the kernel to cancel every operation in flight, and wait for them without running completions
+  void cancel_all();
+
+public:
+  //! \param[in] entries is the size of the submission ring (rounded up to a power of two by the kernel);
+  //! the completion ring is twice as large
+  explicit IOUring( unsigned entries = 256 );
+
+  //! Queue a read into `buffer`
+  void read( FileDescriptor& fd, std::span<char> buffer, Completion done );
+
+  //! Queue a read into the full capacity of `buffer`, which is resized to the result before `done` runs
+  void read( FileDescriptor& fd, OwnedBuffer& buffer, Completion done );
+
+  //! Queue a write of `buffer`
+  void write( FileDescriptor& fd, std::string_view buffer, Completion done );
+
+  //! \brief Register buffers with the kernel, which pins them once instead of mapping them on every operation
+  //! \details May be called once; the buffers must stay valid for the life of the IOUring.
+  void register_buffers( std::span<const std::span<char>> buffers );
+
+  //! Queue a read into `buffer`, which must lie within registered buffer number `buffer_index`
+  void read_fixed( FileDescriptor& fd, std::span<char> buffer, unsigned buffer_index, Completion done );
+
+  //! Queue a write of `buffer`, which must lie within registered buffer number `buffer_index`
+  void write_fixed( FileDescriptor& fd, std::string_view buffer, unsigned buffer_index, Completion done );
+
+  //! \brief Add `fd` to the ring's file table
+  //! \details Later operations on it skip the kernel's per-operation file lookup and reference count.
+  //! Unregister it before closing it, or the table keeps the file open.
+  void register_file( const FileDescriptor& fd );
+  void unregister_file( const FileDescriptor& fd );
+
+  //! \brief Send the read(), write() and accept() calls of `fd` and its duplicates through this ring
+  //! \details Each call still blocks until its own operation completes, and returns or throws just as it
+  //! would have, so code written for FileDescriptor or TCPSocket needs no changes. Its operation goes to the
+  //! kernel in one io_uring_enter with everything else queued at the time, and uses the file table if `fd`
+  //! is registered. The non-throwing try_*() calls, and socket calls with system calls of their own
+  //! (sendmsg, recvfrom, ...), still go to the kernel directly. Descriptors are detached automatically
+  //! when the IOUring is destroyed.
+  void attach( FileDescriptor& fd );
+  void detach( FileDescriptor& fd );
+
+  //! Hand every queued operation to the kernel without waiting
+  //! \returns the number of operations submitted
+  size_t submit();
+
+  //! \brief Submit queued operations, wait until at least `min_complete` have completed, and run the
+  //! completions of every finished operation
+  //! \details Throws unix_error for an operation that failed (other than EAGAIN on a non-blocking
+  //! descriptor); completions that weren't reached are delivered by the next call.
+  //! \returns the number of completions run
+  size_t complete( unsigned min_complete = 1 );
+
+  //! Number of operations queued, in flight, or finished but not yet delivered by complete()
+  size_t pending() const { return in_flight_; }
+
+  //! Detaches descriptors, and cancels operations still in flight; their completions are not run
+  ~IOUring();
+
+  IOUring( const IOUring& other ) = delete;
+  IOUring& operator=( const IOUring& other ) = delete;
+  IOUring( IOUring&& other ) = delete;
+  IOUring& operator=( IOUring&& other ) = delete;
+};
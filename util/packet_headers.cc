@@ -0,0 +1,119 @@
+#include "packet_headers.hh"
+
+#include "checksum.hh"
+
+#include <netinet/in.h>
+
+using namespace std;
+
+namespace {
+constexpr size_t kEthernetHeaderLength = 14;
+constexpr size_t kVLANTagLength = 4;
+constexpr size_t kIPv4MinimumHeaderLength = 20;
+constexpr size_t kTCPMinimumHeaderLength = 20;
+constexpr size_t kUDPHeaderLength = 8;
+
+array<uint8_t, 6> load_mac( const string_view bytes, const size_t offset )
+{
+  array<uint8_t, 6> mac {};
+  memcpy( mac.data(), bytes.data() + offset, mac.size() );
+  return mac;
+}
+} // namespace
+
+optional<EthernetView> EthernetView::parse( const string_view frame )
+{
+  if ( frame.size() < kEthernetHeaderLength ) {
+    return {};
+  }
+  if ( packet_detail::load16( frame, kEthernetHeaderLength - 2 ) != kTypeVLAN ) {
+    return EthernetView { frame, kEthernetHeaderLength };
+  }
+  if ( frame.size() < kEthernetHeaderLength + kVLANTagLength ) {
+    return {};
+  }
+  return EthernetView { frame, kEthernetHeaderLength + kVLANTagLength };
+}
+
+array<uint8_t, 6> EthernetView::destination() const
+{
+  return load_mac( frame_, 0 );
+}
+
+array<uint8_t, 6> EthernetView::source() const
+{
+  return load_mac( frame_, 6 );
+}
+
+optional<uint16_t> EthernetView::vlan_id() const
+{
+  if ( header_length_ == kEthernetHeaderLength ) {
+    return {};
+  }
+  return packet_detail::load16( frame_, kEthernetHeaderLength ) & 0x0fffU; // NOLINT(*-magic-numbers)
+}
+
+//! \param[in] bytes starts with the packet, and may have padding after it
+optional<IPv4View> IPv4View::parse( const string_view bytes )
+{
+  if ( bytes.size() < kIPv4MinimumHeaderLength or packet_detail::load8( bytes, 0 ) >> 4U != 4 ) {
+    return {};
+  }
+
+  const size_t header_length = size_t { packet_detail::load8( bytes, 0 ) & 0x0fU } * 4; // NOLINT
+  const size_t total_length = packet_detail::load16( bytes, 2 );
+  if ( header_length < kIPv4MinimumHeaderLength or total_length < header_length or total_length > bytes.size() ) {
+    return {};
+  }
+  return IPv4View { bytes.substr( 0, total_length ) };
+}
+
+bool IPv4View::checksum_valid() const
+{
+  return internet_checksum( header() ) == 0;
+}
+
+uint32_t IPv4View::pseudo_header_sum() const
+{
+  const auto payload_length = static_cast<uint16_t>( packet_.size() - header_length() );
+  return ipv4_pseudo_header_sum( source(), destination(), protocol(), payload_length );
+}
+
+optional<TCPView> TCPView::parse( const string_view bytes )
+{
+  if ( bytes.size() < kTCPMinimumHeaderLength ) {
+    return {};
+  }
+  const size_t header_length = ( size_t { packet_detail::load8( bytes, 12 ) } >> 4U ) * 4; // NOLINT
+  if ( header_length < kTCPMinimumHeaderLength or header_length > bytes.size() ) {
+    return {};
+  }
+  return TCPView { bytes };
+}
+
+bool TCPView::checksum_valid( const IPv4View& ip ) const
+{
+  return internet_checksum( segment_, ip.pseudo_header_sum() ) == 0;
+}
+
+optional<UDPView> UDPView::parse( const string_view bytes )
+{
+  if ( bytes.size() < kUDPHeaderLength ) {
+    return {};
+  }
+  const size_t length = packet_detail::load16( bytes, 4 );
+  if ( length < kUDPHeaderLength or length > bytes.size() ) {
+    return {};
+  }
+  return UDPView { bytes.substr( 0, length ) };
+}
+
+bool UDPView::checksum_valid( const IPv4View& ip ) const
+{
+  if ( checksum() == 0 ) {
+    return true;
+  }
+  // the pseudo-header has the UDP length, which may be less than the IP payload's
+  const uint32_t pseudo_header = ipv4_pseudo_header_sum( ip.source(), ip.destination(), IPPROTO_UDP, length() );
+  return internet_checksum( datagram_, pseudo_header ) == 0;
+}
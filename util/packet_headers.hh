@@ -0,0 +1,209 @@
+#pragma once
+
+#include "flow_table.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+#include <optional>
+#include <string_view>
+
+//! \file
+//! \brief Views of Ethernet, IPv4, TCP and UDP headers that parse received bytes in place
+//! \details A view doesn't own or copy anything: it refers to the frame or packet it was parsed from (e.g. a
+//! FrameView from a PacketRing, or a packet read from a TunFD into an OwnedBuffer), which must outlive it.
+//! parse() checks only that the header is complete and consistent with the lengths it claims, and fields
+//! are decoded from network byte order when they are read, so fields that aren't read cost nothing.
+//!
+//! With checksum offload, a TCP or UDP packet captured on its way out (including over loopback) carries
+//! just the pseudo-header's partial sum for the NIC to finish, so its checksum_valid() is false.
+
+namespace packet_detail {
+
+inline uint8_t load8( std::string_view bytes, size_t offset )
+{
+  return static_cast<uint8_t>( bytes[offset] );
+}
+
+inline uint16_t load16( std::string_view bytes, size_t offset )
+{
+  uint16_t value {};
+  memcpy( &value, bytes.data() + offset, sizeof( value ) );
+  return be16toh( value );
+}
+
+inline uint32_t load32( std::string_view bytes, size_t offset )
+{
+  uint32_t value {};
+  memcpy( &value, bytes.data() + offset, sizeof( value ) );
+  return be32toh( value );
+}
+
+} // namespace packet_detail
+
+//! An Ethernet II frame, optionally with one 802.1Q VLAN tag
+class EthernetView
+{
+  std::string_view frame_;
+  size_t header_length_;
+
+  EthernetView( std::string_view frame, size_t header_length ) : frame_( frame ), header_length_( header_length )
+  {}
+
+public:
+  static constexpr uint16_t kTypeIPv4 = 0x0800; //!< EtherType of IPv4
+  static constexpr uint16_t kTypeARP = 0x0806;  //!< EtherType of ARP
+  static constexpr uint16_t kTypeVLAN = 0x8100; //!< EtherType of an 802.1Q tag
+  static constexpr uint16_t kTypeIPv6 = 0x86dd; //!< EtherType of IPv6
+
+  //! The header at the start of `frame`, or nothing if it is truncated
+  static std::optional<EthernetView> parse( std::string_view frame );
+
+  //! Destination MAC address
+  std::array<uint8_t, 6> destination() const;
+  //! Source MAC address
+  std::array<uint8_t, 6> source() const;
+  //! The payload's EtherType (after the VLAN tag, if there is one)
+  uint16_t ethertype() const { return packet_detail::load16( frame_, header_length_ - 2 ); }
+  //! The 12-bit VLAN identifier, if the frame is tagged
+  std::optional<uint16_t> vlan_id() const;
+
+  //! Length of the header, including any VLAN tag
+  size_t header_length() const { return header_length_; }
+  //! Everything after the header
+  std::string_view payload() const { return frame_.substr( header_length_ ); }
+};
+
+//! An IPv4 packet (trimmed to its total length, so link-layer padding isn't part of it)
+class IPv4View
+{
+  std::string_view packet_;
+
+  explicit IPv4View( std::string_view packet ) : packet_( packet ) {}
+
+public:
+  //! \brief The packet at the start of `bytes`, or nothing if it isn't a complete IPv4 packet
+  //! \details The header checksum isn't checked; see checksum_valid().
+  static std::optional<IPv4View> parse( std::string_view bytes );
+
+  //! \name Fields
+  //!@{
+  size_t header_length() const { return size_t { packet_detail::load8( packet_, 0 ) & 0x0fU } * 4; }
+  uint8_t tos() const { return packet_detail::load8( packet_, 1 ); }
+  uint16_t total_length() const { return static_cast<uint16_t>( packet_.size() ); }
+  uint16_t identification() const { return packet_detail::load16( packet_, 4 ); }
+  bool dont_fragment() const { return ( packet_detail::load16( packet_, 6 ) & 0x4000U ) != 0; }
+  bool more_fragments() const { return ( packet_detail::load16( packet_, 6 ) & 0x2000U ) != 0; }
+  //! Where this fragment's payload goes in the original packet's, in bytes
+  size_t fragment_offset() const { return size_t { packet_detail::load16( packet_, 6 ) & 0x1fffU } * 8; }
+  uint8_t ttl() const { return packet_detail::load8( packet_, 8 ); }
+  uint8_t protocol() const { return packet_detail::load8( packet_, 9 ); }
+  uint16_t checksum() const { return packet_detail::load16( packet_, 10 ); }
+  uint32_t source() const { return packet_detail::load32( packet_, 12 ); }
+  uint32_t destination() const { return packet_detail::load32( packet_, 16 ); }
+  //!@}
+
+  //! Whether this is a fragment of a larger packet (so its payload isn't a whole TCP or UDP header and data)
+  bool is_fragment() const { return more_fragments() or fragment_offset() != 0; }
+
+  //! The header, including options
+  std::string_view header() const { return packet_.substr( 0, header_length() ); }
+  //! The options, if any
+  std::string_view options() const { return packet_.substr( 20, header_length() - 20 ); }
+  //! The packet after the header
+  std::string_view payload() const { return packet_.substr( header_length() ); }
+
+  //! Whether the header checksum is correct
+  bool checksum_valid() const;
+
+  //! The partial sum of the pseudo-header that covers this packet's payload, for a TCP or UDP checksum
+  uint32_t pseudo_header_sum() const;
+};
+
+//! A TCP segment
+class TCPView
+{
+  std::string_view segment_;
+
+  explicit TCPView( std::string_view segment ) : segment_( segment ) {}
+
+public:
+  //! \name Flags
+  //!@{
+  static constexpr uint8_t kFin = 0x01;
+  static constexpr uint8_t kSyn = 0x02;
+  static constexpr uint8_t kRst = 0x04;
+  static constexpr uint8_t kPsh = 0x08;
+  static constexpr uint8_t kAck = 0x10;
+  static constexpr uint8_t kUrg = 0x20;
+  static constexpr uint8_t kEce = 0x40;
+  static constexpr uint8_t kCwr = 0x80;
+  //!@}
+
+  //! The segment in `bytes` (e.g. an IPv4View's payload()), or nothing if its header is incomplete
+  static std::optional<TCPView> parse( std::string_view bytes );
+
+  //! \name Fields
+  //!@{
+  uint16_t source_port() const { return packet_detail::load16( segment_, 0 ); }
+  uint16_t destination_port() const { return packet_detail::load16( segment_, 2 ); }
+  uint32_t sequence_number() const { return packet_detail::load32( segment_, 4 ); }
+  uint32_t acknowledgment_number() const { return packet_detail::load32( segment_, 8 ); }
+  size_t header_length() const { return ( size_t { packet_detail::load8( segment_, 12 ) } >> 4U ) * 4; }
+  uint8_t flags() const { return packet_detail::load8( segment_, 13 ); }
+  uint16_t window() const { return packet_detail::load16( segment_, 14 ); }
+  uint16_t checksum() const { return packet_detail::load16( segment_, 16 ); }
+  uint16_t urgent_pointer() const { return packet_detail::load16( segment_, 18 ); }
+  //!@}
+
+  //! Whether every flag in `mask` is set, e.g. `has( TCPView::kSyn | TCPView::kAck )`
+  bool has( uint8_t mask ) const { return ( flags() & mask ) == mask; }
+
+  //! The options, if any
+  std::string_view options() const { return segment_.substr( 20, header_length() - 20 ); }
+  //! The data after the header
+  std::string_view payload() const { return segment_.substr( header_length() ); }
+
+  //! Whether the checksum is correct for the segment carried by `ip`
+  bool checksum_valid( const IPv4View& ip ) const;
+
+  //! The flow this segment belongs to, as seen by its receiver (so the key of the local end's state)
+  FlowKey flow_key( const IPv4View& ip ) const
+  {
+    return FlowKey::from_ipv4( ip.destination(), destination_port(), ip.source(), source_port() );
+  }
+};
+
+//! A UDP datagram (trimmed to the length in its header)
+class UDPView
+{
+  std::string_view datagram_;
+
+  explicit UDPView( std::string_view datagram ) : datagram_( datagram ) {}
+
+public:
+  //! The datagram in `bytes` (e.g. an IPv4View's payload()), or nothing if it is incomplete
+  static std::optional<UDPView> parse( std::string_view bytes );
+
+  //! \name Fields
+  //!@{
+  uint16_t source_port() const { return packet_detail::load16( datagram_, 0 ); }
+  uint16_t destination_port() const { return packet_detail::load16( datagram_, 2 ); }
+  uint16_t length() const { return static_cast<uint16_t>( datagram_.size() ); }
+  uint16_t checksum() const { return packet_detail::load16( datagram_, 6 ); }
+  //!@}
+
+  //! The data after the header
+  std::string_view payload() const { return datagram_.substr( 8 ); }
+
+  //! Whether the checksum is correct for the datagram carried by `ip` (or absent, as IPv4 allows)
+  bool checksum_valid( const IPv4View& ip ) const;
+
+  //! The flow this datagram belongs to, as seen by its receiver (so the key of the local end's state)
+  FlowKey flow_key( const IPv4View& ip ) const
+  {
+    return FlowKey::from_ipv4( ip.destination(), destination_port(), ip.source(), source_port() );
+  }
+};
@@ -0,0 +1,158 @@
+#include "resolver.hh"
+
+#include "exception.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+vector<Address> AsyncResolver::Cache::lookup( const string& key )
+{
+  const lock_guard lock { mutex_ };
+  const auto entry = entries_.find( key );
+  if ( entry == entries_.end() ) {
+    return {};
+  }
+  if ( entry->second.expiry <= chrono::steady_clock::now() ) {
+    entries_.erase( entry );
+    return {};
+  }
+  return entry->second.addresses;
+}
+
+void AsyncResolver::Cache::insert( const string& key, const vector<Address>& addresses )
+{
+  const lock_guard lock { mutex_ };
+  entries_.insert_or_assign( key, Entry { addresses, chrono::steady_clock::now() + lifetime_ } );
+}
+
+void AsyncResolver::Cache::set_lifetime( chrono::milliseconds lifetime )
+{
+  const lock_guard lock { mutex_ };
+  lifetime_ = lifetime;
+}
+
+void AsyncResolver::Cache::clear()
+{
+  const lock_guard lock { mutex_ };
+  entries_.clear();
+}
+
+AsyncResolver::Cache& AsyncResolver::cache()
+{
+  static Cache shared_cache;
+  return shared_cache;
+}
+
+AsyncResolver::AsyncResolver( EventLoop& loop, size_t threads )
+  : completion_fd_( ::CheckSystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ), true )
+  , rule_( install_rule( loop ) )
+{
+  for ( size_t i = 0; i < max<size_t>( threads, 1 ); ++i ) {
+    workers_.emplace_back( [this] { worker_loop(); } );
+  }
+}
+
+EventLoop::RuleHandle AsyncResolver::install_rule( EventLoop& loop )
+{
+  return loop.add_rule(
+    loop.add_category( "DNS resolution" ),
+    completion_fd_,
+    Direction::In,
+    [this] {
+      array<char, sizeof( uint64_t )> counter {};
+      completion_fd_.read( counter );
+      deliver();
+    },
+    [this] { return not waiting_.empty(); } );
+}
+
+AsyncResolver::~AsyncResolver()
+{
+  {
+    const lock_guard lock { mutex_ };
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for ( auto& worker : workers_ ) {
+    worker.join();
+  }
+  rule_.cancel();
+}
+
+void AsyncResolver::worker_loop()
+{
+  unique_lock lock { mutex_ };
+  while ( true ) {
+    work_available_.wait( lock, [this] { return stopping_ or not requests_.empty(); } );
+    if ( stopping_ ) {
+      return;
+    }
+
+    Request request = move( requests_.front() );
+    requests_.pop_front();
+    lock.unlock();
+
+    Completion completion { move( request.key ), {}, {} };
+    try {
+      completion.addresses = Address::resolve_all( request.hostname, request.service );
+      cache().insert( completion.key, completion.addresses );
+    } catch ( ... ) {
+      completion.error = current_exception();
+    }
+
+    lock.lock();
+    completions_.push_back( move( completion ) );
+
+    // wake the event loop; any nonzero counter value will do, so a failed write is harmless
+    const uint64_t one = 1;
+    [[maybe_unused]] const ssize_t written = ::write( completion_fd_.fd_num(), &one, sizeof( one ) );
+  }
+}
+
+void AsyncResolver::deliver()
+{
+  {
+    const lock_guard lock { mutex_ };
+    swap( delivering_, completions_ );
+  }
+
+  for ( auto& completion : delivering_ ) {
+    auto waiters = waiting_.extract( completion.key );
+    if ( waiters.empty() ) {
+      continue;
+    }
+    for ( const auto& callback : waiters.mapped() ) {
+      callback( completion.addresses, completion.error );
+    }
+  }
+  delivering_.clear();
+}
+
+void AsyncResolver::resolve( const string& hostname, const string& service, const Callback& callback )
+{
+  string key = hostname + '\0' + service;
+
+  const auto cached = cache().lookup( key );
+  if ( not cached.empty() ) {
+    callback( cached, nullptr );
+    return;
+  }
+
+  auto& waiters = waiting_[key];
+  waiters.push_back( callback );
+  if ( waiters.size() > 1 ) {
+    return; // a lookup for this name is already in flight
+  }
+
+  {
+    const lock_guard lock { mutex_ };
+    requests_.push_back( { hostname, service, move( key ) } );
+  }
+  work_available_.notify_one();
+}
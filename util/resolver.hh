@@ -0,0 +1,105 @@
+#pragma once
+
+#include "address.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//! \brief Resolves hostnames off the event-loop thread, with a cache shared by every resolver in the process.
+//! \details Lookups run [getaddrinfo(3)](\ref man3::getaddrinfo) on worker threads. Their results are
+//! delivered by a rule on the owner's EventLoop, so callbacks always run on the loop's thread.
+//! Concurrent requests for the same name share one lookup.
+class AsyncResolver
+{
+public:
+  //! Receives every resolved address (A and AAAA), or an exception if resolution failed.
+  using Callback = std::function<void( const std::vector<Address>& addresses, std::exception_ptr error )>;
+
+  //! \brief The process-wide cache of successful lookups.
+  //! \details getaddrinfo does not report record TTLs, so entries live for a fixed lifetime.
+  class Cache
+  {
+    struct Entry
+    {
+      std::vector<Address> addresses;
+      std::chrono::steady_clock::time_point expiry;
+    };
+
+    mutable std::mutex mutex_ {};
+    std::unordered_map<std::string, Entry> entries_ {};
+    std::chrono::milliseconds lifetime_ { std::chrono::seconds { 30 } };
+
+  public:
+    //! Cached addresses for `key`, or an empty vector if absent or expired.
+    std::vector<Address> lookup( const std::string& key );
+    void insert( const std::string& key, const std::vector<Address>& addresses );
+    void set_lifetime( std::chrono::milliseconds lifetime );
+    void clear();
+  };
+
+private:
+  struct Request
+  {
+    std::string hostname;
+    std::string service;
+    std::string key;
+  };
+
+  struct Completion
+  {
+    std::string key;
+    std::vector<Address> addresses;
+    std::exception_ptr error;
+  };
+
+  FileDescriptor completion_fd_; //!< eventfd, signaled by workers when completions_ is non-empty
+  EventLoop::RuleHandle rule_;   //!< Delivers completions on the loop's thread
+
+  std::mutex mutex_ {};
+  std::condition_variable work_available_ {};
+  std::deque<Request> requests_ {};
+  std::vector<Completion> completions_ {};
+  bool stopping_ {};
+
+  //! Callbacks waiting on each in-flight key (only touched by the loop thread).
+  std::unordered_map<std::string, std::vector<Callback>> waiting_ {};
+  std::vector<Completion> delivering_ {}; //!< Scratch space for deliver().
+
+  std::vector<std::thread> workers_ {};
+
+  EventLoop::RuleHandle install_rule( EventLoop& loop );
+  void worker_loop();
+  void deliver();
+
+public:
+  //! \param[in] loop will run the callbacks
+  //! \param[in] threads is the number of concurrent lookups
+  explicit AsyncResolver( EventLoop& loop, size_t threads = 2 );
+  ~AsyncResolver();
+
+  //! The cache shared by all resolvers.
+  static Cache& cache();
+
+  //! \brief Resolve `hostname` and `service`, running `callback` once the addresses are known.
+  //! \details On a cache hit the callback runs before resolve() returns.
+  void resolve( const std::string& hostname, const std::string& service, const Callback& callback );
+
+  //! Number of lookups that have not completed yet.
+  size_t pending() const { return waiting_.size(); }
+
+  AsyncResolver( const AsyncResolver& other ) = delete;
+  AsyncResolver& operator=( const AsyncResolver& other ) = delete;
+  AsyncResolver( AsyncResolver&& other ) = delete;
+  AsyncResolver& operator=( AsyncResolver&& other ) = delete;
+};
@@ -2,37 +2,100 @@
 
 #include "exception.hh"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cstddef>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <linux/bpf.h>
+#include <linux/errqueue.h>
 #include <linux/if_packet.h>
 #include <net/if.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <poll.h>
 #include <stdexcept>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 using namespace std;
 
+namespace {
+// control-message space for the UDP_GRO or UDP_SEGMENT value attached to one datagram
+struct alignas( cmsghdr ) SegmentControl
+{
+  array<char, CMSG_SPACE( sizeof( int ) )> bytes;
+};
+
+// bytes moved by a recvmmsg or sendmmsg that returned `result` (passed through if it failed)
+ssize_t batch_bytes( span<const mmsghdr> messages, int result )
+{
+  if ( result < 0 ) {
+    return result;
+  }
+  ssize_t total = 0;
+  for ( const auto& message : messages.first( result ) ) {
+    total += message.msg_len;
+  }
+  return total;
+}
+} // namespace
+
 // default constructor for socket of (subclassed) domain and type
 //! \param[in] domain is as described in [socket(7)](\ref man7::socket), probably `AF_INET` or `AF_UNIX`
 //! \param[in] type is as described in [socket(7)](\ref man7::socket)
+//! \details The new descriptor's O_NONBLOCK flag is known from `type`, so it isn't looked up.
 Socket::Socket( const int domain, const int type, const int protocol )
-  : FileDescriptor( ::CheckSystemCall( "socket", socket( domain, type, protocol ) ) )
+  : FileDescriptor( ::CheckSystemCall( "socket", socket( domain, type, protocol ) ),
+                    ( type & SOCK_NONBLOCK ) != 0 ) // NOLINT(*-bitwise)
 {}
 
 // construct from file descriptor
 //! \param[in] fd is the FileDescriptor from which to construct
-//! \param[in] domain is `fd`'s domain; throws std::runtime_error if wrong value is supplied
+//! \param[in] domain is `fd`'s domain (`AF_UNSPEC` for any); throws std::runtime_error if wrong value is supplied
 //! \param[in] type is `fd`'s type; throws std::runtime_error if wrong value is supplied
 //! \param[in] protocol is `fd`'s protocol; throws std::runtime_error if wrong value is supplied
 Socket::Socket( FileDescriptor&& fd, int domain, int type, int protocol ) // NOLINT(*-swappable-parameters)
   : FileDescriptor( move( fd ) )
+{
+  verify( domain, type, protocol );
+}
+
+// construct from a file descriptor whose properties the kernel guarantees
+//! \param[in] fd is the FileDescriptor from which to construct
+//! \param[in] domain is `fd`'s domain (`AF_UNSPEC` if not known)
+//! \param[in] type is `fd`'s type
+//! \param[in] protocol is `fd`'s protocol
+Socket::Socket( [[maybe_unused]] Trusted tag, // NOLINT(*-swappable-parameters)
+                FileDescriptor&& fd,
+                [[maybe_unused]] int domain,
+                [[maybe_unused]] int type,
+                [[maybe_unused]] int protocol )
+  : FileDescriptor( move( fd ) )
+{
+#ifdef CHECK_TRUSTED_DESCRIPTORS
+  verify( domain, type, protocol );
+#endif
+}
+
+void Socket::verify( int domain, int type, int protocol ) const // NOLINT(*-swappable-parameters)
 {
   int actual_value {};
   socklen_t len {};
 
   // verify domain
-  len = getsockopt( SOL_SOCKET, SO_DOMAIN, actual_value );
-  if ( ( len != sizeof( actual_value ) ) or ( actual_value != domain ) ) {
-    throw runtime_error( "socket domain mismatch" );
+  if ( domain != AF_UNSPEC ) {
+    len = getsockopt( SOL_SOCKET, SO_DOMAIN, actual_value );
+    if ( ( len != sizeof( actual_value ) ) or ( actual_value != domain ) ) {
+      throw runtime_error( "socket domain mismatch" );
+    }
   }
 
   // verify type
@@ -94,6 +157,52 @@ void Socket::connect( const Address& address )
   CheckSystemCall( "connect", ::connect( fd_num(), address, address.size() ) );
 }
 
+// connect socket to a specified peer address, waiting at most `timeout`
+//! \param[in] address is the peer's Address
+//! \param[in] timeout is how long to wait for the connection to be established
+void Socket::connect( const Address& address, const chrono::milliseconds timeout )
+{
+  const bool was_blocking = blocking();
+  if ( was_blocking ) {
+    set_blocking( false );
+  }
+
+  bool finished = false;
+  try {
+    connect( address );
+    finished = wait_writable( timeout );
+  } catch ( const exception& ) {
+    if ( was_blocking ) {
+      set_blocking( true );
+    }
+    throw;
+  }
+
+  if ( was_blocking ) {
+    set_blocking( true );
+  }
+
+  if ( not finished ) {
+    throw unix_error( "connect", ETIMEDOUT );
+  }
+
+  throw_if_error();
+}
+
+//! \param[in] timeout is how long to wait (negative waits forever)
+bool Socket::wait_writable( const chrono::milliseconds timeout ) const
+{
+  pollfd pfd { fd_num(), POLLOUT, 0 };
+  return ::CheckSystemCall( "poll", ::poll( &pfd, 1, static_cast<int>( timeout.count() ) ) ) > 0;
+}
+
+//! \param[in] timeout is how long to wait (negative waits forever)
+bool Socket::wait_readable( const chrono::milliseconds timeout ) const
+{
+  pollfd pfd { fd_num(), POLLIN, 0 };
+  return ::CheckSystemCall( "poll", ::poll( &pfd, 1, static_cast<int>( timeout.count() ) ) ) > 0;
+}
+
 // shut down a socket in the specified way
 //! \param[in] how can be `SHUT_RD`, `SHUT_WR`, or `SHUT_RDWR`; see [shutdown(2)](\ref man2::shutdown)
 void Socket::shutdown( const int how )
@@ -122,12 +231,14 @@ void DatagramSocket::recv( Address& source_address, string& payload )
   Address::Raw datagram_source_address;
   socklen_t fromlen = sizeof( datagram_source_address );
 
-  payload.clear();
+  // without clear(), only bytes beyond the previous contents are zero-filled, and capacity is kept
   payload.resize( kReadBufferSize );
 
-  const ssize_t recv_len = CheckSystemCall(
-    "recvfrom",
-    ::recvfrom( fd_num(), payload.data(), payload.size(), MSG_TRUNC, datagram_source_address, &fromlen ) );
+  const uint64_t started = io_start();
+  ssize_t recv_len
+    = ::recvfrom( fd_num(), payload.data(), payload.size(), MSG_TRUNC, datagram_source_address, &fromlen );
+  record_io( IOStats::Direction::Read, started, recv_len, 0 );
+  recv_len = CheckSystemCall( "recvfrom", recv_len );
 
   if ( recv_len > static_cast<ssize_t>( payload.size() ) ) {
     throw runtime_error( "recvfrom (oversized datagram)" );
@@ -138,19 +249,199 @@ void DatagramSocket::recv( Address& source_address, string& payload )
   payload.resize( recv_len );
 }
 
+//! \note If payload is too small to hold the received datagram, this method throws a std::runtime_error
+void DatagramSocket::recv( Address& source_address, OwnedBuffer& payload )
+{
+  Address::Raw datagram_source_address;
+  socklen_t fromlen = sizeof( datagram_source_address );
+
+  payload.clear();
+
+  const uint64_t started = io_start();
+  ssize_t recv_len
+    = ::recvfrom( fd_num(), payload.data(), payload.capacity(), MSG_TRUNC, datagram_source_address, &fromlen );
+  record_io( IOStats::Direction::Read, started, recv_len, 0 );
+  recv_len = CheckSystemCall( "recvfrom", recv_len );
+
+  if ( recv_len > static_cast<ssize_t>( payload.capacity() ) ) {
+    throw runtime_error( "recvfrom (oversized datagram)" );
+  }
+
+  register_read();
+  source_address = { datagram_source_address, fromlen };
+  payload.resize( recv_len );
+}
+
 void DatagramSocket::sendto( const Address& destination, const string_view payload )
 {
-  CheckSystemCall( "sendto",
-                   ::sendto( fd_num(), payload.data(), payload.length(), 0, destination, destination.size() ) );
+  const uint64_t started = io_start();
+  const ssize_t bytes_sent
+    = ::sendto( fd_num(), payload.data(), payload.length(), 0, destination, destination.size() );
+  record_io( IOStats::Direction::Write, started, bytes_sent, 0 );
+  CheckSystemCall( "sendto", bytes_sent );
   register_write();
 }
 
 void DatagramSocket::send( const string_view payload )
 {
-  CheckSystemCall( "send", ::send( fd_num(), payload.data(), payload.length(), 0 ) );
+  const uint64_t started = io_start();
+  const ssize_t bytes_sent = ::send( fd_num(), payload.data(), payload.length(), 0 );
+  record_io( IOStats::Direction::Write, started, bytes_sent, 0 );
+  CheckSystemCall( "send", bytes_sent );
   register_write();
 }
 
+IOResult DatagramSocket::try_recv( Address& source_address, OwnedBuffer& payload ) noexcept
+{
+  Address::Raw datagram_source_address;
+  socklen_t fromlen = sizeof( datagram_source_address );
+
+  const uint64_t started = io_start();
+  const ssize_t recv_len
+    = ::recvfrom( fd_num(), payload.data(), payload.capacity(), MSG_TRUNC, datagram_source_address, &fromlen );
+  record_io( IOStats::Direction::Read, started, recv_len, 0 );
+  if ( recv_len < 0 ) {
+    payload.clear();
+    return IOResult::failure( errno );
+  }
+
+  register_read();
+  source_address = { datagram_source_address, fromlen };
+  if ( recv_len > static_cast<ssize_t>( payload.capacity() ) ) {
+    payload.resize( payload.capacity() );
+    return IOResult::failure( EMSGSIZE );
+  }
+  payload.resize( recv_len );
+  return IOResult::success( recv_len );
+}
+
+IOResult DatagramSocket::try_sendto( const Address& destination, const string_view payload ) noexcept
+{
+  const uint64_t started = io_start();
+  const ssize_t bytes_sent
+    = ::sendto( fd_num(), payload.data(), payload.length(), 0, destination, destination.size() );
+  return try_finish_write( bytes_sent, 0, started );
+}
+
+IOResult DatagramSocket::try_send( const string_view payload ) noexcept
+{
+  const uint64_t started = io_start();
+  return try_finish_write( ::send( fd_num(), payload.data(), payload.length(), 0 ), 0, started );
+}
+
+//! \note If a slot's payload is too small to hold its datagram, this method throws a std::runtime_error
+size_t DatagramSocket::recv_batch( span<ReceivedDatagram> slots )
+{
+  const size_t count = min( slots.size(), kMaxBatch );
+
+  array<mmsghdr, kMaxBatch> messages; // NOLINT(*-member-init)
+  array<iovec, kMaxBatch> iovecs;     // NOLINT(*-member-init)
+  array<SegmentControl, kMaxBatch> controls; // NOLINT(*-member-init)
+
+  for ( size_t i = 0; i < count; ++i ) {
+    auto& slot = slots[i];
+    if ( slot.payload.capacity() == 0 ) {
+      throw runtime_error( "recv_batch: payload buffer has no capacity" );
+    }
+
+    iovecs[i] = { slot.payload.data(), slot.payload.capacity() };
+    messages[i] = {};
+    auto& header = messages[i].msg_hdr;
+    header.msg_name = &slot.source.storage;
+    header.msg_namelen = sizeof( slot.source.storage );
+    header.msg_iov = &iovecs[i];
+    header.msg_iovlen = 1;
+    header.msg_control = controls[i].bytes.data();
+    header.msg_controllen = controls[i].bytes.size();
+  }
+
+  const uint64_t started = io_start();
+  const int result
+    = ::recvmmsg( fd_num(), messages.data(), static_cast<unsigned>( count ), MSG_WAITFORONE, nullptr );
+  record_io( IOStats::Direction::Read, started, batch_bytes( messages, result ), 0 );
+  const int received = CheckSystemCall( "recvmmsg", result );
+  if ( received > 0 ) {
+    register_read();
+  }
+
+  for ( int i = 0; i < received; ++i ) {
+    auto& slot = slots[i];
+    auto& header = messages[i].msg_hdr;
+    if ( header.msg_flags & MSG_TRUNC ) { // NOLINT(*-signed-bitwise)
+      throw runtime_error( "recvmmsg (oversized datagram)" );
+    }
+
+    slot.source_size = header.msg_namelen;
+    slot.payload.resize( messages[i].msg_len );
+    slot.segment_size = 0;
+    for ( cmsghdr* cmsg = CMSG_FIRSTHDR( &header ); cmsg != nullptr; cmsg = CMSG_NXTHDR( &header, cmsg ) ) {
+      if ( cmsg->cmsg_level == SOL_UDP and cmsg->cmsg_type == UDP_GRO ) {
+        int segment_size {};
+        memcpy( &segment_size, CMSG_DATA( cmsg ), sizeof( segment_size ) );
+        slot.segment_size = segment_size;
+      }
+    }
+  }
+
+  return received;
+}
+
+size_t DatagramSocket::send_batch( span<const OutgoingDatagram> datagrams )
+{
+  const size_t count = min( datagrams.size(), kMaxBatch );
+  if ( count == 0 ) {
+    return 0;
+  }
+
+  array<mmsghdr, kMaxBatch> messages; // NOLINT(*-member-init)
+  array<iovec, kMaxBatch> iovecs;     // NOLINT(*-member-init)
+  array<SegmentControl, kMaxBatch> controls; // NOLINT(*-member-init)
+
+  for ( size_t i = 0; i < count; ++i ) {
+    const auto& datagram = datagrams[i];
+
+    iovecs[i] = { const_cast<char*>( datagram.payload.data() ), datagram.payload.size() }; // NOLINT(*-const-cast)
+    messages[i] = {};
+    auto& header = messages[i].msg_hdr;
+    if ( datagram.destination ) {
+      header.msg_name = const_cast<sockaddr*>( static_cast<const sockaddr*>( *datagram.destination ) ); // NOLINT
+      header.msg_namelen = datagram.destination->size();
+    }
+    header.msg_iov = &iovecs[i];
+    header.msg_iovlen = 1;
+
+    if ( datagram.segment_size ) {
+      header.msg_control = controls[i].bytes.data();
+      header.msg_controllen = CMSG_SPACE( sizeof( uint16_t ) );
+      cmsghdr* const cmsg = CMSG_FIRSTHDR( &header );
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+      memcpy( CMSG_DATA( cmsg ), &datagram.segment_size, sizeof( uint16_t ) );
+    }
+  }
+
+  const uint64_t started = io_start();
+  const int result = ::sendmmsg( fd_num(), messages.data(), static_cast<unsigned>( count ), 0 );
+  record_io( IOStats::Direction::Write, started, batch_bytes( messages, result ), 0 );
+  const int sent = CheckSystemCall( "sendmmsg", result );
+  if ( sent > 0 ) {
+    register_write();
+  }
+
+  return sent;
+}
+
+void UDPSocket::set_gso_segment_size( const uint16_t segment_size )
+{
+  setsockopt( SOL_UDP, UDP_SEGMENT, int { segment_size } );
+}
+
+void UDPSocket::set_gro( const bool enabled )
+{
+  setsockopt( SOL_UDP, UDP_GRO, int { enabled } );
+}
+
 // mark the socket as listening for incoming connections
 //! \param[in] backlog is the number of waiting connections to queue (see [listen(2)](\ref man2::listen))
 void TCPSocket::listen( const int backlog )
@@ -161,10 +452,330 @@ void TCPSocket::listen( const int backlog )
 // accept a new incoming connection
 //! \returns a new TCPSocket connected to the peer.
 //! \note This function blocks until a new connection is available
+//! \details Uses [accept4(2)](\ref man2::accept4), and trusts the kernel for the new connection's properties:
+//! it is a blocking, close-on-exec TCP socket.
 TCPSocket TCPSocket::accept()
 {
   register_read();
-  return TCPSocket( FileDescriptor( CheckSystemCall( "accept", ::accept( fd_num(), nullptr, nullptr ) ) ) );
+  const int fd = CheckSystemCall( "accept4", sys_accept( SOCK_CLOEXEC ) );
+  return TCPSocket { Trusted {}, FileDescriptor { fd, false } };
+}
+
+//! \param[in] file is the source, e.g. a regular file opened for reading
+//! \param[in] offset is where in `file` to start
+//! \param[in] len is the number of bytes to send
+size_t TCPSocket::send_file( const FileDescriptor& file, const off_t offset, const size_t len )
+{
+  size_t sent = 0;
+  while ( sent < len ) {
+    off_t position = offset + static_cast<off_t>( sent );
+    const uint64_t started = io_start();
+    const ssize_t bytes_sent = ::sendfile( fd_num(), file.fd_num(), &position, len - sent );
+    if ( bytes_sent < 0 and ( errno == EINVAL or errno == ESPIPE or errno == ENOSYS ) and sent == 0 ) {
+      return splice_file( file, offset, len );
+    }
+    record_io( IOStats::Direction::Write, started, bytes_sent, len - sent );
+    register_write();
+
+    if ( CheckSystemCall( "sendfile", bytes_sent ) == 0 ) {
+      break; // end of file, or a non-blocking socket is full
+    }
+    sent += bytes_sent;
+  }
+
+  return sent;
+}
+
+void TCPSocket::set_zerocopy( const bool enabled )
+{
+  setsockopt( SOL_SOCKET, SO_ZEROCOPY, int { enabled } );
+  zerocopy_.enabled = enabled;
+}
+
+//! \param[in] buffer holds the data, and is kept until the kernel is done with it
+//! \param[in] offset is where in `buffer` to start
+size_t TCPSocket::write_zerocopy( const Buffer& buffer, const size_t offset )
+{
+  const string_view data = string_view { buffer }.substr( offset );
+  if ( not zerocopy_.enabled ) {
+    return write( data );
+  }
+
+  const uint64_t started = io_start();
+  const ssize_t bytes_sent = ::send( fd_num(), data.data(), data.size(), MSG_ZEROCOPY );
+  if ( bytes_sent < 0 and errno == ENOBUFS ) {
+    return write( data ); // over the socket's optmem limit for notifications
+  }
+
+  const size_t sent = finish_write( "send(MSG_ZEROCOPY)", bytes_sent, data.size(), started );
+  if ( sent > 0 ) {
+    // only sends that moved data use up a notification id
+    zerocopy_.pinned.emplace_back( zerocopy_.next_id++, buffer );
+  }
+  return sent;
+}
+
+size_t TCPSocket::reap_zerocopy()
+{
+  size_t completed = 0;
+
+  while ( true ) {
+    alignas( cmsghdr ) array<char, CMSG_SPACE( sizeof( sock_extended_err ) )> control {};
+    msghdr message {};
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    if ( ::recvmsg( fd_num(), &message, MSG_ERRQUEUE ) < 0 ) {
+      if ( errno == EAGAIN ) {
+        return completed; // the error queue is empty
+      }
+      throw unix_error { "recvmsg(MSG_ERRQUEUE)" };
+    }
+
+    for ( cmsghdr* cmsg = CMSG_FIRSTHDR( &message ); cmsg != nullptr; cmsg = CMSG_NXTHDR( &message, cmsg ) ) {
+      if ( not( cmsg->cmsg_level == SOL_IP and cmsg->cmsg_type == IP_RECVERR )
+           and not( cmsg->cmsg_level == SOL_IPV6 and cmsg->cmsg_type == IPV6_RECVERR ) ) {
+        continue;
+      }
+
+      sock_extended_err error {};
+      memcpy( &error, CMSG_DATA( cmsg ), sizeof( error ) );
+      if ( error.ee_origin != SO_EE_ORIGIN_ZEROCOPY ) {
+        continue;
+      }
+
+      // each notification covers the inclusive range of send ids [ee_info, ee_data]
+      const uint32_t first = error.ee_info;
+      const uint32_t count = error.ee_data - first + 1;
+      completed += count;
+      if ( error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED ) { // NOLINT(*-bitwise)
+        zerocopy_.copied += count;
+      }
+      erase_if( zerocopy_.pinned, [&]( const auto& entry ) { return entry.first - first < count; } );
+    }
+  }
+}
+
+void TCPSocket::set_cork( const bool corked )
+{
+  setsockopt( IPPROTO_TCP, TCP_CORK, int { corked } );
+}
+
+void TCPSocket::set_nodelay( const bool nodelay )
+{
+  setsockopt( IPPROTO_TCP, TCP_NODELAY, int { nodelay } );
+}
+
+size_t TCPSocket::write_more( span<const string_view> buffers )
+{
+  array<iovec, kMaxWriteChunks> iovecs {};
+  const size_t count = min( buffers.size(), iovecs.size() );
+  size_t total_size = 0;
+  for ( size_t i = 0; i < count; ++i ) {
+    iovecs[i] = { const_cast<char*>( buffers[i].data() ), buffers[i].size() }; // NOLINT(*-const-cast)
+    total_size += buffers[i].size();
+  }
+
+  msghdr message {};
+  message.msg_iov = iovecs.data();
+  message.msg_iovlen = count;
+  const uint64_t started = io_start();
+  return finish_write( "sendmsg(MSG_MORE)", ::sendmsg( fd_num(), &message, MSG_MORE ), total_size, started );
+}
+
+namespace {
+
+pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe2", ::pipe2( fds.data(), O_CLOEXEC ) );
+  return { FileDescriptor { fds[0], false }, FileDescriptor { fds[1], false } };
+}
+
+} // namespace
+
+// the pipe lives only as long as the call: bytes left in it when the socket fills up are re-read from
+// `offset` by the next call, or, for a source that can't seek, waited on so they aren't lost
+size_t TCPSocket::splice_file( const FileDescriptor& file, const off_t offset, const size_t len )
+{
+  const bool seekable = ::lseek( file.fd_num(), 0, SEEK_CUR ) >= 0;
+  const auto [pipe_out, pipe_in] = make_pipe();
+
+  size_t sent = 0;
+  while ( sent < len ) {
+    loff_t position = offset + static_cast<loff_t>( sent );
+    const ssize_t filled = ::splice(
+      file.fd_num(), seekable ? &position : nullptr, pipe_in.fd_num(), nullptr, len - sent, SPLICE_F_MOVE );
+    if ( filled < 0 ) {
+      if ( errno == EAGAIN ) {
+        break; // a non-blocking source has nothing more for now
+      }
+      throw unix_error { "splice" };
+    }
+    if ( filled == 0 ) {
+      break; // end of file
+    }
+
+    for ( ssize_t drained = 0; drained < filled; ) {
+      const uint64_t started = io_start();
+      const ssize_t bytes_sent
+        = ::splice( pipe_out.fd_num(), nullptr, fd_num(), nullptr, filled - drained, SPLICE_F_MOVE );
+      record_io( IOStats::Direction::Write, started, bytes_sent, filled - drained );
+      if ( bytes_sent < 0 ) {
+        if ( errno != EAGAIN ) {
+          throw unix_error { "splice" };
+        }
+        if ( seekable ) {
+          return sent + drained;
+        }
+        wait_writable( chrono::milliseconds { -1 } );
+        continue;
+      }
+      register_write();
+      drained += bytes_sent;
+    }
+    sent += filled;
+  }
+
+  return sent;
+}
+
+optional<TCPSocket> TCPSocket::accept_nonblocking()
+{
+  const int fd = ::accept4( fd_num(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+  if ( fd < 0 ) {
+    // a connection reset while it waited in the queue is simply gone
+    if ( errno == EAGAIN or errno == ECONNABORTED ) {
+      return {};
+    }
+    throw unix_error { "accept4" };
+  }
+  register_read();
+  return TCPSocket { Trusted {}, FileDescriptor { fd, true } };
+}
+
+//! \param[in] address is the peer's Address; its family determines the socket's
+PendingConnection TCPSocket::connect_async( const Address& address )
+{
+  TCPSocket socket { address.family() };
+  socket.set_blocking( false );
+  socket.connect( address );
+  return { move( socket ), address };
+}
+
+//! \param[in] addresses are the candidate peers, in order of preference
+//! \param[in] timeout bounds the whole race
+//! \param[in] attempt_delay is how long to give each attempt before starting the next
+TCPSocket TCPSocket::connect_happy_eyeballs( const vector<Address>& addresses,
+                                             const chrono::milliseconds timeout,
+                                             const chrono::milliseconds attempt_delay )
+{
+  using clock = chrono::steady_clock;
+
+  if ( addresses.empty() ) {
+    throw runtime_error( "connect_happy_eyeballs: no addresses" );
+  }
+
+  // interleave address families, starting with the family of the first (preferred) address
+  vector<const Address*> order;
+  {
+    vector<const Address*> preferred;
+    vector<const Address*> other;
+    for ( const auto& address : addresses ) {
+      ( address.family() == addresses.front().family() ? preferred : other ).push_back( &address );
+    }
+    for ( size_t i = 0; i < max( preferred.size(), other.size() ); ++i ) {
+      if ( i < preferred.size() ) {
+        order.push_back( preferred[i] );
+      }
+      if ( i < other.size() ) {
+        order.push_back( other[i] );
+      }
+    }
+  }
+
+  const auto deadline = clock::now() + timeout;
+  auto next_attempt_time = clock::now();
+  size_t next_attempt = 0;
+  vector<PendingConnection> attempts;
+  vector<pollfd> pollfds;
+  vector<size_t> failed;
+  exception_ptr last_error;
+
+  while ( true ) {
+    const auto now = clock::now();
+
+    if ( next_attempt < order.size() and ( now >= next_attempt_time or attempts.empty() ) ) {
+      try {
+        attempts.push_back( connect_async( *order[next_attempt] ) );
+      } catch ( const exception& ) {
+        last_error = current_exception();
+      }
+      ++next_attempt;
+      next_attempt_time = now + attempt_delay;
+      continue;
+    }
+
+    if ( attempts.empty() ) {
+      rethrow_exception( last_error ); // every attempt has failed
+    }
+
+    if ( now >= deadline ) {
+      throw unix_error( "connect", ETIMEDOUT );
+    }
+
+    const auto wake_time = next_attempt < order.size() ? min( deadline, next_attempt_time ) : deadline;
+    const auto wait_ms = chrono::ceil<chrono::milliseconds>( wake_time - now ).count();
+
+    pollfds.clear();
+    for ( auto& attempt : attempts ) {
+      pollfds.push_back( { attempt.socket().fd_num(), POLLOUT, 0 } );
+    }
+    ::CheckSystemCall( "poll", ::poll( pollfds.data(), pollfds.size(), static_cast<int>( wait_ms ) ) );
+
+    failed.clear();
+    for ( size_t i = 0; i < attempts.size(); ++i ) {
+      if ( pollfds[i].revents == 0 ) {
+        continue;
+      }
+      try {
+        TCPSocket connected = attempts[i].finish();
+        connected.set_blocking( true );
+        return connected;
+      } catch ( const exception& ) {
+        last_error = current_exception();
+        failed.push_back( i );
+      }
+    }
+
+    if ( not failed.empty() ) {
+      // a failure lets the next attempt start right away
+      for ( auto it = failed.rbegin(); it != failed.rend(); ++it ) {
+        attempts.erase( attempts.begin() + static_cast<ptrdiff_t>( *it ) );
+      }
+      next_attempt_time = clock::now();
+    }
+  }
+}
+
+PendingConnection::PendingConnection( TCPSocket&& socket, const Address& address )
+  : socket_( move( socket ) ), address_( address )
+{}
+
+//! \param[in] timeout is how long to wait (negative waits forever)
+bool PendingConnection::wait( const chrono::milliseconds timeout )
+{
+  if ( not socket_.wait_writable( timeout ) ) {
+    return false;
+  }
+  socket_.throw_if_error();
+  return true;
+}
+
+TCPSocket PendingConnection::finish()
+{
+  socket_.throw_if_error();
+  return move( socket_ );
 }
 
 // get socket option
@@ -200,6 +811,16 @@ void Socket::set_reuseaddr()
   setsockopt( SOL_SOCKET, SO_REUSEADDR, int { true } );
 }
 
+void Socket::set_reuseport()
+{
+  setsockopt( SOL_SOCKET, SO_REUSEPORT, int { true } );
+}
+
+void Socket::set_ipv6_only( const bool ipv6_only )
+{
+  setsockopt( IPPROTO_IPV6, IPV6_V6ONLY, int { ipv6_only } );
+}
+
 void Socket::throw_if_error() const
 {
   int socket_error = 0;
@@ -213,9 +834,653 @@ void Socket::throw_if_error() const
   }
 }
 
+namespace {
+// a Unix-domain socket address, as passed to bind(), connect() and friends
+struct LocalAddress
+{
+  sockaddr_un address {};
+  socklen_t size = sizeof( address );
+
+  // NOLINTBEGIN(*-reinterpret-cast)
+  sockaddr* raw() { return reinterpret_cast<sockaddr*>( &address ); }
+  const sockaddr* raw() const { return reinterpret_cast<const sockaddr*>( &address ); }
+  // NOLINTEND(*-reinterpret-cast)
+
+  // the path or abstract name ("" if unnamed)
+  string path() const
+  {
+    const size_t length = size > offsetof( sockaddr_un, sun_path ) ? size - offsetof( sockaddr_un, sun_path ) : 0;
+    const string_view name { address.sun_path, min( length, sizeof( address.sun_path ) ) };
+    return string { name.empty() or name.front() == '\0' ? name : name.substr( 0, name.find( '\0' ) ) };
+  }
+};
+
+// the Unix-domain socket address for a filesystem path or (starting with '\0') abstract name
+LocalAddress to_local_address( const string_view path )
+{
+  LocalAddress local;
+  sockaddr_un& address = local.address;
+  address.sun_family = AF_UNIX;
+
+  // a filesystem path needs room for its terminating NUL, but an abstract name is just its bytes
+  const bool abstract = not path.empty() and path.front() == '\0';
+  if ( path.empty() or path.size() + ( abstract ? 0 : 1 ) > sizeof( address.sun_path ) ) {
+    throw runtime_error( "invalid Unix-domain socket path (" + to_string( path.size() ) + " bytes)" );
+  }
+
+  ranges::copy( path, begin( address.sun_path ) );
+  local.size = offsetof( sockaddr_un, sun_path ) + path.size() + ( abstract ? 0 : 1 );
+  return local;
+}
+
+// control-message space for the descriptors passed by one send_fds() or recv_fds()
+struct alignas( cmsghdr ) DescriptorControl
+{
+  array<char, CMSG_SPACE( sizeof( int ) * LocalSocket::kMaxPassedFds )> bytes;
+};
+
+template<class SocketType>
+pair<SocketType, SocketType> make_local_pair( const int type )
+{
+  array<int, 2> fds {};
+  ::CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, type, 0, fds.data() ) );
+  return { SocketType { FileDescriptor { fds[0], false } }, SocketType { FileDescriptor { fds[1], false } } };
+}
+} // namespace
+
+//! \param[in] path is a filesystem path, or an abstract name starting with '\0'
+void LocalSocket::bind( const string_view path )
+{
+  const LocalAddress address = to_local_address( path );
+  CheckSystemCall( "bind", ::bind( fd_num(), address.raw(), address.size ) );
+}
+
+//! \param[in] path is a filesystem path, or an abstract name starting with '\0'
+void LocalSocket::connect( const string_view path )
+{
+  const LocalAddress address = to_local_address( path );
+  CheckSystemCall( "connect", ::connect( fd_num(), address.raw(), address.size ) );
+}
+
+string LocalSocket::local_path() const
+{
+  LocalAddress address;
+  CheckSystemCall( "getsockname", ::getsockname( fd_num(), address.raw(), &address.size ) );
+  return address.path();
+}
+
+string LocalSocket::peer_path() const
+{
+  LocalAddress address;
+  CheckSystemCall( "getpeername", ::getpeername( fd_num(), address.raw(), &address.size ) );
+  return address.path();
+}
+
+//! \param[in] payload is the data to send (at least one byte)
+//! \param[in] fds are the descriptors to pass (at most kMaxPassedFds)
+size_t LocalSocket::send_fds( const string_view payload,
+                              const span<const reference_wrapper<const FileDescriptor>> fds )
+{
+  if ( payload.empty() ) {
+    throw runtime_error( "send_fds: the payload must not be empty" );
+  }
+  if ( fds.size() > kMaxPassedFds ) {
+    throw runtime_error( "send_fds: too many descriptors (" + to_string( fds.size() ) + ")" );
+  }
+
+  iovec iov { const_cast<char*>( payload.data() ), payload.size() }; // NOLINT(*-const-cast)
+  DescriptorControl control {};
+  msghdr message {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+
+  if ( not fds.empty() ) {
+    message.msg_control = control.bytes.data();
+    message.msg_controllen = CMSG_SPACE( sizeof( int ) * fds.size() );
+    cmsghdr* const cmsg = CMSG_FIRSTHDR( &message );
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN( sizeof( int ) * fds.size() );
+    for ( size_t i = 0; i < fds.size(); ++i ) {
+      const int fd = fds[i].get().fd_num();
+      memcpy( CMSG_DATA( cmsg ) + sizeof( int ) * i, &fd, sizeof( int ) ); // NOLINT(*-pointer-arithmetic)
+    }
+  }
+
+  const uint64_t started = io_start();
+  const ssize_t bytes_sent = ::sendmsg( fd_num(), &message, MSG_NOSIGNAL );
+  return finish_write( "sendmsg(SCM_RIGHTS)", bytes_sent, payload.size(), started );
+}
+
+size_t LocalSocket::send_fds( const string_view payload,
+                              const initializer_list<reference_wrapper<const FileDescriptor>> fds )
+{
+  return send_fds( payload, span { fds.begin(), fds.size() } );
+}
+
+//! \param[in] buffer receives the data
+//! \param[out] fds has the descriptors that came with it appended
+//! \details Throws if more descriptors came than kMaxPassedFds (the kernel closes the rest).
+size_t LocalSocket::recv_fds( const span<char> buffer, vector<FileDescriptor>& fds )
+{
+  iovec iov { buffer.data(), buffer.size() };
+  DescriptorControl control {};
+  msghdr message {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.bytes.data();
+  message.msg_controllen = control.bytes.size();
+
+  const uint64_t started = io_start();
+  const ssize_t received = ::recvmsg( fd_num(), &message, MSG_CMSG_CLOEXEC );
+
+  // take ownership of the descriptors first, so they are closed if anything throws
+  if ( received >= 0 ) {
+    for ( cmsghdr* cmsg = CMSG_FIRSTHDR( &message ); cmsg != nullptr; cmsg = CMSG_NXTHDR( &message, cmsg ) ) {
+      if ( cmsg->cmsg_level != SOL_SOCKET or cmsg->cmsg_type != SCM_RIGHTS ) {
+        continue;
+      }
+      const size_t count = ( cmsg->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+      for ( size_t i = 0; i < count; ++i ) {
+        int fd {};
+        memcpy( &fd, CMSG_DATA( cmsg ) + sizeof( int ) * i, sizeof( int ) ); // NOLINT(*-pointer-arithmetic)
+        fds.emplace_back( fd );
+      }
+    }
+  }
+
+  const size_t bytes = finish_read( "recvmsg(SCM_RIGHTS)", received, buffer.size(), started );
+  if ( received >= 0 and ( message.msg_flags & MSG_CTRUNC ) ) { // NOLINT(*-bitwise)
+    throw runtime_error( "recvmsg(SCM_RIGHTS): more descriptors arrived than kMaxPassedFds" );
+  }
+  return bytes;
+}
+
+pair<LocalStreamSocket, LocalStreamSocket> LocalStreamSocket::pair()
+{
+  return make_local_pair<LocalStreamSocket>( SOCK_STREAM );
+}
+
+//! \param[in] backlog is the number of waiting connections to queue (see [listen(2)](\ref man2::listen))
+void LocalStreamSocket::listen( const int backlog )
+{
+  CheckSystemCall( "listen", ::listen( fd_num(), backlog ) );
+}
+
+LocalStreamSocket LocalStreamSocket::accept()
+{
+  register_read();
+  const int fd = CheckSystemCall( "accept4", ::accept4( fd_num(), nullptr, nullptr, SOCK_CLOEXEC ) );
+  return LocalStreamSocket { Trusted {}, FileDescriptor { fd, false } };
+}
+
+optional<LocalStreamSocket> LocalStreamSocket::accept_nonblocking()
+{
+  const int fd = ::accept4( fd_num(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+  if ( fd < 0 ) {
+    if ( errno == EAGAIN or errno == ECONNABORTED ) {
+      return {};
+    }
+    throw unix_error { "accept4" };
+  }
+  register_read();
+  return LocalStreamSocket { Trusted {}, FileDescriptor { fd, true } };
+}
+
+pair<LocalDatagramSocket, LocalDatagramSocket> LocalDatagramSocket::pair()
+{
+  return make_local_pair<LocalDatagramSocket>( SOCK_DGRAM );
+}
+
+//! \param[in] path is a filesystem path, or an abstract name starting with '\0'
+//! \param[in] payload is the datagram's contents
+void LocalDatagramSocket::sendto( const string_view path, const string_view payload )
+{
+  const LocalAddress address = to_local_address( path );
+  const uint64_t started = io_start();
+  const ssize_t bytes_sent
+    = ::sendto( fd_num(), payload.data(), payload.size(), MSG_NOSIGNAL, address.raw(), address.size );
+  record_io( IOStats::Direction::Write, started, bytes_sent, 0 );
+  CheckSystemCall( "sendto", bytes_sent );
+  register_write();
+}
+
 void PacketSocket::set_promiscuous()
 {
   setsockopt( SOL_PACKET,
               PACKET_ADD_MEMBERSHIP,
               packet_mreq { local_address().as<sockaddr_ll>()->sll_ifindex, PACKET_MR_PROMISC, {}, {} } );
 }
+
+//! \param[in] interface_name is the name of the interface, e.g. "eth0"
+void PacketSocket::bind_to_interface( const string_view interface_name )
+{
+  const unsigned int index = if_nametoindex( string { interface_name }.c_str() );
+  if ( index == 0 ) {
+    throw unix_error { "if_nametoindex(" + string { interface_name } + ")" };
+  }
+
+  // a protocol of 0 keeps the one the socket was created with
+  sockaddr_ll address {};
+  address.sll_family = AF_PACKET;
+  address.sll_ifindex = static_cast<int>( index );
+  bind( { reinterpret_cast<const sockaddr*>( &address ), sizeof( address ) } ); // NOLINT(*-reinterpret-cast)
+}
+
+//! \param[in] type is `SOCK_RAW` or `SOCK_DGRAM`
+//! \param[in] protocol is the link-layer protocol in network order
+//! \param[in] config sizes the rings
+PacketRing::PacketRing( const int type, const int protocol, const Config& config )
+  : PacketSocket( type, protocol ), config_( config )
+{
+  if ( config.block_size == 0 or config.block_count == 0 or config.frame_size == 0
+       or config.block_size % config.frame_size != 0 ) {
+    throw runtime_error( "PacketRing: block size must be a positive multiple of the frame size" );
+  }
+
+  setsockopt( SOL_PACKET, PACKET_VERSION, int { TPACKET_V3 } );
+
+  tpacket_req3 request {};
+  request.tp_block_size = config.block_size;
+  request.tp_block_nr = config.block_count;
+  request.tp_frame_size = config.frame_size;
+  request.tp_frame_nr = config.block_size / config.frame_size * config.block_count;
+  request.tp_retire_blk_tov = config.block_timeout_ms;
+  setsockopt( SOL_PACKET, PACKET_RX_RING, request );
+  map_size_ = size_t { config.block_size } * config.block_count;
+
+  if ( config.tx ) {
+    // a TX ring has fixed-size slots, and no block timeout
+    request.tp_retire_blk_tov = 0;
+    setsockopt( SOL_PACKET, PACKET_TX_RING, request );
+    tx_frames_ = request.tp_frame_nr;
+    map_size_ *= 2;
+  }
+
+  map_ = mmap( nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_num(), 0 );
+  if ( map_ == MAP_FAILED ) { // NOLINT(*-cstyle-cast, *-int-to-ptr)
+    map_ = nullptr;
+    throw unix_error { "mmap(PACKET_RX_RING)" };
+  }
+}
+
+PacketRing::~PacketRing()
+{
+  if ( map_ ) {
+    munmap( map_, map_size_ );
+  }
+}
+
+char* PacketRing::rx_block( const uint32_t index ) const
+{
+  return static_cast<char*>( map_ ) + size_t { index } * config_.block_size; // NOLINT(*-pointer-arithmetic)
+}
+
+// TX slots follow the RX ring; a block's slots are contiguous, so they can be numbered straight through
+char* PacketRing::tx_slot( const uint32_t index ) const
+{
+  return rx_block( config_.block_count ) + size_t { index } * config_.frame_size; // NOLINT(*-pointer-arithmetic)
+}
+
+//! \details A block whose frames have all been passed to `callback` goes back to the kernel, even if
+//! `callback` throws (in which case the rest of its frames are lost).
+size_t PacketRing::receive( const function<void( const FrameView& )>& callback, const size_t max_blocks )
+{
+  constexpr uint64_t kNsPerSecond = 1'000'000'000;
+
+  size_t frames = 0;
+  for ( size_t blocks = 0; blocks < max_blocks; ++blocks ) {
+    auto* const block = reinterpret_cast<tpacket_block_desc*>( rx_block( rx_block_ ) ); // NOLINT
+    atomic_ref status { block->hdr.bh1.block_status };
+    if ( ( status.load( memory_order_acquire ) & TP_STATUS_USER ) == 0 ) {
+      break; // the kernel is still filling this block
+    }
+
+    const char* frame = reinterpret_cast<const char*>( block ) + block->hdr.bh1.offset_to_first_pkt; // NOLINT
+    try {
+      for ( uint32_t i = 0; i < block->hdr.bh1.num_pkts; ++i ) {
+        const auto* const header = reinterpret_cast<const tpacket3_hdr*>( frame ); // NOLINT(*-reinterpret-cast)
+        callback( { { frame + header->tp_mac, header->tp_snaplen }, // NOLINT(*-pointer-arithmetic)
+                    header->tp_len,
+                    header->tp_sec * kNsPerSecond + header->tp_nsec } );
+        frame += header->tp_next_offset; // NOLINT(*-pointer-arithmetic)
+      }
+    } catch ( ... ) {
+      status.store( TP_STATUS_KERNEL, memory_order_release );
+      rx_block_ = ( rx_block_ + 1 ) % config_.block_count;
+      throw;
+    }
+
+    frames += block->hdr.bh1.num_pkts;
+    status.store( TP_STATUS_KERNEL, memory_order_release );
+    rx_block_ = ( rx_block_ + 1 ) % config_.block_count;
+  }
+
+  if ( frames ) {
+    register_read();
+  }
+  return frames;
+}
+
+bool PacketRing::send( const string_view frame )
+{
+  if ( tx_frames_ == 0 ) {
+    throw runtime_error( "PacketRing::send: no TX ring (set Config::tx)" );
+  }
+
+  // the kernel expects a TPACKET_V3 slot's data right after the header
+  constexpr size_t kDataOffset = TPACKET3_HDRLEN - sizeof( sockaddr_ll );
+  if ( frame.size() > config_.frame_size - kDataOffset ) {
+    throw runtime_error( "PacketRing::send: frame larger than Config::frame_size allows" );
+  }
+
+  char* const slot = tx_slot( tx_frame_ );
+  auto* const header = reinterpret_cast<tpacket3_hdr*>( slot ); // NOLINT(*-reinterpret-cast)
+  atomic_ref status { header->tp_status };
+  const uint32_t current = status.load( memory_order_acquire );
+  if ( current == TP_STATUS_SEND_REQUEST or current == TP_STATUS_SENDING ) {
+    return false;
+  }
+
+  memcpy( slot + kDataOffset, frame.data(), frame.size() ); // NOLINT(*-pointer-arithmetic)
+  header->tp_len = frame.size();
+  header->tp_snaplen = frame.size();
+  header->tp_next_offset = 0;
+  status.store( TP_STATUS_SEND_REQUEST, memory_order_release );
+  tx_frame_ = ( tx_frame_ + 1 ) % tx_frames_;
+  return true;
+}
+
+void PacketRing::flush()
+{
+  // with MSG_DONTWAIT, the kernel starts transmitting the queued slots and returns without waiting for them
+  if ( ::send( fd_num(), nullptr, 0, MSG_DONTWAIT ) < 0 and errno != EAGAIN and errno != ENOBUFS ) {
+    throw unix_error { "send(PACKET_TX_RING)" };
+  }
+  register_write();
+}
+
+//! \param[in] group_id names the group (per network namespace)
+//! \param[in] mode is the `PACKET_FANOUT_*` policy, optionally combined with `PACKET_FANOUT_FLAG_*` flags
+void PacketRing::join_fanout( const uint16_t group_id, const int mode )
+{
+  setsockopt( SOL_PACKET, PACKET_FANOUT, int { group_id | ( mode << 16 ) } ); // NOLINT(*-signed-bitwise)
+}
+
+PacketRing::Statistics PacketRing::statistics()
+{
+  tpacket_stats_v3 stats {};
+  getsockopt( SOL_PACKET, PACKET_STATISTICS, stats );
+  return { stats.tp_packets, stats.tp_drops, stats.tp_freeze_q_cnt };
+}
+
+namespace {
+// Wrapper around bpf(2), which has no libc wrapper
+int bpf( const bpf_cmd command, bpf_attr& attributes )
+{
+  return static_cast<int>( syscall( __NR_bpf, command, &attributes, sizeof( attributes ) ) );
+}
+
+uint64_t to_u64( const void* pointer )
+{
+  return reinterpret_cast<uintptr_t>( pointer ); // NOLINT(*-reinterpret-cast)
+}
+
+// An XSKMAP with an entry for each of queues 0..`queue`
+FileDescriptor make_xsk_map( const uint32_t queue )
+{
+  bpf_attr attributes {};
+  attributes.map_type = BPF_MAP_TYPE_XSKMAP;
+  attributes.key_size = sizeof( uint32_t );
+  attributes.value_size = sizeof( uint32_t );
+  attributes.max_entries = queue + 1;
+  return FileDescriptor { CheckSystemCall( "bpf(BPF_MAP_CREATE)", bpf( BPF_MAP_CREATE, attributes ) ), false };
+}
+
+// The XDP program: return bpf_redirect_map( xsk_map, ctx->rx_queue_index, XDP_PASS ), which sends a frame to the
+// socket in its queue's entry, or up the stack when the entry is empty
+FileDescriptor load_redirect_program( const FileDescriptor& xsk_map )
+{
+  const array<bpf_insn, 6> program { {
+    // r2 = ctx->rx_queue_index
+    { BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof( xdp_md, rx_queue_index ), 0 },
+    // r1 = xsk_map (a 64-bit immediate, which takes two instructions)
+    { BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, xsk_map.fd_num() },
+    { 0, 0, 0, 0, 0 },
+    // r3 = XDP_PASS (the action when the map has no socket for the queue)
+    { BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS },
+    { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map },
+    { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+  } };
+  static constexpr char license[] = "GPL"; // NOLINT(*-avoid-c-arrays)
+
+  bpf_attr attributes {};
+  attributes.prog_type = BPF_PROG_TYPE_XDP;
+  attributes.insns = to_u64( program.data() );
+  attributes.insn_cnt = program.size();
+  attributes.license = to_u64( license );
+  return FileDescriptor { CheckSystemCall( "bpf(BPF_PROG_LOAD)", bpf( BPF_PROG_LOAD, attributes ) ), false };
+}
+
+const XDPSocket::Config& validated( const XDPSocket::Config& config )
+{
+  const auto page_size = static_cast<uint32_t>( sysconf( _SC_PAGESIZE ) );
+  if ( not has_single_bit( config.frame_size ) or config.frame_size < 2048 or config.frame_size > page_size ) {
+    throw runtime_error( "XDPSocket: frame size must be a power of two from 2048 to the page size" );
+  }
+  // the send half gets the odd frame, and every send frame can be on the TX or completion ring at once
+  if ( config.frame_count < 2 or not has_single_bit( config.ring_size )
+       or config.ring_size < ( config.frame_count + 1 ) / 2 ) {
+    throw runtime_error( "XDPSocket: ring size must be a power of two of at least half the frame count, "
+                         "rounded up" );
+  }
+  return config;
+}
+} // namespace
+
+XDPSocket::Mapping::Mapping( const int fd, const size_t length, const off_t offset )
+  : addr_( mmap( nullptr,
+                 length,
+                 PROT_READ | PROT_WRITE,
+                 ( fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED ) | MAP_POPULATE,
+                 fd,
+                 offset ) )
+  , length_( length )
+{
+  if ( addr_ == MAP_FAILED ) { // NOLINT(*-cstyle-cast)
+    throw unix_error { "mmap" };
+  }
+}
+
+XDPSocket::Mapping::~Mapping()
+{
+  munmap( addr_, length_ );
+}
+
+XDPSocket::XDPSocket( const string_view interface_name, const uint32_t queue, const Config& config )
+  : XDPSocket( interface_name, queue, config, xdp_mmap_offsets {} )
+{}
+
+// offsets is filled in (once the UMEM is registered and the rings sized) before the rings are mapped
+XDPSocket::XDPSocket( const string_view interface_name,
+                      const uint32_t queue,
+                      const Config& config,
+                      xdp_mmap_offsets&& offsets )
+  : Socket( AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0 )
+  , config_( validated( config ) )
+  , umem_( -1, size_t { config.frame_count } * config.frame_size, 0 )
+  , fill_map_( [&] {
+    xdp_umem_reg registration {};
+    registration.addr = to_u64( umem_.get() );
+    registration.len = size_t { config_.frame_count } * config_.frame_size;
+    registration.chunk_size = config_.frame_size;
+    setsockopt( SOL_XDP, XDP_UMEM_REG, registration );
+    setsockopt( SOL_XDP, XDP_UMEM_FILL_RING, config_.ring_size );
+    setsockopt( SOL_XDP, XDP_UMEM_COMPLETION_RING, config_.ring_size );
+    setsockopt( SOL_XDP, XDP_RX_RING, config_.ring_size );
+    setsockopt( SOL_XDP, XDP_TX_RING, config_.ring_size );
+    getsockopt( SOL_XDP, XDP_MMAP_OFFSETS, offsets );
+    return fd_num();
+  }(),
+               offsets.fr.desc + config.ring_size * sizeof( uint64_t ),
+               XDP_UMEM_PGOFF_FILL_RING )
+  , completion_map_( fd_num(),
+                     offsets.cr.desc + config.ring_size * sizeof( uint64_t ),
+                     XDP_UMEM_PGOFF_COMPLETION_RING )
+  , rx_map_( fd_num(), offsets.rx.desc + config.ring_size * sizeof( xdp_desc ), XDP_PGOFF_RX_RING )
+  , tx_map_( fd_num(), offsets.tx.desc + config.ring_size * sizeof( xdp_desc ), XDP_PGOFF_TX_RING )
+  , xsk_map_( make_xsk_map( queue ) )
+  , program_( load_redirect_program( xsk_map_ ) )
+  , link_( [&] {
+    const auto ring_at = []( const Mapping& map, const xdp_ring_offset& offset ) {
+      return Ring { reinterpret_cast<uint32_t*>( map.get() + offset.producer ), // NOLINT
+                    reinterpret_cast<uint32_t*>( map.get() + offset.consumer ), // NOLINT
+                    reinterpret_cast<uint32_t*>( map.get() + offset.flags ),    // NOLINT
+                    map.get() + offset.desc };                                  // NOLINT
+    };
+    fill_ = ring_at( fill_map_, offsets.fr );
+    completion_ = ring_at( completion_map_, offsets.cr );
+    rx_ = ring_at( rx_map_, offsets.rx );
+    tx_ = ring_at( tx_map_, offsets.tx );
+
+    // the first half of the UMEM is for receiving, so goes straight to the fill ring, and the rest to send()
+    const uint32_t rx_frames = config_.frame_count / 2;
+    auto* const fill_entries = reinterpret_cast<uint64_t*>( fill_.entries ); // NOLINT(*-reinterpret-cast)
+    for ( uint32_t i = 0; i < rx_frames; ++i ) {
+      fill_entries[i] = uint64_t { i } * config_.frame_size; // NOLINT(*-pointer-arithmetic)
+    }
+    atomic_ref { *fill_.producer }.store( rx_frames, memory_order_release );
+    for ( uint32_t i = rx_frames; i < config_.frame_count; ++i ) {
+      free_tx_.push_back( uint64_t { i } * config_.frame_size );
+    }
+
+    const unsigned int ifindex = if_nametoindex( string { interface_name }.c_str() );
+    if ( ifindex == 0 ) {
+      throw unix_error { "if_nametoindex(" + string { interface_name } + ")" };
+    }
+
+    sockaddr_xdp address {};
+    address.sxdp_family = AF_XDP;
+    address.sxdp_flags = config_.bind_flags;
+    address.sxdp_ifindex = ifindex;
+    address.sxdp_queue_id = queue;
+    const auto* const generic = reinterpret_cast<const sockaddr*>( &address ); // NOLINT(*-reinterpret-cast)
+    CheckSystemCall( "bind(AF_XDP)", ::bind( fd_num(), generic, sizeof( address ) ) );
+
+    bpf_attr attributes {};
+    attributes.map_fd = xsk_map_.fd_num();
+    attributes.key = to_u64( &queue );
+    const int socket_fd = fd_num();
+    attributes.value = to_u64( &socket_fd );
+    CheckSystemCall( "bpf(BPF_MAP_UPDATE_ELEM)", bpf( BPF_MAP_UPDATE_ELEM, attributes ) );
+
+    // the program stays attached for as long as the link is open
+    attributes = {};
+    attributes.link_create.prog_fd = program_.fd_num();
+    attributes.link_create.target_ifindex = ifindex;
+    attributes.link_create.attach_type = BPF_XDP;
+    attributes.link_create.flags = config_.xdp_flags;
+    return FileDescriptor { CheckSystemCall( "bpf(BPF_LINK_CREATE)", bpf( BPF_LINK_CREATE, attributes ) ), false };
+  }() )
+{}
+
+void XDPSocket::reclaim_completions()
+{
+  const uint32_t producer = atomic_ref { *completion_.producer }.load( memory_order_acquire );
+  uint32_t consumer = *completion_.consumer;
+  const auto* const entries = reinterpret_cast<const uint64_t*>( completion_.entries ); // NOLINT
+  for ( ; consumer != producer; ++consumer ) {
+    free_tx_.push_back( entries[consumer & mask()] ); // NOLINT(*-pointer-arithmetic)
+  }
+  atomic_ref { *completion_.consumer }.store( consumer, memory_order_release );
+}
+
+//! \details Buffers whose frames have been passed to `callback` go back to the fill ring, even if `callback`
+//! throws (in which case the rest of the frames are lost).
+size_t XDPSocket::receive( const function<void( const FrameView& )>& callback, const size_t max_frames )
+{
+  const uint32_t producer = atomic_ref { *rx_.producer }.load( memory_order_acquire );
+  const uint32_t consumer = *rx_.consumer;
+  const auto count = static_cast<uint32_t>( min<size_t>( producer - consumer, max_frames ) );
+
+  if ( count == 0 ) {
+    // in need-wakeup mode, the kernel stops taking buffers from the fill ring until it is poked
+    if ( atomic_ref { *fill_.flags }.load( memory_order_relaxed ) & XDP_RING_NEED_WAKEUP ) { // NOLINT(*-bitwise)
+      ::recvfrom( fd_num(), nullptr, 0, MSG_DONTWAIT, nullptr, nullptr );
+    }
+    return 0;
+  }
+
+  // the fill ring has room: it and the RX ring together never hold more than the receive half of the UMEM
+  const auto* const descriptors = reinterpret_cast<const xdp_desc*>( rx_.entries ); // NOLINT(*-reinterpret-cast)
+  auto* const fill_entries = reinterpret_cast<uint64_t*>( fill_.entries );          // NOLINT(*-reinterpret-cast)
+  const uint32_t fill_producer = *fill_.producer;
+  uint32_t done = 0;
+  const auto give_back = [&] {
+    atomic_ref { *fill_.producer }.store( fill_producer + done, memory_order_release );
+    atomic_ref { *rx_.consumer }.store( consumer + done, memory_order_release );
+  };
+
+  try {
+    for ( ; done < count; ++done ) {
+      const xdp_desc& descriptor = descriptors[( consumer + done ) & mask()]; // NOLINT(*-pointer-arithmetic)
+      const char* const frame = umem_.get() + descriptor.addr;                // NOLINT(*-pointer-arithmetic)
+      fill_entries[( fill_producer + done ) & mask()] // NOLINT(*-pointer-arithmetic)
+        = descriptor.addr & ~uint64_t { config_.frame_size - 1 };
+      callback( { { frame, descriptor.len }, descriptor.len, 0 } );
+    }
+  } catch ( ... ) {
+    ++done;
+    give_back();
+    throw;
+  }
+
+  give_back();
+  register_read();
+  return count;
+}
+
+bool XDPSocket::send( const string_view frame )
+{
+  if ( frame.size() > config_.frame_size ) {
+    throw runtime_error( "XDPSocket::send: frame larger than Config::frame_size" );
+  }
+
+  if ( free_tx_.empty() ) {
+    reclaim_completions();
+    if ( free_tx_.empty() ) {
+      return false;
+    }
+  }
+
+  // the TX ring can't be full: it holds at most the send half of the UMEM
+  const uint64_t offset = free_tx_.back();
+  free_tx_.pop_back();
+  memcpy( umem_.get() + offset, frame.data(), frame.size() ); // NOLINT(*-pointer-arithmetic)
+
+  const uint32_t producer = *tx_.producer;
+  auto* const descriptors = reinterpret_cast<xdp_desc*>( tx_.entries ); // NOLINT(*-reinterpret-cast)
+  descriptors[producer & mask()] = { offset, static_cast<uint32_t>( frame.size() ), 0 }; // NOLINT
+  atomic_ref { *tx_.producer }.store( producer + 1, memory_order_release );
+  return true;
+}
+
+void XDPSocket::flush()
+{
+  // without need-wakeup mode, or when the kernel asks for it, a send kicks off transmission
+  const bool need_wakeup = ( config_.bind_flags & XDP_USE_NEED_WAKEUP ) == 0 // NOLINT(*-bitwise)
+                           or ( atomic_ref { *tx_.flags }.load( memory_order_relaxed ) & XDP_RING_NEED_WAKEUP );
+  if ( need_wakeup and ::sendto( fd_num(), nullptr, 0, MSG_DONTWAIT, nullptr, 0 ) < 0 and errno != EAGAIN
+       and errno != EBUSY and errno != ENOBUFS ) {
+    throw unix_error { "sendto(AF_XDP)" };
+  }
+  reclaim_completions();
+  register_write();
+}
+
+XDPSocket::Statistics XDPSocket::statistics() const
+{
+  xdp_statistics stats {};
+  getsockopt( SOL_XDP, XDP_STATISTICS, stats );
+  return { stats.rx_dropped, stats.rx_ring_full, stats.rx_fill_ring_empty_descs, stats.tx_invalid_descs };
+}
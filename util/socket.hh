@@ -3,26 +3,50 @@
 #include "address.hh"
 #include "file_descriptor.hh"
 
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <functional>
+#include <initializer_list>
+#include <linux/if_xdp.h>
+#include <netinet/in.h>
+#include <optional>
+#include <string>
+#include <span>
+#include <string_view>
 #include <sys/socket.h>
+#include <utility>
+#include <vector>
 
 //! \brief Base class for network sockets (TCP, UDP, etc.)
 //! \details Socket is generally used via a subclass. See TCPSocket and UDPSocket for usage examples.
 class Socket : public FileDescriptor
 {
 private:
+  //! Throw std::runtime_error unless the socket has this domain (unless `AF_UNSPEC`), type and protocol
+  void verify( int domain, int type, int protocol ) const;
+
   //! Get the local or peer address the socket is connected to
   Address get_address( const std::string& name_of_function,
                        const std::function<int( int, sockaddr*, socklen_t* )>& function ) const;
 
 protected:
+  //! \brief Tag for constructors whose caller vouches for the descriptor's domain, type and protocol
+  //! \details Use it only where the kernel guarantees them, e.g. for a connection just returned by
+  //! accept4() on a listener of the same kind. Builds with CHECK_TRUSTED_DESCRIPTORS defined verify them anyway.
+  struct Trusted
+  {};
+
   //! Construct via [socket(2)](\ref man2::socket)
   Socket( int domain, int type, int protocol = 0 );
 
   //! Construct from a file descriptor.
   Socket( FileDescriptor&& fd, int domain, int type, int protocol = 0 );
 
+  //! Construct from a descriptor with known properties, without the getsockopt() calls that verify them
+  Socket( Trusted tag, FileDescriptor&& fd, int domain, int type, int protocol = 0 );
+
   //! Wrapper around [getsockopt(2)](\ref man2::getsockopt)
   template<typename option_type>
   socklen_t getsockopt( int level, int option, option_type& option_value ) const;
@@ -43,6 +67,18 @@ public:
   //! Connect a socket to a specified peer address with [connect(2)](\ref man2::connect)
   void connect( const Address& address );
 
+  //! \brief Connect, giving up with a `unix_error` (ETIMEDOUT) if the connection isn't established within `timeout`
+  //! \details The socket's blocking mode is the same afterwards as before.
+  void connect( const Address& address, std::chrono::milliseconds timeout );
+
+  //! Wait up to `timeout` for the socket to become writable (-1 ms waits forever)
+  //! \returns false on timeout
+  bool wait_writable( std::chrono::milliseconds timeout ) const;
+
+  //! Wait up to `timeout` for the socket to become readable (-1 ms waits forever)
+  //! \returns false on timeout
+  bool wait_readable( std::chrono::milliseconds timeout ) const;
+
   //! Shut down a socket via [shutdown(2)](\ref man2::shutdown)
   void shutdown( int how );
 
@@ -54,6 +90,15 @@ public:
   //! Allow local address to be reused sooner via [SO_REUSEADDR](\ref man7::socket)
   void set_reuseaddr();
 
+  //! Let several sockets bind the same address, with the kernel spreading traffic among them
+  //! ([SO_REUSEPORT](\ref man7::socket))
+  void set_reuseport();
+
+  //! \brief Whether an `AF_INET6` socket is limited to IPv6 ([IPV6_V6ONLY](\ref man7::ipv6))
+  //! \details With false (call before bind()), a socket bound to "::" also serves IPv4, whose peers appear as
+  //! IPv4-mapped addresses (see Address::unmapped()).
+  void set_ipv6_only( bool ipv6_only );
+
   //! Check for errors (will be seen on non-blocking sockets)
   void throw_if_error() const;
 };
@@ -63,44 +108,303 @@ class DatagramSocket : public Socket
   using Socket::Socket;
 
 public:
+  //! Maximum number of datagrams moved by one recv_batch() or send_batch() system call
+  static constexpr size_t kMaxBatch = 64;
+
+  //! A caller-provided slot for one datagram received by recv_batch()
+  struct ReceivedDatagram
+  {
+    Address::Raw source {};   //!< The sender's address (the first source_size bytes are valid)
+    socklen_t source_size {}; //!< Size of the sender's address
+    OwnedBuffer payload {};   //!< Receives the datagram (into its full capacity, which must be nonzero)
+    uint16_t segment_size {}; //!< With UDP GRO, the size of each coalesced segment (0 if not coalesced)
+
+    //! The sender's Address
+    Address source_address() const { return { source, source_size }; }
+  };
+
+  //! A datagram to be sent by send_batch()
+  struct OutgoingDatagram
+  {
+    const Address* destination {}; //!< Where to send it (nullptr for the connected peer)
+    std::string_view payload {};   //!< The datagram's contents
+    uint16_t segment_size {};      //!< With UDP GSO, split payload into datagrams of this size (0 = don't split)
+  };
   //! Receive a datagram and the Address of its sender
   void recv( Address& source_address, std::string& payload );
 
+  //! Receive a datagram into the full capacity of `payload` (e.g. a slab from a BufferPool)
+  void recv( Address& source_address, OwnedBuffer& payload );
+
   //! Send a datagram to specified Address
   void sendto( const Address& destination, std::string_view payload );
 
   //! Send datagram to the socket's connected address (must call connect() first)
   void send( std::string_view payload );
+
+  //! \brief Non-throwing recv() for hot loops
+  //! \details A datagram too big for `payload` fails with EMSGSIZE (its first payload.capacity() bytes are
+  //! kept, and `source_address` is set); every other failure is the kernel's errno.
+  IOResult try_recv( Address& source_address, OwnedBuffer& payload ) noexcept;
+
+  //! Non-throwing sendto() for hot loops
+  IOResult try_sendto( const Address& destination, std::string_view payload ) noexcept;
+
+  //! Non-throwing send() for hot loops
+  IOResult try_send( std::string_view payload ) noexcept;
+
+  //! \brief Receive up to kMaxBatch datagrams with one [recvmmsg(2)](\ref man2::recvmmsg)
+  //! \details Blocks (on a blocking socket) until at least one datagram arrives, then takes whatever
+  //! else is already queued without waiting.
+  //! \returns the number of slots filled (0 if a non-blocking socket had nothing to read)
+  size_t recv_batch( std::span<ReceivedDatagram> slots );
+
+  //! \brief Send up to kMaxBatch datagrams with one [sendmmsg(2)](\ref man2::sendmmsg)
+  //! \returns the number of datagrams sent, which may be fewer than requested
+  size_t send_batch( std::span<const OutgoingDatagram> datagrams );
 };
 
 //! A wrapper around [UDP sockets](\ref man7::udp)
 class UDPSocket : public DatagramSocket
 {
-  //! \param[in] fd is the FileDescriptor from which to construct
-  explicit UDPSocket( FileDescriptor&& fd ) : DatagramSocket( std::move( fd ), AF_INET, SOCK_DGRAM ) {}
+  //! \param[in] fd is the FileDescriptor from which to construct (IPv4 or IPv6)
+  explicit UDPSocket( FileDescriptor&& fd ) : DatagramSocket( std::move( fd ), AF_UNSPEC, SOCK_DGRAM, IPPROTO_UDP )
+  {}
 
 public:
   //! Default: construct an unbound, unconnected UDP socket
   UDPSocket() : DatagramSocket( AF_INET, SOCK_DGRAM ) {}
+
+  //! Construct an unbound, unconnected UDP socket of the given family (`AF_INET` or `AF_INET6`)
+  explicit UDPSocket( int domain ) : DatagramSocket( domain, SOCK_DGRAM ) {}
+
+  //! \brief Split every datagram sent on this socket into segments of `segment_size` bytes in the kernel or NIC
+  //! \details Uses generic segmentation offload ([UDP_SEGMENT](\ref man7::udp)); 0 turns it off.
+  //! Individual datagrams can override this with OutgoingDatagram::segment_size.
+  void set_gso_segment_size( uint16_t segment_size );
+
+  //! \brief Let the kernel coalesce received datagrams of one flow ([UDP_GRO](\ref man7::udp))
+  //! \details recv_batch() reports the segment size of coalesced datagrams in ReceivedDatagram::segment_size.
+  void set_gro( bool enabled );
 };
 
+class PendingConnection;
+
 //! A wrapper around [TCP sockets](\ref man7::tcp)
 class TCPSocket : public Socket
 {
 private:
-  //! \brief Construct from FileDescriptor (used by accept())
-  //! \param[in] fd is the FileDescriptor from which to construct
-  explicit TCPSocket( FileDescriptor&& fd ) : Socket( std::move( fd ), AF_INET, SOCK_STREAM ) {}
+  //! \brief Construct from a connection returned by accept4() on a TCP listener
+  //! \details The connection has the listener's domain, whichever that is, so only its type and protocol
+  //! are verified in checked builds.
+  TCPSocket( Trusted tag, FileDescriptor&& fd )
+    : Socket( tag, std::move( fd ), AF_UNSPEC, SOCK_STREAM, IPPROTO_TCP )
+  {}
+
+  //! Zero-copy sends whose completion notifications haven't been collected
+  struct ZeroCopyState
+  {
+    bool enabled {};
+    uint32_t next_id {};                             //!< The kernel numbers zero-copy sends from 0
+    std::deque<std::pair<uint32_t, Buffer>> pinned {}; //!< Keeps each send's buffer alive until it completes
+    uint64_t copied {};
+  };
+
+  ZeroCopyState zerocopy_ {};
+
+  //! send_file() for sources that sendfile(2) can't read from
+  size_t splice_file( const FileDescriptor& file, off_t offset, size_t len );
 
 public:
   //! Default: construct an unbound, unconnected TCP socket
   TCPSocket() : Socket( AF_INET, SOCK_STREAM ) {}
 
+  //! Construct an unbound, unconnected TCP socket of the given family (`AF_INET` or `AF_INET6`)
+  explicit TCPSocket( int domain ) : Socket( domain, SOCK_STREAM ) {}
+
+  //! \brief Adopt a descriptor, e.g. a connection passed over a LocalSocket
+  //! \param[in] fd is the FileDescriptor from which to construct (IPv4 or IPv6); throws unless it is TCP
+  explicit TCPSocket( FileDescriptor&& fd ) : Socket( std::move( fd ), AF_UNSPEC, SOCK_STREAM, IPPROTO_TCP ) {}
+
   //! Mark a socket as listening for incoming connections
   void listen( int backlog = 16 );
 
   //! Accept a new incoming connection
   TCPSocket accept();
+
+  //! \brief Accept a connection if one is waiting, without blocking
+  //! \details The connection comes back non-blocking and close-on-exec from one
+  //! [accept4(2)](\ref man2::accept4), and isn't re-verified, since the kernel guarantees it is TCP.
+  //! \returns the connection, or nothing if none is waiting (the listener should be non-blocking)
+  std::optional<TCPSocket> accept_nonblocking();
+
+  //! \brief Send `len` bytes of `file` starting at `offset`, without copying them through user space
+  //! \details Uses [sendfile(2)](\ref man2::sendfile), or for sources it can't read from (such as pipes and
+  //! sockets) [splice(2)](\ref man2::splice) through a pipe. The file position of a seekable source is not
+  //! changed; `offset` is ignored for a source that can't seek. A blocking socket is sent everything unless
+  //! the source ends first, and a non-blocking one is sent what it can take without waiting.
+  //! \returns the number of bytes sent
+  size_t send_file( const FileDescriptor& file, off_t offset, size_t len );
+
+  //! Allow write_zerocopy() to send without copying ([SO_ZEROCOPY](\ref man7::socket))
+  void set_zerocopy( bool enabled );
+
+  //! \brief Send `buffer` from `offset` onwards with MSG_ZEROCOPY, so the kernel reads it in place
+  //! \details `buffer` is shared, not copied, and kept until reap_zerocopy() collects the notification
+  //! that this send has completed. Without set_zerocopy(), or when the kernel is short of memory for
+  //! notifications, this is an ordinary write.
+  //! \returns the number of bytes sent
+  size_t write_zerocopy( const Buffer& buffer, size_t offset = 0 );
+
+  //! \brief Collect zero-copy completion notifications from the socket's error queue, releasing their buffers
+  //! \details Never blocks. With an EventLoop, call it from a rule added by EventLoop::add_error_queue_rule(),
+  //! which runs when notifications are pending. Buffers still pinned when the socket is destroyed are
+  //! released with it.
+  //! \returns the number of sends completed
+  size_t reap_zerocopy();
+
+  //! Number of zero-copy sends waiting for their completion notifications
+  size_t zerocopy_pending() const { return zerocopy_.pinned.size(); }
+
+  //! Number of completed zero-copy sends that the kernel copied after all (e.g. over loopback)
+  uint64_t zerocopy_copied() const { return zerocopy_.copied; }
+
+  //! \brief Hold back partial segments while corked ([TCP_CORK](\ref man7::tcp))
+  //! \details Cork before writing a header and body separately, then uncork to send the remainder.
+  void set_cork( bool corked );
+
+  //! Send small segments at once instead of waiting for outstanding data to be acknowledged
+  //! ([TCP_NODELAY](\ref man7::tcp), which turns off Nagle's algorithm)
+  void set_nodelay( bool nodelay );
+
+  //! Gather-write with MSG_MORE, holding back a partial last segment because more data will follow
+  size_t write_more( std::span<const std::string_view> buffers );
+
+  //! Start a non-blocking connection to `address` without waiting for it to complete
+  static PendingConnection connect_async( const Address& address );
+
+  //! \brief Race connections to `addresses` as described in [RFC 8305](https://www.rfc-editor.org/rfc/rfc8305)
+  //! \details Families are interleaved (keeping the first address's family first), and a new attempt
+  //! starts every `attempt_delay` or as soon as the previous attempt fails, whichever comes first. The
+  //! first connection to be established wins and is returned in blocking mode; the others are closed.
+  //! Throws the last attempt's error if every attempt fails, or ETIMEDOUT after `timeout`.
+  static TCPSocket connect_happy_eyeballs(
+    const std::vector<Address>& addresses,
+    std::chrono::milliseconds timeout,
+    std::chrono::milliseconds attempt_delay = std::chrono::milliseconds { 250 } );
+};
+
+//! \brief A non-blocking TCP connection attempt (see TCPSocket::connect_async())
+//! \details The attempt has finished once socket() is writable, e.g. as reported by an EventLoop rule
+//! for Direction::Out or by wait(); then finish() reports the outcome.
+class PendingConnection
+{
+  TCPSocket socket_;
+  Address address_;
+
+public:
+  PendingConnection( TCPSocket&& socket, const Address& address );
+
+  //! The connecting socket, e.g. for registering with an EventLoop
+  TCPSocket& socket() { return socket_; }
+  //! The peer being connected to
+  const Address& address() const { return address_; }
+
+  //! Wait up to `timeout` for the attempt to finish, then throw if it failed
+  //! \returns false on timeout
+  bool wait( std::chrono::milliseconds timeout );
+
+  //! Once the socket is writable, throw if the attempt failed, or return the connected (non-blocking) socket
+  TCPSocket finish();
+};
+
+//! \brief Base class for [Unix-domain sockets](\ref man7::unix), which connect processes on the same host
+//! \details Sockets are named by filesystem path, or in the abstract namespace by a name that starts with
+//! a NUL byte (which disappears with the socket). Data doesn't pass through the TCP/IP stack, and open
+//! descriptors can be handed to the peer with send_fds(), e.g. from an acceptor to worker processes.
+class LocalSocket : public Socket
+{
+protected:
+  using Socket::Socket;
+
+public:
+  //! Maximum number of descriptors passed by one send_fds() or recv_fds()
+  static constexpr size_t kMaxPassedFds = 64;
+
+  //! Bind to a filesystem path (which must not exist yet) or abstract name, with [bind(2)](\ref man2::bind)
+  void bind( std::string_view path );
+
+  //! Connect to the socket bound to `path`, with [connect(2)](\ref man2::connect)
+  void connect( std::string_view path );
+
+  //! The path or abstract name the socket is bound to ("" if unnamed)
+  std::string local_path() const;
+
+  //! The path or abstract name the peer is bound to ("" if unnamed, e.g. as from socketpair())
+  std::string peer_path() const;
+
+  //! \brief Send `payload` with duplicates of `fds` attached ([SCM_RIGHTS](\ref man7::unix))
+  //! \details The receiver's descriptors refer to the same open files (and sockets) as `fds`, which stay
+  //! open here. `payload` must not be empty: on a stream socket, the descriptors travel with its first byte.
+  //! \returns the number of bytes of `payload` sent (the descriptors go with the first one)
+  size_t send_fds( std::string_view payload, std::span<const std::reference_wrapper<const FileDescriptor>> fds );
+  size_t send_fds( std::string_view payload,
+                   std::initializer_list<std::reference_wrapper<const FileDescriptor>> fds );
+
+  //! \brief Receive into `buffer`, appending any descriptors that came with the data to `fds`
+  //! \details Received descriptors are close-on-exec. A stream socket doesn't return data sent by
+  //! separate send_fds() calls from one recv_fds() if either carried descriptors, so they pair up.
+  //! \returns the number of bytes received (0 at EOF, or if a non-blocking socket would block)
+  size_t recv_fds( std::span<char> buffer, std::vector<FileDescriptor>& fds );
+};
+
+//! A wrapper around Unix-domain stream sockets
+class LocalStreamSocket : public LocalSocket
+{
+  //! Construct from a connection returned by accept4() on a Unix-domain listener
+  LocalStreamSocket( Trusted tag, FileDescriptor&& fd ) : LocalSocket( tag, std::move( fd ), AF_UNIX, SOCK_STREAM )
+  {}
+
+public:
+  //! Default: construct an unbound, unconnected Unix-domain stream socket
+  LocalStreamSocket() : LocalSocket( AF_UNIX, SOCK_STREAM ) {}
+
+  //! Adopt a descriptor, e.g. one from recv_fds(); throws unless it is a Unix-domain stream socket
+  explicit LocalStreamSocket( FileDescriptor&& fd ) : LocalSocket( std::move( fd ), AF_UNIX, SOCK_STREAM ) {}
+
+  //! \brief A connected pair of sockets from [socketpair(2)](\ref man2::socketpair)
+  //! \details They aren't close-on-exec, so either end can be left to a child process.
+  static std::pair<LocalStreamSocket, LocalStreamSocket> pair();
+
+  //! Mark a socket as listening for incoming connections
+  void listen( int backlog = 16 );
+
+  //! Accept a new incoming connection (blocking, close-on-exec)
+  LocalStreamSocket accept();
+
+  //! \brief Accept a connection if one is waiting, without blocking
+  //! \returns the (non-blocking, close-on-exec) connection, or nothing if none is waiting
+  std::optional<LocalStreamSocket> accept_nonblocking();
+};
+
+//! \brief A wrapper around Unix-domain datagram sockets
+//! \details Datagrams are never reordered or dropped (a full receiver makes the sender wait). Once
+//! connected, each FileDescriptor::write() sends one datagram and each read() receives one.
+class LocalDatagramSocket : public LocalSocket
+{
+public:
+  //! Default: construct an unbound, unconnected Unix-domain datagram socket
+  LocalDatagramSocket() : LocalSocket( AF_UNIX, SOCK_DGRAM ) {}
+
+  //! Adopt a descriptor, e.g. one from recv_fds(); throws unless it is a Unix-domain datagram socket
+  explicit LocalDatagramSocket( FileDescriptor&& fd ) : LocalSocket( std::move( fd ), AF_UNIX, SOCK_DGRAM ) {}
+
+  //! \brief A connected pair of sockets from [socketpair(2)](\ref man2::socketpair)
+  //! \details They aren't close-on-exec, so either end can be left to a child process.
+  static std::pair<LocalDatagramSocket, LocalDatagramSocket> pair();
+
+  //! Send a datagram to the socket bound to `path`
+  void sendto( std::string_view path, std::string_view payload );
 };
 
 //! A wrapper around [packet sockets](\ref man7:packet)
@@ -109,5 +413,207 @@ class PacketSocket : public DatagramSocket
 public:
   PacketSocket( const int type, const int protocol ) : DatagramSocket( AF_PACKET, type, protocol ) {}
 
+  //! Receive (and send) only on the network interface `interface_name`, e.g. "eth0"
+  void bind_to_interface( std::string_view interface_name );
+
   void set_promiscuous();
 };
+
+//! \brief A frame received without copying it (e.g. from a PacketRing), valid until its ring moves on
+struct FrameView
+{
+  std::string_view data {};  //!< The captured bytes, starting at the link-layer header
+  uint32_t wire_length {};   //!< The frame's length on the wire (more than data.size() if truncated)
+  uint64_t timestamp_ns {};  //!< When the frame was captured (CLOCK_REALTIME in nanoseconds, or 0 if unknown)
+};
+
+//! \brief A PacketSocket that exchanges frames with the kernel through memory-mapped rings
+//! \details Received frames land in a [TPACKET_V3](\ref man7::packet) PACKET_RX_RING of blocks that the
+//! kernel fills and hands over, many frames at a time, so capture costs no system call or copy per frame.
+//! An optional PACKET_TX_RING queues frames to send, which flush() transmits with one system call.
+//!
+//! Bind with bind_to_interface() before receiving; set_promiscuous() and the EventLoop work as for any
+//! socket (the descriptor becomes readable when a block is ready). The recv() family doesn't see frames
+//! that go to the ring.
+class PacketRing : public PacketSocket
+{
+public:
+  //! Sizes of the rings
+  struct Config
+  {
+    uint32_t block_size = 1U << 20U;   //!< Bytes per block (a multiple of the page size)
+    uint32_t block_count = 16;         //!< Number of blocks in each ring
+    uint32_t frame_size = 2048;        //!< Largest frame (TX slots are this size; RX frames are packed)
+    uint32_t block_timeout_ms = 10;    //!< Hand over a partly filled RX block after this long
+    bool tx = false;                   //!< Also set up a TX ring
+  };
+
+  //! Kernel counters for the receive ring, which reset each time they're read
+  struct Statistics
+  {
+    uint32_t packets {};    //!< Frames that reached the socket
+    uint32_t drops {};      //!< Frames dropped because the ring was full
+    uint32_t freezes {};    //!< Times the ring filled completely
+  };
+
+private:
+  Config config_;
+  void* map_ {};      //!< The RX ring, then the TX ring, in one mapping
+  size_t map_size_ {};
+  uint32_t rx_block_ {}; //!< Next RX block to hand to the user
+  uint32_t tx_frame_ {}; //!< Next TX slot to fill
+  uint32_t tx_frames_ {};
+
+  char* rx_block( uint32_t index ) const;
+  char* tx_slot( uint32_t index ) const;
+
+public:
+  //! \param[in] type is `SOCK_RAW` (frames include the link-layer header) or `SOCK_DGRAM`
+  //! \param[in] protocol is the link-layer protocol to capture, in network order (e.g. `htons( ETH_P_ALL )`)
+  //! \param[in] config sizes the rings
+  PacketRing( int type, int protocol, const Config& config );
+  PacketRing( int type, int protocol ) : PacketRing( type, protocol, Config {} ) {}
+
+  //! \brief Pass every frame in the RX blocks the kernel has handed over to `callback`, then give the blocks back
+  //! \details Views are valid only during the callback. Doesn't wait; use wait_readable() or an EventLoop.
+  //! \param[in] max_blocks bounds the work done by one call
+  //! \returns the number of frames passed to `callback`
+  size_t receive( const std::function<void( const FrameView& )>& callback, size_t max_blocks = SIZE_MAX );
+
+  //! \brief Copy `frame` into the next free TX slot (the ring must have been created with Config::tx)
+  //! \returns false (sending nothing) if every slot is waiting to be transmitted
+  bool send( std::string_view frame );
+
+  //! Ask the kernel to transmit every frame queued by send(), without waiting for it to finish
+  void flush();
+
+  //! \brief Share this interface's traffic with the other sockets in fanout group `group_id`
+  //! \details Call after bind_to_interface(). Each frame goes to one socket in the group, chosen by `mode`
+  //! (e.g. `PACKET_FANOUT_HASH`, which keeps each flow on one socket, or `PACKET_FANOUT_CPU`).
+  void join_fanout( uint16_t group_id, int mode );
+
+  //! Counters since the last call
+  Statistics statistics();
+
+  ~PacketRing();
+
+  PacketRing( const PacketRing& other ) = delete;
+  PacketRing& operator=( const PacketRing& other ) = delete;
+  PacketRing( PacketRing&& other ) = delete;
+  PacketRing& operator=( PacketRing&& other ) = delete;
+};
+
+//! \brief An [AF_XDP](https://docs.kernel.org/networking/af_xdp.html) socket, which takes frames from one
+//! receive queue of a network interface before the kernel's network stack sees them
+//! \details The socket owns a UMEM (a region of frame-sized buffers shared with the kernel), the four rings
+//! that pass buffers back and forth (fill and RX for receiving, TX and completion for sending), and a minimal
+//! XDP program, attached to the interface while the socket exists, that redirects its queue's frames here.
+//! Other queues' frames, and everything when no socket is bound, go up the stack as usual.
+//!
+//! Frames are handed over as the same FrameView as from a PacketRing. Only one XDPSocket can be attached to
+//! an interface at a time. The descriptor works with wait_readable() and the EventLoop, which also give the
+//! kernel a chance to refill the RX ring when it is waiting for that (`XDP_USE_NEED_WAKEUP`).
+class XDPSocket : public Socket
+{
+public:
+  //! Sizes of the UMEM and rings, and how to attach
+  struct Config
+  {
+    uint32_t frame_count = 4096;               //!< Buffers in the UMEM, half for receiving and half for sending
+    uint32_t frame_size = 2048;                //!< Bytes per buffer (a power of two from 2048 to the page size)
+    uint32_t ring_size = 2048;                 //!< Entries per ring (a power of two, >= (frame_count + 1) / 2)
+    uint32_t xdp_flags = 0;                    //!< e.g. `XDP_FLAGS_SKB_MODE` for generic XDP (0 = driver's choice)
+    uint16_t bind_flags = XDP_USE_NEED_WAKEUP; //!< e.g. `XDP_COPY` or `XDP_ZEROCOPY` (0 = kernel's choice)
+  };
+
+  //! Kernel counters for the socket (cumulative)
+  struct Statistics
+  {
+    uint64_t rx_dropped {};         //!< Frames dropped for reasons other than a full ring
+    uint64_t rx_ring_full {};       //!< Frames dropped because the RX ring was full
+    uint64_t rx_fill_ring_empty {}; //!< Times a frame arrived with no buffer in the fill ring
+    uint64_t tx_invalid {};         //!< TX descriptors the kernel rejected
+  };
+
+private:
+  //! An mmap(2)ed region: a ring shared with the kernel, or (with fd -1) anonymous memory for the UMEM
+  class Mapping
+  {
+    void* addr_ {};
+    size_t length_ {};
+
+  public:
+    Mapping( int fd, size_t length, off_t offset );
+    ~Mapping();
+
+    char* get() const { return static_cast<char*>( addr_ ); }
+
+    Mapping( const Mapping& other ) = delete;
+    Mapping& operator=( const Mapping& other ) = delete;
+    Mapping( Mapping&& other ) = delete;
+    Mapping& operator=( Mapping&& other ) = delete;
+  };
+
+  //! Pointers into one ring's mapping
+  struct Ring
+  {
+    uint32_t* producer {};
+    uint32_t* consumer {};
+    uint32_t* flags {};
+    char* entries {};
+  };
+
+  Config config_;
+  Mapping umem_;
+  Mapping fill_map_;
+  Mapping completion_map_;
+  Mapping rx_map_;
+  Mapping tx_map_;
+  Ring fill_ {};
+  Ring completion_ {};
+  Ring rx_ {};
+  Ring tx_ {};
+  std::vector<uint64_t> free_tx_ {}; //!< UMEM offsets of the buffers available to send()
+
+  // the XSKMAP that the program redirects through, the program, and the link that attaches it
+  FileDescriptor xsk_map_;
+  FileDescriptor program_;
+  FileDescriptor link_;
+
+  // the rings' mappings are sized from offsets that only exist once the socket is configured
+  XDPSocket( std::string_view interface_name, uint32_t queue, const Config& config, xdp_mmap_offsets&& offsets );
+
+  uint32_t mask() const { return config_.ring_size - 1; }
+
+  //! Move the buffers of finished transmissions back to free_tx_
+  void reclaim_completions();
+
+public:
+  //! \param[in] interface_name is the network interface, e.g. "eth0"
+  //! \param[in] queue is the interface's receive queue to take frames from
+  //! \param[in] config sizes the UMEM and rings
+  XDPSocket( std::string_view interface_name, uint32_t queue, const Config& config );
+  XDPSocket( std::string_view interface_name, uint32_t queue )
+    : XDPSocket( interface_name, queue, Config {} )
+  {}
+
+  //! \brief Pass each received frame (at most `max_frames`) to `callback`, then give the buffers back
+  //! \details Views are valid only during the callback. Doesn't wait; use wait_readable() or an EventLoop.
+  //! \returns the number of frames passed to `callback`
+  size_t receive( const std::function<void( const FrameView& )>& callback, size_t max_frames = SIZE_MAX );
+
+  //! \brief Copy `frame` (which starts at the link-layer header) into a free buffer and queue it on the TX ring
+  //! \returns false (sending nothing) if every buffer is in flight
+  bool send( std::string_view frame );
+
+  //! Ask the kernel to transmit every frame queued by send(), without waiting for it to finish
+  void flush();
+
+  //! Counters since the socket was created
+  Statistics statistics() const;
+
+  XDPSocket( const XDPSocket& other ) = delete;
+  XDPSocket& operator=( const XDPSocket& other ) = delete;
+  XDPSocket( XDPSocket&& other ) = delete;
+  XDPSocket& operator=( XDPSocket&& other ) = delete;
+};
@@ -0,0 +1,152 @@
+#include "tcp_server.hh"
+
+#include "exception.hh"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+namespace {
+//! Run the calling thread on `cpu`, if the machine has that many
+void pin_to_cpu( size_t cpu )
+{
+  if ( thread::hardware_concurrency() <= cpu ) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  CPU_SET( cpu, &set );
+  pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+}
+
+//! \brief Have the kernel pick the listener whose index is the CPU that is handling the new connection
+//! \details Applies to the whole SO_REUSEPORT group, whose members are indexed in the order they were bound.
+//! When the CPU has no listener, the kernel falls back to its usual hash of the connection's addresses.
+void steer_by_cpu( const Socket& listener )
+{
+  // A = the current CPU; return A
+  array<sock_filter, 2> code { {
+    { BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>( SKF_AD_OFF + SKF_AD_CPU ) },
+    { BPF_RET | BPF_A, 0, 0, 0 },
+  } };
+  const sock_fprog program { code.size(), code.data() };
+  const int fd = listener.fd_num();
+  CheckSystemCall( "setsockopt(SO_ATTACH_REUSEPORT_CBPF)",
+                   ::setsockopt( fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof( program ) ) );
+}
+} // namespace
+
+ShardedTCPServer::Shard::Shard( TCPSocket&& s_listener, FileDescriptor&& s_stop_fd )
+  : listener( move( s_listener ) ), stop_fd( move( s_stop_fd ) )
+{}
+
+ShardedTCPServer::ShardedTCPServer( const Address& address,
+                                    ConnectionHandler handler,
+                                    size_t shards,
+                                    int backlog )
+  : handler_( move( handler ) )
+{
+  Address bound = address;
+  for ( size_t i = 0; i < max<size_t>( shards, 1 ); ++i ) {
+    TCPSocket listener { address.family() };
+    listener.set_reuseaddr();
+    listener.set_reuseport();
+    listener.bind( bound );
+    if ( i == 0 ) {
+      bound = listener.local_address(); // the rest of the group must share the port the kernel chose
+    }
+    listener.listen( backlog );
+    listener.set_blocking( false );
+
+    FileDescriptor stop_fd { CheckSystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ), true };
+    shards_.push_back( make_unique<Shard>( move( listener ), move( stop_fd ) ) );
+  }
+
+  // with more shards than CPUs, some shards would never be chosen; leave those to the kernel's hash instead
+  if ( shards_.size() > 1 and shards_.size() <= thread::hardware_concurrency() ) {
+    steer_by_cpu( shards_.front()->listener );
+  }
+}
+
+void ShardedTCPServer::start()
+{
+  if ( started_ ) {
+    throw runtime_error( "ShardedTCPServer already started" );
+  }
+  started_ = true;
+  for ( size_t i = 0; i < shards_.size(); ++i ) {
+    shards_[i]->thread = thread { [this, i] { run_shard( i ); } };
+  }
+}
+
+void ShardedTCPServer::run_shard( const size_t index )
+{
+  Shard& shard = *shards_[index];
+  try {
+    pin_to_cpu( index );
+
+    EventLoop loop;
+    loop.add_rule( loop.add_category( "accept" ), shard.listener, Direction::In, [&] {
+      // drain the queue, since every connection waiting now arrived on this shard's listener
+      while ( auto connection = shard.listener.accept_nonblocking() ) {
+        shard.accepted.fetch_add( 1, memory_order_relaxed );
+        handler_( index, loop, move( *connection ) );
+      }
+    } );
+    loop.add_rule( loop.add_category( "stop" ), shard.stop_fd, Direction::In, [&] {
+      array<char, sizeof( uint64_t )> counter {};
+      shard.stop_fd.read( counter );
+    } );
+
+    while ( not stopping_.load() ) {
+      if ( loop.wait_next_event( -1 ) == EventLoop::Result::Exit ) {
+        break;
+      }
+    }
+  } catch ( ... ) {
+    shard.error = current_exception();
+  }
+}
+
+void ShardedTCPServer::stop()
+{
+  if ( not started_ ) {
+    return;
+  }
+  started_ = false;
+  stopping_ = true;
+  for ( const auto& shard : shards_ ) {
+    // any nonzero counter value will do, so a failed write is harmless
+    const uint64_t one = 1;
+    [[maybe_unused]] const ssize_t written = ::write( shard->stop_fd.fd_num(), &one, sizeof( one ) );
+  }
+
+  exception_ptr first_error;
+  for ( const auto& shard : shards_ ) {
+    shard->thread.join();
+    if ( shard->error and not first_error ) {
+      first_error = shard->error;
+    }
+  }
+  if ( first_error ) {
+    rethrow_exception( first_error );
+  }
+}
+
+ShardedTCPServer::~ShardedTCPServer()
+{
+  try {
+    stop();
+  } catch ( const exception& e ) {
+    cerr << "ShardedTCPServer: " << e.what() << "\n";
+  }
+}
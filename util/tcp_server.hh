@@ -0,0 +1,83 @@
+#pragma once
+
+#include "address.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "socket.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//! \brief A TCP server that accepts on one [SO_REUSEPORT](\ref man7::socket) listener per core
+//! \details Each shard owns a listener bound to the same address, a thread pinned to its own CPU, and an
+//! EventLoop on that thread. The kernel spreads incoming connections among the listeners (preferring the
+//! shard on the CPU that received the SYN), so no accept queue, lock or cache line is shared between
+//! shards and the accept rate grows with the number of cores.
+//!
+//! A connection stays on the shard that accepted it: the handler runs on that shard's thread and may add
+//! rules for the connection to the shard's EventLoop.
+class ShardedTCPServer
+{
+public:
+  //! Receives each new (non-blocking) connection on the thread of the shard that accepted it
+  using ConnectionHandler = std::function<void( size_t shard, EventLoop& loop, TCPSocket&& connection )>;
+
+private:
+  struct Shard
+  {
+    TCPSocket listener;
+    FileDescriptor stop_fd; //!< eventfd, signaled by stop() to wake the shard's loop
+    std::atomic<uint64_t> accepted {};
+    std::exception_ptr error {};
+    std::thread thread {};
+
+    Shard( TCPSocket&& s_listener, FileDescriptor&& s_stop_fd );
+  };
+
+  ConnectionHandler handler_;
+  std::vector<std::unique_ptr<Shard>> shards_ {};
+  std::atomic<bool> stopping_ {};
+  bool started_ {};
+
+  //! Body of the thread of shard number `index`
+  void run_shard( size_t index );
+
+public:
+  //! \brief Bind the listeners
+  //! \param[in] address is the address to listen on; with port 0, the kernel picks one for every shard
+  //! \param[in] handler is called for each accepted connection
+  //! \param[in] shards is the number of listeners and threads (by default, one per CPU)
+  //! \param[in] backlog is the length of each listener's accept queue
+  ShardedTCPServer( const Address& address,
+                    ConnectionHandler handler,
+                    size_t shards = std::thread::hardware_concurrency(),
+                    int backlog = 1024 );
+
+  //! Start the shards' threads
+  void start();
+
+  //! \brief Stop and join every shard's thread
+  //! \details Rethrows the first exception that ended a shard (e.g. one thrown by the handler).
+  void stop();
+
+  //! Address the listeners are bound to (with the actual port, if 0 was requested)
+  Address local_address() const { return shards_.front()->listener.local_address(); }
+
+  size_t shards() const { return shards_.size(); }
+
+  //! Number of connections accepted so far by shard number `index`
+  uint64_t accepted( size_t index ) const { return shards_.at( index )->accepted.load(); }
+
+  ~ShardedTCPServer();
+
+  ShardedTCPServer( const ShardedTCPServer& other ) = delete;
+  ShardedTCPServer& operator=( const ShardedTCPServer& other ) = delete;
+  ShardedTCPServer( ShardedTCPServer&& other ) = delete;
+  ShardedTCPServer& operator=( ShardedTCPServer&& other ) = delete;
+};
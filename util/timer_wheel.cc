@@ -0,0 +1,218 @@
+#include "timer_wheel.hh"
+
+#include "exception.hh"
+
+#include <bit>
+#include <ctime>
+#include <utility>
+
+using namespace std;
+
+uint64_t TimerWheel::now_ms()
+{
+  timespec now {};
+  CheckSystemCall( "clock_gettime", clock_gettime( CLOCK_MONOTONIC_COARSE, &now ) );
+  return static_cast<uint64_t>( now.tv_sec ) * 1000 + static_cast<uint64_t>( now.tv_nsec ) / 1'000'000;
+}
+
+TimerWheel::TimerWheel( const uint64_t start ) : now_( start )
+{
+  heads_.fill( kNone );
+}
+
+void TimerWheel::link( const uint32_t index, const uint32_t list )
+{
+  Timer& timer = timers_[index];
+  timer.prev = kNone;
+  timer.next = heads_[list];
+  timer.list = list;
+  if ( timer.next != kNone ) {
+    timers_[timer.next].prev = index;
+  }
+  heads_[list] = index;
+  if ( list != kExpiring ) {
+    occupied_[list / kSlots][list % kSlots / 64] |= uint64_t { 1 } << ( list % 64 );
+  }
+}
+
+void TimerWheel::unlink( const uint32_t index )
+{
+  Timer& timer = timers_[index];
+  if ( timer.prev != kNone ) {
+    timers_[timer.prev].next = timer.next;
+  } else {
+    heads_[timer.list] = timer.next;
+  }
+  if ( timer.next != kNone ) {
+    timers_[timer.next].prev = timer.prev;
+  }
+  if ( timer.list != kExpiring and heads_[timer.list] == kNone ) {
+    occupied_[timer.list / kSlots][timer.list % kSlots / 64] &= ~( uint64_t { 1 } << ( timer.list % 64 ) );
+  }
+  timer.list = kNone;
+}
+
+void TimerWheel::release( const uint32_t index )
+{
+  Timer& timer = timers_[index];
+  timer.callback = {};
+  ++timer.generation;
+  timer.next = free_;
+  free_ = index;
+  --size_;
+}
+
+void TimerWheel::schedule( const uint32_t index )
+{
+  const uint64_t deadline = timers_[index].deadline;
+  if ( deadline <= now_ ) {
+    link( index, kExpiring );
+    return;
+  }
+
+  // the coarsest level whose slots are still finer than the time left; beyond the top level's range,
+  // wait in the top level's last slot and be rescheduled from there
+  const uint64_t delta = deadline - now_;
+  unsigned level = 0;
+  while ( level + 1 < kLevels and delta >= uint64_t { 1 } << ( kLevelBits * ( level + 1 ) ) ) {
+    ++level;
+  }
+  const uint64_t horizon = now_ + ( uint64_t { 1 } << ( kLevelBits * kLevels ) ) - 1;
+  const uint64_t slot = ( min( deadline, horizon ) >> ( kLevelBits * level ) ) & kSlotMask;
+  link( index, level * kSlots + static_cast<uint32_t>( slot ) );
+}
+
+void TimerWheel::cascade( const unsigned level )
+{
+  const auto list = static_cast<uint32_t>( level * kSlots + ( ( now_ >> ( kLevelBits * level ) ) & kSlotMask ) );
+  uint32_t index = heads_[list];
+  heads_[list] = kNone;
+  occupied_[level][list % kSlots / 64] &= ~( uint64_t { 1 } << ( list % 64 ) );
+
+  while ( index != kNone ) {
+    const uint32_t next = timers_[index].next;
+    schedule( index );
+    index = next;
+  }
+}
+
+optional<uint32_t> TimerWheel::next_occupied( const unsigned level, const uint32_t from ) const
+{
+  for ( uint32_t word = from / 64; word < kSlots / 64; ++word ) {
+    uint64_t bits = occupied_[level][word];
+    if ( word == from / 64 ) {
+      bits &= ~uint64_t { 0 } << ( from % 64 );
+    }
+    if ( bits ) {
+      return word * 64 + static_cast<uint32_t>( countr_zero( bits ) );
+    }
+  }
+  return {};
+}
+
+TimerWheel::Handle TimerWheel::arm( const chrono::milliseconds delay, Callback callback )
+{
+  return arm_at( now_ms() + static_cast<uint64_t>( max<int64_t>( delay.count(), 0 ) ), move( callback ) );
+}
+
+TimerWheel::Handle TimerWheel::arm_at( const uint64_t deadline, Callback callback )
+{
+  uint32_t index = free_;
+  if ( index != kNone ) {
+    free_ = timers_[index].next;
+  } else {
+    index = static_cast<uint32_t>( timers_.size() );
+    timers_.emplace_back();
+  }
+
+  Timer& timer = timers_[index];
+  timer.callback = move( callback );
+  timer.deadline = deadline;
+  ++size_;
+  schedule( index );
+  return { index, timer.generation };
+}
+
+bool TimerWheel::cancel( const Handle handle )
+{
+  if ( handle.index >= timers_.size() ) {
+    return false;
+  }
+  const Timer& timer = timers_[handle.index];
+  if ( timer.generation != handle.generation or timer.list == kNone ) {
+    return false;
+  }
+  unlink( handle.index );
+  release( handle.index );
+  return true;
+}
+
+size_t TimerWheel::expire( const uint64_t now )
+{
+  size_t ran = 0;
+  const auto run_expiring = [&] {
+    while ( heads_[kExpiring] != kNone ) {
+      const uint32_t index = heads_[kExpiring];
+      unlink( index );
+      // the callback may arm timers, which can move timers_
+      const Callback callback = move( timers_[index].callback );
+      release( index );
+      callback();
+      ++ran;
+    }
+  };
+
+  run_expiring();
+  while ( now_ < now ) {
+    if ( empty() ) {
+      now_ = now;
+      break;
+    }
+
+    // skip the ticks at which no slot with timers comes up
+    now_ = min( now, next_event() );
+
+    for ( unsigned level = kLevels - 1; level > 0; --level ) {
+      if ( ( now_ & ( ( uint64_t { 1 } << ( kLevelBits * level ) ) - 1 ) ) == 0 ) {
+        cascade( level );
+      }
+    }
+    cascade( 0 );
+    run_expiring();
+  }
+  return ran;
+}
+
+uint64_t TimerWheel::next_event() const
+{
+  // the first occupied slot after the current one on each level (wrapping around), and when it next comes up
+  uint64_t next = numeric_limits<uint64_t>::max();
+  for ( unsigned level = 0; level < kLevels; ++level ) {
+    const unsigned shift = kLevelBits * level;
+    const auto current = static_cast<uint32_t>( ( now_ >> shift ) & kSlotMask );
+    const uint64_t rotation = ( now_ >> shift ) & ~uint64_t { kSlotMask };
+    optional<uint32_t> slot = current < kSlotMask ? next_occupied( level, current + 1 ) : nullopt;
+    uint64_t position = rotation + slot.value_or( 0 );
+    if ( not slot ) {
+      slot = next_occupied( level, 0 );
+      position = rotation + kSlots + slot.value_or( 0 );
+    }
+    if ( slot ) {
+      next = min( next, position << shift );
+    }
+  }
+  return next;
+}
+
+optional<uint64_t> TimerWheel::ms_until_next( const uint64_t now ) const
+{
+  if ( empty() ) {
+    return {};
+  }
+  if ( heads_[kExpiring] != kNone ) {
+    return 0;
+  }
+
+  const uint64_t next = next_event();
+  return next <= now ? 0 : next - now;
+}
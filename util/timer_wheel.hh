@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <vector>
+
+//! \brief A hierarchical timing wheel (Varghese and Lauck) of one-shot timers with millisecond resolution
+//! \details Four levels of 256 slots cover 2^32 ms (about 49 days; later deadlines wait at the top and are
+//! rescheduled as they come in range). A timer goes into the slot of the coarsest level that still tells
+//! its deadline apart, and moves one level down each time the wheel below wraps around to it, so arming,
+//! canceling and expiring each take O(1) time however many timers are pending. Timers live in one
+//! vector and link to each other by index, so no operation allocates once the vector has grown.
+//!
+//! Time comes from CLOCK_MONOTONIC_COARSE, which costs no system call to read but advances only once per
+//! kernel tick (a few milliseconds), so a delay is only accurate to about a tick. Not thread-safe.
+class TimerWheel
+{
+public:
+  using Callback = std::function<void()>;
+
+  //! Milliseconds on the coarse monotonic clock
+  static uint64_t now_ms();
+
+  //! Identifies an armed timer; stays safe to cancel after the timer has fired or been canceled
+  struct Handle
+  {
+    uint32_t index { std::numeric_limits<uint32_t>::max() };
+    uint32_t generation {};
+  };
+
+private:
+  static constexpr unsigned kLevelBits = 8;
+  static constexpr unsigned kLevels = 4;
+  static constexpr uint32_t kSlots = 1U << kLevelBits;
+  static constexpr uint32_t kSlotMask = kSlots - 1;
+  static constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+  //! The list of timers whose callbacks are about to run, after the kLevels * kSlots wheel slots
+  static constexpr uint32_t kExpiring = kLevels * kSlots;
+
+  struct Timer
+  {
+    Callback callback {};
+    uint64_t deadline {};
+    uint32_t prev { kNone };
+    uint32_t next { kNone };
+    uint32_t list { kNone }; //!< The slot (or kExpiring) holding the timer (kNone if free)
+    uint32_t generation {};
+  };
+
+  std::vector<Timer> timers_ {};
+  uint32_t free_ { kNone };                        //!< Free timers, linked through next
+  std::array<uint32_t, kExpiring + 1> heads_ {};   //!< First timer in each slot, and in the expiring list
+  std::array<std::array<uint64_t, kSlots / 64>, kLevels> occupied_ {}; //!< One bit per nonempty slot
+  uint64_t now_;                                   //!< Every deadline up to and including this has expired
+  size_t size_ {};
+
+  void link( uint32_t index, uint32_t list );
+  void unlink( uint32_t index );
+  void release( uint32_t index );
+
+  //! File a timer in the slot for its deadline, relative to now_
+  void schedule( uint32_t index );
+
+  //! Move the timers of one slot at `level` into the levels below
+  void cascade( unsigned level );
+
+  //! The first slot at or after `from` on `level` that has timers, if any
+  std::optional<uint32_t> next_occupied( unsigned level, uint32_t from ) const;
+
+  //! The next tick at which a slot with timers comes up (the timers expire, or move down a level)
+  uint64_t next_event() const;
+
+public:
+  //! \param[in] start is the time the wheel begins at
+  explicit TimerWheel( uint64_t start = now_ms() );
+
+  //! Run `callback` once, `delay` from now (a delay of 0 runs it on the next call to expire())
+  Handle arm( std::chrono::milliseconds delay, Callback callback );
+
+  //! Run `callback` once at `deadline` (in now_ms() time)
+  Handle arm_at( uint64_t deadline, Callback callback );
+
+  //! \brief Cancel a timer, so its callback never runs
+  //! \returns false if it had already fired or been canceled
+  bool cancel( Handle handle );
+
+  //! \brief Run the callbacks of every timer whose deadline is at or before `now`, in order of deadline
+  //! \details Callbacks may arm and cancel timers; one armed to expire by `now` runs during this call.
+  //! \returns the number of callbacks run
+  size_t expire( uint64_t now = now_ms() );
+
+  //! \brief Milliseconds from `now` until the next timer is due (0 if it already is), e.g. as an epoll timeout
+  //! \details Exact when that timer is within 256 ms; otherwise it may be earlier than the deadline (when the
+  //! timer first needs to move down a level), so waiting that long never oversleeps. Empty if no timers.
+  std::optional<uint64_t> ms_until_next( uint64_t now = now_ms() ) const;
+
+  //! Number of timers armed and not yet fired or canceled
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+};
@@ -0,0 +1,140 @@
+#include "tun.hh"
+
+#include "exception.hh"
+
+#include <array>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/if.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+
+static constexpr const char* CLONEDEV = "/dev/net/tun";
+
+using namespace std;
+
+namespace {
+int open_tun( const bool non_blocking )
+{
+  return CheckSystemCall( "open", open( CLONEDEV, O_RDWR | O_CLOEXEC | ( non_blocking ? O_NONBLOCK : 0 ) ) );
+}
+
+// the layout of struct virtio_net_hdr
+static_assert( sizeof( TunTapFD::VirtioNetHeader ) == 10 );
+} // namespace
+
+//! \param[in] devname is the name of the TUN or TAP device, as given to `ip tuntap add`
+//! \param[in] is_tun is `true` for a TUN device (expects IP datagrams), or `false` for a TAP device
+//! \param[in] options selects multiple queues and virtio-net headers
+TunTapFD::TunTapFD( const string& devname, const bool is_tun, const Options& options )
+  : FileDescriptor( open_tun( options.non_blocking ), options.non_blocking ), vnet_hdr_( options.vnet_hdr )
+{
+  if ( options.offloads and not options.vnet_hdr ) {
+    throw runtime_error( "TunTapFD: offloads require Options::vnet_hdr" );
+  }
+  if ( devname.size() >= IFNAMSIZ ) {
+    throw runtime_error( "TunTapFD: device name too long" );
+  }
+
+  ifreq tun_req {};
+  // IFF_NO_PI: no packet-information header in front of each packet
+  short flags = static_cast<short>( ( is_tun ? IFF_TUN : IFF_TAP ) | IFF_NO_PI ); // NOLINT(*-signed-bitwise)
+  if ( options.multi_queue ) {
+    flags |= IFF_MULTI_QUEUE; // NOLINT(*-signed-bitwise)
+  }
+  if ( options.vnet_hdr ) {
+    flags |= IFF_VNET_HDR; // NOLINT(*-signed-bitwise)
+  }
+  tun_req.ifr_flags = flags;
+
+  // copy devname to ifr_name, making sure to null terminate
+  strncpy( static_cast<char*>( tun_req.ifr_name ), devname.data(), IFNAMSIZ );
+  tun_req.ifr_name[IFNAMSIZ - 1] = '\0';
+
+  CheckSystemCall( "ioctl(TUNSETIFF)", ioctl( fd_num(), TUNSETIFF, static_cast<void*>( &tun_req ) ) );
+
+  if ( options.vnet_hdr ) {
+    int header_size = sizeof( VirtioNetHeader );
+    CheckSystemCall( "ioctl(TUNSETVNETHDRSZ)", ioctl( fd_num(), TUNSETVNETHDRSZ, &header_size ) );
+    CheckSystemCall( "ioctl(TUNSETOFFLOAD)", ioctl( fd_num(), TUNSETOFFLOAD, options.offloads ) );
+  }
+}
+
+void TunTapFD::set_queue_enabled( const bool enabled )
+{
+  ifreq queue_req {};
+  queue_req.ifr_flags = static_cast<short>( enabled ? IFF_ATTACH_QUEUE : IFF_DETACH_QUEUE );
+  CheckSystemCall( "ioctl(TUNSETQUEUE)", ioctl( fd_num(), TUNSETQUEUE, static_cast<void*>( &queue_req ) ) );
+}
+
+void TunTapFD::read_packet( VirtioNetHeader& header, OwnedBuffer& payload )
+{
+  if ( not vnet_hdr_ ) {
+    throw runtime_error( "TunTapFD::read_packet: device has no virtio-net headers" );
+  }
+
+  const array<iovec, 2> iov { { { &header, sizeof( header ) }, { payload.data(), payload.capacity() } } };
+  const uint64_t started = io_start();
+  const size_t bytes = finish_read(
+    "readv", ::readv( fd_num(), iov.data(), iov.size() ), sizeof( header ) + payload.capacity(), started );
+  if ( bytes != 0 and bytes < sizeof( header ) ) {
+    throw runtime_error( "TunTapFD::read_packet: short virtio-net header" );
+  }
+  payload.resize( bytes == 0 ? 0 : bytes - sizeof( header ) );
+}
+
+void TunTapFD::write_packet( const VirtioNetHeader& header, const string_view payload )
+{
+  if ( not vnet_hdr_ ) {
+    throw runtime_error( "TunTapFD::write_packet: device has no virtio-net headers" );
+  }
+
+  const array<string_view, 2> buffers {
+    { { reinterpret_cast<const char*>( &header ), sizeof( header ) }, payload } }; // NOLINT(*-reinterpret-cast)
+  if ( write( buffers ) != sizeof( header ) + payload.size() ) {
+    throw runtime_error( "TunTapFD::write_packet: short write" );
+  }
+}
+
+size_t TunTapFD::read_batch( BufferPool& pool, vector<OwnedBuffer>& packets, const size_t max_packets )
+{
+  size_t count = 0;
+  while ( count < max_packets ) {
+    if ( count > 0 and blocking() ) {
+      // don't wait for a second packet
+      pollfd pfd { fd_num(), POLLIN, 0 };
+      if ( CheckSystemCall( "poll", ::poll( &pfd, 1, 0 ) ) == 0 ) {
+        break;
+      }
+    }
+
+    OwnedBuffer packet = pool.acquire();
+    read( packet );
+    if ( packet.empty() ) {
+      break; // nothing waiting on a non-blocking descriptor
+    }
+    packets.push_back( move( packet ) );
+    ++count;
+  }
+  return count;
+}
+
+TunTapFD::VirtioNetHeader TunTapFD::header( const string_view packet )
+{
+  if ( packet.size() < sizeof( VirtioNetHeader ) ) {
+    throw runtime_error( "TunTapFD::header: packet shorter than a virtio-net header" );
+  }
+  VirtioNetHeader result {};
+  memcpy( &result, packet.data(), sizeof( result ) );
+  return result;
+}
+
+string_view TunTapFD::payload( const string_view packet )
+{
+  if ( packet.size() < sizeof( VirtioNetHeader ) ) {
+    throw runtime_error( "TunTapFD::payload: packet shorter than a virtio-net header" );
+  }
+  return packet.substr( sizeof( VirtioNetHeader ) );
+}
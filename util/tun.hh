@@ -0,0 +1,102 @@
+#pragma once
+
+#include "buffer.hh"
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/if_tun.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//! \brief A FileDescriptor to a [TUN/TAP](https://docs.kernel.org/networking/tuntap.html) device, through which
+//! a user-space network stack exchanges packets (TUN) or Ethernet frames (TAP) with the kernel
+//! \details Each read() or write() moves exactly one packet. Opening the device requires CAP_NET_ADMIN,
+//! unless it was created beforehand (e.g. with `ip tuntap add`) for the current user.
+class TunTapFD : public FileDescriptor
+{
+public:
+  //! The offloads that let TCP segments of up to 64 KiB cross the device in one read or write
+  static constexpr unsigned kTsoOffloads = TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6;
+
+  //! Optional features of the device
+  struct Options
+  {
+    bool multi_queue = false;  //!< `IFF_MULTI_QUEUE`: open the device once per worker for a queue each
+    bool vnet_hdr = false;     //!< `IFF_VNET_HDR`: each packet is preceded by a VirtioNetHeader
+    unsigned offloads = 0;     //!< `TUN_F_*` offloads to accept from the kernel (e.g. kTsoOffloads; needs vnet_hdr)
+    bool non_blocking = false; //!< Open the descriptor non-blocking (e.g. for an EventLoop)
+  };
+
+  //! \brief The header in front of each packet with Options::vnet_hdr, laid out as the kernel's `virtio_net_hdr`
+  //! \details (which <linux/virtio_net.h> can't declare in C++); fields are in host byte order.
+  struct VirtioNetHeader
+  {
+    static constexpr uint8_t kNeedsChecksum = 1; //!< flags: fill in the checksum at csum_start + csum_offset
+    static constexpr uint8_t kGsoNone = 0;       //!< gso_type: a single packet
+    static constexpr uint8_t kGsoTcpV4 = 1;      //!< gso_type: a TCP/IPv4 segment to split into gso_size pieces
+    static constexpr uint8_t kGsoUdp = 3;        //!< gso_type: a UDP datagram to fragment
+    static constexpr uint8_t kGsoTcpV6 = 4;      //!< gso_type: a TCP/IPv6 segment to split into gso_size pieces
+
+    uint8_t flags {};
+    uint8_t gso_type {};
+    uint16_t hdr_len {};     //!< Length of the headers to copy into each segment
+    uint16_t gso_size {};    //!< Payload bytes per segment
+    uint16_t csum_start {};  //!< Where checksumming starts
+    uint16_t csum_offset {}; //!< Where the checksum goes, from csum_start
+  };
+
+private:
+  bool vnet_hdr_;
+
+public:
+  //! \brief Open `devname`, creating it if it doesn't exist
+  //! \details With Options::multi_queue, each TunTapFD opened on the same name adds a queue, and the kernel
+  //! spreads the device's packets across the queues by flow.
+  TunTapFD( const std::string& devname, bool is_tun, const Options& options );
+  TunTapFD( const std::string& devname, bool is_tun ) : TunTapFD( devname, is_tun, Options {} ) {}
+
+  //! Whether each packet is preceded by a VirtioNetHeader (Options::vnet_hdr)
+  bool vnet_hdr() const { return vnet_hdr_; }
+
+  //! Stop (false) or resume (true) delivering packets to this queue of a multi-queue device
+  void set_queue_enabled( bool enabled );
+
+  //! \brief Read one packet and its header (a device opened with Options::vnet_hdr only)
+  //! \details `payload` is filled to at most its capacity, which, with TSO, should be 64 KiB or more.
+  void read_packet( VirtioNetHeader& header, OwnedBuffer& payload );
+
+  //! \brief Write one packet with its header (a device opened with Options::vnet_hdr only)
+  //! \details With a `kGso*` type other than kGsoNone, the kernel segments `payload` (and with
+  //! kNeedsChecksum, fills in the checksum), so one write can carry a whole TSO segment.
+  void write_packet( const VirtioNetHeader& header, std::string_view payload );
+
+  //! \brief Read up to `max_packets` packets into buffers from `pool`, appending them to `packets`
+  //! \details Stops early once no packet is waiting (after the first, on a blocking descriptor, which waits
+  //! for it). With Options::vnet_hdr, each buffer begins with a VirtioNetHeader; see header() and payload().
+  //! \returns the number of packets read
+  size_t read_batch( BufferPool& pool, std::vector<OwnedBuffer>& packets, size_t max_packets );
+
+  //! The header at the start of a packet from read_batch() on a device with Options::vnet_hdr
+  static VirtioNetHeader header( std::string_view packet );
+
+  //! The rest of such a packet
+  static std::string_view payload( std::string_view packet );
+};
+
+//! A FileDescriptor to a [Linux TUN](https://docs.kernel.org/networking/tuntap.html) device (IP packets)
+class TunFD : public TunTapFD
+{
+public:
+  explicit TunFD( const std::string& devname ) : TunTapFD( devname, true ) {}
+  TunFD( const std::string& devname, const Options& options ) : TunTapFD( devname, true, options ) {}
+};
+
+//! A FileDescriptor to a [Linux TAP](https://docs.kernel.org/networking/tuntap.html) device (Ethernet frames)
+class TapFD : public TunTapFD
+{
+public:
+  explicit TapFD( const std::string& devname ) : TunTapFD( devname, false ) {}
+  TapFD( const std::string& devname, const Options& options ) : TunTapFD( devname, false, options ) {}
+};